@@ -56,7 +56,7 @@ static void at_cbm_notify(GAtResult *result, gpointer user_data)
 	int pdulen;
 	GAtResultIter iter;
 	unsigned char pdu[88];
-	long hexpdulen;
+	int hexpdulen;
 
 	g_at_result_iter_init(&iter, result);
 
@@ -80,7 +80,7 @@ static void at_cbm_notify(GAtResult *result, gpointer user_data)
 
 	DBG("Got new Cell Broadcast via CBM: %s, %d", hexpdu, pdulen);
 
-	if (decode_hex_own_buf(hexpdu, -1, &hexpdulen, 0, pdu) == NULL) {
+	if (!g_at_result_pdu_decode(result, pdu, sizeof(pdu), &hexpdulen)) {
 		ofono_error("Unable to hex-decode the PDU");
 		return;
 	}
@@ -384,7 +384,7 @@ static void at_cds_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
 	struct sms_data *data = ofono_sms_get_data(sms);
-	long pdu_len;
+	int pdu_len;
 	int tpdu_len;
 	const char *hexpdu;
 	unsigned char pdu[176];
@@ -394,15 +394,14 @@ static void at_cds_notify(GAtResult *result, gpointer user_data)
 		return;
 	}
 
-	if (strlen(hexpdu) > sizeof(pdu) * 2) {
-		ofono_error("Bad PDU length in CDS notification");
+	if (!g_at_result_pdu_decode(result, pdu, sizeof(pdu), &pdu_len)) {
+		ofono_error("Bad PDU in CDS notification");
 		return;
 	}
 
 	DBG("Got new Status-Report PDU via CDS: %s, %d", hexpdu, tpdu_len);
 
-	/* Decode pdu and notify about new SMS status report */
-	decode_hex_own_buf(hexpdu, -1, &pdu_len, 0, pdu);
+	/* Notify about new SMS status report */
 	ofono_sms_status_notify(sms, pdu, pdu_len, tpdu_len);
 
 	if (data->cnma_enabled)
@@ -413,7 +412,7 @@ static void at_cmt_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_sms *sms = user_data;
 	const char *hexpdu;
-	long pdu_len;
+	int pdu_len;
 	int tpdu_len;
 	unsigned char pdu[176];
 
@@ -422,14 +421,13 @@ static void at_cmt_notify(GAtResult *result, gpointer user_data)
 		return;
 	}
 
-	if (strlen(hexpdu) > sizeof(pdu) * 2) {
-		ofono_error("Bad PDU length in CMT notification");
+	if (!g_at_result_pdu_decode(result, pdu, sizeof(pdu), &pdu_len)) {
+		ofono_error("Bad PDU in CMT notification");
 		return;
 	}
 
 	DBG("Got new SMS Deliver PDU via CMT: %s, %d", hexpdu, tpdu_len);
 
-	decode_hex_own_buf(hexpdu, -1, &pdu_len, 0, pdu);
 	ofono_sms_deliver_notify(sms, pdu, pdu_len, tpdu_len);
 
 	at_ack_delivery(sms);
@@ -442,7 +440,7 @@ static void at_cmgr_notify(GAtResult *result, gpointer user_data)
 	GAtResultIter iter;
 	const char *hexpdu;
 	unsigned char pdu[176];
-	long pdu_len;
+	int pdu_len;
 	int tpdu_len;
 
 	g_at_result_iter_init(&iter, result);
@@ -461,13 +459,11 @@ static void at_cmgr_notify(GAtResult *result, gpointer user_data)
 
 	hexpdu = g_at_result_pdu(result);
 
-	if (strlen(hexpdu) > sizeof(pdu) * 2)
+	if (!g_at_result_pdu_decode(result, pdu, sizeof(pdu), &pdu_len))
 		goto err;
 
 	DBG("Got PDU: %s, with len: %d", hexpdu, tpdu_len);
 
-	decode_hex_own_buf(hexpdu, -1, &pdu_len, 0, pdu);
-
 	if (data->expect_sr)
 		ofono_sms_status_notify(sms, pdu, pdu_len, tpdu_len);
 	else
@@ -620,7 +616,7 @@ static void at_cmgl_notify(GAtResult *result, gpointer user_data)
 	GAtResultIter iter;
 	const char *hexpdu;
 	unsigned char pdu[176];
-	long pdu_len;
+	int pdu_len;
 	int tpdu_len;
 	int index;
 	int status;
@@ -650,10 +646,10 @@ static void at_cmgl_notify(GAtResult *result, gpointer user_data)
 		DBG("Found an old SMS PDU: %s, with len: %d",
 				hexpdu, tpdu_len);
 
-		if (strlen(hexpdu) > sizeof(pdu) * 2)
+		if (!g_at_result_pdu_decode(result, pdu, sizeof(pdu),
+						&pdu_len))
 			continue;
 
-		decode_hex_own_buf(hexpdu, -1, &pdu_len, 0, pdu);
 		ofono_sms_deliver_notify(sms, pdu, pdu_len, tpdu_len);
 
 		/* We don't buffer SMS on the SIM/ME, send along a CMGD */
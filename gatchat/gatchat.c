@@ -38,6 +38,12 @@
 
 /* #define WRITE_SCHEDULER_DEBUG 1 */
 
+/* Initial size of the line arenas, they grow on demand */
+#define LINE_ARENA_SIZE 256
+
+/* Arenas grown beyond this by large responses are released when idle */
+#define LINE_ARENA_TRIM_SIZE 16384
+
 static void chat_wakeup_writer(GAtChat *chat);
 
 static const char *none_prefix[] = { NULL };
@@ -46,6 +52,8 @@ struct at_command {
 	char *cmd;
 	char **prefixes;
 	gboolean expect_pdu;
+	gboolean pipeline;		/* No side effects, can be pipelined */
+	gboolean written_ahead;		/* Written before previous finished */
 	guint id;
 	GAtResultFunc callback;
 	GAtNotifyFunc listing;
@@ -60,9 +68,32 @@ struct at_notify_node {
 	GDestroyNotify notify;
 };
 
+struct notify_trie_node;
+
 struct at_notify {
 	GSList *nodes;
 	gboolean pdu;
+	struct notify_trie_node *trie;
+};
+
+/*
+ * Prefix trie over all registered notification prefixes, one node per
+ * character.  Nodes are never removed before the chat itself is freed, so
+ * callbacks are free to unregister while a line is being matched.  The
+ * number of nodes is bounded by the distinct prefixes ever registered.
+ */
+struct notify_trie_node {
+	char c;
+	struct at_notify *notify;
+	struct notify_trie_node *child;
+	struct notify_trie_node *next;
+};
+
+/* Reusable storage for NUL-terminated lines, avoids a malloc per line */
+struct line_arena {
+	char *buf;
+	guint size;
+	guint used;
 };
 
 struct _GAtChat {
@@ -72,15 +103,27 @@ struct _GAtChat {
 	GAtIO *io;				/* AT IO */
 	GQueue *command_queue;			/* Command queue */
 	guint cmd_bytes_written;		/* bytes written from cmd */
+	guint pipeline_depth;			/* Max commands in flight */
+	guint pipeline_timeout;			/* How long to wait for resp */
+	guint pipeline_source;			/* Pipeline stall timer */
+	gboolean pipeline_draining;		/* Dropping late responses */
+	guint cmds_ahead;			/* Cmds written after head */
+	guint ahead_bytes_written;		/* bytes written of next cmd */
 	GHashTable *notify_list;		/* List of notification reg */
+	struct notify_trie_node *notify_trie;	/* Prefix index of notify_list */
 	GAtDisconnectFunc user_disconnect;	/* user disconnect func */
 	gpointer user_disconnect_data;		/* user disconnect data */
 	guint read_so_far;			/* Number of bytes processed */
 	gboolean suspended;			/* Are we suspended? */
 	GAtDebugFunc debugf;			/* debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
-	char *pdu_notify;			/* Unsolicited Resp w/ PDU */
-	GSList *response_lines;			/* char * lines of the response */
+	gboolean pdu_notify;			/* Unsolicited Resp w/ PDU pending */
+	struct line_arena scratch;		/* Line being processed + PDU hdr */
+	struct line_arena response;		/* Lines of the response */
+	guint num_response_lines;		/* Number of lines in response */
+	gboolean response_lost;			/* A line did not fit, OOM */
+	GSList *line_nodes;			/* GAtResult list node pool */
+	guint num_line_nodes;			/* Size of the node pool */
 	char *wakeup;				/* command sent to wakeup modem */
 	gint timeout_source;
 	gdouble inactivity_time;		/* Period of inactivity */
@@ -126,10 +169,110 @@ static void at_notify_destroy(gpointer user_data)
 {
 	struct at_notify *notify = user_data;
 
+	if (notify->trie)
+		notify->trie->notify = NULL;
+
 	g_slist_foreach(notify->nodes, at_notify_node_destroy, NULL);
 	g_free(notify);
 }
 
+static struct notify_trie_node *notify_trie_find(struct notify_trie_node *l,
+							char c)
+{
+	for (; l; l = l->next)
+		if (l->c == c)
+			return l;
+
+	return NULL;
+}
+
+static struct notify_trie_node *notify_trie_insert(GAtChat *chat,
+							const char *prefix)
+{
+	struct notify_trie_node **list = &chat->notify_trie;
+	struct notify_trie_node *node = NULL;
+
+	for (; *prefix; prefix++) {
+		node = notify_trie_find(*list, *prefix);
+
+		if (!node) {
+			node = g_try_new0(struct notify_trie_node, 1);
+			if (!node)
+				return NULL;
+
+			node->c = *prefix;
+			node->next = *list;
+			*list = node;
+		}
+
+		list = &node->child;
+	}
+
+	return node;
+}
+
+static void notify_trie_free(struct notify_trie_node *node)
+{
+	struct notify_trie_node *next;
+
+	while (node) {
+		next = node->next;
+		notify_trie_free(node->child);
+		g_free(node);
+		node = next;
+	}
+}
+
+/*
+ * Reserves len bytes at the end of the arena.  The returned pointer, as well
+ * as any previously returned one, is only valid until the next allocation
+ * since the arena might be moved while growing.
+ */
+static char *line_arena_alloc(struct line_arena *arena, guint len)
+{
+	char *buf;
+	guint size;
+
+	if (arena->used + len > arena->size) {
+		size = arena->size ? arena->size : LINE_ARENA_SIZE;
+
+		while (size < arena->used + len)
+			size <<= 1;
+
+		buf = g_try_realloc(arena->buf, size);
+		if (!buf)
+			return NULL;
+
+		arena->buf = buf;
+		arena->size = size;
+	}
+
+	buf = arena->buf + arena->used;
+	arena->used += len;
+
+	return buf;
+}
+
+static void line_arena_reset(struct line_arena *arena)
+{
+	arena->used = 0;
+
+	if (arena->size <= LINE_ARENA_TRIM_SIZE)
+		return;
+
+	g_free(arena->buf);
+	arena->buf = NULL;
+	arena->size = 0;
+}
+
+static void line_arena_free(struct line_arena *arena)
+{
+	g_free(arena->buf);
+	arena->buf = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
+
 static gint at_command_compare_by_id(gconstpointer a, gconstpointer b)
 {
 	const struct at_command *command = a;
@@ -227,6 +370,173 @@ static void free_terminator(struct terminator_info *info)
 	info = NULL;
 }
 
+static void pipeline_reset(GAtChat *chat)
+{
+	if (chat->pipeline_source) {
+		g_source_remove(chat->pipeline_source);
+		chat->pipeline_source = 0;
+	}
+
+	chat->pipeline_draining = FALSE;
+	chat->cmds_ahead = 0;
+	chat->ahead_bytes_written = 0;
+}
+
+static gboolean pipeline_drained(gpointer user_data)
+{
+	GAtChat *chat = user_data;
+
+	chat->pipeline_source = 0;
+	chat->pipeline_draining = FALSE;
+
+	if (g_queue_peek_head(chat->command_queue))
+		chat_wakeup_writer(chat);
+
+	return FALSE;
+}
+
+static void pipeline_drain(GAtChat *chat)
+{
+	if (chat->pipeline_source)
+		g_source_remove(chat->pipeline_source);
+
+	chat->pipeline_draining = TRUE;
+	chat->pipeline_source = g_timeout_add(chat->pipeline_timeout,
+						pipeline_drained, chat);
+}
+
+/*
+ * The modem did not answer a command written ahead in time, most likely
+ * it discarded input received while busy.  Turn pipelining off and send
+ * the outstanding commands again one by one.  Answers to the original
+ * submissions may still trickle in, and responses are matched in order,
+ * so nothing is sent until the modem has been quiet for another timeout.
+ * Whatever arrives until then is treated as unsolicited.
+ */
+static gboolean pipeline_stalled(gpointer user_data)
+{
+	GAtChat *chat = user_data;
+	struct at_command *cmd;
+	int n = 0;
+
+	chat->pipeline_source = 0;
+
+	cmd = g_queue_peek_head(chat->command_queue);
+	if (cmd == NULL || cmd->written_ahead == FALSE)
+		return FALSE;
+
+	if (chat->debugf)
+		chat->debugf("Pipelined command got no response, "
+				"falling back to serial mode\n",
+				chat->debug_data);
+
+	chat->pipeline_depth = 1;
+
+	while ((cmd = g_queue_peek_nth(chat->command_queue, n++)))
+		cmd->written_ahead = FALSE;
+
+	pipeline_reset(chat);
+
+	chat->cmd_bytes_written = 0;
+	chat->num_response_lines = 0;
+	chat->response_lost = FALSE;
+	line_arena_reset(&chat->response);
+
+	pipeline_drain(chat);
+
+	return FALSE;
+}
+
+static void pipeline_arm(GAtChat *chat)
+{
+	if (chat->pipeline_source)
+		g_source_remove(chat->pipeline_source);
+
+	chat->pipeline_source = g_timeout_add(chat->pipeline_timeout,
+						pipeline_stalled, chat);
+}
+
+/* Called once the head of the queue has been removed */
+static void pipeline_advance(GAtChat *chat)
+{
+	struct at_command *cmd = g_queue_peek_head(chat->command_queue);
+
+	if (chat->cmds_ahead > 0) {
+		chat->cmd_bytes_written = strlen(cmd->cmd);
+		chat->cmds_ahead -= 1;
+	} else if (chat->ahead_bytes_written > 0) {
+		chat->cmd_bytes_written = chat->ahead_bytes_written;
+		chat->ahead_bytes_written = 0;
+	}
+
+	/* Restart the stall timer for every response we get */
+	if (cmd && cmd->written_ahead)
+		pipeline_arm(chat);
+	else if (chat->pipeline_source) {
+		g_source_remove(chat->pipeline_source);
+		chat->pipeline_source = 0;
+	}
+}
+
+/* Returns whether the nth command in the queue was already sent out */
+static gboolean command_in_flight(GAtChat *chat, guint n)
+{
+	if (n == 0)
+		return chat->cmd_bytes_written > 0;
+
+	if (n <= chat->cmds_ahead)
+		return TRUE;
+
+	return n == chat->cmds_ahead + 1 && chat->ahead_bytes_written > 0;
+}
+
+/*
+ * Writes the commands following the head of the queue without waiting for
+ * its final response, as long as every command in flight is independent
+ */
+static gboolean can_write_ahead(GAtChat *chat)
+{
+	struct at_command *cmd;
+	gsize bytes_written;
+	gsize towrite;
+	guint n = chat->cmds_ahead + 1;
+
+	if (n >= chat->pipeline_depth)
+		return FALSE;
+
+	cmd = g_queue_peek_head(chat->command_queue);
+	if (cmd->pipeline == FALSE)
+		return FALSE;
+
+	cmd = g_queue_peek_nth(chat->command_queue, n);
+	if (cmd == NULL || cmd->pipeline == FALSE)
+		return FALSE;
+
+	towrite = strlen(cmd->cmd) - chat->ahead_bytes_written;
+
+	bytes_written = g_at_io_write(chat->io,
+					cmd->cmd + chat->ahead_bytes_written,
+					towrite);
+
+	if (bytes_written == 0)
+		return FALSE;
+
+	cmd->written_ahead = TRUE;
+	chat->ahead_bytes_written += bytes_written;
+
+	if (bytes_written < towrite)
+		return TRUE;
+
+	chat->ahead_bytes_written = 0;
+	chat->cmds_ahead += 1;
+
+	if (chat->pipeline_source == 0)
+		pipeline_arm(chat);
+
+	/* Try to fit in the next one as well */
+	return TRUE;
+}
+
 static void chat_cleanup(GAtChat *chat)
 {
 	struct at_command *c;
@@ -238,20 +548,19 @@ static void chat_cleanup(GAtChat *chat)
 	g_queue_free(chat->command_queue);
 	chat->command_queue = NULL;
 
-	/* Cleanup any response lines we have pending */
-	g_slist_foreach(chat->response_lines, (GFunc)g_free, NULL);
-	g_slist_free(chat->response_lines);
-	chat->response_lines = NULL;
+	/* Cleanup any response lines we have pending.  The arenas themselves
+	 * are only released together with the chat, a result callback might
+	 * still be looking at them
+	 */
+	chat->num_response_lines = 0;
+	chat->response.used = 0;
+	chat->scratch.used = 0;
+	chat->pdu_notify = FALSE;
 
 	/* Cleanup registered notifications */
 	g_hash_table_destroy(chat->notify_list);
 	chat->notify_list = NULL;
 
-	if (chat->pdu_notify) {
-		g_free(chat->pdu_notify);
-		chat->pdu_notify = NULL;
-	}
-
 	if (chat->wakeup) {
 		g_free(chat->wakeup);
 		chat->wakeup = NULL;
@@ -267,6 +576,8 @@ static void chat_cleanup(GAtChat *chat)
 		chat->timeout_source = 0;
 	}
 
+	pipeline_reset(chat);
+
 	g_at_syntax_unref(chat->syntax);
 	chat->syntax = NULL;
 
@@ -278,6 +589,15 @@ static void chat_cleanup(GAtChat *chat)
 	}
 }
 
+static void chat_free(GAtChat *chat)
+{
+	notify_trie_free(chat->notify_trie);
+	line_arena_free(&chat->scratch);
+	line_arena_free(&chat->response);
+	g_free(chat->line_nodes);
+	g_free(chat);
+}
+
 static void io_disconnect(gpointer user_data)
 {
 	GAtChat *chat = user_data;
@@ -300,24 +620,32 @@ static void at_notify_call_callback(gpointer data, gpointer user_data)
 
 static gboolean g_at_chat_match_notify(GAtChat *chat, char *line)
 {
-	GHashTableIter iter;
+	struct notify_trie_node *node = chat->notify_trie;
 	struct at_notify *notify;
-	gpointer key, value;
 	gboolean ret = FALSE;
 	GAtResult result;
+	GSList line_node;
+	const char *c;
 
-	g_hash_table_iter_init(&iter, chat->notify_list);
-	result.lines = 0;
+	line_node.data = line;
+	line_node.next = NULL;
+	result.lines = &line_node;
 	result.final_or_pdu = 0;
 
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		notify = value;
+	/* Every node on the path spells out a prefix of the line */
+	for (c = line; *c; c++) {
+		node = notify_trie_find(node, *c);
+		if (!node)
+			break;
+
+		notify = node->notify;
+		node = node->child;
 
-		if (!g_str_has_prefix(line, key))
+		if (!notify)
 			continue;
 
 		if (notify->pdu) {
-			chat->pdu_notify = line;
+			chat->pdu_notify = TRUE;
 
 			if (chat->syntax->set_hint)
 				chat->syntax->set_hint(chat->syntax,
@@ -325,26 +653,65 @@ static gboolean g_at_chat_match_notify(GAtChat *chat, char *line)
 			return TRUE;
 		}
 
-		if (!result.lines)
-			result.lines = g_slist_prepend(NULL, line);
-
 		g_slist_foreach(notify->nodes, at_notify_call_callback,
 					&result);
 		ret = TRUE;
 	}
 
-	if (ret) {
-		g_slist_free(result.lines);
-		g_free(line);
+	return ret;
+}
+
+static gboolean response_add_line(GAtChat *p, const char *line)
+{
+	guint len = strlen(line) + 1;
+	char *buf = line_arena_alloc(&p->response, len);
+
+	if (!buf)
+		return FALSE;
+
+	memcpy(buf, line, len);
+	p->num_response_lines += 1;
+
+	return TRUE;
+}
+
+/*
+ * Links the response lines into the node pool, the list is only valid until
+ * the response lines are reset
+ */
+static GSList *response_build_list(GAtChat *p)
+{
+	guint num = p->num_response_lines;
+	char *line = p->response.buf;
+	GSList *nodes;
+	guint i;
+
+	if (num == 0)
+		return NULL;
+
+	if (p->num_line_nodes < num) {
+		nodes = g_try_renew(GSList, p->line_nodes, num);
+		if (!nodes)
+			return NULL;
+
+		p->line_nodes = nodes;
+		p->num_line_nodes = num;
+	}
+
+	nodes = p->line_nodes;
+
+	for (i = 0; i < num; i++) {
+		nodes[i].data = line;
+		nodes[i].next = i + 1 < num ? &nodes[i + 1] : NULL;
+		line += strlen(line) + 1;
 	}
 
-	return ret;
+	return nodes;
 }
 
 static void g_at_chat_finish_command(GAtChat *p, gboolean ok, char *final)
 {
 	struct at_command *cmd = g_queue_pop_head(p->command_queue);
-	GSList *response_lines;
 
 	/* Cannot happen, but lets be paranoid */
 	if (!cmd)
@@ -352,27 +719,31 @@ static void g_at_chat_finish_command(GAtChat *p, gboolean ok, char *final)
 
 	p->cmd_bytes_written = 0;
 
+	pipeline_advance(p);
+
 	if (g_queue_peek_head(p->command_queue))
 		chat_wakeup_writer(p);
 
-	response_lines = p->response_lines;
-	p->response_lines = NULL;
-
 	if (cmd->callback) {
 		GAtResult result;
 
-		response_lines = g_slist_reverse(response_lines);
-
 		result.final_or_pdu = final;
-		result.lines = response_lines;
+		result.lines = response_build_list(p);
+
+		/* Rather fail the command than hand out a partial response */
+		if (p->num_response_lines > 0 && result.lines == NULL)
+			p->response_lost = TRUE;
+
+		if (p->response_lost)
+			ok = FALSE;
 
 		cmd->callback(ok, &result, cmd->user_data);
 	}
 
-	g_slist_foreach(response_lines, (GFunc)g_free, NULL);
-	g_slist_free(response_lines);
+	p->num_response_lines = 0;
+	p->response_lost = FALSE;
+	line_arena_reset(&p->response);
 
-	g_free(final);
 	at_command_destroy(cmd);
 }
 
@@ -455,22 +826,22 @@ out:
 		p->syntax->set_hint(p->syntax, hint);
 
 	if (cmd->listing && cmd->expect_pdu) {
-		p->pdu_notify = line;
+		p->pdu_notify = TRUE;
 		return TRUE;
 	}
 
 	if (cmd->listing) {
 		GAtResult result;
+		GSList line_node;
 
-		result.lines = g_slist_prepend(NULL, line);
+		line_node.data = line;
+		line_node.next = NULL;
+		result.lines = &line_node;
 		result.final_or_pdu = NULL;
 
 		cmd->listing(&result, cmd->user_data);
-
-		g_slist_free(result.lines);
-		g_free(line);
-	} else
-		p->response_lines = g_slist_prepend(p->response_lines, line);
+	} else if (response_add_line(p, line) == FALSE)
+		p->response_lost = TRUE;
 
 	return TRUE;
 }
@@ -485,7 +856,7 @@ static void have_line(GAtChat *p, char *str)
 
 	/* Check for echo, this should not happen, but lets be paranoid */
 	if (!strncmp(str, "AT", 2) == TRUE)
-		goto done;
+		return;
 
 	cmd = g_queue_peek_head(p->command_queue);
 
@@ -505,31 +876,28 @@ static void have_line(GAtChat *p, char *str)
 			return;
 	}
 
-	if (g_at_chat_match_notify(p, str) == TRUE)
-		return;
-
-done:
-	/* No matches & no commands active, ignore line */
-	g_free(str);
+	/* No matches & no commands active, the line is simply dropped
+	 * together with the rest of the scratch arena
+	 */
+	if (g_at_chat_match_notify(p, str) == FALSE && p->pipeline_draining)
+		pipeline_drain(p);
 }
 
 static void have_notify_pdu(GAtChat *p, char *pdu, GAtResult *result)
 {
-	GHashTableIter iter;
+	struct notify_trie_node *node = p->notify_trie;
 	struct at_notify *notify;
-	char *prefix;
-	gpointer key, value;
+	const char *c;
 
-	g_hash_table_iter_init(&iter, p->notify_list);
-
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		prefix = key;
-		notify = value;
+	for (c = result->lines->data; *c; c++) {
+		node = notify_trie_find(node, *c);
+		if (!node)
+			break;
 
-		if (!g_str_has_prefix(p->pdu_notify, prefix))
-			continue;
+		notify = node->notify;
+		node = node->child;
 
-		if (!notify->pdu)
+		if (!notify || !notify->pdu)
 			continue;
 
 		g_slist_foreach(notify->nodes, at_notify_call_callback, result);
@@ -540,12 +908,16 @@ static void have_pdu(GAtChat *p, char *pdu)
 {
 	struct at_command *cmd;
 	GAtResult result;
+	GSList line_node;
 	gboolean listing_pdu = FALSE;
 
-	if (!pdu)
+	if (!pdu || p->pdu_notify == FALSE)
 		goto error;
 
-	result.lines = g_slist_prepend(NULL, p->pdu_notify);
+	/* The unsolicited response always sits at the start of the arena */
+	line_node.data = p->scratch.buf;
+	line_node.next = NULL;
+	result.lines = &line_node;
 	result.final_or_pdu = pdu;
 
 	cmd = g_queue_peek_head(p->command_queue);
@@ -566,14 +938,8 @@ static void have_pdu(GAtChat *p, char *pdu)
 	} else
 		have_notify_pdu(p, pdu, &result);
 
-	g_slist_free(result.lines);
-
 error:
-	g_free(p->pdu_notify);
-	p->pdu_notify = NULL;
-
-	if (pdu)
-		g_free(pdu);
+	p->pdu_notify = FALSE;
 }
 
 static char *extract_line(GAtChat *p, struct ring_buffer *rbuf)
@@ -601,7 +967,8 @@ static char *extract_line(GAtChat *p, struct ring_buffer *rbuf)
 			buf = ring_buffer_read_ptr(rbuf, pos);
 	}
 
-	line = g_try_new(char, line_length + 1);
+	/* The line is placed after a pending unsolicited response, if any */
+	line = line_arena_alloc(&p->scratch, line_length + 1);
 	if (!line) {
 		ring_buffer_drain(rbuf, p->read_so_far);
 		return NULL;
@@ -645,11 +1012,22 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		switch (result) {
 		case G_AT_SYNTAX_RESULT_LINE:
 		case G_AT_SYNTAX_RESULT_MULTILINE:
+			/* A line where the PDU should be, it is not coming */
+			if (p->pdu_notify) {
+				p->pdu_notify = FALSE;
+				line_arena_reset(&p->scratch);
+			}
+
 			have_line(p, extract_line(p, rbuf));
+
+			/* Keep the line around if it is waiting for a PDU */
+			if (p->pdu_notify == FALSE)
+				line_arena_reset(&p->scratch);
 			break;
 
 		case G_AT_SYNTAX_RESULT_PDU:
 			have_pdu(p, extract_line(p, rbuf));
+			line_arena_reset(&p->scratch);
 			break;
 
 		case G_AT_SYNTAX_RESULT_PROMPT:
@@ -670,7 +1048,7 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 	p->in_read_handler = FALSE;
 
 	if (p->destroyed)
-		g_free(p);
+		chat_free(p);
 }
 
 static void wakeup_cb(gboolean ok, GAtResult *result, gpointer user_data)
@@ -731,14 +1109,18 @@ static gboolean can_write_data(gpointer data)
 	if (cmd == NULL)
 		return FALSE;
 
+	/* Late responses to a stalled pipeline are still being dropped */
+	if (chat->pipeline_draining)
+		return FALSE;
+
 	len = strlen(cmd->cmd);
 
-	/* For some reason write watcher fired, but we've already
-	 * written the entire command out to the io channel,
+	/* We've already written the entire command out to the io channel,
+	 * see if the following commands can be sent out already, otherwise
 	 * cancel write watcher
 	 */
 	if (chat->cmd_bytes_written >= len)
-		return FALSE;
+		return can_write_ahead(chat);
 
 	if (chat->wakeup) {
 		if (!chat->wakeup_timer) {
@@ -793,7 +1175,7 @@ static gboolean can_write_data(gpointer data)
 	if (chat->wakeup_timer)
 		g_timer_start(chat->wakeup_timer);
 
-	return FALSE;
+	return can_write_ahead(chat);
 }
 
 static void chat_wakeup_writer(GAtChat *chat)
@@ -820,6 +1202,7 @@ static GAtChat *create_chat(GIOChannel *channel, GIOFlags flags,
 	chat->next_cmd_id = 1;
 	chat->next_notify_id = 1;
 	chat->debugf = NULL;
+	chat->pipeline_depth = 1;
 
 	if (flags & G_IO_FLAG_NONBLOCK)
 		chat->io = g_at_io_new(channel);
@@ -949,7 +1332,7 @@ void g_at_chat_unref(GAtChat *chat)
 	if (chat->in_read_handler)
 		chat->destroyed = TRUE;
 	else
-		g_free(chat);
+		chat_free(chat);
 }
 
 gboolean g_at_chat_set_disconnect_function(GAtChat *chat,
@@ -981,7 +1364,7 @@ gboolean g_at_chat_set_debug(GAtChat *chat,
 
 static guint send_common(GAtChat *chat, const char *cmd,
 			const char **prefix_list,
-			gboolean expect_pdu,
+			gboolean expect_pdu, gboolean pipeline,
 			GAtNotifyFunc listing, GAtResultFunc func,
 			gpointer user_data, GDestroyNotify notify)
 {
@@ -998,9 +1381,13 @@ static guint send_common(GAtChat *chat, const char *cmd,
 
 	c->id = chat->next_cmd_id++;
 
+	/* Commands waiting for a prompt are never pipelined */
+	c->pipeline = pipeline && strchr(cmd, '\r') == NULL;
+
 	g_queue_push_tail(chat->command_queue, c);
 
-	if (g_queue_get_length(chat->command_queue) == 1)
+	if (g_queue_get_length(chat->command_queue) == 1 ||
+			(c->pipeline && chat->pipeline_depth > 1))
 		chat_wakeup_writer(chat);
 
 	return c->id;
@@ -1010,7 +1397,15 @@ guint g_at_chat_send(GAtChat *chat, const char *cmd,
 			const char **prefix_list, GAtResultFunc func,
 			gpointer user_data, GDestroyNotify notify)
 {
-	return send_common(chat, cmd, prefix_list, FALSE, NULL, func,
+	return send_common(chat, cmd, prefix_list, FALSE, FALSE, NULL, func,
+				user_data, notify);
+}
+
+guint g_at_chat_send_pipelined(GAtChat *chat, const char *cmd,
+				const char **prefix_list, GAtResultFunc func,
+				gpointer user_data, GDestroyNotify notify)
+{
+	return send_common(chat, cmd, prefix_list, FALSE, TRUE, NULL, func,
 				user_data, notify);
 }
 
@@ -1022,7 +1417,7 @@ guint g_at_chat_send_listing(GAtChat *chat, const char *cmd,
 	if (listing == NULL)
 		return 0;
 
-	return send_common(chat, cmd, prefix_list, FALSE, listing, func,
+	return send_common(chat, cmd, prefix_list, FALSE, FALSE, listing, func,
 				user_data, notify);
 }
 
@@ -1034,7 +1429,7 @@ guint g_at_chat_send_pdu_listing(GAtChat *chat, const char *cmd,
 	if (listing == NULL)
 		return 0;
 
-	return send_common(chat, cmd, prefix_list, TRUE, listing, func,
+	return send_common(chat, cmd, prefix_list, TRUE, FALSE, listing, func,
 				user_data, notify);
 }
 
@@ -1055,8 +1450,8 @@ gboolean g_at_chat_cancel(GAtChat *chat, guint id)
 	if (!l)
 		return FALSE;
 
-	if (l == g_queue_peek_head(chat->command_queue) &&
-			chat->cmd_bytes_written > 0) {
+	if (command_in_flight(chat,
+			g_queue_index(chat->command_queue, l->data))) {
 		struct at_command *c = l->data;
 
 		/* We can't actually remove it since it is most likely
@@ -1086,7 +1481,7 @@ gboolean g_at_chat_cancel_all(GAtChat *chat)
 			continue;
 		}
 
-		if (n == 0 && chat->cmd_bytes_written > 0) {
+		if (command_in_flight(chat, n)) {
 			c->callback = NULL;
 			n += 1;
 			continue;
@@ -1118,6 +1513,15 @@ static struct at_notify *at_notify_create(GAtChat *chat, const char *prefix,
 
 	notify->pdu = pdu;
 
+	notify->trie = notify_trie_insert(chat, prefix);
+	if (!notify->trie) {
+		g_free(notify);
+		g_free(key);
+		return 0;
+	}
+
+	notify->trie->notify = notify;
+
 	g_hash_table_insert(chat->notify_list, key, notify);
 
 	return notify;
@@ -1221,6 +1625,20 @@ gboolean g_at_chat_unregister_all(GAtChat *chat)
 	return TRUE;
 }
 
+gboolean g_at_chat_set_pipeline(GAtChat *chat, guint depth, guint timeout)
+{
+	if (chat == NULL || depth == 0)
+		return FALSE;
+
+	if (depth > 1 && timeout == 0)
+		return FALSE;
+
+	chat->pipeline_depth = depth;
+	chat->pipeline_timeout = timeout;
+
+	return TRUE;
+}
+
 gboolean g_at_chat_set_wakeup_command(GAtChat *chat, const char *cmd,
 					unsigned int timeout, unsigned int msec)
 {
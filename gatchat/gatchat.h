@@ -95,6 +95,18 @@ guint g_at_chat_send(GAtChat *chat, const char *cmd,
 				const char **valid_resp, GAtResultFunc func,
 				gpointer user_data, GDestroyNotify notify);
 
+/*!
+ * Same as the above command, except that the command is marked as having
+ * no side effects and not depending on the commands queued before it.  If
+ * pipelining has been enabled with g_at_chat_set_pipeline, such commands
+ * are written out without waiting for the final response of the previous
+ * pipelined command.  Responses are still matched in submission order.
+ * Commands expecting a prompt are always sent one at a time.
+ */
+guint g_at_chat_send_pipelined(GAtChat *chat, const char *cmd,
+				const char **valid_resp, GAtResultFunc func,
+				gpointer user_data, GDestroyNotify notify);
+
 /*!
  * Same as the above command, except that the caller wishes to receive the
  * intermediate responses immediately through the GAtNotifyFunc callback.
@@ -132,6 +144,16 @@ gboolean g_at_chat_unregister_all(GAtChat *chat);
 gboolean g_at_chat_set_wakeup_command(GAtChat *chat, const char *cmd,
 					guint timeout, guint msec);
 
+/*!
+ * Allows up to depth commands sent with g_at_chat_send_pipelined to be in
+ * flight at the same time, a depth of 1 turns pipelining off and timeout
+ * is then ignored.  Should the modem not answer a command written ahead
+ * within timeout milliseconds, pipelining is turned off.  Once the modem
+ * has been quiet for another timeout, with any late responses dropped,
+ * the outstanding commands are sent again one at a time.
+ */
+gboolean g_at_chat_set_pipeline(GAtChat *chat, guint depth, guint timeout);
+
 void g_at_chat_add_terminator(GAtChat *chat, char *terminator,
 				int len, gboolean success);
 
@@ -26,14 +26,17 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 
 #include "crc-ccitt.h"
 #include "ringbuffer.h"
+#include "tracebuffer.h"
 #include "gatio.h"
 #include "gathdlc.h"
 
@@ -48,22 +51,40 @@
 
 #define HDLC_FCS(fcs, c) crc_ccitt_byte(fcs, c)
 
+/* Every byte and both FCS bytes escaped, plus the closing flag */
+#define HDLC_MAX_FRAME(size) ((size) * 2 + 5)
+
+/*
+ * Word-at-a-time byte tests, see "Bit Twiddling Hacks".  HAS_ZERO is
+ * non-zero if any byte of v is zero and HAS_LESS if any byte is below n
+ * (n <= 128).  Neither says which byte, callers fall back to a byte loop.
+ */
+#define WORD_ONES	(~0UL / 0xff)
+#define WORD_HIGHS	(WORD_ONES * 0x80)
+#define HAS_ZERO(v)	(((v) - WORD_ONES) & ~(v) & WORD_HIGHS)
+#define HAS_LESS(v, n)	(((v) - WORD_ONES * (n)) & ~(v) & WORD_HIGHS)
+
 struct _GAtHDLC {
 	gint ref_count;
 	GAtIO *io;
 	guint write_watch;
 	struct ring_buffer *write_buffer;
+	unsigned char *encode_buffer;
 	unsigned char *decode_buffer;
 	guint decode_offset;
 	guint16 decode_fcs;
 	gboolean decode_escape;
+	gboolean decode_overflow;
 	guint32 xmit_accm[8];
 	guint32 recv_accm;
 	GAtReceiveFunc receive_func;
 	gpointer receive_data;
+	GAtHDLCWritableFunc writable_func;
+	gpointer writable_data;
 	GAtDebugFunc debugf;
 	gpointer debug_data;
 	int record_fd;
+	struct trace_channel *trace;
 	gboolean in_read_handler;
 	gboolean destroyed;
 };
@@ -73,7 +94,15 @@ static void hdlc_record(int fd, gboolean in, guint8 *data, guint16 length)
 	guint16 len = htons(length);
 	guint32 ts;
 	struct timeval now;
-	unsigned char id;
+	unsigned char time_id = 0x07;
+	unsigned char dir_id = in ? 0x02 : 0x01;
+	struct iovec iov[5] = {
+		{ &time_id, 1 },
+		{ &ts, 4 },
+		{ &dir_id, 1 },
+		{ &len, 2 },
+		{ data, length },
+	};
 	int err;
 
 	if (fd < 0)
@@ -85,14 +114,8 @@ static void hdlc_record(int fd, gboolean in, guint8 *data, guint16 length)
 	gettimeofday(&now, NULL);
 	ts = htonl(now.tv_sec & 0xffffffff);
 
-	id = 0x07;
-	err = write(fd, &id, 1);
-	err = write(fd, &ts, 4);
-
-	id = in ? 0x02 : 0x01;
-	err = write(fd, &id, 1);
-	err = write(fd, &len, 2);
-	err = write(fd, data, length);
+	/* One system call per record, so records are never interleaved */
+	err = writev(fd, iov, G_N_ELEMENTS(iov));
 }
 
 void g_at_hdlc_set_recording(GAtHDLC *hdlc, const char *filename)
@@ -128,31 +151,107 @@ guint32 g_at_hdlc_get_recv_accm(GAtHDLC *hdlc)
 	return hdlc->recv_accm;
 }
 
+/*
+ * Returns the length of the leading run of buf that can be copied through
+ * verbatim: no flag, no control escape and, if ctrl is set, no byte below
+ * 0x20.  Those are the only bytes the ACCMs can ever select.
+ */
+static gsize hdlc_clean_run(const unsigned char *buf, gsize len,
+				gboolean ctrl)
+{
+	gsize i = 0;
+
+	while (len - i >= sizeof(unsigned long)) {
+		unsigned long v;
+
+		memcpy(&v, buf + i, sizeof(v));
+
+		if (HAS_ZERO(v ^ (WORD_ONES * HDLC_FLAG)) ||
+				HAS_ZERO(v ^ (WORD_ONES * HDLC_ESCAPE)))
+			break;
+
+		if (ctrl && HAS_LESS(v, 0x20))
+			break;
+
+		i += sizeof(v);
+	}
+
+	for (; i < len; i++) {
+		if (buf[i] == HDLC_FLAG || buf[i] == HDLC_ESCAPE)
+			break;
+
+		if (ctrl && buf[i] < 0x20)
+			break;
+	}
+
+	return i;
+}
+
+static void hdlc_decode(GAtHDLC *hdlc, const unsigned char *buf,
+				unsigned int len)
+{
+	if (hdlc->decode_offset + len > BUFFER_SIZE * 2) {
+		hdlc->decode_overflow = TRUE;
+		return;
+	}
+
+	memcpy(hdlc->decode_buffer + hdlc->decode_offset, buf, len);
+	hdlc->decode_offset += len;
+	hdlc->decode_fcs = crc_ccitt(hdlc->decode_fcs, buf, len);
+}
+
+static inline void hdlc_decode_byte(GAtHDLC *hdlc, unsigned char val)
+{
+	if (hdlc->decode_offset == BUFFER_SIZE * 2) {
+		hdlc->decode_overflow = TRUE;
+		return;
+	}
+
+	hdlc->decode_buffer[hdlc->decode_offset++] = val;
+	hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, val);
+}
+
 static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 {
 	GAtHDLC *hdlc = user_data;
 	unsigned int len = ring_buffer_len(rbuf);
 	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
 	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	gboolean ctrl = hdlc->recv_accm != 0;
 	unsigned int pos = 0;
+	unsigned int end;
+	unsigned int run;
 
 	hdlc_record(hdlc->record_fd, TRUE, buf, wrap);
 
 	hdlc->in_read_handler = TRUE;
 
 	while (pos < len) {
-		if (hdlc->decode_escape == TRUE) {
-			unsigned char val = *buf ^ HDLC_TRANS;
-
-			hdlc->decode_buffer[hdlc->decode_offset++] = val;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, val);
+		if (hdlc->decode_escape == FALSE) {
+			end = pos < wrap ? wrap : len;
+			run = hdlc_clean_run(buf, end - pos, ctrl);
+
+			if (run > 0) {
+				hdlc_decode(hdlc, buf, run);
+				buf += run;
+				pos += run;
+				goto next;
+			}
+		}
 
+		if (hdlc->decode_escape == TRUE) {
+			hdlc_decode_byte(hdlc, *buf ^ HDLC_TRANS);
 			hdlc->decode_escape = FALSE;
 		} else if (*buf == HDLC_ESCAPE) {
 			hdlc->decode_escape = TRUE;
 		} else if (*buf == HDLC_FLAG) {
 			if (hdlc->receive_func && hdlc->decode_offset > 2 &&
+					hdlc->decode_overflow == FALSE &&
 					hdlc->decode_fcs == HDLC_GOODFCS) {
+				trace_record(hdlc->trace, TRUE,
+						hdlc->decode_buffer,
+						hdlc->decode_offset - 2);
+
 				hdlc->receive_func(hdlc->decode_buffer,
 							hdlc->decode_offset - 2,
 							hdlc->receive_data);
@@ -163,15 +262,16 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 
 			hdlc->decode_fcs = HDLC_INITFCS;
 			hdlc->decode_offset = 0;
+			hdlc->decode_overflow = FALSE;
 		} else if (*buf >= 0x20 ||
 					(hdlc->recv_accm & (1 << *buf)) == 0) {
-			hdlc->decode_buffer[hdlc->decode_offset++] = *buf;
-			hdlc->decode_fcs = HDLC_FCS(hdlc->decode_fcs, *buf);
+			hdlc_decode_byte(hdlc, *buf);
 		}
 
 		buf++;
 		pos++;
 
+next:
 		if (pos == wrap) {
 			buf = ring_buffer_read_ptr(rbuf, pos);
 			hdlc_record(hdlc->record_fd, TRUE, buf, len - wrap);
@@ -208,7 +308,7 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 	hdlc->xmit_accm[3] = 0x60000000; /* 0x7d, 0x7e */
 	hdlc->recv_accm = ~0U;
 
-	hdlc->write_buffer = ring_buffer_new(BUFFER_SIZE * 2);
+	hdlc->write_buffer = ring_buffer_new_mirrored(BUFFER_SIZE * 2);
 	if (!hdlc->write_buffer)
 		goto error;
 
@@ -217,11 +317,16 @@ GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io)
 	*buf = HDLC_FLAG;
 	ring_buffer_write_advance(hdlc->write_buffer, 1);
 
+	hdlc->encode_buffer = g_try_malloc(BUFFER_SIZE * 2);
+	if (!hdlc->encode_buffer)
+		goto error;
+
 	hdlc->decode_buffer = g_try_malloc(BUFFER_SIZE * 2);
 	if (!hdlc->decode_buffer)
 		goto error;
 
 	hdlc->record_fd = -1;
+	hdlc->trace = trace_channel_new("hdlc", TRACE_FORMAT_HEX);
 
 	hdlc->io = g_at_io_ref(io);
 	g_at_io_set_read_handler(hdlc->io, new_bytes, hdlc);
@@ -232,8 +337,8 @@ error:
 	if (hdlc->write_buffer)
 		ring_buffer_free(hdlc->write_buffer);
 
-	if (hdlc->decode_buffer)
-		g_free(hdlc->decode_buffer);
+	g_free(hdlc->encode_buffer);
+	g_free(hdlc->decode_buffer);
 
 	g_free(hdlc);
 
@@ -281,7 +386,11 @@ void g_at_hdlc_unref(GAtHDLC *hdlc)
 	g_at_io_unref(hdlc->io);
 	hdlc->io = NULL;
 
+	trace_channel_free(hdlc->trace);
+	hdlc->trace = NULL;
+
 	ring_buffer_free(hdlc->write_buffer);
+	g_free(hdlc->encode_buffer);
 	g_free(hdlc->decode_buffer);
 
 	if (hdlc->in_read_handler)
@@ -309,6 +418,16 @@ void g_at_hdlc_set_receive(GAtHDLC *hdlc, GAtReceiveFunc func,
 	hdlc->receive_data = user_data;
 }
 
+void g_at_hdlc_set_writable(GAtHDLC *hdlc, GAtHDLCWritableFunc func,
+							gpointer user_data)
+{
+	if (!hdlc)
+		return;
+
+	hdlc->writable_func = func;
+	hdlc->writable_data = user_data;
+}
+
 static gboolean can_write_data(gpointer data)
 {
 	GAtHDLC *hdlc = data;
@@ -323,6 +442,11 @@ static gboolean can_write_data(gpointer data)
 	hdlc_record(hdlc->record_fd, FALSE, buf, bytes_written);
 	ring_buffer_drain(hdlc->write_buffer, bytes_written);
 
+	/* Frames sent from here are picked up by this same write watch */
+	if (hdlc->writable_func &&
+			ring_buffer_avail(hdlc->write_buffer) >= BUFFER_SIZE)
+		hdlc->writable_func(hdlc->writable_data);
+
 	if (ring_buffer_len(hdlc->write_buffer) > 0)
 		return TRUE;
 
@@ -355,79 +479,105 @@ GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc)
 
 #define NEED_ESCAPE(xmit_accm, c) xmit_accm[c >> 5] & (1 << (c & 0x1f))
 
-gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+/*
+ * Escapes len bytes of src into dst, returns the number of bytes written
+ * or -1 if that would exceed limit.
+ */
+static int hdlc_escape(const guint32 *xmit_accm, unsigned char *dst,
+			unsigned int limit, const unsigned char *src, gsize len)
 {
-	unsigned int avail = ring_buffer_avail(hdlc->write_buffer);
-	unsigned int wrap = ring_buffer_avail_no_wrap(hdlc->write_buffer);
-	unsigned char *buf = ring_buffer_write_ptr(hdlc->write_buffer, 0);
-	unsigned char tail[2];
-	unsigned int i = 0;
-	guint16 fcs = HDLC_INITFCS;
-	gboolean escape = FALSE;
-	gsize pos = 0;
+	gboolean ctrl = xmit_accm[0] != 0;
+	unsigned int pos = 0;
+	gsize run;
+	gsize i = 0;
 
-	if (avail < size)
-		return FALSE;
+	while (i < len) {
+		run = hdlc_clean_run(src + i, len - i, ctrl);
+
+		if (pos + run > limit)
+			return -1;
+
+		memcpy(dst + pos, src + i, run);
+		pos += run;
+		i += run;
 
-	i = 0;
+		if (i == len)
+			break;
 
-	while (pos < avail && i < size) {
-		if (escape == TRUE) {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, data[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
+		if (NEED_ESCAPE(xmit_accm, src[i])) {
+			if (pos + 2 > limit)
+				return -1;
+
+			dst[pos++] = HDLC_ESCAPE;
+			dst[pos++] = src[i++] ^ HDLC_TRANS;
 		} else {
-			fcs = HDLC_FCS(fcs, data[i]);
-			*buf = data[i++];
+			if (pos + 1 > limit)
+				return -1;
+
+			dst[pos++] = src[i++];
 		}
+	}
 
-		buf++;
-		pos++;
+	return pos;
+}
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(hdlc->write_buffer, pos);
-	}
+gboolean g_at_hdlc_can_send(GAtHDLC *hdlc, gsize size)
+{
+	if (hdlc == NULL)
+		return FALSE;
+
+	return (gsize) ring_buffer_avail(hdlc->write_buffer) >=
+							HDLC_MAX_FRAME(size);
+}
+
+gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size)
+{
+	unsigned int avail = ring_buffer_avail(hdlc->write_buffer);
+	unsigned int wrap = ring_buffer_avail_no_wrap(hdlc->write_buffer);
+	unsigned char *buf;
+	unsigned char tail[2];
+	guint16 fcs;
+	int pos;
+	int len;
 
-	if (i < size)
+	if (avail < size)
 		return FALSE;
 
-	fcs ^= HDLC_INITFCS;
+	fcs = crc_ccitt(HDLC_INITFCS, data, size) ^ HDLC_INITFCS;
 	tail[0] = fcs & 0xff;
 	tail[1] = fcs >> 8;
 
-	i = 0;
+	/*
+	 * Escape straight into the ring buffer if even the worst case frame
+	 * cannot wrap, otherwise go through encode_buffer.
+	 */
+	if (wrap >= HDLC_MAX_FRAME(size))
+		buf = ring_buffer_write_ptr(hdlc->write_buffer, 0);
+	else
+		buf = hdlc->encode_buffer;
 
-	while (pos < avail && i < sizeof(tail)) {
-		if (escape == TRUE) {
-			*buf = tail[i++] ^ HDLC_TRANS;
-			escape = FALSE;
-		} else if (NEED_ESCAPE(hdlc->xmit_accm, tail[i])) {
-			*buf = HDLC_ESCAPE;
-			escape = TRUE;
-		} else {
-			*buf = tail[i++];
-		}
+	pos = hdlc_escape(hdlc->xmit_accm, buf, avail, data, size);
+	if (pos < 0)
+		return FALSE;
 
-		buf++;
-		pos++;
+	len = hdlc_escape(hdlc->xmit_accm, buf + pos, avail - pos,
+				tail, sizeof(tail));
+	if (len < 0)
+		return FALSE;
 
-		if (pos == wrap)
-			buf = ring_buffer_write_ptr(hdlc->write_buffer, pos);
-	}
+	pos += len;
 
-	if (i < sizeof(tail))
+	if ((unsigned int) pos + 1 > avail)
 		return FALSE;
 
-	if (pos + 1 > avail)
-		return FALSE;
+	buf[pos++] = HDLC_FLAG;
 
-	*buf = HDLC_FLAG;
-	pos++;
+	trace_record(hdlc->trace, FALSE, data, size);
 
-	ring_buffer_write_advance(hdlc->write_buffer, pos);
+	if (buf == hdlc->encode_buffer)
+		ring_buffer_write(hdlc->write_buffer, buf, pos);
+	else
+		ring_buffer_write_advance(hdlc->write_buffer, pos);
 
 	g_at_io_set_write_handler(hdlc->io, can_write_data, hdlc);
 
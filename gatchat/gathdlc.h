@@ -33,6 +33,8 @@ struct _GAtHDLC;
 
 typedef struct _GAtHDLC GAtHDLC;
 
+typedef void (*GAtHDLCWritableFunc)(gpointer user_data);
+
 GAtHDLC *g_at_hdlc_new(GIOChannel *channel);
 GAtHDLC *g_at_hdlc_new_from_io(GAtIO *io);
 
@@ -51,6 +53,16 @@ void g_at_hdlc_set_receive(GAtHDLC *hdlc, GAtReceiveFunc func,
 							gpointer user_data);
 gboolean g_at_hdlc_send(GAtHDLC *hdlc, const unsigned char *data, gsize size);
 
+/* TRUE if a frame of size bytes is sure to fit in the write buffer */
+gboolean g_at_hdlc_can_send(GAtHDLC *hdlc, gsize size);
+
+/*
+ * Called from the write handler once the modem has taken enough data for
+ * at least half the write buffer to be free again.
+ */
+void g_at_hdlc_set_writable(GAtHDLC *hdlc, GAtHDLCWritableFunc func,
+							gpointer user_data);
+
 void g_at_hdlc_set_recording(GAtHDLC *hdlc, const char *filename);
 
 GAtIO *g_at_hdlc_get_io(GAtHDLC *hdlc);
@@ -33,6 +33,7 @@
 #include <glib.h>
 
 #include "ringbuffer.h"
+#include "tracebuffer.h"
 #include "gatio.h"
 #include "gatutil.h"
 
@@ -49,9 +50,11 @@ struct _GAtIO {
 	gpointer read_data;			/* Read callback userdata */
 	gboolean use_write_watch;		/* Use write select */
 	GAtIOWriteFunc write_handler;		/* Write callback */
+	gboolean write_blocked;			/* Last write got EAGAIN */
 	gpointer write_data;			/* Write callback userdata */
 	GAtDebugFunc debugf;			/* debugging output function */
 	gpointer debug_data;			/* Data to pass to debug func */
+	struct trace_channel *trace;		/* Recorded traffic */
 	gboolean destroyed;			/* Re-entrancy guard */
 };
 
@@ -102,6 +105,7 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 		buf = ring_buffer_write_ptr(io->buf, 0);
 
 		err = g_io_channel_read(channel, (char *) buf, toread, &rbytes);
+		trace_record(io->trace, TRUE, buf, rbytes);
 		g_at_util_debug_chat(TRUE, (char *)buf, rbytes,
 					io->debugf, io->debug_data);
 
@@ -138,11 +142,18 @@ gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count)
 
 	err = g_io_channel_write(io->channel, data, count, &bytes_written);
 
+	/* Nothing fits right now, the write watch tries again */
+	if (err == G_IO_ERROR_AGAIN) {
+		io->write_blocked = TRUE;
+		return 0;
+	}
+
 	if (err != G_IO_ERROR_NONE) {
 		g_source_remove(io->read_watch);
 		return 0;
 	}
 
+	trace_record(io->trace, FALSE, data, bytes_written);
 	g_at_util_debug_chat(FALSE, data, bytes_written,
 				io->debugf, io->debug_data);
 
@@ -169,8 +180,13 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 	if (io->write_handler == NULL)
 		return FALSE;
 
-	return io->write_handler(io->write_data);
+	io->write_blocked = FALSE;
 
+	if (io->write_handler(io->write_data) == TRUE)
+		return TRUE;
+
+	/* A writer that was pushed back waits for the next G_IO_OUT */
+	return io->write_blocked && io->use_write_watch;
 }
 
 static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
@@ -195,7 +211,7 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		io->use_write_watch = FALSE;
 	}
 
-	io->buf = ring_buffer_new(4096);
+	io->buf = ring_buffer_new_mirrored(4096);
 
 	if (!io->buf)
 		goto error;
@@ -204,6 +220,7 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 		goto error;
 
 	io->channel = channel;
+	io->trace = trace_channel_new("io", TRACE_FORMAT_TEXT);
 	io->read_watch = g_io_add_watch_full(channel, G_PRIORITY_DEFAULT,
 				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 				received_data, io,
@@ -332,6 +349,9 @@ void g_at_io_unref(GAtIO *io)
 
 	io_shutdown(io);
 
+	trace_channel_free(io->trace);
+	io->trace = NULL;
+
 	/* glib delays the destruction of the watcher until it exits, this
 	 * means we can't free the data just yet, even though we've been
 	 * destroyed already.  We have to wait until the read_watcher
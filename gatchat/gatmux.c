@@ -33,6 +33,7 @@
 #include <glib.h>
 
 #include "ringbuffer.h"
+#include "tracebuffer.h"
 #include "gatmux.h"
 #include "gsm0710.h"
 
@@ -55,6 +56,14 @@ typedef void (*GAtMuxWriteFrame)(GAtMux *mux, guint8 dlc, guint8 control,
 #define BITMAP_SIZE 8
 #define MUX_CHANNEL_BUFFER_SIZE 4096
 #define MUX_BUFFER_SIZE 4096
+#define MUX_MAX_READS 8
+#define MUX_QUANTUM 256
+#define MUX_MAX_SENT 128
+
+/* Largest encoded frame, with its queue header, that is ever queued.  Any
+ * frame up to N1 is valid, so a larger N1 is simply not used in full.
+ */
+#define MUX_MAX_FRAME (MUX_BUFFER_SIZE / 2 - (int) sizeof(struct mux_frame))
 
 struct _GAtMuxChannel
 {
@@ -64,7 +73,29 @@ struct _GAtMuxChannel
 	struct ring_buffer *buffer;
 	GSList *sources;
 	gboolean throttled;
+	gboolean flow_stopped;		/* MSC with the FC bit set */
 	guint dlc;
+	struct ring_buffer *queue;	/* Encoded frames waiting to go out */
+	guint priority;			/* Lower is served first */
+	int quantum;			/* DRR bytes per round */
+	int deficit;			/* DRR bytes left this round */
+	GAtMuxChannelStats stats;
+};
+
+static GIOFuncs channel_funcs;
+
+/* Prepended to every frame in a channel's queue */
+struct mux_frame {
+	int len;
+	gdouble queued;
+};
+
+/* A frame moved into the output buffer, until it is written out in full */
+struct mux_sent {
+	guint8 dlc;
+	int len;
+	gdouble queued;
+	guint64 end;		/* out_total just past the frame */
 };
 
 struct _GAtMuxWatch
@@ -89,6 +120,17 @@ struct _GAtMux {
 	void *driver_data;			/* Driver data */
 	char buf[MUX_BUFFER_SIZE];		/* Buffer on the main mux */
 	int buf_used;				/* Bytes of buf being used */
+	char out[MUX_BUFFER_SIZE];		/* Frames being written out */
+	int out_used;				/* Bytes of out being used */
+	guint64 out_total;			/* Bytes ever put into out */
+	struct mux_sent sent[MUX_MAX_SENT];	/* Frames in out, in order */
+	int sent_first;				/* Oldest entry of sent */
+	int sent_count;				/* Entries of sent in use */
+	gboolean flow_stopped;			/* FCoff received */
+	int drr_next;				/* DLC to resume DRR at */
+	gboolean drr_resume;			/* drr_next got its quantum */
+	GTimer *timer;				/* Timestamps queued frames */
+	struct trace_channel *trace;		/* Recorded traffic */
 	gboolean shutdown;
 };
 
@@ -165,51 +207,103 @@ static void dispatch_sources(GAtMuxChannel *channel, GIOCondition condition)
 	}
 }
 
+/*
+ * Another read could deliver up to MUX_BUFFER_SIZE bytes to a single DLC,
+ * only go for it if none of the DLCs waiting for dispatch could overflow.
+ */
+static gboolean dlc_buffers_have_room(GAtMux *mux)
+{
+	int i;
+
+	for (i = 1; i <= MAX_CHANNELS; i++) {
+		if (!(mux->newdata[i / 8] & (1 << (i % 8))))
+			continue;
+
+		if (mux->dlcs[i-1] == NULL)
+			continue;
+
+		if (ring_buffer_avail(mux->dlcs[i-1]->buffer) < MUX_BUFFER_SIZE)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void dispatch_newdata(GAtMux *mux)
+{
+	int offset;
+	int bit;
+	int i;
+
+	for (offset = 0; offset < BITMAP_SIZE; offset++) {
+		guint8 bits = mux->newdata[offset];
+
+		while (bits) {
+			bit = g_bit_nth_lsf(bits, -1);
+			bits &= ~(1 << bit);
+
+			i = offset * 8 + bit;
+			if (i < 1 || i > MAX_CHANNELS || mux->dlcs[i-1] == NULL)
+				continue;
+
+			DBG("dispatching sources for channel: %p",
+				mux->dlcs[i-1]);
+
+			dispatch_sources(mux->dlcs[i-1], G_IO_IN);
+		}
+	}
+}
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 							gpointer data)
 {
 	GAtMux *mux = data;
-	int i;
 	GError *error = NULL;
 	GIOStatus status;
 	gsize bytes_read;
+	int reads = 0;
 
 	if (cond & G_IO_NVAL)
 		return FALSE;
 
 	DBG("received data");
 
-	bytes_read = 0;
-	status = g_io_channel_read_chars(mux->channel, mux->buf + mux->buf_used,
+	memset(mux->newdata, 0, BITMAP_SIZE);
+
+	/*
+	 * Demultiplex everything the modem has sent so far into the DLC
+	 * buffers first, and only then wake up the DLC sources.  That way
+	 * each DLC gets dispatched once per wakeup, not once per frame
+	 * or per read.
+	 */
+	do {
+		bytes_read = 0;
+		status = g_io_channel_read_chars(mux->channel,
+					mux->buf + mux->buf_used,
 					sizeof(mux->buf) - mux->buf_used,
 					&bytes_read, &error);
 
-	mux->buf_used += bytes_read;
-
-	if (bytes_read > 0 && mux->driver->feed_data) {
-		int nread;
+		trace_record(mux->trace, TRUE, mux->buf + mux->buf_used,
+				bytes_read);
+		mux->buf_used += bytes_read;
 
-		memset(mux->newdata, 0, BITMAP_SIZE);
+		if (bytes_read > 0 && mux->driver->feed_data) {
+			int nread;
 
-		nread = mux->driver->feed_data(mux, mux->buf, mux->buf_used);
-		mux->buf_used -= nread;
-
-		if (mux->buf_used > 0)
-			memmove(mux->buf, mux->buf + nread, mux->buf_used);
-
-		for (i = 1; i <= MAX_CHANNELS; i++) {
-			int offset = i / 8;
-			int bit = i % 8;
-
-			if (!(mux->newdata[offset] & (1 << bit)))
-				continue;
+			nread = mux->driver->feed_data(mux, mux->buf,
+							mux->buf_used);
+			mux->buf_used -= nread;
 
-			DBG("dispatching sources for channel: %p",
-				mux->dlcs[i-1]);
-
-			dispatch_sources(mux->dlcs[i-1], G_IO_IN);
+			if (mux->buf_used > 0)
+				memmove(mux->buf, mux->buf + nread,
+						mux->buf_used);
 		}
-	}
+	} while (bytes_read > 0 && status == G_IO_STATUS_NORMAL &&
+			mux->driver->feed_data && ++reads < MUX_MAX_READS &&
+			mux->buf_used < (int) sizeof(mux->buf) &&
+			dlc_buffers_have_room(mux));
+
+	dispatch_newdata(mux);
 
 	if (cond & (G_IO_HUP | G_IO_ERR))
 		return FALSE;
@@ -230,6 +324,213 @@ static void write_watcher_destroy_notify(gpointer user_data)
 	mux->write_watch = 0;
 }
 
+static gboolean channel_can_send(GAtMux *mux, GAtMuxChannel *channel)
+{
+	if (mux->flow_stopped)
+		return FALSE;
+
+	return !channel->throttled && !channel->flow_stopped;
+}
+
+static gboolean channel_has_room(GAtMuxChannel *channel)
+{
+	return ring_buffer_avail(channel->queue) >= MUX_BUFFER_SIZE / 2;
+}
+
+static gboolean channel_wants_write(GAtMuxChannel *channel)
+{
+	GSList *l;
+	GAtMuxWatch *source;
+
+	for (l = channel->sources; l; l = l->next) {
+		source = l->data;
+
+		if (source->condition & G_IO_OUT)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void ring_buffer_peek(struct ring_buffer *rbuf, void *data,
+				unsigned int len)
+{
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+
+	if (len <= wrap) {
+		memcpy(data, ring_buffer_read_ptr(rbuf, 0), len);
+		return;
+	}
+
+	memcpy(data, ring_buffer_read_ptr(rbuf, 0), wrap);
+	memcpy((guint8 *) data + wrap, ring_buffer_read_ptr(rbuf, wrap),
+			len - wrap);
+}
+
+static void channel_dequeue_frame(GAtMux *mux, GAtMuxChannel *channel,
+					struct mux_frame *frame)
+{
+	GAtMuxChannelStats *stats = &channel->stats;
+	struct mux_sent *sent;
+
+	ring_buffer_drain(channel->queue, sizeof(*frame));
+	ring_buffer_read(channel->queue, mux->out + mux->out_used,
+				frame->len);
+	mux->out_used += frame->len;
+	mux->out_total += frame->len;
+
+	stats->queue_depth -= 1;
+	stats->queue_bytes -= frame->len;
+
+	/* Latency is only known once the device has taken the last byte */
+	sent = &mux->sent[(mux->sent_first + mux->sent_count) % MUX_MAX_SENT];
+	sent->dlc = channel->dlc;
+	sent->len = frame->len;
+	sent->queued = frame->queued;
+	sent->end = mux->out_total;
+	mux->sent_count += 1;
+}
+
+static void account_sent_frames(GAtMux *mux)
+{
+	guint64 flushed = mux->out_total - mux->out_used;
+	GAtMuxChannelStats *stats;
+	GAtMuxChannel *channel;
+	struct mux_sent *sent;
+	gdouble now;
+	guint latency;
+
+	now = g_timer_elapsed(mux->timer, NULL);
+
+	while (mux->sent_count > 0) {
+		sent = &mux->sent[mux->sent_first];
+
+		if (sent->end > flushed)
+			break;
+
+		mux->sent_first = (mux->sent_first + 1) % MUX_MAX_SENT;
+		mux->sent_count -= 1;
+
+		/* The DLC might have been closed in the meantime */
+		channel = mux->dlcs[sent->dlc - 1];
+		if (channel == NULL)
+			continue;
+
+		stats = &channel->stats;
+		latency = (now - sent->queued) * 1e6;
+
+		stats->frames_sent += 1;
+		stats->bytes_sent += sent->len;
+		stats->total_latency += latency;
+
+		if (latency > stats->max_latency)
+			stats->max_latency = latency;
+	}
+}
+
+/*
+ * One deficit round robin pass over the sendable DLCs of the given
+ * priority.  Returns FALSE if the output buffer filled up, in which case
+ * the pass picks up where it left off next time.
+ */
+static gboolean drr_round(GAtMux *mux, guint priority)
+{
+	GAtMuxChannel *channel;
+	struct mux_frame frame;
+	gboolean resume = mux->drr_resume;
+	int n;
+	int i;
+
+	mux->drr_resume = FALSE;
+
+	for (n = 0; n < MAX_CHANNELS; n++) {
+		i = (mux->drr_next + n) % MAX_CHANNELS;
+		channel = mux->dlcs[i];
+
+		if (channel == NULL || channel->priority != priority)
+			continue;
+
+		if (channel->stats.queue_depth == 0 ||
+				!channel_can_send(mux, channel))
+			continue;
+
+		if (n > 0 || resume == FALSE)
+			channel->deficit += channel->quantum;
+
+		while (channel->stats.queue_depth > 0) {
+			ring_buffer_peek(channel->queue, &frame,
+						sizeof(frame));
+
+			if (frame.len > channel->deficit)
+				break;
+
+			if (frame.len > MUX_BUFFER_SIZE - mux->out_used ||
+					mux->sent_count == MUX_MAX_SENT) {
+				mux->drr_next = i;
+				mux->drr_resume = TRUE;
+				return FALSE;
+			}
+
+			channel_dequeue_frame(mux, channel, &frame);
+			channel->deficit -= frame.len;
+		}
+
+		if (channel->stats.queue_depth == 0)
+			channel->deficit = 0;
+	}
+
+	return TRUE;
+}
+
+/* Move queued frames into the output buffer, highest priority first */
+static void schedule_frames(GAtMux *mux)
+{
+	GAtMuxChannel *channel;
+	gboolean found;
+	guint priority;
+	int i;
+
+	do {
+		found = FALSE;
+		priority = 0;
+
+		for (i = 0; i < MAX_CHANNELS; i++) {
+			channel = mux->dlcs[i];
+
+			if (channel == NULL)
+				continue;
+
+			if (channel->stats.queue_depth == 0 ||
+					!channel_can_send(mux, channel))
+				continue;
+
+			if (found == FALSE || channel->priority < priority)
+				priority = channel->priority;
+
+			found = TRUE;
+		}
+	} while (found && drr_round(mux, priority));
+}
+
+static void flush_output(GAtMux *mux)
+{
+	gsize bytes_written = 0;
+
+	if (mux->out_used == 0)
+		return;
+
+	g_io_channel_write_chars(mux->channel, mux->out, mux->out_used,
+					&bytes_written, NULL);
+
+	trace_record(mux->trace, FALSE, mux->out, bytes_written);
+	mux->out_used -= bytes_written;
+
+	if (mux->out_used > 0)
+		memmove(mux->out, mux->out + bytes_written, mux->out_used);
+
+	account_sent_frames(mux);
+}
+
 static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
@@ -249,7 +550,7 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 
 		DBG("Checking channel for write: %p", channel);
 
-		if (channel->throttled)
+		if (channel->throttled || !channel_has_room(channel))
 			continue;
 
 		DBG("Dispatching write sources: %p", channel);
@@ -257,23 +558,27 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 		dispatch_sources(channel, G_IO_OUT);
 	}
 
+	schedule_frames(mux);
+	flush_output(mux);
+
+	if (mux->out_used > 0)
+		return TRUE;
+
 	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
 		GAtMuxChannel *channel = mux->dlcs[dlc];
-		GSList *l;
-		GAtMuxWatch *source;
 
 		if (channel == NULL)
 			continue;
 
-		if (channel->throttled)
+		if (!channel_can_send(mux, channel))
 			continue;
 
-		for (l = channel->sources; l; l = l->next) {
-			source = l->data;
+		if (channel->stats.queue_depth > 0)
+			return TRUE;
 
-			if (source->condition & G_IO_OUT)
-				return TRUE;
-		}
+		if (channel_has_room(channel) &&
+				channel_wants_write(channel))
+			return TRUE;
 	}
 
 	return FALSE;
@@ -295,14 +600,79 @@ static void wakeup_writer(GAtMux *mux)
 
 int g_at_mux_raw_write(GAtMux *mux, const void *data, int towrite)
 {
-	GError *error = NULL;
-	gssize count = towrite;
-	gsize bytes_written;
+	gsize bytes_written = 0;
+	int len;
+
+	/* Never cut into a frame that is only partly written out */
+	if (mux->out_used == 0) {
+		g_io_channel_write_chars(mux->channel, (gchar *) data,
+					towrite, &bytes_written, NULL);
 
-	g_io_channel_write_chars(mux->channel, (gchar *) data,
-					count, &bytes_written, &error);
+		trace_record(mux->trace, FALSE, data, bytes_written);
+		data = (const guint8 *) data + bytes_written;
+		towrite -= bytes_written;
+	}
+
+	if (towrite == 0)
+		return bytes_written;
+
+	len = towrite;
+
+	/* Drop what does not fit rather than corrupt the stream */
+	if (len > MUX_BUFFER_SIZE - mux->out_used) {
+		if (bytes_written == 0)
+			return 0;
+
+		len = MUX_BUFFER_SIZE - mux->out_used;
+	}
+
+	memcpy(mux->out + mux->out_used, data, len);
+	mux->out_used += len;
+	mux->out_total += len;
+
+	wakeup_writer(mux);
+
+	return bytes_written + len;
+}
+
+gboolean g_at_mux_queue_frame(GAtMux *mux, guint8 dlc,
+					const guint8 *data, int len)
+{
+	GAtMuxChannel *channel;
+	GAtMuxChannelStats *stats;
+	struct mux_frame frame;
+
+	if (dlc < 1 || dlc > MAX_CHANNELS)
+		return FALSE;
 
-	return bytes_written;
+	channel = mux->dlcs[dlc-1];
+	if (channel == NULL)
+		return FALSE;
+
+	if (len > MUX_BUFFER_SIZE)
+		return FALSE;
+
+	if ((unsigned int) ring_buffer_avail(channel->queue) <
+			sizeof(frame) + len)
+		return FALSE;
+
+	frame.len = len;
+	frame.queued = g_timer_elapsed(mux->timer, NULL);
+
+	ring_buffer_write(channel->queue, &frame, sizeof(frame));
+	ring_buffer_write(channel->queue, data, len);
+
+	stats = &channel->stats;
+	stats->queue_depth += 1;
+	stats->queue_bytes += len;
+
+	if (stats->queue_bytes > stats->max_queue_bytes)
+		stats->max_queue_bytes = stats->queue_bytes;
+
+	if (channel_can_send(mux, channel))
+		wakeup_writer(mux);
+
+	return TRUE;
 }
 
 void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
@@ -350,23 +720,72 @@ void g_at_mux_set_dlc_status(GAtMux *mux, guint8 dlc, int status)
 		return;
 
 	if (status & G_AT_MUX_DLC_STATUS_RTR) {
-		GSList *l;
-
 		mux->dlcs[dlc-1]->throttled = FALSE;
 		DBG("setting throttled to FALSE");
 
-		for (l = mux->dlcs[dlc-1]->sources; l; l = l->next) {
-			GAtMuxWatch *source = l->data;
-
-			if (source->condition & G_IO_OUT) {
-				wakeup_writer(mux);
-				break;
-			}
-		}
+		if (channel->stats.queue_depth > 0 ||
+				channel_wants_write(channel))
+			wakeup_writer(mux);
 	} else
 		mux->dlcs[dlc-1]->throttled = TRUE;
 }
 
+void g_at_mux_set_flow(GAtMux *mux, guint8 dlc, gboolean on)
+{
+	GAtMuxChannel *channel;
+
+	DBG("Flow %s for channel %hu", on ? "on" : "off", dlc);
+
+	if (dlc > MAX_CHANNELS)
+		return;
+
+	if (dlc == 0) {
+		mux->flow_stopped = !on;
+	} else {
+		channel = mux->dlcs[dlc-1];
+		if (channel == NULL)
+			return;
+
+		channel->flow_stopped = !on;
+	}
+
+	if (on)
+		wakeup_writer(mux);
+}
+
+gboolean g_at_mux_set_channel_priority(GAtMux *mux, GIOChannel *channel,
+					guint priority, guint weight)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+
+	if (mux == NULL || channel == NULL || weight == 0)
+		return FALSE;
+
+	if (channel->funcs != &channel_funcs || mux_channel->mux != mux)
+		return FALSE;
+
+	mux_channel->priority = priority;
+	mux_channel->quantum = MIN(weight, 1024U) * MUX_QUANTUM;
+
+	return TRUE;
+}
+
+gboolean g_at_mux_get_channel_stats(GAtMux *mux, GIOChannel *channel,
+					GAtMuxChannelStats *stats)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+
+	if (mux == NULL || channel == NULL || stats == NULL)
+		return FALSE;
+
+	if (channel->funcs != &channel_funcs || mux_channel->mux != mux)
+		return FALSE;
+
+	*stats = mux_channel->stats;
+
+	return TRUE;
+}
+
 void g_at_mux_set_data(GAtMux *mux, void *data)
 {
 	if (mux == NULL)
@@ -444,10 +863,17 @@ static GIOStatus channel_write(GIOChannel *channel, const gchar *buf,
 {
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
 	GAtMux *mux = mux_channel->mux;
+	int written = count;
 
+	/* What does not fit in the queue is offered again on G_IO_OUT */
 	if (mux->driver->write)
-		mux->driver->write(mux, mux_channel->dlc, buf, count);
-	*bytes_written = count;
+		written = mux->driver->write(mux, mux_channel->dlc,
+						buf, count);
+
+	*bytes_written = written;
+
+	if (written == 0 && count > 0)
+		return G_IO_STATUS_AGAIN;
 
 	return G_IO_STATUS_NORMAL;
 }
@@ -480,6 +906,7 @@ static void channel_free(GIOChannel *channel)
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
 
 	ring_buffer_free(mux_channel->buffer);
+	ring_buffer_free(mux_channel->queue);
 
 	g_free(channel);
 }
@@ -500,7 +927,7 @@ static GSource *channel_create_watch(GIOChannel *channel,
 
 	watch->condition = condition;
 
-	if ((watch->condition & G_IO_OUT) && dlc->throttled == FALSE)
+	if ((watch->condition & G_IO_OUT) && channel_can_send(mux, dlc))
 		wakeup_writer(mux);
 
 	DBG("Creating source: %p for channel: %p, writer: %d, reader: %d",
@@ -552,6 +979,9 @@ GAtMux *g_at_mux_new(GIOChannel *channel, const GAtMuxDriver *driver)
 	mux->driver = driver;
 	mux->shutdown = TRUE;
 
+	mux->timer = g_timer_new();
+	mux->trace = trace_channel_new("mux", TRACE_FORMAT_HEX);
+
 	mux->channel = channel;
 	g_io_channel_ref(channel);
 
@@ -583,6 +1013,9 @@ void g_at_mux_unref(GAtMux *mux)
 		if (mux->driver->remove)
 			mux->driver->remove(mux);
 
+		g_timer_destroy(mux->timer);
+		trace_channel_free(mux->trace);
+
 		g_free(mux);
 	}
 }
@@ -630,6 +1063,11 @@ gboolean g_at_mux_shutdown(GAtMux *mux)
 	if (mux->driver->shutdown)
 		mux->driver->shutdown(mux);
 
+	if (mux->write_watch > 0)
+		g_source_remove(mux->write_watch);
+
+	mux->out_used = 0;
+	mux->sent_count = 0;
 	mux->shutdown = TRUE;
 
 	return TRUE;
@@ -690,7 +1128,10 @@ GIOChannel *g_at_mux_create_channel(GAtMux *mux)
 	mux_channel->mux = mux;
 	mux_channel->dlc = i+1;
 	mux_channel->buffer = ring_buffer_new(MUX_CHANNEL_BUFFER_SIZE);
+	mux_channel->queue = ring_buffer_new_mirrored(
+						MUX_CHANNEL_BUFFER_SIZE * 2);
 	mux_channel->throttled = FALSE;
+	mux_channel->quantum = MUX_QUANTUM;
 
 	mux->dlcs[i] = mux_channel;
 
@@ -905,6 +1346,17 @@ static gboolean gsm0710_packet(GAtMux *mux, int dlc, guint8 control,
 				memcpy(resp, data, len);
 				resp[0] = 0x41;	/* Clear the C/R bit in the response */
 				write_frame(mux, 0, GSM0710_DATA, resp, len);
+			} else if (len >= 2 && (data[0] == GSM0710_FCON ||
+						data[0] == GSM0710_FCOFF)) {
+				/* Flow control for the whole multiplexer */
+				guint8 resp[2];
+
+				g_at_mux_set_flow(mux, 0,
+						data[0] == GSM0710_FCON);
+
+				resp[0] = data[0] & ~0x02;
+				resp[1] = 0x01;
+				write_frame(mux, 0, GSM0710_DATA, resp, 2);
 			}
 		}
 	} else if (control == GSM0710_STATUS_ACK && dlc == 0) {
@@ -915,8 +1367,11 @@ static gboolean gsm0710_packet(GAtMux *mux, int dlc, guint8 control,
 			/* Handle status changes on other channels */
 			dlc = ((data[0] & 0xFC) >> 2);
 
-			if (dlc >= 1 && dlc <= 63)
+			if (dlc >= 1 && dlc <= 63) {
 				g_at_mux_set_dlc_status(mux, dlc, data[1]);
+				g_at_mux_set_flow(mux, dlc,
+					!(data[1] & GSM0710_V24_FC));
+			}
 		}
 
 		/* Send the response to the status change request to ACK it */
@@ -932,11 +1387,11 @@ static gboolean gsm0710_packet(GAtMux *mux, int dlc, guint8 control,
 	return TRUE;
 }
 
+/* Control frames, such as echoed test commands, can be up to the full N1 */
 static void gsm0710_basic_write_frame(GAtMux *mux, guint8 dlc, guint8 control,
 					const guint8 *data, int towrite)
 {
-	struct gsm0710_data *gd = g_at_mux_get_data(mux);
-	guint8 *frame = alloca(gd->frame_size + 7);
+	guint8 *frame = alloca(towrite + 7);
 	int frame_size;
 
 	frame_size = gsm0710_basic_fill_frame(frame, dlc, control,
@@ -1046,22 +1501,28 @@ static void gsm0710_basic_set_status(GAtMux *mux, guint8 dlc, guint8 status)
 	g_at_mux_raw_write(mux, frame, frame_size);
 }
 
-static void gsm0710_basic_write(GAtMux *mux, guint8 dlc,
+static int gsm0710_basic_write(GAtMux *mux, guint8 dlc,
 				const void *data, int towrite)
 {
 	struct gsm0710_data *gd = g_at_mux_get_data(mux);
 	guint8 *frame = alloca(gd->frame_size + 7);
+	int written = 0;
 	int max;
 	int frame_size;
 
-	while (towrite > 0) {
-		max = MIN(towrite, gd->frame_size);
-		frame_size = gsm0710_basic_fill_frame(frame, dlc,
-						GSM0710_DATA, data, max);
-		g_at_mux_raw_write(mux, frame, frame_size);
-		data = data + max;
-		towrite -= max;
+	while (written < towrite) {
+		max = MIN(towrite - written, gd->frame_size);
+		frame_size = gsm0710_basic_fill_frame(frame, dlc, GSM0710_DATA,
+						(const guint8 *) data + written,
+						max);
+
+		if (!g_at_mux_queue_frame(mux, dlc, frame, frame_size))
+			break;
+
+		written += max;
 	}
+
+	return written;
 }
 
 static GAtMuxDriver gsm0710_basic_driver = {
@@ -1086,7 +1547,8 @@ GAtMux *g_at_mux_new_gsm0710_basic(GIOChannel *channel, int frame_size)
 		return NULL;
 
 	gd = g_new0(struct gsm0710_data, 1);
-	gd->frame_size = frame_size;
+	/* DLC data is cut into frames that fit the queues */
+	gd->frame_size = MIN(frame_size, MUX_MAX_FRAME - 7);
 
 	g_at_mux_set_data(mux, gd);
 
@@ -1096,8 +1558,7 @@ GAtMux *g_at_mux_new_gsm0710_basic(GIOChannel *channel, int frame_size)
 static void gsm0710_advanced_write_frame(GAtMux *mux, guint8 dlc, guint8 control,
 					const guint8 *data, int towrite)
 {
-	struct gsm0710_data *gd = g_at_mux_get_data(mux);
-	guint8 *frame = alloca(gd->frame_size * 2 + 7);
+	guint8 *frame = alloca(towrite * 2 + 7);
 	int frame_size;
 
 	frame_size = gsm0710_advanced_fill_frame(frame, dlc, control,
@@ -1201,22 +1662,28 @@ static void gsm0710_advanced_set_status(GAtMux *mux, guint8 dlc, guint8 status)
 	g_at_mux_raw_write(mux, frame, frame_size);
 }
 
-static void gsm0710_advanced_write(GAtMux *mux, guint8 dlc,
+static int gsm0710_advanced_write(GAtMux *mux, guint8 dlc,
 					const void *data, int towrite)
 {
 	struct gsm0710_data *gd = g_at_mux_get_data(mux);
 	guint8 *frame = alloca(gd->frame_size * 2 + 7);
+	int written = 0;
 	int max;
 	int frame_size;
 
-	while (towrite > 0) {
-		max = MIN(towrite, gd->frame_size);
-		frame_size = gsm0710_advanced_fill_frame(frame, dlc,
-						GSM0710_DATA, data, max);
-		g_at_mux_raw_write(mux, frame, frame_size);
-		data = data + max;
-		towrite -= max;
+	while (written < towrite) {
+		max = MIN(towrite - written, gd->frame_size);
+		frame_size = gsm0710_advanced_fill_frame(frame, dlc, GSM0710_DATA,
+						(const guint8 *) data + written,
+						max);
+
+		if (!g_at_mux_queue_frame(mux, dlc, frame, frame_size))
+			break;
+
+		written += max;
 	}
+
+	return written;
 }
 
 static GAtMuxDriver gsm0710_advanced_driver = {
@@ -1241,7 +1708,8 @@ GAtMux *g_at_mux_new_gsm0710_advanced(GIOChannel *channel, int frame_size)
 		return NULL;
 
 	gd = g_new0(struct gsm0710_data, 1);
-	gd->frame_size = frame_size;
+	/* DLC data is cut into frames that fit the queues */
+	gd->frame_size = MIN(frame_size, (MUX_MAX_FRAME - 7) / 2);
 
 	g_at_mux_set_data(mux, gd);
 
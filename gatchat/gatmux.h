@@ -33,6 +33,7 @@ struct _GAtMux;
 
 typedef struct _GAtMux GAtMux;
 typedef struct _GAtMuxDriver GAtMuxDriver;
+typedef struct _GAtMuxChannelStats GAtMuxChannelStats;
 typedef enum _GAtMuxChannelStatus GAtMuxChannelStatus;
 typedef void (*GAtMuxSetupFunc)(GAtMux *mux, gpointer user_data);
 
@@ -43,6 +44,17 @@ enum _GAtMuxDlcStatus {
 	G_AT_MUX_DLC_STATUS_DV = 0x80,
 };
 
+/* Latencies are in microseconds, from queueing until written out */
+struct _GAtMuxChannelStats {
+	guint queue_depth;		/* Frames waiting in the queue */
+	guint queue_bytes;		/* Bytes waiting in the queue */
+	guint max_queue_bytes;		/* High water mark of queue_bytes */
+	guint64 frames_sent;
+	guint64 bytes_sent;
+	guint64 total_latency;
+	guint max_latency;
+};
+
 struct _GAtMuxDriver {
 	void (*remove)(GAtMux *mux);
 	gboolean (*startup)(GAtMux *mux);
@@ -50,7 +62,7 @@ struct _GAtMuxDriver {
 	gboolean (*open_dlc)(GAtMux *mux, guint8 dlc);
 	gboolean (*close_dlc)(GAtMux *mux, guint8 dlc);
 	void (*set_status)(GAtMux *mux, guint8 dlc, guint8 status);
-	void (*write)(GAtMux *mux, guint8 dlc, const void *data, int towrite);
+	int (*write)(GAtMux *mux, guint8 dlc, const void *data, int towrite);
 	int (*feed_data)(GAtMux *mux, void *data, int len);
 };
 
@@ -71,6 +83,17 @@ gboolean g_at_mux_set_debug(GAtMux *mux, GAtDebugFunc func, gpointer user_data);
 
 GIOChannel *g_at_mux_create_channel(GAtMux *mux);
 
+/*!
+ * Frames queued on channels of a lower priority value are always written
+ * out first.  Channels of equal priority share the link in proportion to
+ * their weight.  By default all channels have priority 0 and weight 1.
+ */
+gboolean g_at_mux_set_channel_priority(GAtMux *mux, GIOChannel *channel,
+					guint priority, guint weight);
+
+gboolean g_at_mux_get_channel_stats(GAtMux *mux, GIOChannel *channel,
+					GAtMuxChannelStats *stats);
+
 /*!
  * Multiplexer driver integration functions
  */
@@ -78,8 +101,17 @@ void g_at_mux_set_dlc_status(GAtMux *mux, guint8 dlc, int status);
 void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
 				const void *data, int tofeed);
 
+void g_at_mux_set_flow(GAtMux *mux, guint8 dlc, gboolean on);
+
 int g_at_mux_raw_write(GAtMux *mux, const void *data, int towrite);
 
+/*!
+ * Queues an encoded frame on the dlc for the write scheduler.  Returns
+ * FALSE if the dlc's queue has no room for it.
+ */
+gboolean g_at_mux_queue_frame(GAtMux *mux, guint8 dlc,
+					const guint8 *data, int len);
+
 void g_at_mux_set_data(GAtMux *mux, void *data);
 void *g_at_mux_get_data(GAtMux *mux);
 
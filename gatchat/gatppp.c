@@ -42,6 +42,7 @@
 
 #define DEFAULT_MRU	1500
 #define DEFAULT_MTU	1500
+#define DEFAULT_XMIT_BUDGET	(16 * 1024)
 
 #define PPP_ADDR_FIELD	0xff
 #define PPP_CTRL	0x03
@@ -74,6 +75,18 @@ struct _GAtPPP {
 	GAtPPPDisconnectReason disconnect_reason;
 	GAtDebugFunc debugf;
 	gpointer debug_data;
+	GQueue *xmit_queue;
+	guint xmit_budget;
+	GAtPPPXmitStats xmit_stats;
+	gboolean xmit_pfc;		/* Peer takes one byte protocols */
+	gboolean xmit_acfc;		/* Peer takes no address, control */
+	struct ppp_vj *vj;
+};
+
+struct ppp_xmit_frame {
+	gboolean default_accm;
+	guint len;
+	guint8 data[0];
 };
 
 void ppp_debug(GAtPPP *ppp, const char *str)
@@ -131,15 +144,49 @@ static inline gboolean ppp_drop_packet(GAtPPP *ppp, guint16 protocol)
 static void ppp_receive(const unsigned char *buf, gsize len, void *data)
 {
 	GAtPPP *ppp = data;
-	guint16 protocol = ppp_proto(buf);
-	const guint8 *packet = ppp_info(buf);
+	const guint8 *packet = buf;
+	gsize infolen = len;
+	guint16 protocol;
+
+	/*
+	 * Address and control may be left out and the protocol shortened
+	 * to one byte once negotiated, but full headers are always valid
+	 */
+	if (infolen >= 2 && packet[0] == PPP_ADDR_FIELD &&
+			packet[1] == PPP_CTRL) {
+		packet += 2;
+		infolen -= 2;
+	}
+
+	if (infolen >= 1 && (packet[0] & 0x01)) {
+		protocol = packet[0];
+		packet += 1;
+		infolen -= 1;
+	} else if (infolen >= 2) {
+		protocol = get_host_short(packet);
+		packet += 2;
+		infolen -= 2;
+	} else
+		return;
+
+	/* Code, identifier and length, then as much data as length claims */
+	if ((protocol == LCP_PROTOCOL || protocol == IPCP_PROTO ||
+			protocol == CHAP_PROTOCOL) &&
+			(infolen < 4 || get_host_short(packet + 2) > infolen))
+		return;
 
 	if (ppp_drop_packet(ppp, protocol))
 		return;
 
 	switch (protocol) {
 	case PPP_IP_PROTO:
-		ppp_net_process_packet(ppp->net, packet);
+		ppp_net_process_packet(ppp->net, packet, infolen);
+		break;
+	case PPP_VJ_COMP_PROTO:
+	case PPP_VJ_UNCOMP_PROTO:
+		packet = ppp_vj_uncompress(ppp->vj, protocol, packet, &infolen);
+		if (packet != NULL)
+			ppp_net_process_packet(ppp->net, packet, infolen);
 		break;
 	case LCP_PROTOCOL:
 		pppcp_process_packet(ppp->lcp, packet);
@@ -159,18 +206,127 @@ static void ppp_receive(const unsigned char *buf, gsize len, void *data)
 	};
 }
 
+static gboolean ppp_send_frame(GAtPPP *ppp, const guint8 *frame, guint len,
+					gboolean default_accm)
+{
+	guint32 xmit_accm = 0;
+	gboolean sent;
+
+	if (default_accm) {
+		xmit_accm = g_at_hdlc_get_xmit_accm(ppp->hdlc);
+		g_at_hdlc_set_xmit_accm(ppp->hdlc, ~0U);
+	}
+
+	sent = g_at_hdlc_send(ppp->hdlc, frame, len);
+
+	if (default_accm)
+		g_at_hdlc_set_xmit_accm(ppp->hdlc, xmit_accm);
+
+	return sent;
+}
+
+/* Called by GAtHDLC as the modem drains the write buffer */
+static void ppp_xmit_flush(gpointer user_data)
+{
+	GAtPPP *ppp = user_data;
+	struct ppp_xmit_frame *frame;
+
+	while ((frame = g_queue_peek_head(ppp->xmit_queue)) != NULL) {
+		if (!g_at_hdlc_can_send(ppp->hdlc, frame->len))
+			break;
+
+		if (!ppp_send_frame(ppp, frame->data, frame->len,
+					frame->default_accm))
+			break;
+
+		g_queue_pop_head(ppp->xmit_queue);
+		ppp->xmit_stats.queue_bytes -= frame->len;
+		g_free(frame);
+	}
+
+	/* Resume reading from the interface once half the budget is free */
+	if (ppp->net && ppp->xmit_stats.queue_bytes <= ppp->xmit_budget / 2)
+		ppp_net_resume(ppp->net);
+}
+
+static void ppp_xmit_clear(GAtPPP *ppp)
+{
+	struct ppp_xmit_frame *frame;
+
+	while ((frame = g_queue_pop_head(ppp->xmit_queue)) != NULL)
+		g_free(frame);
+
+	ppp->xmit_stats.queue_bytes = 0;
+}
+
+/*
+ * Puts the PPP header in front of info, compressed as far as the peer
+ * allows.  LCP packets always go out with full headers.
+ */
+static guint8 *ppp_put_header(GAtPPP *ppp, guint8 *info, guint16 proto)
+{
+	gboolean lcp = (proto == LCP_PROTOCOL);
+
+	if (!lcp && ppp->xmit_pfc && proto < 0x100) {
+		*--info = proto;
+	} else {
+		info -= 2;
+		put_network_short(info, proto);
+	}
+
+	if (lcp || !ppp->xmit_acfc) {
+		*--info = PPP_CTRL;
+		*--info = PPP_ADDR_FIELD;
+	}
+
+	return info;
+}
+
+static gboolean ppp_xmit_enqueue(GAtPPP *ppp, const guint8 *data, gsize len,
+					gboolean default_accm)
+{
+	struct ppp_xmit_frame *frame;
+
+	frame = g_try_malloc(sizeof(*frame) + len);
+	if (frame == NULL) {
+		ppp->xmit_stats.dropped += 1;
+		return FALSE;
+	}
+
+	frame->default_accm = default_accm;
+	frame->len = len;
+	memcpy(frame->data, data, len);
+
+	g_queue_push_tail(ppp->xmit_queue, frame);
+
+	ppp->xmit_stats.queued += 1;
+	ppp->xmit_stats.queue_bytes += len;
+
+	if (ppp->xmit_stats.queue_bytes > ppp->xmit_stats.max_queue_bytes)
+		ppp->xmit_stats.max_queue_bytes = ppp->xmit_stats.queue_bytes;
+
+	return TRUE;
+}
+
 /*
  * transmit out through the lower layer interface
  *
  * infolen - length of the information part of the packet
+ *
+ * Frames that do not fit into the HDLC write buffer are queued behind
+ * each other.  IP packets are dropped once the queue would exceed
+ * xmit_budget, control packets are always queued.
  */
-void ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen)
+gboolean ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen)
 {
-	struct ppp_header *header = (struct ppp_header *) packet;
+	struct ppp_header header = *(struct ppp_header *) packet;
 	guint16 proto = ppp_proto(packet);
+	guint8 *info = ppp_info(packet);
+	guint8 *frame;
+	gsize len = infolen;
+	gboolean ret;
 	guint8 code;
 	gboolean lcp = (proto == LCP_PROTOCOL);
-	guint32 xmit_accm = 0;
 
 	/*
 	 * all LCP Link Configuration, Link Termination, and Code-Reject
@@ -181,20 +337,40 @@ void ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen)
 		lcp = code > 0 && code < 8;
 	}
 
-	if (lcp) {
-		xmit_accm = g_at_hdlc_get_xmit_accm(ppp->hdlc);
-		g_at_hdlc_set_xmit_accm(ppp->hdlc, ~0U);
+	/* Drop before compressing, the peer could not tell it is missing */
+	if (proto == PPP_IP_PROTO && !g_queue_is_empty(ppp->xmit_queue) &&
+			ppp->xmit_stats.queue_bytes + infolen +
+				sizeof(struct ppp_header) > ppp->xmit_budget) {
+		ppp->xmit_stats.dropped += 1;
+		return FALSE;
 	}
 
-	header->address = PPP_ADDR_FIELD;
-	header->control = PPP_CTRL;
+	if (proto == PPP_IP_PROTO)
+		proto = ppp_vj_compress(ppp->vj, &info, &len);
 
-	if (g_at_hdlc_send(ppp->hdlc, packet,
-			infolen + sizeof(*header)) == FALSE)
-		g_print("Failed to send a frame\n");
+	frame = ppp_put_header(ppp, info, proto);
+	len += info - frame;
 
-	if (lcp)
-		g_at_hdlc_set_xmit_accm(ppp->hdlc, xmit_accm);
+	if (g_queue_is_empty(ppp->xmit_queue) &&
+			ppp_send_frame(ppp, frame, len, lcp))
+		ret = TRUE;
+	else
+		ret = ppp_xmit_enqueue(ppp, frame, len, lcp);
+
+	/* Callers reuse their packet, give them back the full header */
+	*(struct ppp_header *) packet = header;
+
+	return ret;
+}
+
+/* TRUE if an IP packet of infolen bytes would not be dropped */
+gboolean ppp_can_transmit(GAtPPP *ppp, guint infolen)
+{
+	if (g_queue_is_empty(ppp->xmit_queue))
+		return TRUE;
+
+	return ppp->xmit_stats.queue_bytes + infolen +
+			sizeof(struct ppp_header) <= ppp->xmit_budget;
 }
 
 static void ppp_dead(GAtPPP *ppp)
@@ -327,6 +503,27 @@ void ppp_set_xmit_accm(GAtPPP *ppp, guint32 accm)
 	g_at_hdlc_set_xmit_accm(ppp->hdlc, accm);
 }
 
+void ppp_set_xmit_pfc(GAtPPP *ppp, gboolean pfc)
+{
+	ppp->xmit_pfc = pfc;
+}
+
+void ppp_set_xmit_acfc(GAtPPP *ppp, gboolean acfc)
+{
+	ppp->xmit_acfc = acfc;
+}
+
+void ppp_set_xmit_vj(GAtPPP *ppp, int max_slot, gboolean comp_slot)
+{
+	/* Without memory for the slots, packets simply go uncompressed */
+	ppp_vj_set_xmit(ppp->vj, max_slot, comp_slot);
+}
+
+void ppp_set_recv_vj(GAtPPP *ppp, int max_slot)
+{
+	ppp_vj_set_recv(ppp->vj, max_slot);
+}
+
 /*
  * The only time we use other than default MTU is when we are in
  * the network phase.
@@ -456,6 +653,7 @@ void g_at_ppp_unref(GAtPPP *ppp)
 
 	g_at_io_set_disconnect_function(g_at_hdlc_get_io(ppp->hdlc),
 						NULL, NULL);
+	g_at_hdlc_set_writable(ppp->hdlc, NULL, NULL);
 
 	if (ppp->net)
 		ppp_net_free(ppp->net);
@@ -468,6 +666,10 @@ void g_at_ppp_unref(GAtPPP *ppp)
 
 	g_at_hdlc_unref(ppp->hdlc);
 
+	ppp_xmit_clear(ppp);
+	g_queue_free(ppp->xmit_queue);
+	ppp_vj_free(ppp->vj);
+
 	g_free(ppp);
 }
 
@@ -485,6 +687,24 @@ void g_at_ppp_set_server_info(GAtPPP *ppp, const char *remote,
 	ipcp_set_server_info(ppp->ipcp, r, d1, d2);
 }
 
+void g_at_ppp_set_xmit_budget(GAtPPP *ppp, guint bytes)
+{
+	if (ppp == NULL)
+		return;
+
+	ppp->xmit_budget = bytes;
+}
+
+gboolean g_at_ppp_get_xmit_stats(GAtPPP *ppp, GAtPPPXmitStats *stats)
+{
+	if (ppp == NULL || stats == NULL)
+		return FALSE;
+
+	*stats = ppp->xmit_stats;
+
+	return TRUE;
+}
+
 static GAtPPP *ppp_init_common(GAtHDLC *hdlc, gboolean is_server, guint32 ip)
 {
 	GAtPPP *ppp;
@@ -493,6 +713,12 @@ static GAtPPP *ppp_init_common(GAtHDLC *hdlc, gboolean is_server, guint32 ip)
 	if (!ppp)
 		return NULL;
 
+	ppp->vj = ppp_vj_new();
+	if (!ppp->vj) {
+		g_free(ppp);
+		return NULL;
+	}
+
 	ppp->hdlc = g_at_hdlc_ref(hdlc);
 
 	ppp->ref_count = 1;
@@ -500,6 +726,9 @@ static GAtPPP *ppp_init_common(GAtHDLC *hdlc, gboolean is_server, guint32 ip)
 	/* set options to defaults */
 	ppp->mru = DEFAULT_MRU;
 	ppp->mtu = DEFAULT_MTU;
+	ppp->xmit_budget = DEFAULT_XMIT_BUDGET;
+
+	ppp->xmit_queue = g_queue_new();
 
 	/* initialize the lcp state */
 	ppp->lcp = lcp_new(ppp, is_server);
@@ -508,6 +737,7 @@ static GAtPPP *ppp_init_common(GAtHDLC *hdlc, gboolean is_server, guint32 ip)
 	ppp->ipcp = ipcp_new(ppp, is_server, ip);
 
 	g_at_hdlc_set_receive(ppp->hdlc, ppp_receive, ppp);
+	g_at_hdlc_set_writable(ppp->hdlc, ppp_xmit_flush, ppp);
 	g_at_io_set_disconnect_function(g_at_hdlc_get_io(ppp->hdlc),
 						io_disconnect, ppp);
 
@@ -32,6 +32,7 @@ extern "C" {
 struct _GAtPPP;
 
 typedef struct _GAtPPP GAtPPP;
+typedef struct _GAtPPPXmitStats GAtPPPXmitStats;
 
 typedef enum _GAtPPPDisconnectReason {
 	G_AT_PPP_REASON_UNKNOWN,
@@ -43,6 +44,14 @@ typedef enum _GAtPPPDisconnectReason {
 	G_AT_PPP_REASON_LOCAL_CLOSE,	/* Normal user close */
 } GAtPPPDisconnectReason;
 
+/* Frames waiting for room in the HDLC write buffer */
+struct _GAtPPPXmitStats {
+	guint queue_bytes;		/* Bytes waiting in the queue */
+	guint max_queue_bytes;		/* High water mark of queue_bytes */
+	guint queued;			/* Frames that had to wait */
+	guint dropped;			/* Frames over the byte budget */
+};
+
 typedef void (*GAtPPPConnectFunc)(const char *iface, const char *local,
 					const char *peer,
 					const char *dns1, const char *dns2,
@@ -75,6 +84,14 @@ void g_at_ppp_set_recording(GAtPPP *ppp, const char *filename);
 void g_at_ppp_set_server_info(GAtPPP *ppp, const char *remote_ip,
 				const char *dns1, const char *dns2);
 
+/*
+ * Bounds the bytes of IP traffic queued while the modem is slower than
+ * the network interface.  Reading from the interface is paused instead
+ * of going over it.  Control packets are never dropped.
+ */
+void g_at_ppp_set_xmit_budget(GAtPPP *ppp, guint bytes);
+gboolean g_at_ppp_get_xmit_stats(GAtPPP *ppp, GAtPPPXmitStats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,11 +24,11 @@
 #endif
 
 #include <string.h>
-#include <stdio.h>
 
 #include <glib.h>
 
 #include "gatresult.h"
+#include "hexcodec.h"
 
 void g_at_result_iter_init(GAtResultIter *iter, GAtResult *result)
 {
@@ -225,24 +225,21 @@ gboolean g_at_result_iter_next_hexstring(GAtResultIter *iter,
 	if (line[pos] == ',') {
 		end = pos;
 		iter->buf[pos] = '\0';
+		*length = 0;
 		goto out;
 	}
 
 	if (line[pos] == '"')
 		pos += 1;
 
-	end = pos;
-
-	while (end < len && g_ascii_isxdigit(line[end]))
-		end += 1;
+	end = pos + hex_span(line + pos, len - pos);
 
 	if ((end - pos) & 1)
 		return FALSE;
 
 	*length = (end - pos) / 2;
 
-	for (; pos < end; pos += 2)
-		sscanf(line + pos, "%02hhx", bufpos++);
+	hex_decode(line + pos, end - pos, (guint8 *) bufpos);
 
 	if (line[end] == '"')
 		end += 1;
@@ -251,7 +248,7 @@ out:
 	iter->line_pos = skip_to_next_field(line, end, len);
 
 	if (str)
-		*str = (guint8 *) bufpos - *length;
+		*str = (guint8 *) bufpos;
 
 	return TRUE;
 }
@@ -481,6 +478,30 @@ const char *g_at_result_pdu(GAtResult *result)
 	return result->final_or_pdu;
 }
 
+gboolean g_at_result_pdu_decode(GAtResult *result, guint8 *buf, gint size,
+					gint *length)
+{
+	const char *pdu;
+	gsize len;
+
+	if (!result || !result->final_or_pdu)
+		return FALSE;
+
+	pdu = result->final_or_pdu;
+	len = strlen(pdu);
+
+	if ((len & 1) || len / 2 > (gsize) size)
+		return FALSE;
+
+	if (hex_decode(pdu, len, buf) == FALSE)
+		return FALSE;
+
+	if (length)
+		*length = len / 2;
+
+	return TRUE;
+}
+
 gint g_at_result_num_response_lines(GAtResult *result)
 {
 	if (!result)
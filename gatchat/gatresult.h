@@ -65,6 +65,8 @@ const char *g_at_result_iter_raw_line(GAtResultIter *iter);
 
 const char *g_at_result_final_response(GAtResult *result);
 const char *g_at_result_pdu(GAtResult *result);
+gboolean g_at_result_pdu_decode(GAtResult *result, guint8 *buf, gint size,
+					gint *length);
 
 gint g_at_result_num_response_lines(GAtResult *result);
 
@@ -30,11 +30,15 @@
 
 #include "gatutil.h"
 
+/* Debug lines up to this size are escaped on the stack */
+#define DEBUG_BUFFER_SIZE 512
+
 void g_at_util_debug_chat(gboolean in, const char *str, gsize len,
 				GAtDebugFunc debugf, gpointer user_data)
 {
 	char type = in ? '<' : '>';
 	gsize escaped = 2; /* Enough for '<', ' ' */
+	char stack_str[DEBUG_BUFFER_SIZE];
 	char *escaped_str;
 	const char *esc = "<ESC>";
 	gsize esc_size = strlen(esc);
@@ -60,7 +64,11 @@ void g_at_util_debug_chat(gboolean in, const char *str, gsize len,
 			escaped += 4;
 	}
 
-	escaped_str = g_try_malloc(escaped + 1);
+	if (escaped < sizeof(stack_str))
+		escaped_str = stack_str;
+	else
+		escaped_str = g_try_malloc(escaped + 1);
+
 	if (escaped_str == NULL)
 		return;
 
@@ -106,30 +114,47 @@ void g_at_util_debug_chat(gboolean in, const char *str, gsize len,
 	}
 
 	debugf(escaped_str, user_data);
-	g_free(escaped_str);
+
+	if (escaped_str != stack_str)
+		g_free(escaped_str);
 }
 
 void g_at_util_debug_dump(gboolean in, const unsigned char *buf, gsize len,
 				GAtDebugFunc debugf, gpointer user_data)
 {
-	char type = in ? '<' : '>';
-	GString *str;
+	static const char digits[] = "0123456789abcdef";
+	char stack_str[DEBUG_BUFFER_SIZE];
+	char *str;
+	char *p;
 	gsize i;
 
 	if (!debugf || !len)
 		return;
 
-	str = g_string_sized_new(1 + (len * 2));
-	if (!str)
+	/* Type, then a space and two digits per byte */
+	if (1 + len * 3 < sizeof(stack_str))
+		str = stack_str;
+	else
+		str = g_try_malloc(1 + len * 3 + 1);
+
+	if (str == NULL)
 		return;
 
-	g_string_append_c(str, type);
+	p = str;
+	*p++ = in ? '<' : '>';
+
+	for (i = 0; i < len; i++) {
+		*p++ = ' ';
+		*p++ = digits[buf[i] >> 4];
+		*p++ = digits[buf[i] & 0xf];
+	}
+
+	*p = '\0';
 
-	for (i = 0; i < len; i++)
-		g_string_append_printf(str, " %02x", buf[i]);
+	debugf(str, user_data);
 
-	debugf(str->str, user_data);
-	g_string_free(str, TRUE);
+	if (str != stack_str)
+		g_free(str);
 }
 
 gboolean g_at_util_setup_io(GIOChannel *io, GIOFlags flags)
@@ -81,10 +81,23 @@ static inline guint8 gsm0710_fcs(const guint8 *data, int len)
 	return 0xff - gsm0710_crc(data, len);
 }
 
+/*
+ * Checked once per received frame, over a header that is always 2 to 4
+ * bytes long, so spell the table walk out rather than loop over it.
+ */
 static inline gboolean gsm0710_check_fcs(const guint8 *data, int len,
 						guint8 cfcs)
 {
-	guint8 fcs = gsm0710_crc(data, len);
+	guint8 fcs;
+
+	fcs = crc_table[0xFF ^ data[0]];
+	fcs = crc_table[fcs ^ data[1]];
+
+	if (len > 2)
+		fcs = crc_table[fcs ^ data[2]];
+
+	if (len > 3)
+		fcs = crc_table[fcs ^ data[3]];
 
 	fcs = crc_table[fcs ^ cfcs];
 
@@ -101,12 +114,16 @@ int gsm0710_advanced_extract_frame(guint8 *buf, int len,
 	int posn = 0;
 	int posn2;
 	int framelen;
+	int run;
+	guint8 *flag;
+	guint8 *escape;
 	guint8 dlc;
 	guint8 control;
 
 	while (posn < len) {
 		if (buf[posn] != 0x7E) {
-			posn += 1;
+			flag = memchr(buf + posn, 0x7E, len - posn);
+			posn = flag ? flag - buf : len;
 			continue;
 		}
 
@@ -115,32 +132,37 @@ int gsm0710_advanced_extract_frame(guint8 *buf, int len,
 			posn += 1;
 
 		/* Search for the end of the packet (the next 0x7E byte) */
-		framelen = posn + 1;
-		while (framelen < len && buf[framelen] != 0x7E)
-			framelen += 1;
-
-		if (framelen >= len)
+		flag = memchr(buf + posn + 1, 0x7E, len - posn - 1);
+		if (flag == NULL)
 			break;
 
+		framelen = flag - buf;
+
 		if (framelen < 4) {
 			posn = framelen;
 			continue;
 		}
 
-		/* Undo control byte quoting in the packet */
+		/* Undo control byte quoting in the packet, a run at a time */
 		posn2 = 0;
 		++posn;
 		while (posn < framelen) {
-			if (buf[posn] == 0x7D) {
-				++posn;
+			escape = memchr(buf + posn, 0x7D, framelen - posn);
+			run = (escape ? escape - buf : framelen) - posn;
+
+			memmove(buf + posn2, buf + posn, run);
+			posn2 += run;
+			posn += run;
+
+			if (posn == framelen)
+				break;
 
-				if (posn >= framelen)
-					break;
+			++posn;
+
+			if (posn >= framelen)
+				break;
 
-				buf[posn2++] = buf[posn++] ^ 0x20;
-			} else {
-				buf[posn2++] = buf[posn++];
-			}
+			buf[posn2++] = buf[posn++] ^ 0x20;
 		}
 
 		/* Validate the checksum on the packet header */
@@ -225,13 +247,15 @@ int gsm0710_basic_extract_frame(guint8 *buf, int len,
 	int posn = 0;
 	int framelen;
 	int header_size;
+	guint8 *flag;
 	guint8 fcs;
 	guint8 dlc;
 	guint8 type;
 
 	while (posn < len) {
 		if (buf[posn] != 0xF9) {
-			posn += 1;
+			flag = memchr(buf + posn, 0xF9, len - posn);
+			posn = flag ? flag - buf : len;
 			continue;
 		}
 
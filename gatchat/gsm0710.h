@@ -34,6 +34,11 @@ extern "C" {
 #define GSM0710_DATA_ALT		0x03
 #define GSM0710_STATUS_SET		0xE3
 #define GSM0710_STATUS_ACK		0xE1
+#define GSM0710_FCON			0xA3
+#define GSM0710_FCOFF			0x63
+
+/* V.24 signals in a modem status command */
+#define GSM0710_V24_FC			0x02
 
 int gsm0710_basic_extract_frame(guint8 *data, int len,
 					guint8 *out_dlc, guint8 *out_type,
@@ -25,10 +25,13 @@
 #define CHAP_PROTOCOL	0xc223
 #define IPCP_PROTO	0x8021
 #define PPP_IP_PROTO	0x0021
+#define PPP_VJ_COMP_PROTO	0x002d
+#define PPP_VJ_UNCOMP_PROTO	0x002f
 #define MD5		5
 
 struct ppp_chap;
 struct ppp_net;
+struct ppp_vj;
 
 struct ppp_header {
 	guint8 address;
@@ -97,13 +100,25 @@ void ppp_chap_process_packet(struct ppp_chap *chap, const guint8 *new_packet);
 /* TUN / Network related functions */
 struct ppp_net *ppp_net_new(GAtPPP *ppp);
 const char *ppp_net_get_interface(struct ppp_net *net);
-void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet);
+void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
+				gsize len);
 void ppp_net_free(struct ppp_net *net);
 gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu);
+void ppp_net_resume(struct ppp_net *net);
+
+/* Van Jacobson TCP/IP header compression, max_slot < 0 turns it off */
+struct ppp_vj *ppp_vj_new(void);
+void ppp_vj_free(struct ppp_vj *vj);
+gboolean ppp_vj_set_xmit(struct ppp_vj *vj, int max_slot, gboolean comp_slot);
+gboolean ppp_vj_set_recv(struct ppp_vj *vj, int max_slot);
+guint16 ppp_vj_compress(struct ppp_vj *vj, guint8 **packet, gsize *len);
+const guint8 *ppp_vj_uncompress(struct ppp_vj *vj, guint16 proto,
+					const guint8 *data, gsize *len);
 
 /* PPP functions related to main GAtPPP object */
 void ppp_debug(GAtPPP *ppp, const char *str);
-void ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen);
+gboolean ppp_transmit(GAtPPP *ppp, guint8 *packet, guint infolen);
+gboolean ppp_can_transmit(GAtPPP *ppp, guint infolen);
 void ppp_set_auth(GAtPPP *ppp, const guint8 *auth_data);
 void ppp_auth_notify(GAtPPP *ppp, gboolean success);
 void ppp_ipcp_up_notify(GAtPPP *ppp, const char *local, const char *peer,
@@ -116,4 +131,8 @@ void ppp_lcp_finished_notify(GAtPPP *ppp);
 void ppp_set_recv_accm(GAtPPP *ppp, guint32 accm);
 void ppp_set_xmit_accm(GAtPPP *ppp, guint32 accm);
 void ppp_set_mtu(GAtPPP *ppp, const guint8 *data);
+void ppp_set_xmit_pfc(GAtPPP *ppp, gboolean pfc);
+void ppp_set_xmit_acfc(GAtPPP *ppp, gboolean acfc);
+void ppp_set_xmit_vj(GAtPPP *ppp, int max_slot, gboolean comp_slot);
+void ppp_set_recv_vj(GAtPPP *ppp, int max_slot);
 struct ppp_header *ppp_packet_new(gsize infolen, guint16 protocol);
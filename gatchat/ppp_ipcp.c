@@ -54,14 +54,18 @@ enum ipcp_option_types {
 	SECONDARY_NBNS_SERVER	= 132,
 };
 
-/* We request IP_ADDRESS, PRIMARY/SECONDARY DNS & NBNS */
-#define MAX_CONFIG_OPTION_SIZE 5*6
+/* We request IP_ADDRESS, PRIMARY/SECONDARY DNS & NBNS and VJ */
+#define MAX_CONFIG_OPTION_SIZE 6*6
 
 #define REQ_OPTION_IPADDR	0x01
 #define REQ_OPTION_DNS1		0x02
 #define REQ_OPTION_DNS2		0x04
 #define REQ_OPTION_NBNS1	0x08
 #define REQ_OPTION_NBNS2	0x10
+#define REQ_OPTION_VJ		0x20
+
+/* Slots we keep for the peer compressing towards us, RFC 1332 */
+#define VJ_MAX_SLOT_ID		15
 
 #define MAX_IPCP_FAILURE	100
 
@@ -75,6 +79,8 @@ struct ipcp_data {
 	guint32 dns2;
 	guint32 nbns1;
 	guint32 nbns2;
+	guint8 vj_max_slot;
+	guint8 vj_comp_slot;
 	gboolean is_server;
 };
 
@@ -102,14 +108,32 @@ static void ipcp_generate_config_options(struct ipcp_data *ipcp)
 	FILL_IP(ipcp->options, ipcp->req_options & REQ_OPTION_NBNS2,
 					SECONDARY_NBNS_SERVER, &ipcp->nbns2);
 
+	if (ipcp->req_options & REQ_OPTION_VJ) {
+		ipcp->options[len] = IP_COMPRESSION_PROTO;
+		ipcp->options[len + 1] = 6;
+		put_network_short(ipcp->options + len + 2, PPP_VJ_COMP_PROTO);
+		ipcp->options[len + 4] = ipcp->vj_max_slot;
+		ipcp->options[len + 5] = ipcp->vj_comp_slot;
+
+		len += 6;
+	}
+
 	ipcp->options_len = len;
 }
 
+static void ipcp_reset_vj(struct ipcp_data *ipcp)
+{
+	ipcp->req_options |= REQ_OPTION_VJ;
+	ipcp->vj_max_slot = VJ_MAX_SLOT_ID;
+	ipcp->vj_comp_slot = 1;
+}
+
 static void ipcp_reset_client_config_options(struct ipcp_data *ipcp)
 {
 	ipcp->req_options = REQ_OPTION_IPADDR | REQ_OPTION_DNS1 |
 				REQ_OPTION_DNS2 | REQ_OPTION_NBNS1 |
 				REQ_OPTION_NBNS2;
+	ipcp_reset_vj(ipcp);
 
 	ipcp->local_addr = 0;
 	ipcp->peer_addr = 0;
@@ -128,6 +152,8 @@ static void ipcp_reset_server_config_options(struct ipcp_data *ipcp)
 	else
 		ipcp->req_options = 0;
 
+	ipcp_reset_vj(ipcp);
+
 	ipcp_generate_config_options(ipcp);
 }
 
@@ -175,6 +201,10 @@ static void ipcp_up(struct pppcp_data *pppcp)
 static void ipcp_down(struct pppcp_data *pppcp)
 {
 	struct ipcp_data *ipcp = pppcp_get_data(pppcp);
+	GAtPPP *ppp = pppcp_get_ppp(pppcp);
+
+	ppp_set_xmit_vj(ppp, -1, FALSE);
+	ppp_set_recv_vj(ppp, -1);
 
 	if (ipcp->is_server)
 		ipcp_reset_server_config_options(ipcp);
@@ -196,6 +226,10 @@ static void ipcp_rca(struct pppcp_data *pppcp,
 	struct ipcp_data *ipcp = pppcp_get_data(pppcp);
 	struct ppp_option_iter iter;
 
+	/* The peer agreed to compress what it sends us */
+	if (ipcp->req_options & REQ_OPTION_VJ)
+		ppp_set_recv_vj(pppcp_get_ppp(pppcp), ipcp->vj_max_slot);
+
 	if (ipcp->is_server)
 		return;
 
@@ -232,8 +266,30 @@ static void ipcp_rcn_nak(struct pppcp_data *pppcp,
 	struct ipcp_data *ipcp = pppcp_get_data(pppcp);
 	struct ppp_option_iter iter;
 
-	if (ipcp->is_server)
+	ppp_option_iter_init(&iter, packet);
+
+	while (ppp_option_iter_next(&iter) == TRUE) {
+		const guint8 *data = ppp_option_iter_get_data(&iter);
+
+		if (ppp_option_iter_get_type(&iter) != IP_COMPRESSION_PROTO)
+			continue;
+
+		/* Take fewer slots, but only ever VJ */
+		if (ppp_option_iter_get_length(&iter) == 4 &&
+				get_host_short(data) == PPP_VJ_COMP_PROTO &&
+				data[2] <= VJ_MAX_SLOT_ID) {
+			ipcp->vj_max_slot = data[2];
+			ipcp->vj_comp_slot = data[3] ? 1 : 0;
+		} else
+			ipcp->req_options &= ~REQ_OPTION_VJ;
+	}
+
+	if (ipcp->is_server) {
+		ipcp_generate_config_options(ipcp);
+		pppcp_set_local_options(pppcp, ipcp->options,
+						ipcp->options_len);
 		return;
+	}
 
 	g_print("Received IPCP NAK\n");
 
@@ -302,6 +358,9 @@ static void ipcp_rcn_rej(struct pppcp_data *pppcp,
 		case SECONDARY_NBNS_SERVER:
 			ipcp->req_options &= ~REQ_OPTION_NBNS2;
 			break;
+		case IP_COMPRESSION_PROTO:
+			ipcp->req_options &= ~REQ_OPTION_VJ;
+			break;
 		default:
 			break;
 		}
@@ -311,6 +370,18 @@ static void ipcp_rcn_rej(struct pppcp_data *pppcp,
 	pppcp_set_local_options(pppcp, ipcp->options, ipcp->options_len);
 }
 
+/* Compression of what we send, only VJ is supported */
+static gboolean ipcp_vj_acceptable(struct ppp_option_iter *iter)
+{
+	const guint8 *data = ppp_option_iter_get_data(iter);
+
+	if (ppp_option_iter_get_type(iter) != IP_COMPRESSION_PROTO)
+		return FALSE;
+
+	return ppp_option_iter_get_length(iter) == 4 &&
+			get_host_short(data) == PPP_VJ_COMP_PROTO;
+}
+
 static enum rcr_result ipcp_server_rcr(struct ipcp_data *ipcp,
 					const struct pppcp_packet *packet,
 					guint8 **new_options, guint16 *new_len)
@@ -328,6 +399,9 @@ static enum rcr_result ipcp_server_rcr(struct ipcp_data *ipcp,
 		const guint8 *data = ppp_option_iter_get_data(&iter);
 		guint8 type = ppp_option_iter_get_type(&iter);
 
+		if (ipcp_vj_acceptable(&iter))
+			continue;
+
 		switch (type) {
 		case IP_ADDRESS:
 			memcpy(&addr, data, 4);
@@ -400,6 +474,9 @@ static enum rcr_result ipcp_client_rcr(struct ipcp_data *ipcp,
 		const guint8 *data = ppp_option_iter_get_data(&iter);
 		guint8 type = ppp_option_iter_get_type(&iter);
 
+		if (ipcp_vj_acceptable(&iter))
+			continue;
+
 		switch (type) {
 		case IP_ADDRESS:
 			memcpy(&ipcp->peer_addr, data, 4);
@@ -445,11 +522,32 @@ static enum rcr_result ipcp_rcr(struct pppcp_data *pppcp,
 					guint8 **new_options, guint16 *new_len)
 {
 	struct ipcp_data *ipcp = pppcp_get_data(pppcp);
+	struct ppp_option_iter iter;
+	enum rcr_result result;
+	const guint8 *data;
 
 	if (ipcp->is_server)
-		return ipcp_server_rcr(ipcp, packet, new_options, new_len);
+		result = ipcp_server_rcr(ipcp, packet, new_options, new_len);
 	else
-		return ipcp_client_rcr(ipcp, packet, new_options, new_len);
+		result = ipcp_client_rcr(ipcp, packet, new_options, new_len);
+
+	if (result != RCR_ACCEPT)
+		return result;
+
+	/* Compress what we send only if the peer asked for it */
+	ppp_set_xmit_vj(pppcp_get_ppp(pppcp), -1, FALSE);
+
+	ppp_option_iter_init(&iter, packet);
+
+	while (ppp_option_iter_next(&iter) == TRUE) {
+		if (!ipcp_vj_acceptable(&iter))
+			continue;
+
+		data = ppp_option_iter_get_data(&iter);
+		ppp_set_xmit_vj(pppcp_get_ppp(pppcp), data[2], data[3] != 0);
+	}
+
+	return RCR_ACCEPT;
 }
 
 struct pppcp_proto ipcp_proto = {
@@ -58,11 +58,13 @@ enum lcp_options {
 	ACFC			= 8,
 };
 
-/* Maximum size of all options, we only ever request ACCM and MRU */ 
-#define MAX_CONFIG_OPTION_SIZE 10
+/* Maximum size of all options, we only ever request ACCM, MRU, PFC, ACFC */
+#define MAX_CONFIG_OPTION_SIZE 14
 
 #define REQ_OPTION_ACCM	0x1
 #define REQ_OPTION_MRU	0x2
+#define REQ_OPTION_PFC	0x4
+#define REQ_OPTION_ACFC	0x8
 
 struct lcp_data {
 	guint8 options[MAX_CONFIG_OPTION_SIZE];
@@ -100,12 +102,24 @@ static void lcp_generate_config_options(struct lcp_data *lcp)
 		len += 4;
 	}
 
+	if (lcp->req_options & REQ_OPTION_PFC) {
+		lcp->options[len] = PFC;
+		lcp->options[len + 1] = 2;
+		len += 2;
+	}
+
+	if (lcp->req_options & REQ_OPTION_ACFC) {
+		lcp->options[len] = ACFC;
+		lcp->options[len + 1] = 2;
+		len += 2;
+	}
+
 	lcp->options_len = len;
 }
 
 static void lcp_reset_config_options(struct lcp_data *lcp)
 {
-	lcp->req_options = REQ_OPTION_ACCM;
+	lcp->req_options = REQ_OPTION_ACCM | REQ_OPTION_PFC | REQ_OPTION_ACFC;
 	lcp->accm = 0;
 
 	lcp_generate_config_options(lcp);
@@ -125,6 +139,10 @@ static void lcp_up(struct pppcp_data *pppcp)
 static void lcp_down(struct pppcp_data *pppcp)
 {
 	struct lcp_data *lcp = pppcp_get_data(pppcp);
+	GAtPPP *ppp = pppcp_get_ppp(pppcp);
+
+	ppp_set_xmit_pfc(ppp, FALSE);
+	ppp_set_xmit_acfc(ppp, FALSE);
 
 	lcp_reset_config_options(lcp);
 	pppcp_set_local_options(pppcp, lcp->options, lcp->options_len);
@@ -194,7 +212,26 @@ static void lcp_rcn_nak(struct pppcp_data *pppcp,
 static void lcp_rcn_rej(struct pppcp_data *pppcp,
 				const struct pppcp_packet *packet)
 {
+	struct lcp_data *lcp = pppcp_get_data(pppcp);
+	struct ppp_option_iter iter;
+
+	ppp_option_iter_init(&iter, packet);
+
+	while (ppp_option_iter_next(&iter) == TRUE) {
+		switch (ppp_option_iter_get_type(&iter)) {
+		case PFC:
+			lcp->req_options &= ~REQ_OPTION_PFC;
+			break;
+		case ACFC:
+			lcp->req_options &= ~REQ_OPTION_ACFC;
+			break;
+		default:
+			break;
+		}
+	}
 
+	lcp_generate_config_options(lcp);
+	pppcp_set_local_options(pppcp, lcp->options, lcp->options_len);
 }
 
 static enum rcr_result lcp_rcr(struct pppcp_data *pppcp,
@@ -258,6 +295,9 @@ static enum rcr_result lcp_rcr(struct pppcp_data *pppcp,
 	}
 
 	/* All options were found acceptable, apply them here and return */
+	ppp_set_xmit_pfc(ppp, FALSE);
+	ppp_set_xmit_acfc(ppp, FALSE);
+
 	ppp_option_iter_init(&iter, packet);
 
 	while (ppp_option_iter_next(&iter) == TRUE) {
@@ -272,9 +312,13 @@ static enum rcr_result lcp_rcr(struct pppcp_data *pppcp,
 		case MRU:
 			ppp_set_mtu(ppp, ppp_option_iter_get_data(&iter));
 			break;
-		case MAGIC_NUMBER:
 		case PFC:
+			ppp_set_xmit_pfc(ppp, TRUE);
+			break;
 		case ACFC:
+			ppp_set_xmit_acfc(ppp, TRUE);
+			break;
+		case MAGIC_NUMBER:
 			/* don't care */
 			break;
 		}
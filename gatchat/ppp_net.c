@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -39,14 +40,25 @@
 #include "ppp.h"
 
 #define MAX_PACKET 1500
+#define MAX_BURST 16
+
+struct ppp_net_stats {
+	guint packets;
+	guint64 bytes;
+	guint drops;
+};
 
 struct ppp_net {
 	GAtPPP *ppp;
 	char *if_name;
 	GIOChannel *channel;
+	int fd;
 	gint watch;
 	gint mtu;
 	struct ppp_header *ppp_packet;
+	struct ppp_net_stats rx;	/* modem to tun */
+	struct ppp_net_stats tx;	/* tun to modem */
+	guint pauses;			/* Times the modem held up tun */
 };
 
 gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
@@ -74,49 +86,96 @@ gboolean ppp_net_set_mtu(struct ppp_net *net, guint16 mtu)
 	return (rc < 0) ? FALSE : TRUE;
 }
 
-void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet)
+void ppp_net_process_packet(struct ppp_net *net, const guint8 *packet,
+				gsize len)
 {
-	GError *error = NULL;
-	GIOStatus status;
-	gsize bytes_written;
-	guint16 len;
+	guint16 ip_len;
+	ssize_t written;
+
+	if (len < 4)
+		goto drop;
 
 	/* find the length of the packet to transmit */
-	len = get_host_short(&packet[2]);
-	status = g_io_channel_write_chars(net->channel, (gchar *) packet,
-						len, &bytes_written, &error);
+	ip_len = get_host_short(&packet[2]);
+	if (ip_len > len)
+		goto drop;
+
+	/* tun takes one packet per write, no need to go through GIOChannel */
+	do {
+		written = write(net->fd, packet, ip_len);
+	} while (written < 0 && errno == EINTR);
+
+	if (written != ip_len)
+		goto drop;
+
+	net->rx.packets += 1;
+	net->rx.bytes += ip_len;
+	return;
+
+drop:
+	net->rx.drops += 1;
 }
 
 /*
  * packets received by the tun interface need to be written to
- * the modem.  So, just read a packet, write out to the modem
+ * the modem.  Drain up to MAX_BURST of them per wakeup, so that they go
+ * out to the modem in a single write.  While the modem is congested the
+ * watch is removed and the packets wait in the tun queue instead, until
+ * GAtPPP calls ppp_net_resume().
  */
 static gboolean ppp_net_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer userdata)
 {
 	struct ppp_net *net = (struct ppp_net *) userdata;
-	GIOStatus status;
-	gsize bytes_read;
-	GError *error = NULL;
-	gchar *buf = (gchar *) net->ppp_packet->info;
+	guint8 *buf = net->ppp_packet->info;
+	ssize_t bytes_read;
+	int i;
 
 	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP))
 		return FALSE;
 
-	if (cond & G_IO_IN) {
+	for (i = 0; i < MAX_BURST; i++) {
+		if (!ppp_can_transmit(net->ppp, net->mtu)) {
+			net->pauses += 1;
+			net->watch = 0;
+			return FALSE;
+		}
+
 		/* leave space to add PPP protocol field */
-		status = g_io_channel_read_chars(channel, buf, net->mtu,
-							&bytes_read, &error);
-		if (bytes_read > 0)
-			ppp_transmit(net->ppp, (guint8 *) net->ppp_packet,
-					bytes_read);
+		bytes_read = read(net->fd, buf, net->mtu);
+		if (bytes_read < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
 
-		if (status != G_IO_STATUS_NORMAL && status != G_IO_STATUS_AGAIN)
 			return FALSE;
+		}
+
+		if (bytes_read == 0)
+			break;
+
+		if (ppp_transmit(net->ppp, (guint8 *) net->ppp_packet,
+					bytes_read) == FALSE) {
+			net->tx.drops += 1;
+			continue;
+		}
+
+		net->tx.packets += 1;
+		net->tx.bytes += bytes_read;
 	}
+
 	return TRUE;
 }
 
+void ppp_net_resume(struct ppp_net *net)
+{
+	if (net->watch > 0)
+		return;
+
+	net->watch = g_io_add_watch(net->channel,
+			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+			ppp_net_callback, net);
+}
+
 const char *ppp_net_get_interface(struct ppp_net *net)
 {
 	return net->if_name;
@@ -160,12 +219,13 @@ struct ppp_net *ppp_net_new(GAtPPP *ppp)
 	if (channel == NULL)
 		goto error;
 
-	if (!g_at_util_setup_io(channel, 0))
+	if (!g_at_util_setup_io(channel, G_IO_FLAG_NONBLOCK))
 		goto error;
 
 	g_io_channel_set_buffered(channel, FALSE);
 
 	net->channel = channel;
+	net->fd = fd;
 	net->watch = g_io_add_watch(channel,
 			G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
 			ppp_net_callback, net);
@@ -189,7 +249,21 @@ error:
 
 void ppp_net_free(struct ppp_net *net)
 {
-	g_source_remove(net->watch);
+	char *str;
+
+	str = g_strdup_printf("%s: rx %u packets %" G_GUINT64_FORMAT
+				" bytes %u dropped, tx %u packets %"
+				G_GUINT64_FORMAT " bytes %u dropped %u paused",
+				net->if_name,
+				net->rx.packets, net->rx.bytes, net->rx.drops,
+				net->tx.packets, net->tx.bytes, net->tx.drops,
+				net->pauses);
+	ppp_debug(net->ppp, str);
+	g_free(str);
+
+	if (net->watch > 0)
+		g_source_remove(net->watch);
+
 	g_io_channel_unref(net->channel);
 
 	g_free(net->ppp_packet);
@@ -0,0 +1,635 @@
+/*
+ *
+ *  PPP library with GLib integration
+ *
+ *  Copyright (C) 2009-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <glib.h>
+
+#include "gatppp.h"
+#include "ppp.h"
+
+/* RFC 1144, Compressing TCP/IP Headers for Low-Speed Serial Links */
+
+#define VJ_MAX_HEADER	120	/* 60 bytes each of IP and TCP header */
+
+/* Bits in the change mask of a compressed header */
+#define NEW_C		0x40	/* Connection number present */
+#define NEW_I		0x20	/* IP ID delta present */
+#define TCP_PUSH_BIT	0x10
+#define NEW_S		0x08	/* Sequence number delta present */
+#define NEW_A		0x04	/* Ack delta present */
+#define NEW_W		0x02	/* Window delta present */
+#define NEW_U		0x01	/* Urgent pointer present */
+
+/* Combinations that cannot occur, used for the common cases */
+#define SPECIAL_I	(NEW_S | NEW_W | NEW_U)		/* Echoed data */
+#define SPECIAL_D	(NEW_S | NEW_A | NEW_W | NEW_U)	/* Unidirectional data */
+#define SPECIALS_MASK	(NEW_S | NEW_A | NEW_W | NEW_U)
+
+#define TH_FIN		0x01
+#define TH_SYN		0x02
+#define TH_RST		0x04
+#define TH_PUSH		0x08
+#define TH_ACK		0x10
+#define TH_URG		0x20
+
+/* Offsets into the IP and TCP headers */
+#define IP_LEN(ip)	((ip) + 2)
+#define IP_ID(ip)	((ip) + 4)
+#define IP_CSUM(ip)	((ip) + 10)
+#define IP_HLEN(ip)	(((ip)[0] & 0x0f) << 2)
+#define TCP_SEQ(th)	((th) + 4)
+#define TCP_ACK(th)	((th) + 8)
+#define TCP_HLEN(th)	(((th)[12] >> 4) << 2)
+#define TCP_FLAGS(th)	((th)[13])
+#define TCP_WIN(th)	((th) + 14)
+#define TCP_CSUM(th)	((th) + 16)
+#define TCP_URP(th)	((th) + 18)
+
+struct vj_slot {
+	guint8 hdr[VJ_MAX_HEADER];	/* IP and TCP header last seen */
+	guint8 hlen;
+	guint8 next;			/* Next less recently used slot */
+	gboolean valid;
+};
+
+struct ppp_vj {
+	struct vj_slot *xmit;
+	guint8 xmit_lru;		/* Least recently used slot */
+	gboolean xmit_comp_slot;	/* Peer allows eliding the slot */
+	gint last_xmit;
+	struct vj_slot *recv;
+	guint8 recv_max;
+	guint8 last_recv;
+	gboolean toss;			/* Lost sync, wait for a NEW_C */
+	guint8 *buf;			/* Holds uncompressed packets */
+	gsize buf_size;
+};
+
+static inline guint16 get_short(const guint8 *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static inline void put_short(guint8 *p, guint16 val)
+{
+	p[0] = val >> 8;
+	p[1] = val & 0xff;
+}
+
+static inline guint32 get_long(const guint8 *p)
+{
+	return (guint32) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline void put_long(guint8 *p, guint32 val)
+{
+	p[0] = val >> 24;
+	p[1] = (val >> 16) & 0xff;
+	p[2] = (val >> 8) & 0xff;
+	p[3] = val & 0xff;
+}
+
+/* Deltas below 256 take one byte, others a zero and two bytes */
+static guint8 *vj_encode(guint8 *cp, guint16 val, gboolean zero)
+{
+	if (val >= 256 || (zero && val == 0)) {
+		*cp++ = 0;
+		put_short(cp, val);
+		return cp + 2;
+	}
+
+	*cp++ = val;
+	return cp;
+}
+
+static const guint8 *vj_decode(const guint8 *cp, guint16 *val)
+{
+	if (*cp == 0) {
+		*val = get_short(cp + 1);
+		return cp + 3;
+	}
+
+	*val = *cp;
+	return cp + 1;
+}
+
+static guint16 ip_checksum(const guint8 *ip, guint len)
+{
+	guint32 sum = 0;
+	guint i;
+
+	for (i = 0; i < len; i += 2)
+		sum += get_short(ip + i);
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+struct ppp_vj *ppp_vj_new(void)
+{
+	struct ppp_vj *vj;
+
+	vj = g_try_new0(struct ppp_vj, 1);
+	if (vj == NULL)
+		return NULL;
+
+	vj->last_xmit = -1;
+	vj->toss = TRUE;
+
+	return vj;
+}
+
+void ppp_vj_free(struct ppp_vj *vj)
+{
+	if (vj == NULL)
+		return;
+
+	g_free(vj->xmit);
+	g_free(vj->recv);
+	g_free(vj->buf);
+	g_free(vj);
+}
+
+gboolean ppp_vj_set_xmit(struct ppp_vj *vj, int max_slot, gboolean comp_slot)
+{
+	int i;
+
+	g_free(vj->xmit);
+	vj->xmit = NULL;
+	vj->last_xmit = -1;
+
+	if (max_slot < 0)
+		return TRUE;
+
+	vj->xmit = g_try_new0(struct vj_slot, max_slot + 1);
+	if (vj->xmit == NULL)
+		return FALSE;
+
+	/*
+	 * Slots form a ring from the most to the least recently used, the
+	 * least recently used slot links back to the most recently used.
+	 */
+	for (i = 0; i < max_slot; i++)
+		vj->xmit[i].next = i + 1;
+
+	vj->xmit[max_slot].next = 0;
+	vj->xmit_lru = max_slot;
+	vj->xmit_comp_slot = comp_slot;
+
+	return TRUE;
+}
+
+gboolean ppp_vj_set_recv(struct ppp_vj *vj, int max_slot)
+{
+	g_free(vj->recv);
+	vj->recv = NULL;
+	vj->toss = TRUE;
+
+	if (max_slot < 0)
+		return TRUE;
+
+	vj->recv = g_try_new0(struct vj_slot, max_slot + 1);
+	if (vj->recv == NULL)
+		return FALSE;
+
+	vj->recv_max = max_slot;
+
+	return TRUE;
+}
+
+/*
+ * Finds the slot of the connection and makes it the most recently used.
+ * A connection seen for the first time takes over the least recently
+ * used slot, which is returned invalidated.
+ */
+static struct vj_slot *vj_find_slot(struct ppp_vj *vj, const guint8 *ip,
+					const guint8 *th, guint8 *id)
+{
+	struct vj_slot *slot;
+	guint8 prev = vj->xmit_lru;
+	guint8 cur = vj->xmit[prev].next;
+	const guint8 *oth;
+
+	while (1) {
+		slot = &vj->xmit[cur];
+		oth = slot->hdr + IP_HLEN(slot->hdr);
+
+		if (slot->valid && memcmp(ip + 12, slot->hdr + 12, 8) == 0 &&
+				memcmp(th, oth, 4) == 0)
+			break;
+
+		if (cur == vj->xmit_lru) {
+			/* Not found, reuse the least recently used slot */
+			slot->valid = FALSE;
+			break;
+		}
+
+		prev = cur;
+		cur = slot->next;
+	}
+
+	*id = cur;
+
+	if (cur == vj->xmit_lru) {
+		vj->xmit_lru = prev;
+		return slot;
+	}
+
+	/* Unlink and put in front of the ring */
+	if (cur != vj->xmit[vj->xmit_lru].next) {
+		vj->xmit[prev].next = slot->next;
+		slot->next = vj->xmit[vj->xmit_lru].next;
+		vj->xmit[vj->xmit_lru].next = cur;
+	}
+
+	return slot;
+}
+
+/*
+ * Compresses the TCP/IP header of the IP packet at *packet in place.  The
+ * packet may move forward in the buffer, returns the PPP protocol to send
+ * it with.
+ */
+guint16 ppp_vj_compress(struct ppp_vj *vj, guint8 **packet, gsize *len)
+{
+	guint8 *ip = *packet;
+	guint8 *th;
+	guint8 *oip;
+	guint8 *oth;
+	struct vj_slot *slot;
+	guint8 new_seq[16];
+	guint8 *cp = new_seq;
+	guint8 changes = 0;
+	guint8 id;
+	guint ihl;
+	guint hlen;
+	guint16 delta_w;
+	guint32 delta_s;
+	guint32 delta_a;
+	guint16 delta_i;
+	guint16 csum;
+	guint32 last_data;
+	guint clen;
+
+	if (vj->xmit == NULL || *len < 40)
+		return PPP_IP_PROTO;
+
+	ihl = IP_HLEN(ip);
+
+	/* Only unfragmented TCP */
+	if ((ip[0] >> 4) != 4 || ihl < 20 || ip[9] != IPPROTO_TCP ||
+			(get_short(ip + 6) & 0x3fff) != 0)
+		return PPP_IP_PROTO;
+
+	th = ip + ihl;
+
+	if (*len < ihl + 20)
+		return PPP_IP_PROTO;
+
+	hlen = ihl + TCP_HLEN(th);
+
+	if (TCP_HLEN(th) < 20 || *len < hlen)
+		return PPP_IP_PROTO;
+
+	/* Connection setup and teardown are sent as is */
+	if ((TCP_FLAGS(th) & (TH_SYN | TH_FIN | TH_RST | TH_ACK)) != TH_ACK)
+		return PPP_IP_PROTO;
+
+	slot = vj_find_slot(vj, ip, th, &id);
+	if (slot->valid == FALSE)
+		goto uncompressed;
+
+	oip = slot->hdr;
+	oth = oip + IP_HLEN(oip);
+	last_data = get_short(IP_LEN(oip)) - slot->hlen;
+
+	/* Everything that is not sent as a delta must be unchanged */
+	if (memcmp(ip, oip, 2) || memcmp(ip + 6, oip + 6, 4) ||
+			TCP_HLEN(th) != TCP_HLEN(oth) || ihl != IP_HLEN(oip) ||
+			memcmp(ip + 20, oip + 20, ihl - 20) ||
+			memcmp(th + 20, oth + 20, TCP_HLEN(th) - 20))
+		goto uncompressed;
+
+	/* Only PUSH and URG are carried, the peer keeps the other flags */
+	if ((TCP_FLAGS(th) ^ TCP_FLAGS(oth)) & ~(TH_PUSH | TH_URG))
+		goto uncompressed;
+
+	if (TCP_FLAGS(th) & TH_URG) {
+		cp = vj_encode(cp, get_short(TCP_URP(th)), TRUE);
+		changes |= NEW_U;
+	} else if (memcmp(TCP_URP(th), TCP_URP(oth), 2) ||
+			(TCP_FLAGS(oth) & TH_URG))
+		goto uncompressed;
+
+	delta_w = get_short(TCP_WIN(th)) - get_short(TCP_WIN(oth));
+	if (delta_w) {
+		cp = vj_encode(cp, delta_w, FALSE);
+		changes |= NEW_W;
+	}
+
+	delta_a = get_long(TCP_ACK(th)) - get_long(TCP_ACK(oth));
+	if (delta_a) {
+		if (delta_a > 0xffff)
+			goto uncompressed;
+
+		cp = vj_encode(cp, delta_a, FALSE);
+		changes |= NEW_A;
+	}
+
+	delta_s = get_long(TCP_SEQ(th)) - get_long(TCP_SEQ(oth));
+	if (delta_s) {
+		if (delta_s > 0xffff)
+			goto uncompressed;
+
+		cp = vj_encode(cp, delta_s, FALSE);
+		changes |= NEW_S;
+	}
+
+	switch (changes) {
+	case 0:
+		/*
+		 * Nothing changed.  Data following a pure ack is sent
+		 * compressed, anything else is likely a retransmission
+		 * and goes uncompressed in case the peer lost sync.
+		 */
+		if (get_short(IP_LEN(ip)) != get_short(IP_LEN(oip)) &&
+				last_data == 0)
+			break;
+
+		goto uncompressed;
+	case SPECIAL_I:
+	case SPECIAL_D:
+		/* Would be mistaken for the special cases */
+		goto uncompressed;
+	case NEW_S | NEW_A:
+		if (delta_s == delta_a && delta_s == last_data) {
+			changes = SPECIAL_I;
+			cp = new_seq;
+		}
+		break;
+	case NEW_S:
+		if (delta_s == last_data) {
+			changes = SPECIAL_D;
+			cp = new_seq;
+		}
+		break;
+	default:
+		break;
+	}
+
+	delta_i = get_short(IP_ID(ip)) - get_short(IP_ID(oip));
+	if (delta_i != 1) {
+		cp = vj_encode(cp, delta_i, TRUE);
+		changes |= NEW_I;
+	}
+
+	if (TCP_FLAGS(th) & TH_PUSH)
+		changes |= TCP_PUSH_BIT;
+
+	csum = get_short(TCP_CSUM(th));
+
+	memcpy(slot->hdr, ip, hlen);
+	slot->hlen = hlen;
+
+	/* Write the compressed header right in front of the payload */
+	clen = cp - new_seq;
+	cp = ip + hlen - clen - 2;
+
+	memcpy(cp + 2, new_seq, clen);
+	put_short(cp, csum);
+
+	if (vj->xmit_comp_slot == FALSE || vj->last_xmit != id) {
+		*--cp = id;
+		*--cp = changes | NEW_C;
+		vj->last_xmit = id;
+	} else
+		*--cp = changes;
+
+	*len -= cp - ip;
+	*packet = cp;
+
+	return PPP_VJ_COMP_PROTO;
+
+uncompressed:
+	memcpy(slot->hdr, ip, hlen);
+	slot->hlen = hlen;
+	slot->valid = TRUE;
+
+	ip[9] = id;
+	vj->last_xmit = id;
+
+	return PPP_VJ_UNCOMP_PROTO;
+}
+
+static gboolean vj_reserve(struct ppp_vj *vj, gsize size)
+{
+	if (vj->buf_size >= size)
+		return TRUE;
+
+	g_free(vj->buf);
+	vj->buf_size = 0;
+
+	vj->buf = g_try_malloc(size);
+	if (vj->buf == NULL)
+		return FALSE;
+
+	vj->buf_size = size;
+
+	return TRUE;
+}
+
+static const guint8 *vj_uncompress_tcp(struct ppp_vj *vj,
+					const guint8 *data, gsize *len)
+{
+	struct vj_slot *slot;
+	guint8 *ip;
+	guint hlen;
+
+	if (*len < 40 || IP_HLEN(data) < 20 ||
+			(gsize) IP_HLEN(data) + 20 > *len)
+		goto toss;
+
+	hlen = IP_HLEN(data) + TCP_HLEN(data + IP_HLEN(data));
+
+	if (data[9] > vj->recv_max || hlen > *len ||
+			TCP_HLEN(data + IP_HLEN(data)) < 20)
+		goto toss;
+
+	if (vj_reserve(vj, *len) == FALSE)
+		goto toss;
+
+	ip = vj->buf;
+	memcpy(ip, data, *len);
+
+	slot = &vj->recv[data[9]];
+	vj->last_recv = data[9];
+	vj->toss = FALSE;
+
+	/* The IP checksum still covers the protocol, not the slot */
+	ip[9] = IPPROTO_TCP;
+
+	memcpy(slot->hdr, ip, hlen);
+	slot->hlen = hlen;
+	slot->valid = TRUE;
+
+	return ip;
+
+toss:
+	vj->toss = TRUE;
+	return NULL;
+}
+
+static const guint8 *vj_uncompress(struct ppp_vj *vj, const guint8 *data,
+					gsize *len)
+{
+	struct vj_slot *slot;
+	guint8 comp[24];
+	const guint8 *cp = comp;
+	guint8 *ip;
+	guint8 *th;
+	guint8 changes;
+	guint16 delta;
+	guint payload;
+	guint used;
+
+	/* Never read past the packet, however garbled the header */
+	memset(comp, 0, sizeof(comp));
+	memcpy(comp, data, MIN(*len, sizeof(comp)));
+
+	changes = *cp++;
+
+	if (changes & NEW_C) {
+		if (*cp > vj->recv_max || vj->recv[*cp].valid == FALSE)
+			goto toss;
+
+		vj->last_recv = *cp++;
+		vj->toss = FALSE;
+	} else if (vj->toss)
+		return NULL;
+
+	slot = &vj->recv[vj->last_recv];
+	ip = slot->hdr;
+	th = ip + IP_HLEN(ip);
+
+	memcpy(TCP_CSUM(th), cp, 2);
+	cp += 2;
+
+	if (changes & TCP_PUSH_BIT)
+		TCP_FLAGS(th) |= TH_PUSH;
+	else
+		TCP_FLAGS(th) &= ~TH_PUSH;
+
+	switch (changes & SPECIALS_MASK) {
+	case SPECIAL_I:
+		delta = get_short(IP_LEN(ip)) - slot->hlen;
+		put_long(TCP_ACK(th), get_long(TCP_ACK(th)) + delta);
+		put_long(TCP_SEQ(th), get_long(TCP_SEQ(th)) + delta);
+		break;
+	case SPECIAL_D:
+		delta = get_short(IP_LEN(ip)) - slot->hlen;
+		put_long(TCP_SEQ(th), get_long(TCP_SEQ(th)) + delta);
+		break;
+	default:
+		if (changes & NEW_U) {
+			TCP_FLAGS(th) |= TH_URG;
+			cp = vj_decode(cp, &delta);
+			put_short(TCP_URP(th), delta);
+		} else
+			TCP_FLAGS(th) &= ~TH_URG;
+
+		if (changes & NEW_W) {
+			cp = vj_decode(cp, &delta);
+			put_short(TCP_WIN(th), get_short(TCP_WIN(th)) + delta);
+		}
+
+		if (changes & NEW_A) {
+			cp = vj_decode(cp, &delta);
+			put_long(TCP_ACK(th), get_long(TCP_ACK(th)) + delta);
+		}
+
+		if (changes & NEW_S) {
+			cp = vj_decode(cp, &delta);
+			put_long(TCP_SEQ(th), get_long(TCP_SEQ(th)) + delta);
+		}
+
+		break;
+	}
+
+	if (changes & NEW_I)
+		cp = vj_decode(cp, &delta);
+	else
+		delta = 1;
+
+	put_short(IP_ID(ip), get_short(IP_ID(ip)) + delta);
+
+	used = cp - comp;
+	if (used > *len)
+		goto toss;
+
+	payload = *len - used;
+
+	if (slot->hlen + payload > 0xffff ||
+			vj_reserve(vj, slot->hlen + payload) == FALSE)
+		goto toss;
+
+	put_short(IP_LEN(ip), slot->hlen + payload);
+	put_short(IP_CSUM(ip), 0);
+	put_short(IP_CSUM(ip), ip_checksum(ip, IP_HLEN(ip)));
+
+	memcpy(vj->buf, ip, slot->hlen);
+	memcpy(vj->buf + slot->hlen, data + used, payload);
+
+	*len = slot->hlen + payload;
+
+	return vj->buf;
+
+toss:
+	vj->toss = TRUE;
+	return NULL;
+}
+
+/*
+ * Rebuilds the IP packet from a VJ compressed or uncompressed TCP
+ * packet.  Returns NULL if the packet has to be dropped, otherwise the
+ * packet is valid until the next call.
+ */
+const guint8 *ppp_vj_uncompress(struct ppp_vj *vj, guint16 proto,
+					const guint8 *data, gsize *len)
+{
+	if (vj->recv == NULL || *len == 0)
+		return NULL;
+
+	switch (proto) {
+	case PPP_VJ_COMP_PROTO:
+		return vj_uncompress(vj, data, len);
+	case PPP_VJ_UNCOMP_PROTO:
+		return vj_uncompress_tcp(vj, data, len);
+	}
+
+	return NULL;
+}
@@ -24,6 +24,9 @@
 #endif
 
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include <glib.h>
 
@@ -31,22 +34,34 @@
 
 #define MAX_SIZE 262144
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
 struct ring_buffer {
 	unsigned char *buffer;
 	unsigned int size;
 	unsigned int in;
 	unsigned int out;
+	gboolean mirrored;	/* buffer is mapped twice, back to back */
 };
 
-struct ring_buffer *ring_buffer_new(unsigned int size)
+static unsigned int ring_buffer_size(unsigned int size)
 {
 	unsigned int real_size = 1;
-	struct ring_buffer *buffer;
 
 	/* Find the next power of two for size */
 	while (real_size < size && real_size < MAX_SIZE)
 		real_size = real_size << 1;
 
+	return real_size;
+}
+
+struct ring_buffer *ring_buffer_new(unsigned int size)
+{
+	unsigned int real_size = ring_buffer_size(size);
+	struct ring_buffer *buffer;
+
 	if (real_size > MAX_SIZE)
 		return NULL;
 
@@ -63,10 +78,98 @@ struct ring_buffer *ring_buffer_new(unsigned int size)
 	buffer->size = real_size;
 	buffer->in = 0;
 	buffer->out = 0;
+	buffer->mirrored = FALSE;
+
+	return buffer;
+}
+
+/*
+ * Maps the same size bytes of a memfd twice in a row, so that anything
+ * running off the end of the first mapping lands on the start of the
+ * buffer again.
+ */
+static unsigned char *mirror_map(unsigned int size)
+{
+#ifdef __NR_memfd_create
+	unsigned char *addr;
+	void *map;
+	int fd;
+
+	fd = syscall(__NR_memfd_create, "ringbuffer", MFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, size) < 0)
+		goto error;
+
+	/* Reserve the address space for both halves first */
+	addr = mmap(NULL, size * 2, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		goto error;
+
+	map = mmap(addr, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0);
+	if (map != addr)
+		goto unmap;
+
+	map = mmap(addr + size, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0);
+	if (map != addr + size)
+		goto unmap;
+
+	close(fd);
+
+	return addr;
+
+unmap:
+	munmap(addr, size * 2);
+error:
+	close(fd);
+#endif
+
+	return NULL;
+}
+
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size)
+{
+	unsigned int real_size = ring_buffer_size(size);
+	unsigned int page_size = sysconf(_SC_PAGESIZE);
+	struct ring_buffer *buffer;
+
+	if (real_size > MAX_SIZE)
+		return NULL;
+
+	/* Both are powers of two, so real_size is a multiple of a page */
+	if (real_size < page_size)
+		real_size = page_size;
+
+	buffer = g_try_new(struct ring_buffer, 1);
+	if (!buffer)
+		return NULL;
+
+	buffer->buffer = mirror_map(real_size);
+	if (!buffer->buffer) {
+		g_free(buffer);
+		return ring_buffer_new(size);
+	}
+
+	buffer->size = real_size;
+	buffer->in = 0;
+	buffer->out = 0;
+	buffer->mirrored = TRUE;
 
 	return buffer;
 }
 
+gboolean ring_buffer_is_mirrored(struct ring_buffer *buf)
+{
+	if (!buf)
+		return FALSE;
+
+	return buf->mirrored;
+}
+
 int ring_buffer_write(struct ring_buffer *buf, const void *data,
 			unsigned int len)
 {
@@ -79,7 +182,7 @@ int ring_buffer_write(struct ring_buffer *buf, const void *data,
 
 	/* Determine how much to write before wrapping */
 	offset = buf->in % buf->size;
-	end = MIN(len, buf->size - offset);
+	end = buf->mirrored ? len : MIN(len, buf->size - offset);
 	memcpy(buf->buffer+offset, d, end);
 
 	/* Now put the remainder on the beginning of the buffer */
@@ -101,6 +204,9 @@ int ring_buffer_avail_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->in % buf->size;
 	unsigned int len = buf->size - buf->in + buf->out;
 
+	if (buf->mirrored)
+		return len;
+
 	return MIN(len, buf->size - offset);
 }
 
@@ -122,7 +228,7 @@ int ring_buffer_read(struct ring_buffer *buf, void *data, unsigned int len)
 
 	/* Grab data from buffer starting at offset until the end */
 	offset = buf->out % buf->size;
-	end = MIN(len, buf->size - offset);
+	end = buf->mirrored ? len : MIN(len, buf->size - offset);
 	memcpy(d, buf->buffer + offset, end);
 
 	/* Now grab remainder from the beginning */
@@ -153,6 +259,9 @@ int ring_buffer_len_no_wrap(struct ring_buffer *buf)
 	unsigned int offset = buf->out % buf->size;
 	unsigned int len = buf->in - buf->out;
 
+	if (buf->mirrored)
+		return len;
+
 	return MIN(len, buf->size - offset);
 }
 
@@ -200,6 +309,10 @@ void ring_buffer_free(struct ring_buffer *buf)
 	if (!buf)
 		return;
 
-	g_free(buf->buffer);
+	if (buf->mirrored)
+		munmap(buf->buffer, buf->size * 2);
+	else
+		g_free(buf->buffer);
+
 	g_free(buf);
 }
@@ -26,6 +26,20 @@ struct ring_buffer;
  */
 struct ring_buffer *ring_buffer_new(unsigned int size);
 
+/*!
+ * Creates a new ring buffer with capacity size, rounded up to a whole
+ * page, whose memory is mapped twice back to back.  Data never wraps,
+ * the read and write pointers are followed by ring_buffer_len and
+ * ring_buffer_avail contiguous bytes respectively.  Falls back to
+ * ring_buffer_new if the mapping cannot be set up.
+ */
+struct ring_buffer *ring_buffer_new_mirrored(unsigned int size);
+
+/*!
+ * Returns TRUE if the ring buffer is mirrored and never wraps
+ */
+gboolean ring_buffer_is_mirrored(struct ring_buffer *buf);
+
 /*!
  * Frees the resources allocated for the ring buffer
  */
@@ -0,0 +1,373 @@
+/*
+ *
+ *  AT chat library with GLib integration
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "tracebuffer.h"
+
+#define MIN_SIZE 4096
+#define MAX_SIZE 16777216
+
+#define TRACE_FLAG_IN		0x01
+#define TRACE_FLAG_HEX		0x02
+#define TRACE_FLAG_TRUNCATED	0x04
+
+struct trace_buffer {
+	unsigned char *buffer;
+	unsigned int size;
+	unsigned int in;
+	unsigned int out;
+	unsigned int records;
+	unsigned int dropped;
+};
+
+struct trace_channel {
+	guint16 id;
+	enum trace_format format;
+	char *name;
+};
+
+/* Precedes the data of each record, both are stored unaligned */
+struct trace_header {
+	guint64 usec;				/* Wall clock time */
+	guint32 len;				/* Bytes of data that follow */
+	guint16 channel;
+	guint8 flags;
+	guint8 reserved;
+};
+
+static struct trace_buffer *trace_current;
+static GHashTable *trace_channels;
+static guint16 trace_next_id;
+
+struct trace_buffer *trace_buffer_new(unsigned int size)
+{
+	unsigned int real_size = MIN_SIZE;
+	struct trace_buffer *tb;
+
+	/* Find the next power of two for size */
+	while (real_size < size && real_size < MAX_SIZE)
+		real_size = real_size << 1;
+
+	tb = g_try_new0(struct trace_buffer, 1);
+	if (!tb)
+		return NULL;
+
+	tb->buffer = g_try_new(unsigned char, real_size);
+	if (!tb->buffer) {
+		g_free(tb);
+		return NULL;
+	}
+
+	tb->size = real_size;
+
+	return tb;
+}
+
+void trace_buffer_free(struct trace_buffer *tb)
+{
+	if (!tb)
+		return;
+
+	if (trace_current == tb)
+		trace_current = NULL;
+
+	g_free(tb->buffer);
+	g_free(tb);
+}
+
+unsigned int trace_buffer_len(struct trace_buffer *tb)
+{
+	return tb->records;
+}
+
+unsigned int trace_buffer_dropped(struct trace_buffer *tb)
+{
+	return tb->dropped;
+}
+
+static void trace_buffer_copy_in(struct trace_buffer *tb, const void *data,
+					unsigned int len)
+{
+	unsigned int offset = tb->in & (tb->size - 1);
+	unsigned int end = MIN(len, tb->size - offset);
+
+	memcpy(tb->buffer + offset, data, end);
+	memcpy(tb->buffer, (const unsigned char *) data + end, len - end);
+
+	tb->in += len;
+}
+
+static void trace_buffer_copy_out(struct trace_buffer *tb, unsigned int pos,
+					void *data, unsigned int len)
+{
+	unsigned int offset = pos & (tb->size - 1);
+	unsigned int end = MIN(len, tb->size - offset);
+
+	memcpy(data, tb->buffer + offset, end);
+	memcpy((unsigned char *) data + end, tb->buffer, len - end);
+}
+
+/* Makes room by dropping the oldest record */
+static void trace_buffer_drop(struct trace_buffer *tb)
+{
+	struct trace_header hdr;
+
+	trace_buffer_copy_out(tb, tb->out, &hdr, sizeof(hdr));
+
+	tb->out += sizeof(hdr) + hdr.len;
+	tb->records -= 1;
+	tb->dropped += 1;
+}
+
+static void trace_buffer_append(struct trace_buffer *tb,
+				struct trace_channel *channel, gboolean in,
+				const struct iovec *iov, unsigned int iovcnt)
+{
+	struct trace_header hdr;
+	struct timeval now;
+	unsigned int len = 0;
+	unsigned int chunk;
+	unsigned int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if (len == 0)
+		return;
+
+	gettimeofday(&now, NULL);
+
+	hdr.usec = (guint64) now.tv_sec * 1000000 + now.tv_usec;
+	hdr.channel = channel->id;
+	hdr.flags = in ? TRACE_FLAG_IN : 0;
+	hdr.reserved = 0;
+
+	if (channel->format == TRACE_FORMAT_HEX)
+		hdr.flags |= TRACE_FLAG_HEX;
+
+	/* Keep the start of anything too big to fit at all */
+	if (len > tb->size - sizeof(hdr)) {
+		len = tb->size - sizeof(hdr);
+		hdr.flags |= TRACE_FLAG_TRUNCATED;
+	}
+
+	hdr.len = len;
+
+	while (tb->size - (tb->in - tb->out) < sizeof(hdr) + len)
+		trace_buffer_drop(tb);
+
+	trace_buffer_copy_in(tb, &hdr, sizeof(hdr));
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		chunk = MIN(len, iov[i].iov_len);
+
+		trace_buffer_copy_in(tb, iov[i].iov_base, chunk);
+		len -= chunk;
+	}
+
+	tb->records += 1;
+}
+
+static void format_text(GString *str, struct trace_buffer *tb,
+				unsigned int pos, unsigned int len)
+{
+	unsigned char c;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		c = tb->buffer[(pos + i) & (tb->size - 1)];
+
+		switch (c) {
+		case '\r':
+			g_string_append(str, "\\r");
+			break;
+		case '\t':
+			g_string_append(str, "\\t");
+			break;
+		case '\n':
+			g_string_append(str, "\\n");
+			break;
+		case 26:
+			g_string_append(str, "<CtrlZ>");
+			break;
+		case 25:
+			g_string_append(str, "<ESC>");
+			break;
+		default:
+			if (g_ascii_isprint(c)) {
+				g_string_append_c(str, c);
+				break;
+			}
+
+			g_string_append_c(str, '\\');
+			g_string_append_c(str, '0' + ((c >> 6) & 07));
+			g_string_append_c(str, '0' + ((c >> 3) & 07));
+			g_string_append_c(str, '0' + (c & 07));
+		}
+	}
+}
+
+static void format_hex(GString *str, struct trace_buffer *tb,
+				unsigned int pos, unsigned int len)
+{
+	static const char digits[] = "0123456789abcdef";
+	unsigned char c;
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		c = tb->buffer[(pos + i) & (tb->size - 1)];
+
+		g_string_append_c(str, ' ');
+		g_string_append_c(str, digits[c >> 4]);
+		g_string_append_c(str, digits[c & 0xf]);
+	}
+}
+
+void trace_buffer_dump(struct trace_buffer *tb, TracePrintFunc func,
+							void *user_data)
+{
+	struct trace_channel *channel = NULL;
+	struct trace_header hdr;
+	GString *str;
+	unsigned int pos;
+	time_t sec;
+	struct tm tm;
+
+	if (!tb || !func)
+		return;
+
+	str = g_string_sized_new(256);
+
+	for (pos = tb->out; pos != tb->in; pos += hdr.len) {
+		trace_buffer_copy_out(tb, pos, &hdr, sizeof(hdr));
+		pos += sizeof(hdr);
+
+		sec = hdr.usec / 1000000;
+		localtime_r(&sec, &tm);
+
+		if (trace_channels)
+			channel = g_hash_table_lookup(trace_channels,
+					GUINT_TO_POINTER(hdr.channel));
+
+		g_string_printf(str, "%02d:%02d:%02d.%06u %s/%u %c",
+				tm.tm_hour, tm.tm_min, tm.tm_sec,
+				(unsigned int) (hdr.usec % 1000000),
+				channel ? channel->name : "?", hdr.channel,
+				hdr.flags & TRACE_FLAG_IN ? '<' : '>');
+
+		if (hdr.flags & TRACE_FLAG_HEX) {
+			format_hex(str, tb, pos, hdr.len);
+		} else {
+			g_string_append_c(str, ' ');
+			format_text(str, tb, pos, hdr.len);
+		}
+
+		if (hdr.flags & TRACE_FLAG_TRUNCATED)
+			g_string_append(str, " ...");
+
+		func(str->str, user_data);
+	}
+
+	g_string_free(str, TRUE);
+}
+
+void trace_set_buffer(struct trace_buffer *tb)
+{
+	trace_current = tb;
+}
+
+struct trace_channel *trace_channel_new(const char *name,
+						enum trace_format format)
+{
+	struct trace_channel *channel;
+
+	channel = g_try_new0(struct trace_channel, 1);
+	if (!channel)
+		return NULL;
+
+	if (!trace_channels)
+		trace_channels = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+
+	/* Skip IDs still in use after wrapping around */
+	do
+		trace_next_id += 1;
+	while (trace_next_id == 0 || g_hash_table_lookup(trace_channels,
+					GUINT_TO_POINTER(trace_next_id)));
+
+	channel->id = trace_next_id;
+	channel->format = format;
+	channel->name = g_strdup(name);
+
+	g_hash_table_insert(trace_channels, GUINT_TO_POINTER(channel->id),
+				channel);
+
+	return channel;
+}
+
+void trace_channel_free(struct trace_channel *channel)
+{
+	if (!channel)
+		return;
+
+	g_hash_table_remove(trace_channels, GUINT_TO_POINTER(channel->id));
+
+	if (g_hash_table_size(trace_channels) == 0) {
+		g_hash_table_destroy(trace_channels);
+		trace_channels = NULL;
+	}
+
+	g_free(channel->name);
+	g_free(channel);
+}
+
+void trace_record(struct trace_channel *channel, gboolean in,
+					const void *data, unsigned int len)
+{
+	struct iovec iov;
+
+	if (!trace_current || !channel)
+		return;
+
+	iov.iov_base = (void *) data;
+	iov.iov_len = len;
+
+	trace_buffer_append(trace_current, channel, in, &iov, 1);
+}
+
+void trace_recordv(struct trace_channel *channel, gboolean in,
+				const struct iovec *iov, unsigned int iovcnt)
+{
+	if (!trace_current || !channel)
+		return;
+
+	trace_buffer_append(trace_current, channel, in, iov, iovcnt);
+}
@@ -0,0 +1,90 @@
+/*
+ *
+ *  AT chat library with GLib integration
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+struct trace_buffer;
+struct trace_channel;
+struct iovec;
+
+enum trace_format {
+	TRACE_FORMAT_TEXT,	/* AT commands and responses */
+	TRACE_FORMAT_HEX,	/* Frames and binary protocols */
+};
+
+typedef void (*TracePrintFunc)(const char *str, void *user_data);
+
+/*!
+ * Creates a new trace buffer holding the most recent size bytes worth
+ * of records, size being rounded up to a power of two
+ */
+struct trace_buffer *trace_buffer_new(unsigned int size);
+
+/*!
+ * Frees the resources allocated for the trace buffer
+ */
+void trace_buffer_free(struct trace_buffer *tb);
+
+/*!
+ * Returns the number of records currently held in the trace buffer
+ */
+unsigned int trace_buffer_len(struct trace_buffer *tb);
+
+/*!
+ * Returns the number of records overwritten to make room for newer ones
+ */
+unsigned int trace_buffer_dropped(struct trace_buffer *tb);
+
+/*!
+ * Formats the records held in the trace buffer, oldest first, and hands
+ * them to func one line at a time.  The records are left in place.
+ */
+void trace_buffer_dump(struct trace_buffer *tb, TracePrintFunc func,
+							void *user_data);
+
+/*!
+ * Sets the trace buffer trace_record records into, NULL disables tracing
+ */
+void trace_set_buffer(struct trace_buffer *tb);
+
+/*!
+ * Creates a new trace channel, name identifying it in dumps along with
+ * a number unique to the channel
+ */
+struct trace_channel *trace_channel_new(const char *name,
+						enum trace_format format);
+
+/*!
+ * Frees the trace channel, its records stay in the trace buffer
+ */
+void trace_channel_free(struct trace_channel *channel);
+
+/*!
+ * Records len bytes of data, in being TRUE for data received and FALSE
+ * for data sent.  Copies the data into the trace buffer as is, without
+ * allocating or formatting anything.
+ */
+void trace_record(struct trace_channel *channel, gboolean in,
+					const void *data, unsigned int len);
+
+/*!
+ * Same as trace_record, for data held in a scatter-gather array
+ */
+void trace_recordv(struct trace_channel *channel, gboolean in,
+				const struct iovec *iov, unsigned int iovcnt);
@@ -25,9 +25,9 @@
 
 #define _GNU_SOURCE
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <search.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
@@ -37,30 +37,77 @@
 
 #include "socket.h"
 #include "client.h"
+#include "tracebuffer.h"
 
 #define PN_COMMGR			0x10
 #define PNS_SUBSCRIBED_RESOURCES_IND	0x10
 
+/*
+ * Messages read per system call, and dispatched per main loop wakeup.
+ * A datagram cannot be read in parts, so each message read in a batch
+ * needs a buffer of PHONET_MAX_SDU; the batch is kept small for that.
+ */
+#define G_ISI_BATCH			4
+#define G_ISI_BUDGET			32
+
+/* One second ticks, requests with longer timeouts go round again */
+#define G_ISI_WHEEL_SLOTS		64
+
 static const struct sockaddr_pn commgr = {
 	.spn_family = AF_PHONET,
 	.spn_resource = PN_COMMGR,
 };
 
 struct _GIsiRequest {
-	unsigned int id; /* don't move, see g_isi_cmp */
+	unsigned int id;
 	GIsiClient *client;
-	guint timeout;
+	unsigned int expires; /* timer wheel tick */
+	GIsiRequest *next;
+	GIsiRequest *prev;
 	GIsiResponseFunc func;
 	void *data;
 };
 
 struct _GIsiIndication {
-	unsigned int type; /* don't move, see g_isi_cmp */
 	GIsiIndicationFunc func;
 	void *data;
 };
 typedef struct _GIsiIndication GIsiIndication;
 
+/*
+ * The sockets of a modem, shared by all of its clients.  Responses and
+ * indications are routed to the clients by resource.
+ */
+struct _GIsiDispatcher {
+	unsigned int ifindex;
+	unsigned int refcount;
+	GIsiModem *modem;
+
+	/* Requests, for all resources */
+	struct {
+		int fd;
+		guint source;
+		uint8_t last[256]; /* last used transaction ID, by resource */
+	} reqs;
+
+	/* Indications, for all subscribed resources */
+	struct {
+		int fd;
+		guint source;
+		unsigned int count[256]; /* subscribed clients, by resource */
+	} inds;
+
+	GSList *clients[256]; /* by resource */
+	struct trace_channel *trace[256]; /* by resource */
+
+	GTimer *timer;
+	unsigned int wakeups;
+
+	gboolean dispatching;
+	GSList *destroyed; /* clients to free once dispatching is done */
+};
+typedef struct _GIsiDispatcher GIsiDispatcher;
+
 struct _GIsiClient {
 	uint8_t resource;
 	struct {
@@ -68,29 +115,47 @@ struct _GIsiClient {
 		int minor;
 	} version;
 	GIsiModem *modem;
+	GIsiDispatcher *dispatcher;
 	int error;
 
 	/* Requests */
 	struct {
-		int fd;
-		guint source;
-		unsigned int last; /* last used transaction ID */
-		void *pending;
+		unsigned int count;
+		GIsiRequest *pending[256]; /* by transaction ID */
 	} reqs;
 
 	/* Indications */
 	struct {
-		int fd;
-		guint source;
 		unsigned int count;
-		void *subs;
+		GIsiIndication subs[256]; /* by message type */
 	} inds;
 
+	/* Request timeouts */
+	struct {
+		guint source;
+		unsigned int now; /* last tick processed */
+		GIsiRequest *slots[G_ISI_WHEEL_SLOTS];
+	} wheel;
+
 	/* Debugging */
 	GIsiDebugFunc debug_func;
 	void *debug_data;
+
+	/* Statistics */
+	GTimer *timer;
+	GIsiClientStats stats;
+	unsigned int wakeup; /* last dispatcher wakeup with input */
+
+	gboolean dispatching;
+	gboolean destroyed;
 };
 
+/* Receive buffers, shared by all clients as dispatching never nests */
+static uint8_t *g_isi_pool;
+static unsigned int g_isi_pool_users;
+
+static GSList *g_isi_dispatchers;
+
 static gboolean g_isi_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer data);
 static gboolean g_isi_timeout(gpointer data);
@@ -103,6 +168,12 @@ static void g_isi_vdebug(const struct iovec *__restrict iov,
 	uint8_t *ptr = debug;
 	size_t i;
 
+	/* Nothing to gather for the usual single buffer */
+	if (iovlen == 1) {
+		func(iov[0].iov_base, total_len, data);
+		return;
+	}
+
 	for (i = 0; i < iovlen; i++) {
 		memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
 		ptr += iov[i].iov_len;
@@ -112,12 +183,161 @@ static void g_isi_vdebug(const struct iovec *__restrict iov,
 }
 
 
-static int g_isi_cmp(const void *a, const void *b)
+static gboolean g_isi_pool_ref(void)
 {
-	const unsigned int *ua = (const unsigned int *)a;
-	const unsigned int *ub = (const unsigned int *)b;
+	if (g_isi_pool == NULL) {
+		g_isi_pool = g_try_malloc(G_ISI_BATCH * PHONET_MAX_SDU);
+		if (g_isi_pool == NULL)
+			return FALSE;
+	}
 
-	return *ua - *ub;
+	g_isi_pool_users++;
+	return TRUE;
+}
+
+static void g_isi_pool_unref(void)
+{
+	if (--g_isi_pool_users > 0)
+		return;
+
+	g_free(g_isi_pool);
+	g_isi_pool = NULL;
+}
+
+static GIsiDispatcher *g_isi_dispatcher_ref(GIsiModem *modem)
+{
+	unsigned int ifindex = g_isi_modem_index(modem);
+	GIsiDispatcher *disp;
+	GIOChannel *channel;
+	GSList *l;
+
+	for (l = g_isi_dispatchers; l; l = l->next) {
+		disp = l->data;
+
+		if (disp->ifindex == ifindex) {
+			disp->refcount++;
+			return disp;
+		}
+	}
+
+	disp = g_try_new0(GIsiDispatcher, 1);
+	if (!disp) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (!g_isi_pool_ref()) {
+		g_free(disp);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* Responses carry the resource, so one socket serves them all */
+	channel = phonet_new(modem, 0);
+	if (!channel) {
+		g_isi_pool_unref();
+		g_free(disp);
+		return NULL;
+	}
+
+	disp->ifindex = ifindex;
+	disp->refcount = 1;
+	disp->modem = modem;
+	disp->timer = g_timer_new();
+
+	disp->reqs.fd = g_io_channel_unix_get_fd(channel);
+	disp->reqs.source = g_io_add_watch(channel,
+					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
+					g_isi_callback, disp);
+	g_io_channel_unref(channel);
+
+	g_isi_dispatchers = g_slist_prepend(g_isi_dispatchers, disp);
+
+	return disp;
+}
+
+static void g_isi_dispatcher_unref(GIsiDispatcher *disp)
+{
+	if (--disp->refcount > 0)
+		return;
+
+	g_isi_dispatchers = g_slist_remove(g_isi_dispatchers, disp);
+
+	if (disp->reqs.source > 0)
+		g_source_remove(disp->reqs.source);
+
+	if (disp->inds.source > 0)
+		g_source_remove(disp->inds.source);
+
+	g_timer_destroy(disp->timer);
+	g_isi_pool_unref();
+	g_free(disp);
+}
+
+/* Returns the request waiting for a response, whichever client made it */
+static GIsiRequest *g_isi_dispatcher_pending(GIsiDispatcher *disp,
+						uint8_t resource, uint8_t id)
+{
+	GIsiClient *client;
+	GSList *l;
+
+	for (l = disp->clients[resource]; l; l = l->next) {
+		client = l->data;
+
+		if (client->reqs.pending[id])
+			return client->reqs.pending[id];
+	}
+
+	return NULL;
+}
+
+/* Tells the modem all the resources we want indications from */
+static void g_isi_dispatcher_update(GIsiDispatcher *disp)
+{
+	uint8_t msg[3 + 256] = {
+		0, PNS_SUBSCRIBED_RESOURCES_IND,
+	};
+	unsigned int i;
+	unsigned int n;
+
+	for (i = 0, n = 0; i < G_N_ELEMENTS(disp->inds.count); i++)
+		if (disp->inds.count[i] > 0)
+			msg[3 + n++] = i;
+
+	/* An empty list unsubscribes */
+	msg[2] = n;
+
+	sendto(disp->inds.fd, msg, 3 + n, MSG_NOSIGNAL, (void *)&commgr,
+		sizeof(commgr));
+}
+
+static int g_isi_dispatcher_subscribe(GIsiDispatcher *disp, uint8_t resource)
+{
+	GIOChannel *channel;
+
+	if (disp->inds.source == 0) {
+		channel = phonet_new(disp->modem, PN_COMMGR);
+		if (!channel)
+			return errno;
+
+		disp->inds.fd = g_io_channel_unix_get_fd(channel);
+		disp->inds.source = g_io_add_watch(channel,
+					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
+					g_isi_callback, disp);
+		g_io_channel_unref(channel);
+	}
+
+	if (disp->inds.count[resource]++ == 0)
+		g_isi_dispatcher_update(disp);
+
+	return 0;
+}
+
+static void g_isi_dispatcher_unsubscribe(GIsiDispatcher *disp,
+						uint8_t resource)
+{
+	if (--disp->inds.count[resource] == 0)
+		g_isi_dispatcher_update(disp);
 }
 
 /**
@@ -127,8 +347,9 @@ static int g_isi_cmp(const void *a, const void *b)
  */
 GIsiClient *g_isi_client_create(GIsiModem *modem, uint8_t resource)
 {
+	GIsiDispatcher *disp;
 	GIsiClient *client;
-	GIOChannel *channel;
+	char name[8];
 
 	client  = g_try_new0(GIsiClient, 1);
 	if (!client) {
@@ -143,22 +364,27 @@ GIsiClient *g_isi_client_create(GIsiModem *modem, uint8_t resource)
 	client->error = 0;
 	client->debug_func = NULL;
 
-	client->reqs.last = 0;
-	client->reqs.pending = NULL;
-
+	client->reqs.count = 0;
 	client->inds.count = 0;
-	client->inds.subs = NULL;
 
-	channel = phonet_new(modem, resource);
-	if (!channel) {
+	disp = g_isi_dispatcher_ref(modem);
+	if (!disp) {
 		g_free(client);
 		return NULL;
 	}
-	client->reqs.fd = g_io_channel_unix_get_fd(channel);
-	client->reqs.source = g_io_add_watch(channel,
-					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
-					g_isi_callback, client);
-	g_io_channel_unref(channel);
+
+	/* Traffic is traced per resource, whichever client it is for */
+	if (!disp->clients[resource]) {
+		snprintf(name, sizeof(name), "isi%02x", resource);
+		disp->trace[resource] = trace_channel_new(name,
+							TRACE_FORMAT_HEX);
+	}
+
+	disp->clients[resource] = g_slist_prepend(disp->clients[resource],
+							client);
+
+	client->dispatcher = disp;
+	client->timer = g_timer_new();
 
 	return client;
 }
@@ -227,70 +453,89 @@ void g_isi_client_set_debug(GIsiClient *client, GIsiDebugFunc func,
 	client->debug_data = opaque;
 }
 
-static void g_isi_cleanup_req(void *data)
+static unsigned int g_isi_wheel_tick(GIsiClient *client)
 {
-	GIsiRequest *req = data;
+	return g_timer_elapsed(client->timer, NULL);
+}
 
-	if (!req)
-		return;
+static void g_isi_wheel_insert(GIsiClient *client, GIsiRequest *req,
+				unsigned timeout)
+{
+	GIsiRequest **slot;
 
-	/* Finalize any pending requests */
-	req->client->error = ESHUTDOWN;
-	if (req->func)
-		req->func(req->client, NULL, 0, 0, req->data);
-	req->client->error = 0;
+	/* Rounded up, so that a request never times out early */
+	req->expires = g_isi_wheel_tick(client) + timeout + 1;
+	slot = &client->wheel.slots[req->expires % G_ISI_WHEEL_SLOTS];
 
-	if (req->timeout > 0)
-		g_source_remove(req->timeout);
+	req->prev = NULL;
+	req->next = *slot;
+	if (*slot)
+		(*slot)->prev = req;
+	*slot = req;
 
-	g_free(req);
+	if (client->wheel.source > 0)
+		return;
+
+	client->wheel.now = g_isi_wheel_tick(client);
+	client->wheel.source = g_timeout_add_seconds(1, g_isi_timeout, client);
 }
 
-static void g_isi_cleanup_ind(void *data)
+static void g_isi_wheel_remove(GIsiClient *client, GIsiRequest *req)
 {
-	GIsiIndication *ind = data;
+	if (req->prev)
+		req->prev->next = req->next;
+	else
+		client->wheel.slots[req->expires % G_ISI_WHEEL_SLOTS] =
+								req->next;
 
-	if (!ind)
-		return;
+	if (req->next)
+		req->next->prev = req->prev;
 
-	g_free(ind);
+	req->next = NULL;
+	req->prev = NULL;
 }
 
-static int g_isi_indication_init(GIsiClient *client)
+/* Unlinks the request, so that it can be finalized safely */
+static void g_isi_request_unlink(GIsiRequest *req)
 {
-	GIOChannel *channel;
-	uint8_t msg[] = {
-		0, PNS_SUBSCRIBED_RESOURCES_IND,
-		1, client->resource,
-	};
+	GIsiClient *client = req->client;
 
-	channel = phonet_new(client->modem, PN_COMMGR);
-	if (!channel)
-		return errno;
+	client->reqs.pending[req->id] = NULL;
+	client->reqs.count--;
 
-	client->inds.fd = g_io_channel_unix_get_fd(channel);
+	g_isi_wheel_remove(client, req);
+}
 
-	/* Subscribe by sending an indication */
-	sendto(client->inds.fd, msg, 4, MSG_NOSIGNAL, (void *)&commgr,
-		sizeof(commgr));
-	client->inds.source = g_io_add_watch(channel,
-					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
-					g_isi_callback, client);
+static void g_isi_request_finish(GIsiRequest *req, int error)
+{
+	GIsiClient *client = req->client;
 
-	g_io_channel_unref(channel);
-	return 0;
+	g_isi_request_unlink(req);
+
+	client->error = error;
+	if (req->func)
+		req->func(client, NULL, 0, 0, req->data);
+	client->error = 0;
+
+	g_free(req);
 }
 
-static void g_isi_indication_deinit(GIsiClient *client)
+static void g_isi_client_free(GIsiClient *client)
 {
-	uint8_t msg[] = {
-		0, PNS_SUBSCRIBED_RESOURCES_IND,
-		0,
-	};
+	GIsiDispatcher *disp = client->dispatcher;
 
-	/* Unsubscribe by sending an empty subscribe indication */
-	sendto(client->inds.fd, msg, 3, MSG_NOSIGNAL, (void *)&commgr,
-		sizeof(commgr));
+	disp->clients[client->resource] =
+		g_slist_remove(disp->clients[client->resource], client);
+
+	if (!disp->clients[client->resource]) {
+		trace_channel_free(disp->trace[client->resource]);
+		disp->trace[client->resource] = NULL;
+	}
+
+	g_timer_destroy(client->timer);
+	g_free(client);
+
+	g_isi_dispatcher_unref(disp);
 }
 
 /**
@@ -299,20 +544,37 @@ static void g_isi_indication_deinit(GIsiClient *client)
  */
 void g_isi_client_destroy(GIsiClient *client)
 {
+	unsigned int i;
+
 	if (!client)
 		return;
 
-	tdestroy(client->reqs.pending, g_isi_cleanup_req);
-	tdestroy(client->inds.subs, g_isi_cleanup_ind);
+	/* Finalize any pending requests */
+	for (i = 0; i < G_N_ELEMENTS(client->reqs.pending); i++)
+		if (client->reqs.pending[i])
+			g_isi_request_finish(client->reqs.pending[i],
+						ESHUTDOWN);
 
-	if (client->reqs.source > 0)
-		g_source_remove(client->reqs.source);
+	if (client->wheel.source > 0)
+		g_source_remove(client->wheel.source);
 
-	if (client->inds.source > 0)
-		g_source_remove(client->inds.source);
+	if (client->inds.count > 0)
+		g_isi_dispatcher_unsubscribe(client->dispatcher,
+						client->resource);
 
-	g_isi_indication_deinit(client);
-	g_free(client);
+	client->destroyed = TRUE;
+
+	/* Freed once the dispatch loop we are called from unwinds */
+	if (client->dispatching)
+		return;
+
+	if (client->dispatcher->dispatching) {
+		client->dispatcher->destroyed =
+			g_slist_prepend(client->dispatcher->destroyed, client);
+		return;
+	}
+
+	g_isi_client_free(client);
 }
 
 /**
@@ -372,14 +634,28 @@ GIsiRequest *g_isi_request_vmake(GIsiClient *client,
 	size_t i, len;
 	uint8_t id;
 
+	GIsiDispatcher *disp;
 	GIsiRequest *req;
-	GIsiRequest **old;
 
 	if (!client) {
 		errno = EINVAL;
 		return NULL;
 	}
 
+	/* Transaction IDs are shared by the clients of a resource */
+	disp = client->dispatcher;
+	id = (disp->reqs.last[client->resource] + 1) % 255;
+
+	if (g_isi_dispatcher_pending(disp, client->resource, id)) {
+		/* FIXME: perhaps retry with randomized access after
+		 * initial miss. Although if the rate at which
+		 * requests are sent is so high that the transaction
+		 * ID wraps it's likely there is something wrong and
+		 * we might as well fail here. */
+		errno = EBUSY;
+		return NULL;
+	}
+
 	req = g_try_new0(GIsiRequest, 1);
 	if (!req) {
 		errno = ENOMEM;
@@ -387,29 +663,12 @@ GIsiRequest *g_isi_request_vmake(GIsiClient *client,
 	}
 
 	req->client = client;
-	req->id = (client->reqs.last + 1) % 255;
+	req->id = id;
 	req->func = cb;
 	req->data = opaque;
 
-	old = tsearch(req, &client->reqs.pending, g_isi_cmp);
-	if (!old) {
-		errno = ENOMEM;
-		goto error;
-	}
-
-	if (*old != req) {
-		/* FIXME: perhaps retry with randomized access after
-		 * initial miss. Although if the rate at which
-		 * requests are sent is so high that the transaction
-		 * ID wraps it's likely there is something wrong and
-		 * we might as well fail here. */
-		errno = EBUSY;
-		goto error;
-	}
-
 	dst.spn_resource = client->resource,
 
-	id = req->id;
 	_iov[0].iov_base = &id;
 	_iov[0].iov_len = 1;
 
@@ -418,11 +677,13 @@ GIsiRequest *g_isi_request_vmake(GIsiClient *client,
 		len += iov[i].iov_len;
 	}
 
+	trace_recordv(disp->trace[client->resource], FALSE, _iov, 1 + iovlen);
+
 	if (client->debug_func)
 		g_isi_vdebug(iov, iovlen, len - 1, client->debug_func,
 				client->debug_data);
 
-	ret = sendmsg(client->reqs.fd, &msg, MSG_NOSIGNAL);
+	ret = sendmsg(disp->reqs.fd, &msg, MSG_NOSIGNAL);
 	if (ret == -1)
 		goto error;
 
@@ -431,12 +692,14 @@ GIsiRequest *g_isi_request_vmake(GIsiClient *client,
 		goto error;
 	}
 
-	req->timeout = g_timeout_add_seconds(timeout, g_isi_timeout, req);
-	client->reqs.last = req->id;
+	client->reqs.pending[id] = req;
+	client->reqs.count++;
+	disp->reqs.last[client->resource] = id;
+
+	g_isi_wheel_insert(client, req, timeout);
 	return req;
 
 error:
-	tdelete(req, &client->reqs.pending, g_isi_cmp);
 	g_free(req);
 	return NULL;
 }
@@ -451,10 +714,7 @@ void g_isi_request_cancel(GIsiRequest *req)
 	if (!req)
 		return;
 
-	if (req->timeout > 0)
-		g_source_remove(req->timeout);
-
-	tdelete(req, &req->client->reqs.pending, g_isi_cmp);
+	g_isi_request_unlink(req);
 	g_free(req);
 }
 
@@ -472,43 +732,27 @@ int g_isi_subscribe(GIsiClient *client, uint8_t type,
 			GIsiIndicationFunc cb, void *data)
 {
 	GIsiIndication *ind;
-	GIsiIndication **old;
 
 	if (cb == NULL)
 		return -EINVAL;
 
-	ind = g_try_new0(GIsiIndication, 1);
-	if (!ind)
-		return -ENOMEM;
-
-	ind->type = type;
-
-	old = tsearch(ind, &client->inds.subs, g_isi_cmp);
-	if (!old) {
-		g_free(ind);
-		return -ENOMEM;
-	}
+	ind = &client->inds.subs[type];
 
 	/* FIXME: This overrides any existing subscription. We should
 	 * enable multiple subscriptions to a single indication in
 	 * order to allow efficient client sharing. */
-	if (*old != ind) {
-		g_free(ind);
-		ind = *old;
+	if (ind->func == NULL) {
+		if (client->inds.count == 0) {
+			int ret = g_isi_dispatcher_subscribe(client->dispatcher,
+							client->resource);
+			if (ret)
+				return ret;
+		}
+		client->inds.count++;
 	}
 
 	ind->func = cb;
 	ind->data = data;
-
-	if (client->inds.count == 0) {
-		int ret = g_isi_indication_init(client);
-		if (ret) {
-			tdelete(ind, &client->inds.subs, g_isi_cmp);
-			g_free(ind);
-			return ret;
-		}
-		client->inds.count++;
-	}
 	return 0;
 }
 
@@ -520,112 +764,228 @@ int g_isi_subscribe(GIsiClient *client, uint8_t type,
 void g_isi_unsubscribe(GIsiClient *client, uint8_t type)
 {
 	GIsiIndication *ind;
-	unsigned int id = type;
 
 	if (!client)
 		return;
 
-	ind = tdelete(&id, &client->inds.subs, g_isi_cmp);
-	if (!ind)
+	ind = &client->inds.subs[type];
+	if (ind->func == NULL)
 		return;
 
+	ind->func = NULL;
+	ind->data = NULL;
+
 	if (--client->inds.count == 0)
-		g_isi_indication_deinit(client);
+		g_isi_dispatcher_unsubscribe(client->dispatcher,
+						client->resource);
+}
+
+/* Accounts a message once it has been dispatched to @a client */
+static void g_isi_client_account(GIsiClient *client, gdouble start)
+{
+	GIsiDispatcher *disp = client->dispatcher;
+	unsigned int latency;
+
+	/* Includes waiting behind the rest of the batch */
+	latency = (g_timer_elapsed(disp->timer, NULL) - start) * 1000000;
+
+	if (client->wakeup != disp->wakeups) {
+		client->wakeup = disp->wakeups;
+		client->stats.wakeups++;
+	}
 
-	g_free(ind);
+	client->stats.messages++;
+	client->stats.dispatch_usec += latency;
+
+	if (latency > client->stats.dispatch_max_usec)
+		client->stats.dispatch_max_usec = latency;
 }
 
 static void g_isi_dispatch_indication(GIsiClient *client, uint16_t obj,
 					uint8_t *msg, size_t len)
 {
-	void *ret;
-	GIsiIndication *ind;
-	unsigned type = msg[0];
+	GIsiIndication *ind = &client->inds.subs[msg[0]];
 
-	ret = tfind(&type, &client->inds.subs, g_isi_cmp);
-	if (!ret)
-		return;
-
-	ind = *(GIsiIndication **)ret;
+	if (client->debug_func)
+		client->debug_func(msg, len, client->debug_data);
 
 	if (ind->func)
 		ind->func(client, msg, len, obj, ind->data);
 }
 
-static void g_isi_dispatch_response(GIsiClient *client, uint16_t obj,
+static void g_isi_dispatch_response(GIsiRequest *req, uint16_t obj,
 					uint8_t *msg, size_t len)
 {
-	void *ret;
+	GIsiClient *client = req->client;
+
+	if (client->debug_func)
+		client->debug_func(msg + 1, len - 1, client->debug_data);
+
+	if (req->func && !req->func(client, msg + 1, len - 1, obj, req->data))
+		return;
+
+	/* The callback may have destroyed the client, and the request */
+	if (!client->destroyed)
+		g_isi_request_cancel(req);
+}
+
+static void g_isi_dispatch(GIsiDispatcher *disp, int fd,
+				const struct phonet_msg *pm, gdouble start)
+{
+	uint8_t *msg = pm->buf;
+	GIsiClient *client;
 	GIsiRequest *req;
-	unsigned id = msg[0];
-
-	ret = tfind(&id, &client->reqs.pending, g_isi_cmp);
-	if (!ret) {
-		/* This could either be an unsolicited response, which
-		 * we will ignore, or an incoming request, which we
-		 * handle just like an incoming indication */
-		g_isi_dispatch_indication(client, obj, msg + 1, len - 1);
+	GSList *l;
+
+	if (pm->len < 2)
 		return;
+
+	trace_record(disp->trace[pm->res], TRUE, msg, pm->len);
+
+	if (fd == disp->reqs.fd) {
+		req = g_isi_dispatcher_pending(disp, pm->res, msg[0]);
+		if (req) {
+			client = req->client;
+			g_isi_dispatch_response(req, pm->obj, msg, pm->len);
+			g_isi_client_account(client, start);
+			return;
+		}
 	}
 
-	req = *(GIsiRequest **)ret;
+	/* Transaction field at first byte is discarded with indications.
+	 * Unsolicited responses, which we will ignore, and incoming
+	 * requests are handled just like incoming indications. */
+	for (l = disp->clients[pm->res]; l; l = l->next) {
+		client = l->data;
 
-	if (!req->func || req->func(client, msg + 1, len - 1, obj, req->data))
-		g_isi_request_cancel(req);
+		if (client->destroyed)
+			continue;
+
+		g_isi_dispatch_indication(client, pm->obj, msg + 1,
+						pm->len - 1);
+		g_isi_client_account(client, start);
+	}
 }
 
-/* Data callback for both responses and indications */
+/* Frees the clients destroyed while dispatching, and maybe @a disp too */
+static gboolean g_isi_dispatcher_sweep(GIsiDispatcher *disp)
+{
+	GIsiClient *client;
+	gboolean last;
+
+	while (disp->destroyed) {
+		client = disp->destroyed->data;
+		disp->destroyed = g_slist_delete_link(disp->destroyed,
+							disp->destroyed);
+
+		last = disp->refcount == 1;
+		g_isi_client_free(client);
+
+		if (last)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Data callback for both responses and indications.  Drains the socket
+ * a batch at a time, up to G_ISI_BUDGET messages so that a flood on one
+ * resource does not starve the rest of the main loop.  Clients destroyed
+ * meanwhile are only skipped, and freed once the loop is done.
+ */
 static gboolean g_isi_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
-	GIsiClient *client = data;
+	GIsiDispatcher *disp = data;
 	int fd = g_io_channel_unix_get_fd(channel);
-	int len;
+	struct phonet_msg msgs[G_ISI_BATCH];
+	gdouble start;
+	int total = 0;
+	int count;
+	int i;
 
 	if (cond & (G_IO_NVAL|G_IO_HUP)) {
 		g_warning("Unexpected event on Phonet channel %p", channel);
+
+		if (fd == disp->reqs.fd)
+			disp->reqs.source = 0;
+		else
+			disp->inds.source = 0;
+
 		return FALSE;
 	}
 
-	len = phonet_peek_length(channel);
+	for (i = 0; i < G_ISI_BATCH; i++)
+		msgs[i].buf = g_isi_pool + i * PHONET_MAX_SDU;
 
-	if (len > 0) {
-		uint32_t buf[(len + 3) / 4];
-		uint8_t *msg;
-		uint16_t obj;
-		uint8_t res;
+	disp->wakeups++;
+	disp->dispatching = TRUE;
 
-		len = phonet_read(channel, buf, len, &obj, &res);
-		if (len < 2 || res != client->resource)
-			return TRUE;
+	while (total < G_ISI_BUDGET) {
+		count = phonet_read_batch(channel, msgs, G_ISI_BATCH);
+		if (count <= 0)
+			break;
 
-		msg = (uint8_t *)buf;
+		start = g_timer_elapsed(disp->timer, NULL);
 
-		if (client->debug_func)
-			client->debug_func(msg + 1, len - 1,
-						client->debug_data);
+		for (i = 0; i < count; i++)
+			g_isi_dispatch(disp, fd, &msgs[i], start);
 
-		if (fd == client->reqs.fd)
-			g_isi_dispatch_response(client, obj, msg, len);
-		else
-			/* Transaction field at first byte is
-			 * discarded with indications */
-			g_isi_dispatch_indication(client, obj, msg + 1,
-							len - 1);
+		total += count;
+
+		if (count < G_ISI_BATCH)
+			break;
 	}
-	return TRUE;
+
+	disp->dispatching = FALSE;
+
+	return g_isi_dispatcher_sweep(disp);
 }
 
+/*
+ * Timer wheel callback, run every second while requests are pending.
+ * Catches up on any ticks missed while the main loop was busy.
+ */
 static gboolean g_isi_timeout(gpointer data)
 {
-	GIsiRequest *req = data;
+	GIsiClient *client = data;
+	unsigned int now = g_isi_wheel_tick(client);
+	unsigned int ticks = MIN(now - client->wheel.now, G_ISI_WHEEL_SLOTS);
+	GIsiRequest *req;
+	unsigned int slot;
 
-	req->client->error = ETIMEDOUT;
-	if (req->func)
-		req->func(req->client, NULL, 0, 0, req->data);
-	req->client->error = 0;
+	client->wheel.now = now;
+	client->dispatching = TRUE;
+
+	for (; ticks > 0; ticks--) {
+		slot = (now - ticks + 1) % G_ISI_WHEEL_SLOTS;
+		req = client->wheel.slots[slot];
+
+		while (req) {
+			if (req->expires > now) {
+				req = req->next;
+				continue;
+			}
+
+			g_isi_request_finish(req, ETIMEDOUT);
 
-	g_isi_request_cancel(req);
+			if (client->destroyed) {
+				g_isi_client_free(client);
+				return FALSE;
+			}
+
+			/* The callback may have cancelled other requests */
+			req = client->wheel.slots[slot];
+		}
+	}
+
+	client->dispatching = FALSE;
+
+	if (client->reqs.count > 0)
+		return TRUE;
+
+	client->wheel.source = 0;
 	return FALSE;
 }
 
@@ -633,3 +993,20 @@ int g_isi_client_error(const GIsiClient *client)
 {
 	return -client->error;
 }
+
+/**
+ * Returns message counts and dispatch latencies for @a client, from
+ * which message rates for the resource follow.
+ * @param client client for the resource
+ * @param stats filled in with the statistics
+ */
+void g_isi_client_stats(GIsiClient *client, GIsiClientStats *stats)
+{
+	if (!client) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	*stats = client->stats;
+	stats->elapsed_usec = g_timer_elapsed(client->timer, NULL) * 1000000;
+}
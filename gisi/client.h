@@ -35,6 +35,15 @@ typedef struct _GIsiClient GIsiClient;
 struct _GIsiRequest;
 typedef struct _GIsiRequest GIsiRequest;
 
+struct _GIsiClientStats {
+	unsigned int wakeups;		/* Main loop wakeups with input */
+	unsigned int messages;		/* Messages dispatched */
+	uint64_t dispatch_usec;		/* Sum of dispatch latencies */
+	unsigned int dispatch_max_usec;	/* Worst dispatch latency */
+	uint64_t elapsed_usec;		/* Since the client was created */
+};
+typedef struct _GIsiClientStats GIsiClientStats;
+
 typedef void (*GIsiVerifyFunc)(GIsiClient *client, gboolean alive,
 				uint16_t object, void *opaque);
 
@@ -64,6 +73,8 @@ void g_isi_client_destroy(GIsiClient *client);
 
 int g_isi_client_error(const GIsiClient *client);
 
+void g_isi_client_stats(GIsiClient *client, GIsiClientStats *stats);
+
 GIsiRequest *g_isi_request_make(GIsiClient *client, const void *data,
 				size_t len, unsigned timeout,
 				GIsiResponseFunc func, void *opaque);
@@ -25,7 +25,10 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -97,3 +100,89 @@ ssize_t phonet_read(GIOChannel *channel, void *restrict buf, size_t len,
 		*res = addr.spn_resource;
 	return ret;
 }
+
+#define PHONET_BATCH_MAX 16
+
+static int phonet_read_each(int fd, struct phonet_msg *msgs, unsigned count)
+{
+	struct sockaddr_pn addr;
+	socklen_t addrlen;
+	ssize_t ret;
+	unsigned i;
+
+	for (i = 0; i < count; i++) {
+		addrlen = sizeof(addr);
+
+		ret = recvfrom(fd, msgs[i].buf, PHONET_MAX_SDU, MSG_DONTWAIT,
+				(void *)&addr, &addrlen);
+		if (ret == -1)
+			break;
+
+		msgs[i].len = ret;
+		msgs[i].obj = (addr.spn_dev << 8) | addr.spn_obj;
+		msgs[i].res = addr.spn_resource;
+	}
+
+	if (i == 0 && errno != EAGAIN)
+		return -1;
+
+	return i;
+}
+
+/*
+ * Reads whatever is queued on the socket without blocking, at most count
+ * datagrams and in as few system calls as the kernel allows.  Returns the
+ * number of datagrams read, or -1 on error.
+ */
+int phonet_read_batch(GIOChannel *channel, struct phonet_msg *msgs,
+			unsigned count)
+{
+	int fd = g_io_channel_unix_get_fd(channel);
+#ifdef MSG_WAITFORONE
+	static gboolean unsupported = FALSE;
+	struct mmsghdr hdr[PHONET_BATCH_MAX];
+	struct iovec iov[PHONET_BATCH_MAX];
+	struct sockaddr_pn addr[PHONET_BATCH_MAX];
+	int ret;
+	int i;
+
+	if (count > PHONET_BATCH_MAX)
+		count = PHONET_BATCH_MAX;
+
+	if (unsupported)
+		return phonet_read_each(fd, msgs, count);
+
+	memset(hdr, 0, count * sizeof(struct mmsghdr));
+
+	for (i = 0; i < (int) count; i++) {
+		iov[i].iov_base = msgs[i].buf;
+		iov[i].iov_len = PHONET_MAX_SDU;
+		hdr[i].msg_hdr.msg_name = &addr[i];
+		hdr[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		hdr[i].msg_hdr.msg_iov = &iov[i];
+		hdr[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	ret = recvmmsg(fd, hdr, count, MSG_DONTWAIT, NULL);
+	if (ret == -1) {
+		if (errno == EAGAIN)
+			return 0;
+
+		if (errno != ENOSYS)
+			return -1;
+
+		unsupported = TRUE;
+		return phonet_read_each(fd, msgs, count);
+	}
+
+	for (i = 0; i < ret; i++) {
+		msgs[i].len = hdr[i].msg_len;
+		msgs[i].obj = (addr[i].spn_dev << 8) | addr[i].spn_obj;
+		msgs[i].res = addr[i].spn_resource;
+	}
+
+	return ret;
+#else
+	return phonet_read_each(fd, msgs, count);
+#endif
+}
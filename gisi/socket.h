@@ -23,7 +23,19 @@
 
 #include "modem.h"
 
+/* Room for any Phonet datagram, the length field being 16 bits */
+#define PHONET_MAX_SDU 65536
+
+struct phonet_msg {
+	void *buf;		/* PHONET_MAX_SDU bytes, set by caller */
+	size_t len;
+	uint16_t obj;
+	uint8_t res;
+};
+
 GIOChannel *phonet_new(GIsiModem *, uint8_t resource);
 size_t phonet_peek_length(GIOChannel *io);
 ssize_t phonet_read(GIOChannel *io, void *restrict buf, size_t len,
 			uint16_t *restrict obj, uint8_t *restrict res);
+int phonet_read_batch(GIOChannel *io, struct phonet_msg *msgs,
+			unsigned count);
@@ -67,6 +67,7 @@ struct ofono_cbs {
 	GSList *efcbmir_contents;
 	unsigned short efcbmid_length;
 	GSList *efcbmid_contents;
+	struct cbs_topic_filter *efcbmid_filter;
 	guint reset_source;
 	int lac;
 	int ci;
@@ -190,7 +191,8 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 		return;
 	}
 
-	if (cbs_topic_in_range(c.message_identifier, cbs->efcbmid_contents)) {
+	if (cbs_topic_filter_match(cbs->efcbmid_filter,
+					c.message_identifier)) {
 		if (cbs->stk)
 			__ofono_cbs_sim_download(cbs->stk, &c);
 		return;
@@ -591,6 +593,9 @@ static void cbs_unregister(struct ofono_atom *atom)
 		cbs->efcbmid_contents = NULL;
 	}
 
+	cbs_topic_filter_free(cbs->efcbmid_filter);
+	cbs->efcbmid_filter = NULL;
+
 	cbs->sim = NULL;
 	cbs->stk = NULL;
 
@@ -860,6 +865,9 @@ static void sim_cbmid_read_cb(int ok, int length, int record,
 
 	cbs->efcbmid_contents = g_slist_reverse(contents);
 
+	cbs_topic_filter_free(cbs->efcbmid_filter);
+	cbs->efcbmid_filter = cbs_topic_filter_new(cbs->efcbmid_contents);
+
 	str = cbs_topic_ranges_to_string(cbs->efcbmid_contents);
 	DBG("Got cbmid: %s", str);
 	g_free(str);
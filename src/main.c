@@ -37,11 +37,18 @@
 #endif
 
 #include "ofono.h"
+#include "storage.h"
+#include "tracebuffer.h"
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
+/* Most recent modem traffic, dumped to the log on SIGUSR1 */
+#define TRACE_BUFFER_SIZE (256 * 1024)
+
 static GMainLoop *event_loop;
 
+static struct trace_buffer *trace_buffer;
+
 void __ofono_exit()
 {
 	g_main_loop_quit(event_loop);
@@ -53,6 +60,23 @@ static gboolean quit_eventloop(gpointer user_data)
 	return FALSE;
 }
 
+static void trace_print(const char *str, void *user_data)
+{
+	ofono_info("%s", str);
+}
+
+static void trace_dump(void)
+{
+	if (trace_buffer == NULL)
+		return;
+
+	ofono_info("Trace of %u records, %u dropped before",
+			trace_buffer_len(trace_buffer),
+			trace_buffer_dropped(trace_buffer));
+
+	trace_buffer_dump(trace_buffer, trace_print, NULL);
+}
+
 static gboolean signal_cb(GIOChannel *channel, GIOCondition cond, gpointer data)
 {
 	static int terminated = 0;
@@ -78,6 +102,9 @@ static gboolean signal_cb(GIOChannel *channel, GIOCondition cond, gpointer data)
 
 		terminated++;
 		break;
+	case SIGUSR1:
+		trace_dump();
+		break;
 	default:
 		break;
 	}
@@ -137,6 +164,7 @@ int main(int argc, char **argv)
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGTERM);
 	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGUSR1);
 
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
 		perror("Can't set signal mask");
@@ -200,6 +228,9 @@ int main(int argc, char **argv)
 
 	__ofono_log_init(option_debug, option_detach);
 
+	trace_buffer = trace_buffer_new(TRACE_BUFFER_SIZE);
+	trace_set_buffer(trace_buffer);
+
 	dbus_error_init(&error);
 
 	conn = g_dbus_setup_bus(DBUS_BUS_SYSTEM, OFONO_SERVICE, &error);
@@ -228,12 +259,17 @@ int main(int argc, char **argv)
 
 	__ofono_plugin_cleanup();
 
+	/* Settings still open past this point would lose delayed writes */
+	storage_flush_all();
+
 	__ofono_manager_cleanup();
 
 	__ofono_dbus_cleanup();
 	dbus_connection_unref(conn);
 
 cleanup:
+	trace_buffer_free(trace_buffer);
+
 	g_source_remove(signal_source);
 	g_main_loop_unref(event_loop);
 
@@ -43,11 +43,6 @@
 #include "simutil.h"
 #include "storage.h"
 
-#define SIM_CACHE_MODE 0600
-#define SIM_CACHE_PATH STORAGEDIR "/%s-%i/%04x"
-#define SIM_CACHE_PATH_LEN(imsilen) (strlen(SIM_CACHE_PATH) - 3 + imsilen)
-#define SIM_CACHE_HEADER_SIZE 6
-
 static GSList *g_drivers = NULL;
 
 static gboolean sim_op_next(gpointer user_data);
@@ -84,6 +79,7 @@ struct ofono_sim {
 	char **language_prefs;
 	GQueue *simop_q;
 	gint simop_source;
+	struct sim_cache *cache;
 	unsigned char efmsisdn_length;
 	unsigned char efmsisdn_records;
 	unsigned char *efli;
@@ -252,6 +248,7 @@ static char **get_service_numbers(GSList *service_numbers)
 
 static void sim_file_op_free(struct sim_file_op *node)
 {
+	g_free(node->buffer);
 	g_free(node);
 }
 
@@ -1395,29 +1392,13 @@ static void sim_op_error(struct ofono_sim *sim)
 	sim_file_op_free(op);
 }
 
-static gboolean cache_record(const char *path, int current, int record_len,
-				const unsigned char *data)
+/* The cache only exists once the IMSI is known */
+static struct sim_cache *sim_get_cache(struct ofono_sim *sim)
 {
-	int r = 0;
-	int fd;
-
-	fd = TFR(open(path, O_WRONLY));
-
-	if (fd == -1)
-		return FALSE;
-
-	if (lseek(fd, (current - 1) * record_len +
-				SIM_CACHE_HEADER_SIZE, SEEK_SET) != (off_t) -1)
-		r = TFR(write(fd, data, record_len));
-
-	TFR(close(fd));
+	if (sim->cache == NULL && sim->imsi)
+		sim->cache = sim_cache_new(sim->imsi, sim->phase);
 
-	if (r < record_len) {
-		unlink(path);
-		return FALSE;
-	}
-
-	return TRUE;
+	return sim->cache;
 }
 
 static void sim_op_retrieve_cb(const struct ofono_error *error,
@@ -1427,7 +1408,6 @@ static void sim_op_retrieve_cb(const struct ofono_error *error,
 	struct sim_file_op *op = g_queue_peek_head(sim->simop_q);
 	int total = op->length / op->record_length;
 	ofono_sim_file_read_cb_t cb = op->cb;
-	char *imsi = sim->imsi;
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		sim_op_error(sim);
@@ -1436,14 +1416,17 @@ static void sim_op_retrieve_cb(const struct ofono_error *error,
 
 	cb(1, op->length, op->current, data, op->record_length, op->userdata);
 
-	if (op->cache && imsi) {
-		char *path = g_strdup_printf(SIM_CACHE_PATH,
-						imsi, sim->phase, op->id);
+	/* Records are collected and the whole EF cached in one go */
+	if (op->cache && len == op->record_length)
+		memcpy((unsigned char *) op->buffer +
+				(op->current - 1) * op->record_length,
+				data, op->record_length);
+	else
+		op->cache = FALSE;
 
-		op->cache = cache_record(path, op->current, op->record_length,
-						data);
-		g_free(path);
-	}
+	if (op->cache && op->current == total)
+		sim_cache_store(sim_get_cache(sim), op->id, op->structure,
+				op->length, op->record_length, op->buffer);
 
 	if (op->current == total) {
 		op = g_queue_pop_head(sim->simop_q);
@@ -1509,7 +1492,6 @@ static void sim_op_info_cb(const struct ofono_error *error, int length,
 {
 	struct ofono_sim *sim = data;
 	struct sim_file_op *op = g_queue_peek_head(sim->simop_q);
-	char *imsi = sim->imsi;
 	enum sim_file_access update;
 	enum sim_file_access invalidate;
 	enum sim_file_access rehabilitate;
@@ -1550,20 +1532,12 @@ static void sim_op_info_cb(const struct ofono_error *error, int length,
 
 	sim->simop_source = g_timeout_add(0, sim_op_retrieve_next, sim);
 
-	if (op->cache && imsi) {
-		unsigned char fileinfo[6];
-
-		fileinfo[0] = error->type;
-		fileinfo[1] = length >> 8;
-		fileinfo[2] = length & 0xff;
-		fileinfo[3] = structure;
-		fileinfo[4] = record_length >> 8;
-		fileinfo[5] = record_length & 0xff;
+	if (op->cache && sim->imsi && op->record_length > 0 &&
+			op->length >= op->record_length)
+		op->buffer = g_try_malloc(op->length);
 
-		if (write_file(fileinfo, 6, SIM_CACHE_MODE, SIM_CACHE_PATH,
-					imsi, sim->phase, op->id) != 6)
-			op->cache = FALSE;
-	}
+	if (op->buffer == NULL)
+		op->cache = FALSE;
 }
 
 static void sim_op_write_cb(const struct ofono_error *error, void *data)
@@ -1585,88 +1559,35 @@ static void sim_op_write_cb(const struct ofono_error *error, void *data)
 
 static gboolean sim_op_check_cached(struct ofono_sim *sim)
 {
-	char *imsi = sim->imsi;
 	struct sim_file_op *op = g_queue_peek_head(sim->simop_q);
 	ofono_sim_file_read_cb_t cb = op->cb;
-	char *path;
-	int fd;
-	unsigned char fileinfo[SIM_CACHE_HEADER_SIZE];
-	ssize_t len;
-	int error_type;
-	unsigned int file_length;
-	enum ofono_sim_file_structure structure;
-	unsigned int record_length;
-	unsigned int record;
-	guint8 *buffer = NULL;
-	gboolean ret = FALSE;
-
-	if (!imsi)
-		return FALSE;
-
-	path = g_strdup_printf(SIM_CACHE_PATH, imsi, sim->phase, op->id);
+	const struct sim_cache_file *file;
+	int record_length;
+	int record;
 
-	if (path == NULL)
+	file = sim_cache_lookup(sim_get_cache(sim), op->id);
+	if (file == NULL)
 		return FALSE;
 
-	fd = TFR(open(path, O_RDONLY));
-	g_free(path);
+	record_length = file->record_length;
 
-	if (fd == -1) {
-		if (errno != ENOENT)
-			DBG("Error %i opening cache file for "
-					"fileid %04x, IMSI %s",
-					errno, op->id, imsi);
+	if (file->structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+		record_length = file->length;
 
+	if (record_length == 0 || file->length < record_length)
 		return FALSE;
-	}
 
-	len = TFR(read(fd, fileinfo, SIM_CACHE_HEADER_SIZE));
-
-	if (len != SIM_CACHE_HEADER_SIZE)
-		goto cleanup;
-
-	error_type = fileinfo[0];
-	file_length = (fileinfo[1] << 8) | fileinfo[2];
-	structure = fileinfo[3];
-	record_length = (fileinfo[4] << 8) | fileinfo[5];
-
-	if (structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
-		record_length = file_length;
-
-	if (record_length == 0 || file_length < record_length)
-		goto cleanup;
-
-	if (error_type != OFONO_ERROR_TYPE_NO_ERROR ||
-			structure != op->structure) {
-		ret = TRUE;
+	if (file->structure != (int) op->structure) {
 		cb(0, 0, 0, 0, 0, op->userdata);
-		goto cleanup;
+		return TRUE;
 	}
 
-	buffer = g_try_malloc(file_length);
-
-	if (buffer == NULL)
-		goto cleanup;
-
-	len = TFR(read(fd, buffer, file_length));
-
-	if (len < (ssize_t)file_length)
-		goto cleanup;
-
-	for (record = 0; record < file_length / record_length; record++) {
-		cb(1, file_length, record + 1, &buffer[record * record_length],
+	for (record = 0; record < file->length / record_length; record++)
+		cb(1, file->length, record + 1,
+			&file->data[record * record_length],
 			record_length, op->userdata);
-	}
-
-	ret = TRUE;
-
-cleanup:
-	if (buffer)
-		g_free(buffer);
 
-	TFR(close(fd));
-
-	return ret;
+	return TRUE;
 }
 
 static gboolean sim_op_next(gpointer user_data)
@@ -1716,8 +1637,6 @@ static gboolean sim_op_next(gpointer user_data)
 			ofono_error("Unrecognized file structure, "
 					"this can't happen");
 		}
-
-		g_free(op->buffer);
 	}
 
 	return FALSE;
@@ -1798,6 +1717,9 @@ int ofono_sim_write(struct ofono_sim *sim, int id,
 	if (fn == NULL)
 		return -1;
 
+	/* Whatever ends up on the SIM, the cached copy is stale */
+	sim_cache_remove(sim_get_cache(sim), id);
+
 	if (!sim->simop_q)
 		sim->simop_q = g_queue_new();
 
@@ -1889,6 +1811,11 @@ static void sim_free_state(struct ofono_sim *sim)
 		sim->imsi = NULL;
 	}
 
+	if (sim->cache) {
+		sim_cache_free(sim->cache);
+		sim->cache = NULL;
+	}
+
 	if (sim->own_numbers) {
 		g_slist_foreach(sim->own_numbers, (GFunc)g_free, NULL);
 		g_slist_free(sim->own_numbers);
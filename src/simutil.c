@@ -25,6 +25,10 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 
@@ -32,6 +36,15 @@
 #include "simutil.h"
 #include "util.h"
 #include "smsutil.h"
+#include "storage.h"
+
+#define SIM_CACHE_DIR "%s/%s-%i"
+#define SIM_CACHE_PATH SIM_CACHE_DIR "/cache"
+#define SIM_CACHE_MODE 0600
+#define SIM_CACHE_MAGIC "OSC1"
+#define SIM_CACHE_MAGIC_LEN 4
+#define SIM_CACHE_HEADER_LEN 12	/* id, structure, flags, lengths, CRC */
+#define SIM_CACHE_REMOVED 0x01
 
 struct sim_eons {
 	struct sim_eons_operator_info *pnn_list;
@@ -1416,3 +1429,385 @@ gboolean sim_parse_2g_get_response(const unsigned char *response, int len,
 
 	return TRUE;
 }
+
+struct sim_cache_entry {
+	struct sim_cache_file file;
+	unsigned char *copy;		/* Stored since the file was mapped */
+};
+
+/*
+ * The cache is a single file of EFs, each with a header and CRC, where a
+ * later copy of an EF replaces an earlier one.  It is mapped once when
+ * opened and entries point straight into the mapping.
+ */
+struct sim_cache {
+	char *path;
+	int fd;
+	unsigned char *map;
+	size_t map_len;
+	size_t end;			/* Where the next EF goes */
+	size_t dead;			/* Bytes of replaced EFs */
+	gboolean rewrite;		/* File no longer matches entries */
+	GHashTable *entries;
+};
+
+static void sim_cache_entry_free(gpointer data)
+{
+	struct sim_cache_entry *entry = data;
+
+	g_free(entry->copy);
+	g_free(entry);
+}
+
+static size_t sim_cache_entry_size(const struct sim_cache_entry *entry)
+{
+	return SIM_CACHE_HEADER_LEN + entry->file.length;
+}
+
+static void sim_cache_header(unsigned char *header, int id, guint8 flags,
+				const struct sim_cache_file *file)
+{
+	guint32 crc = storage_crc32(file->data, file->length);
+
+	header[0] = id >> 8;
+	header[1] = id & 0xff;
+	header[2] = file->structure;
+	header[3] = flags;
+	header[4] = file->length >> 8;
+	header[5] = file->length & 0xff;
+	header[6] = file->record_length >> 8;
+	header[7] = file->record_length & 0xff;
+	header[8] = crc >> 24;
+	header[9] = (crc >> 16) & 0xff;
+	header[10] = (crc >> 8) & 0xff;
+	header[11] = crc & 0xff;
+}
+
+static void sim_cache_replace(struct sim_cache *cache, int id,
+				struct sim_cache_entry *entry)
+{
+	struct sim_cache_entry *old;
+
+	old = g_hash_table_lookup(cache->entries, GINT_TO_POINTER(id));
+	if (old)
+		cache->dead += sim_cache_entry_size(old);
+
+	if (entry)
+		g_hash_table_replace(cache->entries, GINT_TO_POINTER(id),
+					entry);
+	else
+		g_hash_table_remove(cache->entries, GINT_TO_POINTER(id));
+}
+
+static size_t sim_cache_scan(struct sim_cache *cache)
+{
+	struct sim_cache_entry *entry;
+	const unsigned char *p;
+	size_t offset = SIM_CACHE_MAGIC_LEN;
+	size_t len;
+	guint32 crc;
+	int id;
+
+	while (cache->map_len - offset >= SIM_CACHE_HEADER_LEN) {
+		p = cache->map + offset;
+		len = (p[4] << 8) | p[5];
+
+		if (cache->map_len - offset - SIM_CACHE_HEADER_LEN < len)
+			break;
+
+		crc = ((guint32) p[8] << 24) | (p[9] << 16) |
+			(p[10] << 8) | p[11];
+
+		if (storage_crc32(p + SIM_CACHE_HEADER_LEN, len) != crc)
+			break;
+
+		id = (p[0] << 8) | p[1];
+
+		if (p[3] & SIM_CACHE_REMOVED) {
+			sim_cache_replace(cache, id, NULL);
+			cache->dead += SIM_CACHE_HEADER_LEN + len;
+		} else {
+			entry = g_new0(struct sim_cache_entry, 1);
+			entry->file.structure = p[2];
+			entry->file.length = len;
+			entry->file.record_length = (p[6] << 8) | p[7];
+			entry->file.data = p + SIM_CACHE_HEADER_LEN;
+
+			sim_cache_replace(cache, id, entry);
+		}
+
+		offset += SIM_CACHE_HEADER_LEN + len;
+	}
+
+	return offset;
+}
+
+/* Cache files from before the container, one file per EF */
+static void sim_cache_remove_legacy(const char *imsi, int phase)
+{
+	char *dir = g_strdup_printf(SIM_CACHE_DIR, storage_get_root(),
+					imsi, phase);
+	struct dirent **entries;
+	const char *name;
+	char *path;
+	int len;
+
+	len = scandir(dir, &entries, NULL, alphasort);
+
+	if (len < 0)
+		goto out;
+
+	while (len--) {
+		name = entries[len]->d_name;
+
+		if (strlen(name) == 4 &&
+				strspn(name, "0123456789abcdef") == 4) {
+			path = g_strdup_printf("%s/%s", dir, name);
+			unlink(path);
+			g_free(path);
+		}
+
+		free(entries[len]);
+	}
+
+	free(entries);
+
+out:
+	g_free(dir);
+}
+
+struct sim_cache *sim_cache_new(const char *imsi, int phase)
+{
+	struct sim_cache *cache;
+	struct stat st;
+	size_t valid;
+
+	cache = g_try_new0(struct sim_cache, 1);
+	if (cache == NULL)
+		return NULL;
+
+	cache->fd = -1;
+	cache->path = g_strdup_printf(SIM_CACHE_PATH, storage_get_root(),
+					imsi, phase);
+	cache->entries = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, sim_cache_entry_free);
+
+	if (create_dirs(cache->path, SIM_CACHE_MODE | S_IXUSR) != 0)
+		goto error;
+
+	cache->fd = TFR(open(cache->path, O_RDWR | O_CREAT, SIM_CACHE_MODE));
+	if (cache->fd == -1)
+		goto error;
+
+	if (fstat(cache->fd, &st) == -1)
+		goto error;
+
+	if (st.st_size > 0) {
+		cache->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED,
+					cache->fd, 0);
+		if (cache->map == MAP_FAILED) {
+			cache->map = NULL;
+			goto error;
+		}
+
+		cache->map_len = st.st_size;
+	}
+
+	if (cache->map_len < SIM_CACHE_MAGIC_LEN ||
+			memcmp(cache->map, SIM_CACHE_MAGIC,
+				SIM_CACHE_MAGIC_LEN)) {
+		if (ftruncate(cache->fd, 0) == -1 ||
+				TFR(write(cache->fd, SIM_CACHE_MAGIC,
+					SIM_CACHE_MAGIC_LEN)) !=
+					SIM_CACHE_MAGIC_LEN)
+			goto error;
+
+		sim_cache_remove_legacy(imsi, phase);
+
+		cache->end = SIM_CACHE_MAGIC_LEN;
+
+		return cache;
+	}
+
+	valid = sim_cache_scan(cache);
+
+	/* Drop a torn EF at the end, new ones are written over it */
+	if (valid != cache->map_len && ftruncate(cache->fd, valid) == -1)
+		goto error;
+
+	cache->end = valid;
+
+	return cache;
+
+error:
+	sim_cache_free(cache);
+	return NULL;
+}
+
+const struct sim_cache_file *sim_cache_lookup(struct sim_cache *cache,
+						int id)
+{
+	struct sim_cache_entry *entry;
+
+	if (cache == NULL)
+		return NULL;
+
+	entry = g_hash_table_lookup(cache->entries, GINT_TO_POINTER(id));
+	if (entry == NULL)
+		return NULL;
+
+	return &entry->file;
+}
+
+static gboolean sim_cache_append(struct sim_cache *cache, int id,
+					guint8 flags,
+					const struct sim_cache_file *file)
+{
+	size_t len = SIM_CACHE_HEADER_LEN + file->length;
+	unsigned char *buf;
+	ssize_t written;
+
+	buf = g_try_malloc(len);
+	if (buf == NULL)
+		return FALSE;
+
+	sim_cache_header(buf, id, flags, file);
+
+	if (file->length > 0)
+		memcpy(buf + SIM_CACHE_HEADER_LEN, file->data, file->length);
+
+	written = TFR(pwrite(cache->fd, buf, len, cache->end));
+	g_free(buf);
+
+	/* A torn EF is either written over next time or dropped on load */
+	if (written != (ssize_t) len)
+		return FALSE;
+
+	cache->end += len;
+
+	return TRUE;
+}
+
+/* Stores a whole EF, with a single write */
+gboolean sim_cache_store(struct sim_cache *cache, int id,
+				int structure,
+				int length, int record_length,
+				const unsigned char *data)
+{
+	struct sim_cache_entry *entry;
+
+	if (cache == NULL || length <= 0 || length > 0xffff)
+		return FALSE;
+
+	entry = g_try_new0(struct sim_cache_entry, 1);
+	if (entry == NULL)
+		return FALSE;
+
+	entry->copy = g_try_malloc(length);
+	if (entry->copy == NULL) {
+		g_free(entry);
+		return FALSE;
+	}
+
+	memcpy(entry->copy, data, length);
+
+	entry->file.structure = structure;
+	entry->file.length = length;
+	entry->file.record_length = record_length;
+	entry->file.data = entry->copy;
+
+	if (sim_cache_append(cache, id, 0, &entry->file) == FALSE) {
+		sim_cache_entry_free(entry);
+		return FALSE;
+	}
+
+	sim_cache_replace(cache, id, entry);
+
+	return TRUE;
+}
+
+void sim_cache_remove(struct sim_cache *cache, int id)
+{
+	struct sim_cache_file removed = { 0, 0, 0, NULL };
+
+	if (cache == NULL || sim_cache_lookup(cache, id) == NULL)
+		return;
+
+	/* Otherwise the EF would be back on the next start */
+	if (sim_cache_append(cache, id, SIM_CACHE_REMOVED, &removed) == FALSE)
+		cache->rewrite = TRUE;
+
+	sim_cache_replace(cache, id, NULL);
+	cache->dead += SIM_CACHE_HEADER_LEN;
+}
+
+static void sim_cache_compact(struct sim_cache *cache)
+{
+	char *path = g_strconcat(cache->path, ".new", NULL);
+	struct sim_cache_entry *entry;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	int fd;
+
+	fd = TFR(open(path, O_WRONLY | O_CREAT | O_TRUNC, SIM_CACHE_MODE));
+	if (fd == -1)
+		goto out;
+
+	if (TFR(write(fd, SIM_CACHE_MAGIC, SIM_CACHE_MAGIC_LEN)) !=
+			SIM_CACHE_MAGIC_LEN)
+		goto error;
+
+	g_hash_table_iter_init(&iter, cache->entries);
+
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		unsigned char header[SIM_CACHE_HEADER_LEN];
+
+		entry = value;
+		sim_cache_header(header, GPOINTER_TO_INT(key), 0,
+					&entry->file);
+
+		if (TFR(write(fd, header, sizeof(header))) != sizeof(header))
+			goto error;
+
+		if (TFR(write(fd, entry->file.data, entry->file.length)) !=
+				entry->file.length)
+			goto error;
+	}
+
+	TFR(close(fd));
+
+	if (rename(path, cache->path) == -1)
+		unlink(path);
+
+	goto out;
+
+error:
+	TFR(close(fd));
+	unlink(path);
+
+out:
+	g_free(path);
+}
+
+void sim_cache_free(struct sim_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	/* Rewrite once replaced EFs take up more room than live ones */
+	if (cache->fd != -1 && (cache->rewrite ||
+				cache->dead > cache->end - cache->dead))
+		sim_cache_compact(cache);
+
+	g_hash_table_destroy(cache->entries);
+
+	if (cache->map)
+		munmap(cache->map, cache->map_len);
+
+	if (cache->fd != -1)
+		TFR(close(cache->fd));
+
+	g_free(cache->path);
+	g_free(cache);
+}
@@ -266,3 +266,21 @@ gboolean sim_parse_3g_get_response(const unsigned char *data, int len,
 gboolean sim_parse_2g_get_response(const unsigned char *response, int len,
 					int *file_len, int *record_len,
 					int *structure, unsigned char *access);
+
+/* A cached EF, data holds all of its records back to back */
+struct sim_cache_file {
+	int structure;
+	int length;
+	int record_length;
+	const unsigned char *data;
+};
+
+struct sim_cache *sim_cache_new(const char *imsi, int phase);
+const struct sim_cache_file *sim_cache_lookup(struct sim_cache *cache,
+						int id);
+gboolean sim_cache_store(struct sim_cache *cache, int id,
+				int structure,
+				int length, int record_length,
+				const unsigned char *data);
+void sim_cache_remove(struct sim_cache *cache, int id);
+void sim_cache_free(struct sim_cache *cache);
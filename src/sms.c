@@ -46,6 +46,14 @@
 
 #define TXQ_MAX_RETRIES 4
 
+/*
+ * Reports are not expected past the 24 hour validity period we send with,
+ * give or take the time the network takes to get a late one to us
+ */
+#define SR_VALIDITY_PERIOD (24 * 60 * 60)
+#define SR_REPORT_SLACK (12 * 60 * 60)
+#define SR_MAX_PENDING_TIME (SR_VALIDITY_PERIOD + SR_REPORT_SLACK)
+
 static gboolean tx_next(gpointer user_data);
 
 static GSList *g_drivers = NULL;
@@ -436,12 +444,18 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 	entry->cur_pdu += 1;
 	entry->retry = 0;
 
-	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR)
+	if (entry->flags & OFONO_SMS_SUBMIT_FLAG_REQUEST_SR) {
+		time_t now = time(NULL);
+
+		status_report_assembly_expire(sms->sr_assembly,
+						now - SR_MAX_PENDING_TIME,
+						NULL, NULL);
 		status_report_assembly_add_fragment(sms->sr_assembly,
 							entry->msg_id,
 							&entry->receiver,
-							mr, time(NULL),
+							mr, now,
 							entry->num_pdus);
+	}
 
 	if (entry->cur_pdu < entry->num_pdus) {
 		sms->tx_source = g_timeout_add(0, tx_next, sms);
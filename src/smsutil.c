@@ -41,12 +41,33 @@
 #define uninitialized_var(x) x = x
 
 #define SMS_BACKUP_MODE 0600
-#define SMS_BACKUP_PATH STORAGEDIR "/%s/sms_assembly"
+#define SMS_BACKUP_PATH "%s/%s/sms_assembly"
 #define SMS_BACKUP_PATH_DIR SMS_BACKUP_PATH "/%s-%i-%i"
 #define SMS_BACKUP_PATH_FILE SMS_BACKUP_PATH_DIR "/%03i"
 
 #define SMS_ADDR_FMT "%24[0-9A-F]"
 
+#define SMS_JOURNAL_STORE "sms_assembly.journal"
+#define SMS_JOURNAL_FRAGMENT 1
+#define SMS_JOURNAL_DONE 2
+#define SMS_JOURNAL_SLACK 64
+
+/* Address field, reference, max, seq, timestamp and a serialized SMS */
+#define SMS_JOURNAL_RECORD_SIZE (13 + 4 + 8 + 177)
+
+#define SR_JOURNAL_STORE "sms_sr_assembly.journal"
+#define SR_JOURNAL_NODE 1
+#define SR_JOURNAL_DONE 2
+
+/* Address field, message id, expiration, counters and the TP-MR bitmap */
+#define SR_JOURNAL_RECORD_SIZE (13 + 4 + 8 + 3 + 32)
+
+/* Bounds on what a broadcast storm can make us hold on to */
+#define CBS_MAX_RECV 512
+#define CBS_MAX_ASSEMBLY 64
+
+#define CBS_SERIAL_MESSAGE(serial) ((serial) & ~0xfU)
+
 static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 					const struct sms *sms, time_t ts,
 					const struct sms_address *addr,
@@ -2327,7 +2348,8 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 	unsigned char buf[177];
 	struct sms segment;
 
-	if (dir->d_type != DT_DIR)
+	/* Without d_type, scandir() and read_file() weed out the wrong kind */
+	if (dir->d_type != DT_DIR && dir->d_type != DT_UNKNOWN)
 		return;
 
 	/* Max of SMS address size is 12 bytes, hex encoded */
@@ -2338,7 +2360,7 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 	if (sms_assembly_extract_address(straddr, &addr) == FALSE)
 		return;
 
-	path = g_strdup_printf(SMS_BACKUP_PATH "/%s",
+	path = g_strdup_printf(SMS_BACKUP_PATH "/%s", storage_get_root(),
 			assembly->imsi, dir->d_name);
 	len = scandir(path, &segments, NULL, versionsort);
 	g_free(path);
@@ -2347,7 +2369,8 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 		return;
 
 	for (i = 0; i < len; i++) {
-		if (segments[i]->d_type != DT_REG)
+		if (segments[i]->d_type != DT_REG &&
+				segments[i]->d_type != DT_UNKNOWN)
 			continue;
 
 		seq = strtol(segments[i]->d_name, &endp, 10);
@@ -2355,7 +2378,7 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 			continue;
 
 		r = read_file(buf, sizeof(buf), SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
+				storage_get_root(), assembly->imsi,
 				dir->d_name, segments[i]->d_name);
 		if (r < 0)
 			continue;
@@ -2364,7 +2387,7 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 			continue;
 
 		path = g_strdup_printf(SMS_BACKUP_PATH "/%s/%s",
-				assembly->imsi,
+				storage_get_root(), assembly->imsi,
 				dir->d_name, segments[i]->d_name);
 		r = stat(path, &segment_stat);
 		g_free(path);
@@ -2384,87 +2407,391 @@ static void sms_assembly_load(struct sms_assembly *assembly,
 	free(segments);
 }
 
-static gboolean sms_assembly_store(struct sms_assembly *assembly,
-				struct sms_assembly_node *node,
-				const struct sms *sms, guint8 seq)
+/* Legacy layout: a directory per message, with a file per fragment */
+static gboolean sms_assembly_migrate(struct sms_assembly *assembly)
 {
-	unsigned char buf[177];
+	char *path;
+	struct dirent **entries;
 	int len;
-	DECLARE_SMS_ADDR_STR(straddr);
 
-	if (!assembly->imsi)
+	path = g_strdup_printf(SMS_BACKUP_PATH, storage_get_root(),
+				assembly->imsi);
+	len = scandir(path, &entries, NULL, alphasort);
+	g_free(path);
+
+	if (len < 0)
+		return FALSE;
+
+	while (len--) {
+		sms_assembly_load(assembly, entries[len]);
+		free(entries[len]);
+	}
+
+	free(entries);
+
+	return TRUE;
+}
+
+static void sms_assembly_remove_dir(const char *path)
+{
+	struct dirent **entries;
+	struct stat st;
+	char *entry;
+	int type;
+	int len;
+
+	len = scandir(path, &entries, NULL, alphasort);
+	if (len < 0)
+		return;
+
+	while (len--) {
+		entry = g_strdup_printf("%s/%s", path, entries[len]->d_name);
+		type = entries[len]->d_type;
+
+		/* Not every filesystem fills in d_type */
+		if (type == DT_UNKNOWN && lstat(entry, &st) == 0) {
+			if (S_ISREG(st.st_mode))
+				type = DT_REG;
+			else if (S_ISDIR(st.st_mode))
+				type = DT_DIR;
+		}
+
+		if (type == DT_REG)
+			unlink(entry);
+		else if (type == DT_DIR && entries[len]->d_name[0] != '.')
+			sms_assembly_remove_dir(entry);
+
+		g_free(entry);
+		free(entries[len]);
+	}
+
+	free(entries);
+
+	rmdir(path);
+}
+
+/* Both record types start with the address, reference and max */
+static int sms_journal_key(const struct sms_assembly_node *node,
+				unsigned char *buf)
+{
+	int offset = 1;
+
+	if (sms_encode_address_field(&node->addr, FALSE, buf,
+					&offset) == FALSE)
+		return -1;
+
+	buf[0] = offset - 1;
+	buf[offset++] = node->ref & 0xff;
+	buf[offset++] = node->ref >> 8;
+	buf[offset++] = node->max_fragments;
+
+	return offset;
+}
+
+static int sms_journal_fragment(const struct sms_assembly_node *node,
+				const struct sms *sms, guint8 seq,
+				unsigned char *buf)
+{
+	guint64 ts = node->ts;
+	int len;
+	int i;
+
+	len = sms_journal_key(node, buf);
+	if (len < 0)
+		return -1;
+
+	buf[len++] = seq;
+
+	for (i = 0; i < 8; i++)
+		buf[len++] = (ts >> (i * 8)) & 0xff;
+
+	return len + sms_serialize(buf + len, sms);
+}
+
+/*
+ * Rewrites the journal with only the fragments still pending, or removes
+ * it if there are none.
+ */
+static gboolean sms_assembly_compact(struct sms_assembly *assembly)
+{
+	unsigned char buf[SMS_JOURNAL_RECORD_SIZE];
+	struct sms_assembly_node *node;
+	guint records = 0;
+	guint n;
+	int seq;
+	int len;
+	int fd;
+
+	if (assembly->fragments == 0) {
+		if (assembly->journal_fd != -1)
+			close(assembly->journal_fd);
+
+		storage_journal_remove(assembly->imsi, SMS_JOURNAL_STORE);
+
+		assembly->journal_fd = -1;
+		assembly->journal_records = 0;
+
+		return TRUE;
+	}
+
+	fd = storage_journal_create(assembly->imsi, SMS_JOURNAL_STORE);
+	if (fd == -1)
+		return FALSE;
+
+	for (n = 0; n < assembly->expiry_heap->len; n++) {
+		node = assembly->expiry_heap->pdata[n];
+
+		for (seq = 0; seq < 256; seq++) {
+			if (node->fragments[seq] == NULL)
+				continue;
+
+			len = sms_journal_fragment(node, node->fragments[seq],
+							seq, buf);
+
+			if (len < 0 || storage_journal_append(&fd,
+						SMS_JOURNAL_FRAGMENT,
+						buf, len) < 0) {
+				if (fd != -1)
+					close(fd);
+
+				return FALSE;
+			}
+
+			records += 1;
+		}
+	}
+
+	if (storage_journal_commit(assembly->imsi, SMS_JOURNAL_STORE, fd) < 0)
 		return FALSE;
 
-	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
+	if (assembly->journal_fd != -1)
+		close(assembly->journal_fd);
+
+	assembly->journal_fd = fd;
+	assembly->journal_records = records;
+
+	return TRUE;
+}
+
+static gboolean sms_assembly_journal(struct sms_assembly *assembly,
+					unsigned char type,
+					const unsigned char *buf, int len)
+{
+	if (assembly->journal_fd == -1)
+		assembly->journal_fd = storage_journal_open(assembly->imsi,
+							SMS_JOURNAL_STORE);
+
+	if (assembly->journal_fd == -1)
 		return FALSE;
 
-	len = sms_serialize(buf, sms);
+	if (storage_journal_append(&assembly->journal_fd, type,
+					buf, len) < 0) {
+		/* The journal is not to be trusted, rewrite it as it stands */
+		if (assembly->journal_fd == -1)
+			sms_assembly_compact(assembly);
 
-	if (write_file(buf, len, SMS_BACKUP_MODE,
-				SMS_BACKUP_PATH_FILE, assembly->imsi, straddr,
-				node->ref, node->max_fragments, seq) != len)
 		return FALSE;
+	}
+
+	assembly->journal_records += 1;
 
 	return TRUE;
 }
 
+static gboolean sms_assembly_store(struct sms_assembly *assembly,
+				struct sms_assembly_node *node,
+				const struct sms *sms, guint8 seq)
+{
+	unsigned char buf[SMS_JOURNAL_RECORD_SIZE];
+	int len;
+
+	if (!assembly->imsi)
+		return FALSE;
+
+	len = sms_journal_fragment(node, sms, seq, buf);
+	if (len < 0)
+		return FALSE;
+
+	return sms_assembly_journal(assembly, SMS_JOURNAL_FRAGMENT, buf, len);
+}
+
+/* Called once node has been taken out of the assembly */
 static void sms_assembly_backup_free(struct sms_assembly *assembly,
 					struct sms_assembly_node *node)
 {
-	char *path;
-	int seq;
-	char straddr[25];
+	unsigned char buf[SMS_JOURNAL_RECORD_SIZE];
+	int len;
 
 	if (!assembly->imsi)
 		return;
 
-	if (sms_address_to_hex_string(&node->addr, straddr) == FALSE)
+	len = sms_journal_key(node, buf);
+	if (len < 0)
 		return;
 
-	for (seq = 0; seq < node->max_fragments; seq++) {
-		int offset = seq / 32;
-		int bit = 1 << (seq % 32);
+	sms_assembly_journal(assembly, SMS_JOURNAL_DONE, buf, len);
 
-		if (node->bitmap[offset] & bit) {
-			path = g_strdup_printf(SMS_BACKUP_PATH_FILE,
-					assembly->imsi, straddr,
-					node->ref, node->max_fragments, seq);
-			unlink(path);
-			g_free(path);
-		}
+	if (assembly->journal_records > assembly->fragments * 2 +
+						SMS_JOURNAL_SLACK)
+		sms_assembly_compact(assembly);
+}
+
+static void sms_assembly_replay(unsigned char type, const unsigned char *data,
+				size_t len, void *user_data);
+
+static guint sms_assembly_node_hash(gconstpointer key)
+{
+	const struct sms_assembly_node *node = key;
+
+	return g_str_hash(node->addr.address) ^ (node->ref << 16) ^
+		(node->addr.number_type << 4) ^ node->addr.numbering_plan;
+}
+
+static gboolean sms_assembly_node_equal(gconstpointer a, gconstpointer b)
+{
+	const struct sms_assembly_node *na = a;
+	const struct sms_assembly_node *nb = b;
+
+	if (na->ref != nb->ref)
+		return FALSE;
+
+	if (na->addr.number_type != nb->addr.number_type)
+		return FALSE;
+
+	if (na->addr.numbering_plan != nb->addr.numbering_plan)
+		return FALSE;
+
+	return strcmp(na->addr.address, nb->addr.address) == 0;
+}
+
+static void sms_assembly_node_free(struct sms_assembly_node *node)
+{
+	unsigned int i;
+	int seq;
+
+	for (i = 0; i < G_N_ELEMENTS(node->bitmap); i++) {
+		seq = -1;
+
+		while ((seq = g_bit_nth_lsf(node->bitmap[i], seq)) != -1)
+			g_free(node->fragments[i * 32 + seq]);
 	}
 
-	path = g_strdup_printf(SMS_BACKUP_PATH_DIR, assembly->imsi, straddr,
-				node->ref, node->max_fragments);
-	rmdir(path);
-	g_free(path);
+	g_free(node);
+}
+
+/*
+ * The expiry heap is a binary min-heap on the node timestamp, each node
+ * remembers its own position so that it can be taken out once complete.
+ */
+static void expiry_heap_set(GPtrArray *heap, guint index,
+				struct sms_assembly_node *node)
+{
+	heap->pdata[index] = node;
+	node->heap_index = index;
+}
+
+static void expiry_heap_sift_up(GPtrArray *heap, guint index)
+{
+	struct sms_assembly_node *node = heap->pdata[index];
+	struct sms_assembly_node *parent;
+
+	while (index > 0) {
+		parent = heap->pdata[(index - 1) / 2];
+
+		if (parent->ts <= node->ts)
+			break;
+
+		expiry_heap_set(heap, index, parent);
+		index = (index - 1) / 2;
+	}
+
+	expiry_heap_set(heap, index, node);
+}
+
+static void expiry_heap_sift_down(GPtrArray *heap, guint index)
+{
+	struct sms_assembly_node *node = heap->pdata[index];
+	struct sms_assembly_node *child;
+	guint c;
+
+	while ((c = index * 2 + 1) < heap->len) {
+		child = heap->pdata[c];
+
+		if (c + 1 < heap->len && ((struct sms_assembly_node *)
+				heap->pdata[c + 1])->ts < child->ts)
+			child = heap->pdata[++c];
+
+		if (node->ts <= child->ts)
+			break;
+
+		expiry_heap_set(heap, index, child);
+		index = c;
+	}
+
+	expiry_heap_set(heap, index, node);
+}
+
+static void expiry_heap_push(GPtrArray *heap, struct sms_assembly_node *node)
+{
+	g_ptr_array_add(heap, node);
+	expiry_heap_sift_up(heap, heap->len - 1);
+}
+
+static void expiry_heap_remove(GPtrArray *heap, struct sms_assembly_node *node)
+{
+	guint index = node->heap_index;
+	struct sms_assembly_node *last;
+
+	last = g_ptr_array_remove_index(heap, heap->len - 1);
+
+	if (last == node)
+		return;
+
+	expiry_heap_set(heap, index, last);
+	expiry_heap_sift_up(heap, index);
+	expiry_heap_sift_down(heap, last->heap_index);
+}
+
+static void sms_assembly_remove(struct sms_assembly *assembly,
+				struct sms_assembly_node *node)
+{
+	g_hash_table_remove(assembly->assembly_table, node);
+	expiry_heap_remove(assembly->expiry_heap, node);
+
+	assembly->fragments -= node->num_fragments;
 }
 
 struct sms_assembly *sms_assembly_new(const char *imsi)
 {
 	struct sms_assembly *ret = g_new0(struct sms_assembly, 1);
-	char *path;
-	struct dirent **entries;
-	int len;
+	gboolean legacy;
+	int records;
+
+	ret->assembly_table = g_hash_table_new(sms_assembly_node_hash,
+						sms_assembly_node_equal);
+	ret->expiry_heap = g_ptr_array_new();
+	ret->journal_fd = -1;
 
 	if (imsi) {
 		ret->imsi = imsi;
 
 		/* Restore state from backup */
+		records = storage_journal_replay(imsi, SMS_JOURNAL_STORE,
+						sms_assembly_replay, ret);
+		ret->journal_records = MAX(records, 0);
 
-		path = g_strdup_printf(SMS_BACKUP_PATH, imsi);
-		len = scandir(path, &entries, NULL, alphasort);
-		g_free(path);
+		legacy = sms_assembly_migrate(ret);
 
-		if (len < 0)
-			return ret;
+		/* Fold in what was loaded, and drop what is done with */
+		if (legacy || ret->journal_records > ret->fragments) {
+			if (sms_assembly_compact(ret) && legacy) {
+				char *path = g_strdup_printf(SMS_BACKUP_PATH,
+						storage_get_root(), imsi);
 
-		while (len--) {
-			sms_assembly_load(ret, entries[len]);
-			free(entries[len]);
+				sms_assembly_remove_dir(path);
+				g_free(path);
+			}
 		}
-
-		free(entries);
 	}
 
 	return ret;
@@ -2472,17 +2799,17 @@ struct sms_assembly *sms_assembly_new(const char *imsi)
 
 void sms_assembly_free(struct sms_assembly *assembly)
 {
-	GSList *l;
+	guint i;
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct sms_assembly_node *node = l->data;
+	for (i = 0; i < assembly->expiry_heap->len; i++)
+		sms_assembly_node_free(assembly->expiry_heap->pdata[i]);
 
-		g_slist_foreach(node->fragment_list, (GFunc)g_free, 0);
-		g_slist_free(node->fragment_list);
-		g_free(node);
-	}
+	g_ptr_array_free(assembly->expiry_heap, TRUE);
+	g_hash_table_destroy(assembly->assembly_table);
+
+	if (assembly->journal_fd != -1)
+		close(assembly->journal_fd);
 
-	g_slist_free(assembly->assembly_list);
 	g_free(assembly);
 }
 
@@ -2502,33 +2829,19 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 					gboolean backup)
 {
 	unsigned int offset = seq / 32;
-	unsigned int bit = 1 << (seq % 32);
-	GSList *l;
-	GSList *prev;
-	struct sms *newsms;
+	unsigned int bit = 1U << (seq % 32);
+	struct sms_assembly_node lookup;
 	struct sms_assembly_node *node;
 	GSList *completed;
-	unsigned int position;
 	unsigned int i;
-	unsigned int j;
-
-	prev = NULL;
-
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		node = l->data;
-
-		if (node->addr.number_type != addr->number_type)
-			continue;
-
-		if (node->addr.numbering_plan != addr->numbering_plan)
-			continue;
+	int j;
 
-		if (strcmp(node->addr.address, addr->address))
-			continue;
+	memcpy(&lookup.addr, addr, sizeof(struct sms_address));
+	lookup.ref = ref;
 
-		if (ref != node->ref)
-			continue;
+	node = g_hash_table_lookup(assembly->assembly_table, &lookup);
 
+	if (node) {
 		/* Message Reference and address the same, but max is not
 		 * ignore the SMS completely
 		 */
@@ -2538,48 +2851,21 @@ static GSList *sms_assembly_add_fragment_backup(struct sms_assembly *assembly,
 		/* Now check if we already have this seq number */
 		if (node->bitmap[offset] & bit)
 			return NULL;
-
-		/*
-		 * Iterate over the bitmap to find in which position
-		 * should the fragment be inserted -- basically we
-		 * walk each bit in the bitmap until the bit we care
-		 * about (offset:bit) and count which are stored --
-		 * that gives us in which position we have to insert.
-		 */
-		position = 0;
-		for (i = 0; i < offset; i++)
-			for (j = 0; j < 32; j++)
-				if (node->bitmap[i] & (1 << j))
-					position += 1;
-
-		for (j = 1; j < bit; j = j << 1)
-			if (node->bitmap[offset] & j)
-				position += 1;
-
-		goto out;
+	} else {
+		node = g_new0(struct sms_assembly_node, 1);
+		memcpy(&node->addr, addr, sizeof(struct sms_address));
+		node->ts = ts;
+		node->ref = ref;
+		node->max_fragments = max;
+
+		g_hash_table_insert(assembly->assembly_table, node, node);
+		expiry_heap_push(assembly->expiry_heap, node);
 	}
 
-	node = g_new0(struct sms_assembly_node, 1);
-	memcpy(&node->addr, addr, sizeof(struct sms_address));
-	node->ts = ts;
-	node->ref = ref;
-	node->max_fragments = max;
-
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
-
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
-
-out:
-	newsms = g_new(struct sms, 1);
-
-	memcpy(newsms, sms, sizeof(struct sms));
-	node->fragment_list = g_slist_insert(node->fragment_list,
-						newsms, position);
+	node->fragments[seq] = g_memdup(sms, sizeof(struct sms));
 	node->bitmap[offset] |= bit;
 	node->num_fragments += 1;
+	assembly->fragments += 1;
 
 	if (node->num_fragments < node->max_fragments) {
 		if (backup)
@@ -2588,81 +2874,509 @@ out:
 		return NULL;
 	}
 
-	completed = node->fragment_list;
+	/* Hand the fragments over in sequence number order */
+	completed = NULL;
 
-	sms_assembly_backup_free(assembly, node);
+	for (i = G_N_ELEMENTS(node->bitmap); i-- > 0;) {
+		j = 32;
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
+		while ((j = g_bit_nth_msf(node->bitmap[i], j)) != -1)
+			completed = g_slist_prepend(completed,
+						node->fragments[i * 32 + j]);
+	}
+
+	sms_assembly_remove(assembly, node);
+
+	/*
+	 * Without backup the state is still being loaded, and the journal
+	 * is compacted once that is done, so leave it alone until then
+	 */
+	if (backup)
+		sms_assembly_backup_free(assembly, node);
 
 	g_free(node);
-	g_slist_free_1(l);
+
 	return completed;
 }
 
-/*!
- * Expires all incomplete messages that have been received at time prior
- * to one given by before argument.  The fragment list is freed and the
- * SMSes are vaporized.
- */
-void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
+static void sms_assembly_replay(unsigned char type, const unsigned char *data,
+				size_t len, void *user_data)
 {
-	GSList *cur;
-	GSList *prev;
-	GSList *tmp;
-
-	prev = NULL;
-	cur = assembly->assembly_list;
+	struct sms_assembly *assembly = user_data;
+	struct sms_assembly_node lookup;
+	struct sms_assembly_node *node;
+	struct sms segment;
+	guint64 ts = 0;
+	int offset = 1;
+	guint8 seq;
+	GSList *l;
+	int i;
 
-	while (cur) {
-		struct sms_assembly_node *node = cur->data;
+	if (len < 1 || len < (size_t) data[0] + 4)
+		return;
 
-		if (node->ts > before) {
-			prev = cur;
-			cur = cur->next;
-			continue;
-		}
+	if (sms_decode_address_field(data, data[0] + 1, &offset, FALSE,
+					&lookup.addr) == FALSE)
+		return;
 
-		sms_assembly_backup_free(assembly, node);
+	lookup.ref = data[offset] | (data[offset + 1] << 8);
+	lookup.max_fragments = data[offset + 2];
+	offset += 3;
 
-		g_slist_foreach(node->fragment_list, (GFunc)g_free, 0);
-		g_slist_free(node->fragment_list);
-		g_free(node);
+	if (type == SMS_JOURNAL_DONE) {
+		node = g_hash_table_lookup(assembly->assembly_table, &lookup);
 
-		if (prev)
-			prev->next = cur->next;
-		else
-			assembly->assembly_list = cur->next;
+		if (node) {
+			sms_assembly_remove(assembly, node);
+			sms_assembly_node_free(node);
+		}
 
-		tmp = cur;
-		cur = cur->next;
-		g_slist_free_1(tmp);
+		return;
 	}
-}
 
-struct status_report_assembly *status_report_assembly_new(const char *imsi)
-{
-	struct status_report_assembly *ret =
-				g_new0(struct status_report_assembly, 1);
+	if (type != SMS_JOURNAL_FRAGMENT || len < (size_t) offset + 9)
+		return;
 
-	ret->assembly_table = g_hash_table_new_full(g_str_hash, g_str_equal,
-				g_free, (GDestroyNotify)g_hash_table_destroy);
+	seq = data[offset++];
 
-	if (imsi)
-		ret->imsi = imsi;
+	for (i = 0; i < 8; i++)
+		ts |= (guint64) data[offset++] << (i * 8);
 
-	return ret;
-}
+	if (!sms_deserialize(data + offset, &segment, len - offset))
+		return;
 
-void status_report_assembly_free(struct status_report_assembly *assembly)
-{
-	g_hash_table_destroy(assembly->assembly_table);
-	g_free(assembly);
+	l = sms_assembly_add_fragment_backup(assembly, &segment, ts,
+						&lookup.addr, lookup.ref,
+						lookup.max_fragments, seq,
+						FALSE);
+
+	/* Only if the journal lost a record, nothing to deliver it to */
+	g_slist_foreach(l, (GFunc)g_free, NULL);
+	g_slist_free(l);
 }
 
-static gboolean sr_st_to_delivered(enum sms_st st, gboolean *delivered)
+/*!
+ * Expires all incomplete messages that have been received at time prior
+ * to one given by before argument.  The fragment list is freed and the
+ * SMSes are vaporized.
+ */
+void sms_assembly_expire(struct sms_assembly *assembly, time_t before)
+{
+	struct sms_assembly_node *node;
+
+	while (assembly->expiry_heap->len > 0) {
+		node = assembly->expiry_heap->pdata[0];
+
+		if (node->ts > before)
+			break;
+
+		sms_assembly_remove(assembly, node);
+		sms_assembly_backup_free(assembly, node);
+		sms_assembly_node_free(node);
+	}
+}
+
+/*
+ * Status reports name the receiver the way sms_address_to_string() does, so
+ * keys hold that form of the address along with a message id or a TP-MR.
+ */
+struct sr_assembly_key {
+	char address[22];
+	unsigned int id;
+};
+
+static void sr_assembly_key_init(struct sr_assembly_key *key,
+					const struct sms_address *addr,
+					unsigned int id)
+{
+	if (addr->number_type == SMS_NUMBER_TYPE_INTERNATIONAL &&
+			addr->address[0] != '\0' && addr->address[0] != '+') {
+		key->address[0] = '+';
+		strcpy(key->address + 1, addr->address);
+	} else {
+		strcpy(key->address, addr->address);
+	}
+
+	key->id = id;
+}
+
+static struct sr_assembly_key *sr_assembly_key_new(
+					const struct sms_address *addr,
+					unsigned int id)
+{
+	struct sr_assembly_key *key = g_new(struct sr_assembly_key, 1);
+
+	sr_assembly_key_init(key, addr, id);
+
+	return key;
+}
+
+static guint sr_assembly_key_hash(gconstpointer key)
+{
+	const struct sr_assembly_key *k = key;
+
+	return g_str_hash(k->address) ^ k->id;
+}
+
+static gboolean sr_assembly_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct sr_assembly_key *ka = a;
+	const struct sr_assembly_key *kb = b;
+
+	return ka->id == kb->id && strcmp(ka->address, kb->address) == 0;
+}
+
+/* Makes the node the owner of mr, a reused TP-MR goes to the newest node */
+static void sr_assembly_index(struct status_report_assembly *assembly,
+				struct id_table_node *node, unsigned char mr)
+{
+	g_hash_table_replace(assembly->mr_table,
+				sr_assembly_key_new(&node->to, mr), node);
+}
+
+static void sr_assembly_unindex(struct status_report_assembly *assembly,
+				struct id_table_node *node)
+{
+	struct sr_assembly_key key;
+	unsigned int i;
+	int bit;
+
+	for (i = 0; i < G_N_ELEMENTS(node->mrs); i++) {
+		bit = -1;
+
+		while ((bit = g_bit_nth_lsf(node->mrs[i], bit)) != -1) {
+			sr_assembly_key_init(&key, &node->to, i * 32 + bit);
+
+			if (g_hash_table_lookup(assembly->mr_table,
+							&key) == node)
+				g_hash_table_remove(assembly->mr_table, &key);
+		}
+	}
+}
+
+/*
+ * Nodes are kept in order of expiration.  Fragments are added as they are
+ * sent, so a node almost always goes at the tail.
+ */
+static void sr_expiry_insert(GQueue *queue, struct id_table_node *node)
+{
+	struct id_table_node *other;
+	GList *l;
+
+	for (l = queue->tail; l; l = l->prev) {
+		other = l->data;
+
+		if (other->expiration <= node->expiration)
+			break;
+	}
+
+	if (l == NULL) {
+		g_queue_push_head(queue, node);
+		node->expiry_link = queue->head;
+	} else {
+		g_queue_insert_after(queue, l, node);
+		node->expiry_link = l->next;
+	}
+}
+
+static void sr_assembly_remove(struct status_report_assembly *assembly,
+				struct id_table_node *node)
+{
+	struct sr_assembly_key key;
+
+	sr_assembly_key_init(&key, &node->to, node->msg_id);
+	g_hash_table_remove(assembly->assembly_table, &key);
+
+	sr_assembly_unindex(assembly, node);
+	g_queue_delete_link(assembly->expiry_queue, node->expiry_link);
+}
+
+/* Both record types start with the address and message id */
+static int sr_journal_key(const struct id_table_node *node,
+				unsigned char *buf)
+{
+	int offset = 1;
+	int i;
+
+	if (sms_encode_address_field(&node->to, FALSE, buf,
+					&offset) == FALSE)
+		return -1;
+
+	buf[0] = offset - 1;
+
+	for (i = 0; i < 4; i++)
+		buf[offset++] = (node->msg_id >> (i * 8)) & 0xff;
+
+	return offset;
+}
+
+static int sr_journal_node(const struct id_table_node *node,
+				unsigned char *buf)
+{
+	guint64 expiration = node->expiration;
+	unsigned int i;
+	int len;
+	int j;
+
+	len = sr_journal_key(node, buf);
+	if (len < 0)
+		return -1;
+
+	for (j = 0; j < 8; j++)
+		buf[len++] = (expiration >> (j * 8)) & 0xff;
+
+	buf[len++] = node->total_mrs;
+	buf[len++] = node->sent_mrs;
+	buf[len++] = node->deliverable;
+
+	for (i = 0; i < G_N_ELEMENTS(node->mrs); i++)
+		for (j = 0; j < 4; j++)
+			buf[len++] = (node->mrs[i] >> (j * 8)) & 0xff;
+
+	return len;
+}
+
+/*
+ * Rewrites the journal with only the nodes still pending, or removes it if
+ * there are none.
+ */
+static gboolean sr_assembly_compact(struct status_report_assembly *assembly)
+{
+	unsigned char buf[SR_JOURNAL_RECORD_SIZE];
+	struct id_table_node *node;
+	guint records = 0;
+	GList *l;
+	int len;
+	int fd;
+
+	if (g_queue_is_empty(assembly->expiry_queue)) {
+		if (assembly->journal_fd != -1)
+			close(assembly->journal_fd);
+
+		storage_journal_remove(assembly->imsi, SR_JOURNAL_STORE);
+
+		assembly->journal_fd = -1;
+		assembly->journal_records = 0;
+
+		return TRUE;
+	}
+
+	fd = storage_journal_create(assembly->imsi, SR_JOURNAL_STORE);
+	if (fd == -1)
+		return FALSE;
+
+	for (l = assembly->expiry_queue->head; l; l = l->next) {
+		node = l->data;
+
+		len = sr_journal_node(node, buf);
+
+		if (len < 0 || storage_journal_append(&fd, SR_JOURNAL_NODE,
+							buf, len) < 0) {
+			if (fd != -1)
+				close(fd);
+
+			return FALSE;
+		}
+
+		records += 1;
+	}
+
+	if (storage_journal_commit(assembly->imsi, SR_JOURNAL_STORE, fd) < 0)
+		return FALSE;
+
+	if (assembly->journal_fd != -1)
+		close(assembly->journal_fd);
+
+	assembly->journal_fd = fd;
+	assembly->journal_records = records;
+
+	return TRUE;
+}
+
+static gboolean sr_assembly_journal(struct status_report_assembly *assembly,
+					unsigned char type,
+					const unsigned char *buf, int len)
+{
+	if (assembly->journal_fd == -1)
+		assembly->journal_fd = storage_journal_open(assembly->imsi,
+							SR_JOURNAL_STORE);
+
+	if (assembly->journal_fd == -1)
+		return FALSE;
+
+	if (storage_journal_append(&assembly->journal_fd, type,
+					buf, len) < 0)
+		return FALSE;
+
+	assembly->journal_records += 1;
+
+	return TRUE;
+}
+
+/* Records the current state of node, replacing any earlier record */
+static void sr_assembly_store(struct status_report_assembly *assembly,
+				const struct id_table_node *node)
+{
+	unsigned char buf[SR_JOURNAL_RECORD_SIZE];
+	int len;
+
+	if (!assembly->imsi)
+		return;
+
+	len = sr_journal_node(node, buf);
+	if (len < 0)
+		return;
+
+	/* Rather than leave the journal without it, rewrite it as it stands */
+	if (!sr_assembly_journal(assembly, SR_JOURNAL_NODE, buf, len))
+		sr_assembly_compact(assembly);
+}
+
+/* Called once node has been taken out of the assembly */
+static void sr_assembly_backup_free(struct status_report_assembly *assembly,
+					const struct id_table_node *node)
+{
+	unsigned char buf[SR_JOURNAL_RECORD_SIZE];
+	int len;
+
+	if (!assembly->imsi)
+		return;
+
+	len = sr_journal_key(node, buf);
+	if (len < 0)
+		return;
+
+	if (!sr_assembly_journal(assembly, SR_JOURNAL_DONE, buf, len) ||
+			assembly->journal_records >
+			g_queue_get_length(assembly->expiry_queue) * 2 +
+			SMS_JOURNAL_SLACK)
+		sr_assembly_compact(assembly);
+}
+
+static void sr_assembly_replay(unsigned char type, const unsigned char *data,
+				size_t len, void *user_data)
+{
+	struct status_report_assembly *assembly = user_data;
+	struct id_table_node lookup;
+	struct sr_assembly_key key;
+	struct id_table_node *node;
+	guint64 expiration = 0;
+	unsigned int i;
+	int offset = 1;
+	int bit;
+	int j;
+
+	if (len < 1 || len < (size_t) data[0] + 5)
+		return;
+
+	if (sms_decode_address_field(data, data[0] + 1, &offset, FALSE,
+					&lookup.to) == FALSE)
+		return;
+
+	lookup.msg_id = 0;
+
+	for (j = 0; j < 4; j++)
+		lookup.msg_id |= (unsigned int) data[offset++] << (j * 8);
+
+	sr_assembly_key_init(&key, &lookup.to, lookup.msg_id);
+	node = g_hash_table_lookup(assembly->assembly_table, &key);
+
+	if (type == SR_JOURNAL_DONE) {
+		if (node) {
+			sr_assembly_remove(assembly, node);
+			g_free(node);
+		}
+
+		return;
+	}
+
+	if (type != SR_JOURNAL_NODE ||
+			len < (size_t) offset + 11 + sizeof(node->mrs))
+		return;
+
+	if (node == NULL) {
+		node = g_new0(struct id_table_node, 1);
+		memcpy(&node->to, &lookup.to, sizeof(node->to));
+		node->msg_id = lookup.msg_id;
+
+		g_hash_table_insert(assembly->assembly_table,
+					sr_assembly_key_new(&node->to,
+							node->msg_id), node);
+	} else {
+		sr_assembly_unindex(assembly, node);
+		g_queue_delete_link(assembly->expiry_queue,
+					node->expiry_link);
+	}
+
+	for (j = 0; j < 8; j++)
+		expiration |= (guint64) data[offset++] << (j * 8);
+
+	node->expiration = expiration;
+	node->total_mrs = data[offset++];
+	node->sent_mrs = data[offset++];
+	node->deliverable = data[offset++] != 0;
+
+	for (i = 0; i < G_N_ELEMENTS(node->mrs); i++) {
+		node->mrs[i] = data[offset] | (data[offset + 1] << 8) |
+				(data[offset + 2] << 16) |
+				((unsigned int) data[offset + 3] << 24);
+		offset += 4;
+
+		bit = -1;
+
+		while ((bit = g_bit_nth_lsf(node->mrs[i], bit)) != -1)
+			sr_assembly_index(assembly, node, i * 32 + bit);
+	}
+
+	sr_expiry_insert(assembly->expiry_queue, node);
+}
+
+struct status_report_assembly *status_report_assembly_new(const char *imsi)
+{
+	struct status_report_assembly *ret =
+				g_new0(struct status_report_assembly, 1);
+	int records;
+
+	ret->assembly_table = g_hash_table_new_full(sr_assembly_key_hash,
+							sr_assembly_key_equal,
+							g_free, NULL);
+	ret->mr_table = g_hash_table_new_full(sr_assembly_key_hash,
+						sr_assembly_key_equal,
+						g_free, NULL);
+	ret->expiry_queue = g_queue_new();
+	ret->journal_fd = -1;
+
+	if (imsi) {
+		ret->imsi = imsi;
+
+		/* Restore the reports still pending from backup */
+		records = storage_journal_replay(imsi, SR_JOURNAL_STORE,
+						sr_assembly_replay, ret);
+		ret->journal_records = MAX(records, 0);
+
+		if (ret->journal_records >
+				g_queue_get_length(ret->expiry_queue))
+			sr_assembly_compact(ret);
+	}
+
+	return ret;
+}
+
+void status_report_assembly_free(struct status_report_assembly *assembly)
+{
+	g_queue_foreach(assembly->expiry_queue, (GFunc)g_free, NULL);
+	g_queue_free(assembly->expiry_queue);
+
+	g_hash_table_destroy(assembly->mr_table);
+	g_hash_table_destroy(assembly->assembly_table);
+
+	if (assembly->journal_fd != -1)
+		close(assembly->journal_fd);
+
+	g_free(assembly);
+}
+
+static gboolean sr_st_to_delivered(enum sms_st st, gboolean *delivered)
 {
 	if (st >= SMS_ST_TEMPFINAL_CONGESTION && st <= SMS_ST_TEMPFINAL_LAST)
 		return FALSE;
@@ -2690,12 +3404,9 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 {
 	unsigned int offset = status_report->status_report.mr / 32;
 	unsigned int bit = 1 << (status_report->status_report.mr % 32);
-	struct id_table_node *node = NULL;
-	const char *straddr;
-	GHashTable *id_table;
-	gpointer key, value;
+	struct sr_assembly_key key;
+	struct id_table_node *node;
 	gboolean delivered;
-	GHashTableIter iter;
 	gboolean pending;
 	int i;
 
@@ -2704,35 +3415,25 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 				&delivered) == FALSE)
 		return FALSE;
 
-	straddr = sms_address_to_string(&status_report->status_report.raddr);
-	id_table = g_hash_table_lookup(assembly->assembly_table, straddr);
-
-	/* key (receiver address) does not exist in assembly */
-	if (id_table == NULL)
-		return FALSE;
-
-	g_hash_table_iter_init(&iter, id_table);
-	while (g_hash_table_iter_next(&iter, &key, &value)) {
-		node = value;
-
-		if (node->mrs[offset] & bit)
-			break;
-
-		node = NULL;
-	}
+	sr_assembly_key_init(&key, &status_report->status_report.raddr,
+				status_report->status_report.mr);
+	node = g_hash_table_lookup(assembly->mr_table, &key);
 
 	/* Unable to find a message reference belonging to this address */
 	if (node == NULL)
 		return FALSE;
 
 	/* Mr belongs to this node. */
-	node->mrs[offset] ^= bit;
+	g_hash_table_remove(assembly->mr_table, &key);
+	node->mrs[offset] &= ~bit;
 
 	node->deliverable = node->deliverable && delivered;
 
 	/* If we haven't sent the entire message yet, wait until sent */
-	if (node->sent_mrs < node->total_mrs)
+	if (node->sent_mrs < node->total_mrs) {
+		sr_assembly_store(assembly, node);
 		return FALSE;
+	}
 
 	/* Figure out if we are expecting more status reports */
 	for (i = 0, pending = FALSE; i < 8; i++) {
@@ -2743,20 +3444,20 @@ gboolean status_report_assembly_report(struct status_report_assembly *assembly,
 		}
 	}
 
-	if (pending == TRUE && node->deliverable == TRUE)
+	if (pending == TRUE && node->deliverable == TRUE) {
+		sr_assembly_store(assembly, node);
 		return FALSE;
+	}
 
 	if (out_delivered)
 		*out_delivered = node->deliverable;
 
 	if (out_id)
-		*out_id = *((unsigned int *) key);
-
-	g_hash_table_iter_remove(&iter);
+		*out_id = node->msg_id;
 
-	if (g_hash_table_size(id_table) == 0)
-		g_hash_table_remove(assembly->assembly_table,
-				status_report->status_report.raddr.address);
+	sr_assembly_remove(assembly, node);
+	sr_assembly_backup_free(assembly, node);
+	g_free(node);
 
 	return TRUE;
 }
@@ -2770,48 +3471,58 @@ void status_report_assembly_add_fragment(
 {
 	unsigned int offset = mr / 32;
 	unsigned int bit = 1 << (mr % 32);
-	GHashTable *id_table;
+	struct sr_assembly_key key;
 	struct id_table_node *node;
-	unsigned int *id_table_key;
 
-	id_table = g_hash_table_lookup(assembly->assembly_table,
-					sms_address_to_string(to));
+	sr_assembly_key_init(&key, to, msg_id);
+	node = g_hash_table_lookup(assembly->assembly_table, &key);
 
-	/* Create hashtable keyed by the to address if required */
-	if (id_table == NULL) {
-		id_table = g_hash_table_new_full(g_int_hash, g_int_equal,
-								g_free, g_free);
-		g_hash_table_insert(assembly->assembly_table,
-					g_strdup(sms_address_to_string(to)),
-					id_table);
-	}
-
-	node = g_hash_table_lookup(id_table, &msg_id);
-
-	/* Create node in the message id hashtable if required */
+	/* Create the node for this message if required */
 	if (node == NULL) {
-		id_table_key = g_new0(unsigned int, 1);
-
 		node = g_new0(struct id_table_node, 1);
 		memcpy(&node->to, to, sizeof(*to));
+		node->msg_id = msg_id;
 		node->total_mrs = total_mrs;
 		node->deliverable = TRUE;
 
-		*id_table_key = msg_id;
-		g_hash_table_insert(id_table, id_table_key, node);
+		g_hash_table_insert(assembly->assembly_table,
+					sr_assembly_key_new(to, msg_id), node);
+	} else {
+		g_queue_delete_link(assembly->expiry_queue,
+					node->expiry_link);
 	}
 
-	/* id_table and node both exists */
 	node->mrs[offset] |= bit;
 	node->expiration = expiration;
 	node->sent_mrs++;
+
+	sr_assembly_index(assembly, node, mr);
+	sr_expiry_insert(assembly->expiry_queue, node);
+	sr_assembly_store(assembly, node);
 }
 
+/*!
+ * Expires all messages whose last fragment was sent at or before the time
+ * given by the before argument.  foreach_func, if given, is called with
+ * each node before it is freed.
+ */
 void status_report_assembly_expire(struct status_report_assembly *assembly,
 					time_t before, GFunc foreach_func,
 					gpointer data)
 {
-	/*TODO*/
+	struct id_table_node *node;
+
+	while ((node = g_queue_peek_head(assembly->expiry_queue)) != NULL) {
+		if (node->expiration > before)
+			break;
+
+		if (foreach_func)
+			foreach_func(node, data);
+
+		sr_assembly_remove(assembly, node);
+		sr_assembly_backup_free(assembly, node);
+		g_free(node);
+	}
 }
 
 static inline GSList *sms_list_append(GSList *l, const struct sms *in)
@@ -3450,73 +4161,171 @@ static inline gboolean cbs_is_update_newer(unsigned int n, unsigned int o)
 	return FALSE;
 }
 
-struct cbs_assembly *cbs_assembly_new()
+static void cbs_recv_init(struct cbs_recv_table *recv)
 {
-	return g_new0(struct cbs_assembly, 1);
+	recv->serials = g_hash_table_new(g_direct_hash, g_direct_equal);
+	recv->lru = g_queue_new();
 }
 
-void cbs_assembly_free(struct cbs_assembly *assembly)
+static void cbs_recv_clear(struct cbs_recv_table *recv)
 {
-	GSList *l;
+	g_hash_table_remove_all(recv->serials);
+	g_queue_clear(recv->lru);
+}
 
-	for (l = assembly->assembly_list; l; l = l->next) {
-		struct cbs_assembly_node *node = l->data;
+static void cbs_recv_destroy(struct cbs_recv_table *recv)
+{
+	g_hash_table_destroy(recv->serials);
+	g_queue_free(recv->lru);
+}
 
-		g_slist_foreach(node->pages, (GFunc)g_free, 0);
-		g_slist_free(node->pages);
-		g_free(node);
+static GList *cbs_recv_lookup(struct cbs_recv_table *recv,
+				unsigned int serial)
+{
+	return g_hash_table_lookup(recv->serials,
+				GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(serial)));
+}
+
+static void cbs_recv_touch(struct cbs_recv_table *recv, GList *link)
+{
+	g_queue_unlink(recv->lru, link);
+	g_queue_push_tail_link(recv->lru, link);
+}
+
+/*
+ * Record the latest serial seen for a message.  Once the table is full
+ * the message not seen for the longest time is forgotten, should it be
+ * broadcast again it will be treated as new.
+ */
+static void cbs_recv_update(struct cbs_recv_table *recv, GList *link,
+				unsigned int serial)
+{
+	unsigned int old;
+
+	if (link) {
+		link->data = GUINT_TO_POINTER(serial);
+		cbs_recv_touch(recv, link);
+		return;
+	}
+
+	if (g_queue_get_length(recv->lru) >= CBS_MAX_RECV) {
+		old = GPOINTER_TO_UINT(g_queue_pop_head(recv->lru));
+
+		g_hash_table_remove(recv->serials,
+				GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(old)));
 	}
 
-	g_slist_free(assembly->assembly_list);
-	g_slist_free(assembly->recv_plmn);
-	g_slist_free(assembly->recv_loc);
-	g_slist_free(assembly->recv_cell);
+	g_queue_push_tail(recv->lru, GUINT_TO_POINTER(serial));
+
+	g_hash_table_insert(recv->serials,
+				GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(serial)),
+				g_queue_peek_tail_link(recv->lru));
+}
+
+struct cbs_assembly *cbs_assembly_new()
+{
+	struct cbs_assembly *assembly = g_new0(struct cbs_assembly, 1);
+
+	assembly->assembly_table = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+	assembly->assembly_lru = g_queue_new();
+
+	cbs_recv_init(&assembly->recv_plmn);
+	cbs_recv_init(&assembly->recv_loc);
+	cbs_recv_init(&assembly->recv_cell);
+
+	return assembly;
+}
+
+static void cbs_assembly_node_free(struct cbs_assembly_node *node)
+{
+	g_slist_foreach(node->pages, (GFunc)g_free, NULL);
+	g_slist_free(node->pages);
+	g_free(node);
+}
+
+/* The nodes themselves are owned, and freed, through assembly_lru */
+static void cbs_assembly_list_free(gpointer key, gpointer value,
+					gpointer user_data)
+{
+	g_slist_free(value);
+}
+
+void cbs_assembly_free(struct cbs_assembly *assembly)
+{
+	g_queue_foreach(assembly->assembly_lru,
+				(GFunc)cbs_assembly_node_free, NULL);
+	g_queue_free(assembly->assembly_lru);
+	g_hash_table_foreach(assembly->assembly_table,
+				cbs_assembly_list_free, NULL);
+	g_hash_table_destroy(assembly->assembly_table);
+
+	cbs_recv_destroy(&assembly->recv_plmn);
+	cbs_recv_destroy(&assembly->recv_loc);
+	cbs_recv_destroy(&assembly->recv_cell);
 
 	g_free(assembly);
 }
 
-static gint cbs_compare_node_by_gs(gconstpointer a, gconstpointer b)
+static struct cbs_assembly_node *cbs_assembly_lookup(
+					struct cbs_assembly *assembly,
+					unsigned int serial)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int gs = GPOINTER_TO_UINT(b);
+	GSList *l;
 
-	if (((node->serial >> 14) & 0x3) == gs)
-		return 0;
+	l = g_hash_table_lookup(assembly->assembly_table,
+				GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(serial)));
 
-	return 1;
+	for (; l; l = l->next) {
+		struct cbs_assembly_node *node = l->data;
+
+		if (node->serial == serial)
+			return node;
+	}
+
+	return NULL;
 }
 
-static gint cbs_compare_node_by_update(gconstpointer a, gconstpointer b)
+static void cbs_assembly_remove(struct cbs_assembly *assembly,
+				struct cbs_assembly_node *node)
 {
-	const struct cbs_assembly_node *node = a;
-	unsigned int serial = GPOINTER_TO_UINT(b);
+	gpointer key = GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(node->serial));
+	GSList *l;
 
-	if ((serial & (~0xf)) != (node->serial & (~0xf)))
-		return 1;
+	l = g_hash_table_lookup(assembly->assembly_table, key);
+	l = g_slist_remove(l, node);
 
-	if (cbs_is_update_newer(node->serial, serial))
-		return 1;
+	if (l)
+		g_hash_table_insert(assembly->assembly_table, key, l);
+	else
+		g_hash_table_remove(assembly->assembly_table, key);
 
-	return 0;
+	g_queue_delete_link(assembly->assembly_lru, node->lru_link);
 }
 
-static gint cbs_compare_recv_by_serial(gconstpointer a, gconstpointer b)
+static void cbs_assembly_expire_scope(struct cbs_assembly *assembly,
+					enum cbs_geo_scope gs)
 {
-	unsigned int old_serial = GPOINTER_TO_UINT(a);
-	unsigned int new_serial = GPOINTER_TO_UINT(b);
+	GList *l = g_queue_peek_head_link(assembly->assembly_lru);
+	struct cbs_assembly_node *node;
 
-	if ((old_serial & (~0xf)) == (new_serial & (~0xf)))
-		return 0;
+	while (l) {
+		node = l->data;
+		l = l->next;
 
-	return 1;
+		if (((node->serial >> 14) & 0x3) != gs)
+			continue;
+
+		cbs_assembly_remove(assembly, node);
+		cbs_assembly_node_free(node);
+	}
 }
 
-static void cbs_assembly_expire(struct cbs_assembly *assembly,
-				GCompareFunc func, gconstpointer *userdata)
+static void cbs_assembly_expire_updates(struct cbs_assembly *assembly,
+					unsigned int serial)
 {
 	GSList *l;
-	GSList *prev;
-	GSList *tmp;
+	struct cbs_assembly_node *node;
 
 	/* Take care of the case where several updates are being
 	 * reassembled at the same time.  If the newer one is assembled
@@ -3524,29 +4333,18 @@ static void cbs_assembly_expire(struct cbs_assembly *assembly,
 	 * sure that we're also discarding the assembly node for the
 	 * partially assembled ones
 	 */
-	prev = NULL;
-	l = assembly->assembly_list;
+	l = g_hash_table_lookup(assembly->assembly_table,
+				GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(serial)));
 
 	while (l) {
-		struct cbs_assembly_node *node = l->data;
+		node = l->data;
+		l = l->next;
 
-		if (func(node, userdata) != 0) {
-			prev = l;
-			l = l->next;
+		if (cbs_is_update_newer(node->serial, serial))
 			continue;
-		}
 
-		if (prev)
-			prev->next = l->next;
-		else
-			assembly->assembly_list = l->next;
-
-		g_slist_foreach(node->pages, (GFunc)g_free, NULL);
-		g_slist_free(node->pages);
-		g_free(node->pages);
-		tmp = l;
-		l = l->next;
-		g_slist_free_1(tmp);
+		cbs_assembly_remove(assembly, node);
+		cbs_assembly_node_free(node);
 	}
 }
 
@@ -3569,30 +4367,24 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 
 	if (plmn) {
 		lac = TRUE;
-		g_slist_free(assembly->recv_plmn);
-		assembly->recv_plmn = NULL;
-
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_PLMN));
+		cbs_recv_clear(&assembly->recv_plmn);
+		cbs_assembly_expire_scope(assembly, CBS_GEO_SCOPE_PLMN);
 	}
 
 	if (lac) {
 		/* If LAC changed, then cell id has changed */
 		ci = TRUE;
-		g_slist_free(assembly->recv_loc);
-		assembly->recv_loc = NULL;
-
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_SERVICE_AREA));
+		cbs_recv_clear(&assembly->recv_loc);
+		cbs_assembly_expire_scope(assembly,
+						CBS_GEO_SCOPE_SERVICE_AREA);
 	}
 
 	if (ci) {
-		g_slist_free(assembly->recv_cell);
-		assembly->recv_cell = NULL;
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_IMMEDIATE));
-		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
-				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_NORMAL));
+		cbs_recv_clear(&assembly->recv_cell);
+		cbs_assembly_expire_scope(assembly,
+						CBS_GEO_SCOPE_CELL_IMMEDIATE);
+		cbs_assembly_expire_scope(assembly,
+						CBS_GEO_SCOPE_CELL_NORMAL);
 	}
 }
 
@@ -3601,12 +4393,14 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 {
 	struct cbs *newcbs;
 	struct cbs_assembly_node *node;
+	struct cbs_recv_table *recv;
 	GSList *completed;
 	unsigned int new_serial;
-	GSList **recv;
-	GSList *l;
-	GSList *prev;
+	GSList *group;
+	gpointer key;
+	GList *l;
 	int position;
+	int j;
 
 	new_serial = cbs->gs << 14;
 	new_serial |= cbs->message_code << 4;
@@ -3621,20 +4415,17 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 		recv = &assembly->recv_cell;
 
 	/* Have we seen this message before? */
-	l = g_slist_find_custom(*recv, GUINT_TO_POINTER(new_serial),
-				cbs_compare_recv_by_serial);
+	l = cbs_recv_lookup(recv, new_serial);
 
 	/* If we have, is the message newer? */
-	if (l && !cbs_is_update_newer(new_serial, GPOINTER_TO_UINT(l->data)))
+	if (l && !cbs_is_update_newer(new_serial, GPOINTER_TO_UINT(l->data))) {
+		cbs_recv_touch(recv, l);
 		return NULL;
+	}
 
 	/* Easy case first, page 1 of 1 */
 	if (cbs->max_pages == 1 && cbs->page == 1) {
-		if (l)
-			l->data = GUINT_TO_POINTER(new_serial);
-		else
-			*recv = g_slist_prepend(*recv,
-						GUINT_TO_POINTER(new_serial));
+		cbs_recv_update(recv, l, new_serial);
 
 		newcbs = g_new(struct cbs, 1);
 		memcpy(newcbs, cbs, sizeof(struct cbs));
@@ -3643,16 +4434,10 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 		return completed;
 	}
 
-	prev = NULL;
 	position = 0;
+	node = cbs_assembly_lookup(assembly, new_serial);
 
-	for (l = assembly->assembly_list; l; prev = l, l = l->next) {
-		int j;
-		node = l->data;
-
-		if (new_serial != node->serial)
-			continue;
-
+	if (node) {
 		if (node->bitmap & (1 << cbs->page))
 			return NULL;
 
@@ -3660,18 +4445,29 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 			if (node->bitmap & (1 << j))
 				position += 1;
 
+		g_queue_unlink(assembly->assembly_lru, node->lru_link);
+		g_queue_push_tail_link(assembly->assembly_lru, node->lru_link);
+
 		goto out;
 	}
 
+	/* Give up on the message we have heard from the longest ago */
+	if (g_queue_get_length(assembly->assembly_lru) >= CBS_MAX_ASSEMBLY) {
+		node = g_queue_peek_head(assembly->assembly_lru);
+		cbs_assembly_remove(assembly, node);
+		cbs_assembly_node_free(node);
+	}
+
 	node = g_new0(struct cbs_assembly_node, 1);
 	node->serial = new_serial;
 
-	assembly->assembly_list = g_slist_prepend(assembly->assembly_list,
-							node);
+	g_queue_push_tail(assembly->assembly_lru, node);
+	node->lru_link = g_queue_peek_tail_link(assembly->assembly_lru);
 
-	prev = NULL;
-	l = assembly->assembly_list;
-	position = 0;
+	key = GUINT_TO_POINTER(CBS_SERIAL_MESSAGE(new_serial));
+	group = g_hash_table_lookup(assembly->assembly_table, key);
+	group = g_slist_prepend(group, node);
+	g_hash_table_insert(assembly->assembly_table, key, group);
 
 out:
 	newcbs = g_new(struct cbs, 1);
@@ -3684,17 +4480,11 @@ out:
 
 	completed = node->pages;
 
-	if (prev)
-		prev->next = l->next;
-	else
-		assembly->assembly_list = l->next;
-
+	cbs_assembly_remove(assembly, node);
 	g_free(node);
-	g_slist_free_1(l);
 
-	cbs_assembly_expire(assembly, cbs_compare_node_by_update,
-				GUINT_TO_POINTER(new_serial));
-	*recv = g_slist_prepend(*recv, GUINT_TO_POINTER(new_serial));
+	cbs_assembly_expire_updates(assembly, new_serial);
+	cbs_recv_update(recv, l, new_serial);
 
 	return completed;
 }
@@ -3940,6 +4730,59 @@ gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges)
 					cbs_topic_compare) != NULL;
 }
 
+/*
+ * Compiles the ranges for cbs_topic_filter_match, which unlike
+ * cbs_topic_in_range does not depend on the number of ranges.  Returns
+ * NULL for an empty list, which matches nothing.
+ */
+struct cbs_topic_filter *cbs_topic_filter_new(GSList *ranges)
+{
+	struct cbs_topic_filter *filter;
+	struct cbs_topic_range *range;
+	unsigned int first;
+	unsigned int last;
+	guint32 head;
+	guint32 tail;
+	unsigned int i;
+	GSList *l;
+
+	if (ranges == NULL)
+		return NULL;
+
+	filter = g_new0(struct cbs_topic_filter, 1);
+
+	for (l = ranges; l; l = l->next) {
+		range = l->data;
+
+		if (range->min > range->max)
+			continue;
+
+		first = range->min / 32;
+		last = range->max / 32;
+		head = 0xffffffffU << (range->min % 32);
+		tail = 0xffffffffU >> (31 - range->max % 32);
+
+		if (first == last) {
+			filter->bitmap[first] |= head & tail;
+			continue;
+		}
+
+		filter->bitmap[first] |= head;
+
+		for (i = first + 1; i < last; i++)
+			filter->bitmap[i] = 0xffffffffU;
+
+		filter->bitmap[last] |= tail;
+	}
+
+	return filter;
+}
+
+void cbs_topic_filter_free(struct cbs_topic_filter *filter)
+{
+	g_free(filter);
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data)
 {
 	gboolean udhi;
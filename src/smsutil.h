@@ -352,7 +352,8 @@ struct sms_udh_iter {
 struct sms_assembly_node {
 	struct sms_address addr;
 	time_t ts;
-	GSList *fragment_list;
+	struct sms *fragments[256];	/* Indexed by sequence number */
+	guint heap_index;		/* Position in the expiry heap */
 	guint16 ref;
 	guint8 max_fragments;
 	guint8 num_fragments;
@@ -361,13 +362,19 @@ struct sms_assembly_node {
 
 struct sms_assembly {
 	const char *imsi;
-	GSList *assembly_list;
+	GHashTable *assembly_table;	/* Nodes by address and reference */
+	GPtrArray *expiry_heap;		/* Nodes, oldest first */
+	guint fragments;		/* Fragments held by all nodes */
+	int journal_fd;			/* Backup journal or -1 */
+	guint journal_records;		/* Records in the journal */
 };
 
 struct id_table_node {
 	struct sms_address to;
+	unsigned int msg_id;
 	unsigned int mrs[8];
 	time_t expiration;
+	GList *expiry_link;		/* Position in the expiry queue */
 	unsigned char total_mrs;
 	unsigned char sent_mrs;
 	gboolean deliverable;
@@ -375,7 +382,11 @@ struct id_table_node {
 
 struct status_report_assembly {
 	const char *imsi;
-	GHashTable *assembly_table;
+	GHashTable *assembly_table;	/* Nodes by address and message id */
+	GHashTable *mr_table;		/* Nodes by address and TP-MR */
+	GQueue *expiry_queue;		/* Nodes, oldest first */
+	int journal_fd;			/* Backup journal or -1 */
+	guint journal_records;		/* Records in the journal */
 };
 
 struct cbs {
@@ -393,13 +404,24 @@ struct cbs_assembly_node {
 	guint32 serial;
 	guint16 bitmap;
 	GSList *pages;
+	GList *lru_link;		/* Position in the LRU queue */
+};
+
+/*
+ * Messages are keyed by their serial without the update number, which
+ * leaves the geographical scope, message code and message identifier
+ */
+struct cbs_recv_table {
+	GHashTable *serials;		/* LRU links by message */
+	GQueue *lru;			/* Serials, least recently seen first */
 };
 
 struct cbs_assembly {
-	GSList *assembly_list;
-	GSList *recv_plmn;
-	GSList *recv_loc;
-	GSList *recv_cell;
+	GHashTable *assembly_table;	/* Node lists by message */
+	GQueue *assembly_lru;		/* Nodes, least recently used first */
+	struct cbs_recv_table recv_plmn;
+	struct cbs_recv_table recv_loc;
+	struct cbs_recv_table recv_cell;
 };
 
 struct cbs_topic_range {
@@ -407,6 +429,11 @@ struct cbs_topic_range {
 	unsigned short max;
 };
 
+/* One bit per message identifier, compiled from a list of topic ranges */
+struct cbs_topic_filter {
+	guint32 bitmap[65536 / 32];
+};
+
 static inline gboolean is_bit_set(unsigned char oct, int bit)
 {
 	int mask = 0x1 << bit;
@@ -546,4 +573,17 @@ GSList *cbs_extract_topic_ranges(const char *ranges);
 GSList *cbs_optimize_ranges(GSList *ranges);
 gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges);
 
+struct cbs_topic_filter *cbs_topic_filter_new(GSList *ranges);
+void cbs_topic_filter_free(struct cbs_topic_filter *filter);
+
+static inline gboolean cbs_topic_filter_match(
+					const struct cbs_topic_filter *filter,
+					unsigned short topic)
+{
+	if (filter == NULL)
+		return FALSE;
+
+	return (filter->bitmap[topic / 32] >> (topic % 32)) & 1;
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data);
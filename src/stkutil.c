@@ -24,6 +24,7 @@
 #endif
 
 #include <string.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdint.h>
 
@@ -2005,193 +2006,129 @@ static gboolean parse_dataobj_broadcast_network_info(
 	return TRUE;
 }
 
-static dataobj_handler handler_for_type(enum stk_data_object_type type)
-{
-	switch (type) {
-	case STK_DATA_OBJECT_TYPE_ADDRESS:
-		return parse_dataobj_address;
-	case STK_DATA_OBJECT_TYPE_ALPHA_ID:
-		return parse_dataobj_alpha_id;
-	case STK_DATA_OBJECT_TYPE_SUBADDRESS:
-		return parse_dataobj_subaddress;
-	case STK_DATA_OBJECT_TYPE_CCP:
-		return parse_dataobj_ccp;
-	case STK_DATA_OBJECT_TYPE_CBS_PAGE:
-		return parse_dataobj_cbs_page;
-	case STK_DATA_OBJECT_TYPE_DURATION:
-		return parse_dataobj_duration;
-	case STK_DATA_OBJECT_TYPE_ITEM:
-		return parse_dataobj_item;
-	case STK_DATA_OBJECT_TYPE_ITEM_ID:
-		return parse_dataobj_item_id;
-	case STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH:
-		return parse_dataobj_response_len;
-	case STK_DATA_OBJECT_TYPE_RESULT:
-		return parse_dataobj_result;
-	case STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU:
-		return parse_dataobj_gsm_sms_tpdu;
-	case STK_DATA_OBJECT_TYPE_SS_STRING:
-		return parse_dataobj_ss;
-	case STK_DATA_OBJECT_TYPE_TEXT:
-		return parse_dataobj_text;
-	case STK_DATA_OBJECT_TYPE_TONE:
-		return parse_dataobj_tone;
-	case STK_DATA_OBJECT_TYPE_USSD_STRING:
-		return parse_dataobj_ussd;
-	case STK_DATA_OBJECT_TYPE_FILE_LIST:
-		return parse_dataobj_file_list;
-	case STK_DATA_OBJECT_TYPE_LOCATION_INFO:
-		return parse_dataobj_location_info;
-	case STK_DATA_OBJECT_TYPE_IMEI:
-		return parse_dataobj_imei;
-	case STK_DATA_OBJECT_TYPE_HELP_REQUEST:
-		return parse_dataobj_help_request;
-	case STK_DATA_OBJECT_TYPE_NETWORK_MEASUREMENT_RESULTS:
-		return parse_dataobj_network_measurement_results;
-	case STK_DATA_OBJECT_TYPE_DEFAULT_TEXT:
-		return parse_dataobj_default_text;
-	case STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR:
-		return parse_dataobj_items_next_action_indicator;
-	case STK_DATA_OBJECT_TYPE_EVENT_LIST:
-		return parse_dataobj_event_list;
-	case STK_DATA_OBJECT_TYPE_CAUSE:
-		return parse_dataobj_cause;
-	case STK_DATA_OBJECT_TYPE_LOCATION_STATUS:
-		return parse_dataobj_location_status;
-	case STK_DATA_OBJECT_TYPE_TRANSACTION_ID:
-		return parse_dataobj_transaction_id;
-	case STK_DATA_OBJECT_TYPE_BCCH_CHANNEL_LIST:
-		return parse_dataobj_bcch_channel_list;
-	case STK_DATA_OBJECT_TYPE_CALL_CONTROL_REQUESTED_ACTION:
-		return parse_dataobj_call_control_requested_action;
-	case STK_DATA_OBJECT_TYPE_ICON_ID:
-		return parse_dataobj_icon_id;
-	case STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST:
-		return parse_dataobj_item_icon_id_list;
-	case STK_DATA_OBJECT_TYPE_CARD_READER_STATUS:
-		return parse_dataobj_card_reader_status;
-	case STK_DATA_OBJECT_TYPE_CARD_ATR:
-		return parse_dataobj_card_atr;
-	case STK_DATA_OBJECT_TYPE_C_APDU:
-		return parse_dataobj_c_apdu;
-	case STK_DATA_OBJECT_TYPE_R_APDU:
-		return parse_dataobj_r_apdu;
-	case STK_DATA_OBJECT_TYPE_TIMER_ID:
-		return parse_dataobj_timer_id;
-	case STK_DATA_OBJECT_TYPE_TIMER_VALUE:
-		return parse_dataobj_timer_value;
-	case STK_DATA_OBJECT_TYPE_DATETIME_TIMEZONE:
-		return parse_dataobj_datetime_timezone;
-	case STK_DATA_OBJECT_TYPE_AT_COMMAND:
-		return parse_dataobj_at_command;
-	case STK_DATA_OBJECT_TYPE_AT_RESPONSE:
-		return parse_dataobj_at_response;
-	case STK_DATA_OBJECT_TYPE_BC_REPEAT_INDICATOR:
-		return parse_dataobj_bc_repeat_indicator;
-	case STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE:
-		return parse_dataobj_imm_resp;
-	case STK_DATA_OBJECT_TYPE_DTMF_STRING:
-		return parse_dataobj_dtmf_string;
-	case STK_DATA_OBJECT_TYPE_LANGUAGE:
-		return parse_dataobj_language;
-	case STK_DATA_OBJECT_TYPE_BROWSER_ID:
-		return parse_dataobj_browser_id;
-	case STK_DATA_OBJECT_TYPE_TIMING_ADVANCE:
-		return parse_dataobj_timing_advance;
-	case STK_DATA_OBJECT_TYPE_URL:
-		return parse_dataobj_url;
-	case STK_DATA_OBJECT_TYPE_BEARER:
-		return parse_dataobj_bearer;
-	case STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF:
-		return parse_dataobj_provisioning_file_reference;
-	case STK_DATA_OBJECT_TYPE_BROWSER_TERMINATION_CAUSE:
-		return parse_dataobj_browser_termination_cause;
-	case STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION:
-		return parse_dataobj_bearer_description;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_DATA:
-		return parse_dataobj_channel_data;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH:
-		return parse_dataobj_channel_data_length;
-	case STK_DATA_OBJECT_TYPE_BUFFER_SIZE:
-		return parse_dataobj_buffer_size;
-	case STK_DATA_OBJECT_TYPE_CHANNEL_STATUS:
-		return parse_dataobj_channel_status;
-	case STK_DATA_OBJECT_TYPE_CARD_READER_ID:
-		return parse_dataobj_card_reader_id;
-	case STK_DATA_OBJECT_TYPE_OTHER_ADDRESS:
-		return parse_dataobj_other_address;
-	case STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE:
-		return parse_dataobj_uicc_te_interface;
-	case STK_DATA_OBJECT_TYPE_AID:
-		return parse_dataobj_aid;
-	case STK_DATA_OBJECT_TYPE_ACCESS_TECHNOLOGY:
-		return parse_dataobj_access_technology;
-	case STK_DATA_OBJECT_TYPE_DISPLAY_PARAMETERS:
-		return parse_dataobj_display_parameters;
-	case STK_DATA_OBJECT_TYPE_SERVICE_RECORD:
-		return parse_dataobj_service_record;
-	case STK_DATA_OBJECT_TYPE_DEVICE_FILTER:
-		return parse_dataobj_device_filter;
-	case STK_DATA_OBJECT_TYPE_SERVICE_SEARCH:
-		return parse_dataobj_service_search;
-	case STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO:
-		return parse_dataobj_attribute_info;
-	case STK_DATA_OBJECT_TYPE_SERVICE_AVAILABILITY:
-		return parse_dataobj_service_availability;
-	case STK_DATA_OBJECT_TYPE_REMOTE_ENTITY_ADDRESS:
-		return parse_dataobj_remote_entity_address;
-	case STK_DATA_OBJECT_TYPE_ESN:
-		return parse_dataobj_esn;
-	case STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME:
-		return parse_dataobj_network_access_name;
-	case STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU:
-		return parse_dataobj_cdma_sms_tpdu;
-	case STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE:
-		return parse_dataobj_text_attr;
-	case STK_DATA_OBJECT_TYPE_PDP_ACTIVATION_PARAMETER:
-		return parse_dataobj_pdp_act_par;
-	case STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST:
-		return parse_dataobj_item_text_attribute_list;
-	case STK_DATA_OBJECT_TYPE_UTRAN_MEASUREMENT_QUALIFIER:
-		return parse_dataobj_utran_meas_qualifier;
-	case STK_DATA_OBJECT_TYPE_IMEISV:
-		return parse_dataobj_imeisv;
-	case STK_DATA_OBJECT_TYPE_NETWORK_SEARCH_MODE:
-		return parse_dataobj_network_search_mode;
-	case STK_DATA_OBJECT_TYPE_BATTERY_STATE:
-		return parse_dataobj_battery_state;
-	case STK_DATA_OBJECT_TYPE_BROWSING_STATUS:
-		return parse_dataobj_browsing_status;
-	case STK_DATA_OBJECT_TYPE_FRAME_LAYOUT:
-		return parse_dataobj_frame_layout;
-	case STK_DATA_OBJECT_TYPE_FRAMES_INFO:
-		return parse_dataobj_frames_info;
-	case STK_DATA_OBJECT_TYPE_FRAME_ID:
-		return parse_dataobj_frame_id;
-	case STK_DATA_OBJECT_TYPE_MEID:
-		return parse_dataobj_meid;
-	case STK_DATA_OBJECT_TYPE_MMS_REFERENCE:
-		return parse_dataobj_mms_reference;
-	case STK_DATA_OBJECT_TYPE_MMS_ID:
-		return parse_dataobj_mms_id;
-	case STK_DATA_OBJECT_TYPE_MMS_TRANSFER_STATUS:
-		return parse_dataobj_mms_transfer_status;
-	case STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID:
-		return parse_dataobj_mms_content_id;
-	case STK_DATA_OBJECT_TYPE_MMS_NOTIFICATION:
-		return parse_dataobj_mms_notification;
-	case STK_DATA_OBJECT_TYPE_LAST_ENVELOPE:
-		return parse_dataobj_last_envelope;
-	case STK_DATA_OBJECT_TYPE_REGISTRY_APPLICATION_DATA:
-		return parse_dataobj_registry_application_data;
-	case STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR:
-		return parse_dataobj_activate_descriptor;
-	case STK_DATA_OBJECT_TYPE_BROADCAST_NETWORK_INFO:
-		return parse_dataobj_broadcast_network_info;
-	default:
-		return NULL;
-	}
-}
+/*
+ * Handlers indexed by tag.  All the data objects parsed out of proactive
+ * commands use the single byte tag format, so 7 bits are enough.
+ */
+static const dataobj_handler dataobj_handlers[128] = {
+	[STK_DATA_OBJECT_TYPE_ADDRESS] = parse_dataobj_address,
+	[STK_DATA_OBJECT_TYPE_ALPHA_ID] = parse_dataobj_alpha_id,
+	[STK_DATA_OBJECT_TYPE_SUBADDRESS] = parse_dataobj_subaddress,
+	[STK_DATA_OBJECT_TYPE_CCP] = parse_dataobj_ccp,
+	[STK_DATA_OBJECT_TYPE_CBS_PAGE] = parse_dataobj_cbs_page,
+	[STK_DATA_OBJECT_TYPE_DURATION] = parse_dataobj_duration,
+	[STK_DATA_OBJECT_TYPE_ITEM] = parse_dataobj_item,
+	[STK_DATA_OBJECT_TYPE_ITEM_ID] = parse_dataobj_item_id,
+	[STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH] = parse_dataobj_response_len,
+	[STK_DATA_OBJECT_TYPE_RESULT] = parse_dataobj_result,
+	[STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU] = parse_dataobj_gsm_sms_tpdu,
+	[STK_DATA_OBJECT_TYPE_SS_STRING] = parse_dataobj_ss,
+	[STK_DATA_OBJECT_TYPE_TEXT] = parse_dataobj_text,
+	[STK_DATA_OBJECT_TYPE_TONE] = parse_dataobj_tone,
+	[STK_DATA_OBJECT_TYPE_USSD_STRING] = parse_dataobj_ussd,
+	[STK_DATA_OBJECT_TYPE_FILE_LIST] = parse_dataobj_file_list,
+	[STK_DATA_OBJECT_TYPE_LOCATION_INFO] = parse_dataobj_location_info,
+	[STK_DATA_OBJECT_TYPE_IMEI] = parse_dataobj_imei,
+	[STK_DATA_OBJECT_TYPE_HELP_REQUEST] = parse_dataobj_help_request,
+	[STK_DATA_OBJECT_TYPE_NETWORK_MEASUREMENT_RESULTS] =
+				parse_dataobj_network_measurement_results,
+	[STK_DATA_OBJECT_TYPE_DEFAULT_TEXT] = parse_dataobj_default_text,
+	[STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR] =
+				parse_dataobj_items_next_action_indicator,
+	[STK_DATA_OBJECT_TYPE_EVENT_LIST] = parse_dataobj_event_list,
+	[STK_DATA_OBJECT_TYPE_CAUSE] = parse_dataobj_cause,
+	[STK_DATA_OBJECT_TYPE_LOCATION_STATUS] = parse_dataobj_location_status,
+	[STK_DATA_OBJECT_TYPE_TRANSACTION_ID] = parse_dataobj_transaction_id,
+	[STK_DATA_OBJECT_TYPE_BCCH_CHANNEL_LIST] =
+				parse_dataobj_bcch_channel_list,
+	[STK_DATA_OBJECT_TYPE_CALL_CONTROL_REQUESTED_ACTION] =
+				parse_dataobj_call_control_requested_action,
+	[STK_DATA_OBJECT_TYPE_ICON_ID] = parse_dataobj_icon_id,
+	[STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST] =
+				parse_dataobj_item_icon_id_list,
+	[STK_DATA_OBJECT_TYPE_CARD_READER_STATUS] =
+				parse_dataobj_card_reader_status,
+	[STK_DATA_OBJECT_TYPE_CARD_ATR] = parse_dataobj_card_atr,
+	[STK_DATA_OBJECT_TYPE_C_APDU] = parse_dataobj_c_apdu,
+	[STK_DATA_OBJECT_TYPE_R_APDU] = parse_dataobj_r_apdu,
+	[STK_DATA_OBJECT_TYPE_TIMER_ID] = parse_dataobj_timer_id,
+	[STK_DATA_OBJECT_TYPE_TIMER_VALUE] = parse_dataobj_timer_value,
+	[STK_DATA_OBJECT_TYPE_DATETIME_TIMEZONE] =
+				parse_dataobj_datetime_timezone,
+	[STK_DATA_OBJECT_TYPE_AT_COMMAND] = parse_dataobj_at_command,
+	[STK_DATA_OBJECT_TYPE_AT_RESPONSE] = parse_dataobj_at_response,
+	[STK_DATA_OBJECT_TYPE_BC_REPEAT_INDICATOR] =
+				parse_dataobj_bc_repeat_indicator,
+	[STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE] = parse_dataobj_imm_resp,
+	[STK_DATA_OBJECT_TYPE_DTMF_STRING] = parse_dataobj_dtmf_string,
+	[STK_DATA_OBJECT_TYPE_LANGUAGE] = parse_dataobj_language,
+	[STK_DATA_OBJECT_TYPE_BROWSER_ID] = parse_dataobj_browser_id,
+	[STK_DATA_OBJECT_TYPE_TIMING_ADVANCE] = parse_dataobj_timing_advance,
+	[STK_DATA_OBJECT_TYPE_URL] = parse_dataobj_url,
+	[STK_DATA_OBJECT_TYPE_BEARER] = parse_dataobj_bearer,
+	[STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF] =
+				parse_dataobj_provisioning_file_reference,
+	[STK_DATA_OBJECT_TYPE_BROWSER_TERMINATION_CAUSE] =
+				parse_dataobj_browser_termination_cause,
+	[STK_DATA_OBJECT_TYPE_BEARER_DESCRIPTION] =
+				parse_dataobj_bearer_description,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_DATA] = parse_dataobj_channel_data,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH] =
+				parse_dataobj_channel_data_length,
+	[STK_DATA_OBJECT_TYPE_BUFFER_SIZE] = parse_dataobj_buffer_size,
+	[STK_DATA_OBJECT_TYPE_CHANNEL_STATUS] = parse_dataobj_channel_status,
+	[STK_DATA_OBJECT_TYPE_CARD_READER_ID] = parse_dataobj_card_reader_id,
+	[STK_DATA_OBJECT_TYPE_OTHER_ADDRESS] = parse_dataobj_other_address,
+	[STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE] =
+				parse_dataobj_uicc_te_interface,
+	[STK_DATA_OBJECT_TYPE_AID] = parse_dataobj_aid,
+	[STK_DATA_OBJECT_TYPE_ACCESS_TECHNOLOGY] =
+				parse_dataobj_access_technology,
+	[STK_DATA_OBJECT_TYPE_DISPLAY_PARAMETERS] =
+				parse_dataobj_display_parameters,
+	[STK_DATA_OBJECT_TYPE_SERVICE_RECORD] = parse_dataobj_service_record,
+	[STK_DATA_OBJECT_TYPE_DEVICE_FILTER] = parse_dataobj_device_filter,
+	[STK_DATA_OBJECT_TYPE_SERVICE_SEARCH] = parse_dataobj_service_search,
+	[STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO] = parse_dataobj_attribute_info,
+	[STK_DATA_OBJECT_TYPE_SERVICE_AVAILABILITY] =
+				parse_dataobj_service_availability,
+	[STK_DATA_OBJECT_TYPE_REMOTE_ENTITY_ADDRESS] =
+				parse_dataobj_remote_entity_address,
+	[STK_DATA_OBJECT_TYPE_ESN] = parse_dataobj_esn,
+	[STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME] =
+				parse_dataobj_network_access_name,
+	[STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU] = parse_dataobj_cdma_sms_tpdu,
+	[STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE] = parse_dataobj_text_attr,
+	[STK_DATA_OBJECT_TYPE_PDP_ACTIVATION_PARAMETER] =
+				parse_dataobj_pdp_act_par,
+	[STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST] =
+				parse_dataobj_item_text_attribute_list,
+	[STK_DATA_OBJECT_TYPE_UTRAN_MEASUREMENT_QUALIFIER] =
+				parse_dataobj_utran_meas_qualifier,
+	[STK_DATA_OBJECT_TYPE_IMEISV] = parse_dataobj_imeisv,
+	[STK_DATA_OBJECT_TYPE_NETWORK_SEARCH_MODE] =
+				parse_dataobj_network_search_mode,
+	[STK_DATA_OBJECT_TYPE_BATTERY_STATE] = parse_dataobj_battery_state,
+	[STK_DATA_OBJECT_TYPE_BROWSING_STATUS] = parse_dataobj_browsing_status,
+	[STK_DATA_OBJECT_TYPE_FRAME_LAYOUT] = parse_dataobj_frame_layout,
+	[STK_DATA_OBJECT_TYPE_FRAMES_INFO] = parse_dataobj_frames_info,
+	[STK_DATA_OBJECT_TYPE_FRAME_ID] = parse_dataobj_frame_id,
+	[STK_DATA_OBJECT_TYPE_MEID] = parse_dataobj_meid,
+	[STK_DATA_OBJECT_TYPE_MMS_REFERENCE] = parse_dataobj_mms_reference,
+	[STK_DATA_OBJECT_TYPE_MMS_ID] = parse_dataobj_mms_id,
+	[STK_DATA_OBJECT_TYPE_MMS_TRANSFER_STATUS] =
+				parse_dataobj_mms_transfer_status,
+	[STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID] = parse_dataobj_mms_content_id,
+	[STK_DATA_OBJECT_TYPE_MMS_NOTIFICATION] =
+				parse_dataobj_mms_notification,
+	[STK_DATA_OBJECT_TYPE_LAST_ENVELOPE] = parse_dataobj_last_envelope,
+	[STK_DATA_OBJECT_TYPE_REGISTRY_APPLICATION_DATA] =
+				parse_dataobj_registry_application_data,
+	[STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR] =
+				parse_dataobj_activate_descriptor,
+	[STK_DATA_OBJECT_TYPE_BROADCAST_NETWORK_INFO] =
+				parse_dataobj_broadcast_network_info,
+};
 
 static void destroy_stk_item(struct stk_item *item)
 {
@@ -2281,59 +2218,48 @@ static dataobj_handler list_handler_for_type(enum stk_data_object_type type)
 	}
 }
 
-struct dataobj_handler_entry {
+/*
+ * Describes one data object expected in a proactive command: where it goes
+ * is given as an offset into the command specific structure, tables are
+ * terminated by an entry of type STK_DATA_OBJECT_TYPE_INVALID.
+ */
+struct dataobj_desc {
 	enum stk_data_object_type type;
 	int flags;
-	void *data;
+	size_t offset;
 };
 
+static const struct dataobj_desc *find_dataobj(
+					const struct dataobj_desc *entry,
+					unsigned short tag)
+{
+	for (; entry->type != STK_DATA_OBJECT_TYPE_INVALID; entry++) {
+		if (tag == entry->type)
+			return entry;
+
+		/* Can't skip over mandatory objects */
+		if (entry->flags & DATAOBJ_FLAG_MANDATORY)
+			return NULL;
+	}
+
+	return NULL;
+}
+
 static enum stk_command_parse_result parse_dataobj(
 					struct comprehension_tlv_iter *iter,
-					enum stk_data_object_type type, ...)
+					const struct dataobj_desc *desc,
+					void *obj)
 {
-	GSList *entries = NULL;
-	GSList *l;
-	va_list args;
+	const struct dataobj_desc *next = desc;
 	gboolean minimum_set = TRUE;
 	gboolean parse_error = FALSE;
 
-	va_start(args, type);
-
-	while (type != STK_DATA_OBJECT_TYPE_INVALID) {
-		struct dataobj_handler_entry *entry;
-
-		entry = g_new0(struct dataobj_handler_entry, 1);
-
-		entry->type = type;
-		entry->flags = va_arg(args, int);
-		entry->data = va_arg(args, void *);
-
-		type = va_arg(args, enum stk_data_object_type);
-		entries = g_slist_prepend(entries, entry);
-	}
-
-	entries = g_slist_reverse(entries);
-
-	l = entries;
 	while (comprehension_tlv_iter_next(iter) == TRUE) {
+		unsigned short tag = comprehension_tlv_iter_get_tag(iter);
+		const struct dataobj_desc *entry = find_dataobj(next, tag);
 		dataobj_handler handler;
-		struct dataobj_handler_entry *entry;
-		GSList *l2;
-
-		for (l2 = l; l2; l2 = l2->next) {
-			entry = l2->data;
 
-			if (comprehension_tlv_iter_get_tag(iter) == entry->type)
-				break;
-
-			/* Can't skip over mandatory objects */
-			if (entry->flags & DATAOBJ_FLAG_MANDATORY) {
-				l2 = NULL;
-				break;
-			}
-		}
-
-		if (!l2) {
+		if (entry == NULL) {
 			if (comprehension_tlv_get_cr(iter) == TRUE)
 				parse_error = TRUE;
 
@@ -2343,24 +2269,19 @@ static enum stk_command_parse_result parse_dataobj(
 		if (entry->flags & DATAOBJ_FLAG_LIST)
 			handler = list_handler_for_type(entry->type);
 		else
-			handler = handler_for_type(entry->type);
+			handler = dataobj_handlers[entry->type];
 
-		if (handler(iter, entry->data) == FALSE)
+		if (handler(iter, (char *) obj + entry->offset) == FALSE)
 			parse_error = TRUE;
 
-		l = l2->next;
+		next = entry + 1;
 	}
 
-	for (; l; l = l->next) {
-		struct dataobj_handler_entry *entry = l->data;
-
-		if (entry->flags & DATAOBJ_FLAG_MANDATORY)
+	for (; next->type != STK_DATA_OBJECT_TYPE_INVALID; next++) {
+		if (next->flags & DATAOBJ_FLAG_MANDATORY)
 			minimum_set = FALSE;
 	}
 
-	g_slist_foreach(entries, (GFunc)g_free, NULL);
-	g_slist_free(entries);
-
 	if (minimum_set == FALSE)
 		return STK_PARSE_RESULT_MISSING_VALUE;
 	if (parse_error == TRUE)
@@ -2374,6 +2295,23 @@ static void destroy_display_text(struct stk_command *command)
 	g_free(command->display_text.text);
 }
 
+static const struct dataobj_desc display_text_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_display_text, text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_display_text, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
+		offsetof(struct stk_command_display_text, immediate_response) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+		offsetof(struct stk_command_display_text, duration) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_display_text, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_display_text, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_display_text(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2388,20 +2326,7 @@ static enum stk_command_parse_result parse_display_text(
 
 	command->destructor = destroy_display_text;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->immediate_response,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, display_text_dataobjs, obj);
 }
 
 static void destroy_get_inkey(struct stk_command *command)
@@ -2409,6 +2334,21 @@ static void destroy_get_inkey(struct stk_command *command)
 	g_free(command->get_inkey.text);
 }
 
+static const struct dataobj_desc get_inkey_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_get_inkey, text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_get_inkey, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+		offsetof(struct stk_command_get_inkey, duration) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_get_inkey, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_get_inkey, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_get_inkey(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2423,18 +2363,7 @@ static enum stk_command_parse_result parse_get_inkey(
 
 	command->destructor = destroy_get_inkey;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, get_inkey_dataobjs, obj);
 }
 
 static void destroy_get_input(struct stk_command *command)
@@ -2443,6 +2372,24 @@ static void destroy_get_input(struct stk_command *command)
 	g_free(command->get_input.default_text);
 }
 
+static const struct dataobj_desc get_input_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_get_input, text) },
+	{ STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_get_input, resp_len) },
+	{ STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0,
+		offsetof(struct stk_command_get_input, default_text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_get_input, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_get_input, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_get_input, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_get_input(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2457,21 +2404,7 @@ static enum stk_command_parse_result parse_get_input(
 
 	command->destructor = destroy_get_input;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_RESPONSE_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->resp_len,
-				STK_DATA_OBJECT_TYPE_DEFAULT_TEXT, 0,
-				&obj->default_text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, get_input_dataobjs, obj);
 }
 
 static enum stk_command_parse_result parse_more_time(
@@ -2492,6 +2425,22 @@ static void destroy_play_tone(struct stk_command *command)
 	g_free(command->play_tone.alpha_id);
 }
 
+static const struct dataobj_desc play_tone_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_play_tone, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_TONE, 0,
+		offsetof(struct stk_command_play_tone, tone) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+		offsetof(struct stk_command_play_tone, duration) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_play_tone, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_play_tone, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_play_tone, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_play_tone(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2506,21 +2455,16 @@ static enum stk_command_parse_result parse_play_tone(
 
 	command->destructor = destroy_play_tone;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_TONE, 0,
-				&obj->tone,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, play_tone_dataobjs, obj);
 }
 
+static const struct dataobj_desc poll_interval_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_DURATION,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_poll_interval, duration) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_poll_interval(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2533,10 +2477,7 @@ static enum stk_command_parse_result parse_poll_interval(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_DURATION,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, poll_interval_dataobjs, obj);
 }
 
 static void destroy_setup_menu(struct stk_command *command)
@@ -2547,6 +2488,27 @@ static void destroy_setup_menu(struct stk_command *command)
 	g_slist_free(command->setup_menu.items);
 }
 
+static const struct dataobj_desc setup_menu_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_setup_menu, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+			DATAOBJ_FLAG_LIST,
+		offsetof(struct stk_command_setup_menu, items) },
+	{ STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+		offsetof(struct stk_command_setup_menu, next_act) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_setup_menu, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+		offsetof(struct stk_command_setup_menu, item_icon_id_list) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_setup_menu, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+		offsetof(struct stk_command_setup_menu, item_text_attr_list) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_setup_menu(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2561,24 +2523,7 @@ static enum stk_command_parse_result parse_setup_menu(
 
 	command->destructor = destroy_setup_menu;
 
-	return parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, setup_menu_dataobjs, obj);
 }
 
 static void destroy_select_item(struct stk_command *command)
@@ -2589,6 +2534,30 @@ static void destroy_select_item(struct stk_command *command)
 	g_slist_free(command->select_item.items);
 }
 
+static const struct dataobj_desc select_item_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_select_item, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
+			DATAOBJ_FLAG_LIST,
+		offsetof(struct stk_command_select_item, items) },
+	{ STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
+		offsetof(struct stk_command_select_item, next_act) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_ID, 0,
+		offsetof(struct stk_command_select_item, item_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_select_item, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
+		offsetof(struct stk_command_select_item, item_icon_id_list) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_select_item, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
+		offsetof(struct stk_command_select_item, item_text_attr_list) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_select_item, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_select_item(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2602,27 +2571,7 @@ static enum stk_command_parse_result parse_select_item(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	status = parse_dataobj(iter,
-			STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-			&obj->alpha_id,
-			STK_DATA_OBJECT_TYPE_ITEM,
-			DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM |
-			DATAOBJ_FLAG_LIST, &obj->items,
-			STK_DATA_OBJECT_TYPE_ITEMS_NEXT_ACTION_INDICATOR, 0,
-			&obj->next_act,
-			STK_DATA_OBJECT_TYPE_ITEM_ID, 0,
-			&obj->item_id,
-			STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-			&obj->icon_id,
-			STK_DATA_OBJECT_TYPE_ITEM_ICON_ID_LIST, 0,
-			&obj->item_icon_id_list,
-			STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-			&obj->text_attr,
-			STK_DATA_OBJECT_TYPE_ITEM_TEXT_ATTRIBUTE_LIST, 0,
-			&obj->item_text_attr_list,
-			STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-			&obj->frame_id,
-			STK_DATA_OBJECT_TYPE_INVALID);
+	status = parse_dataobj(iter, select_item_dataobjs, obj);
 
 	command->destructor = destroy_select_item;
 
@@ -2638,14 +2587,46 @@ static void destroy_send_sms(struct stk_command *command)
 	g_free(command->send_sms.cdma_sms.array);
 }
 
+/*
+ * The TPDU and the SC address are only needed until they have been decoded
+ * into gsm_sms, so these are parsed into a temporary next to the fields that
+ * are copied into the command.
+ */
+struct send_sms_dataobjs {
+	char *alpha_id;
+	struct stk_address sc_address;
+	struct gsm_sms_tpdu gsm_tpdu;
+	struct stk_common_byte_array cdma_sms;
+	struct stk_icon_id icon_id;
+	struct stk_text_attribute text_attr;
+	struct stk_frame_id frame_id;
+};
+
+static const struct dataobj_desc send_sms_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct send_sms_dataobjs, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ADDRESS, 0,
+		offsetof(struct send_sms_dataobjs, sc_address) },
+	{ STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0,
+		offsetof(struct send_sms_dataobjs, gsm_tpdu) },
+	{ STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0,
+		offsetof(struct send_sms_dataobjs, cdma_sms) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct send_sms_dataobjs, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct send_sms_dataobjs, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct send_sms_dataobjs, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_send_sms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_send_sms *obj = &command->send_sms;
 	enum stk_command_parse_result status;
-	struct gsm_sms_tpdu gsm_tpdu;
-	struct stk_address sc_address = { 0, NULL };
+	struct send_sms_dataobjs data;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -2653,34 +2634,26 @@ static enum stk_command_parse_result parse_send_sms(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_NETWORK)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	memset(&gsm_tpdu, 0, sizeof(gsm_tpdu));
-	status = parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ADDRESS, 0,
-				&sc_address,
-				STK_DATA_OBJECT_TYPE_GSM_SMS_TPDU, 0,
-				&gsm_tpdu,
-				STK_DATA_OBJECT_TYPE_CDMA_SMS_TPDU, 0,
-				&obj->cdma_sms,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	memset(&data, 0, sizeof(data));
+	status = parse_dataobj(iter, send_sms_dataobjs, &data);
+
+	obj->alpha_id = data.alpha_id;
+	obj->cdma_sms = data.cdma_sms;
+	obj->icon_id = data.icon_id;
+	obj->text_attr = data.text_attr;
+	obj->frame_id = data.frame_id;
 
 	command->destructor = destroy_send_sms;
 
 	if (status != STK_PARSE_RESULT_OK)
 		goto out;
 
-	if (gsm_tpdu.len == 0 && obj->cdma_sms.len == 0) {
+	if (data.gsm_tpdu.len == 0 && obj->cdma_sms.len == 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	if (gsm_tpdu.len > 0 && obj->cdma_sms.len > 0) {
+	if (data.gsm_tpdu.len > 0 && obj->cdma_sms.len > 0) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2691,9 +2664,9 @@ static enum stk_command_parse_result parse_send_sms(
 
 	/* packing is needed */
 	if (command->qualifier & 0x01) {
-		if (sms_decode_unpacked_stk_pdu(gsm_tpdu.tpdu, gsm_tpdu.len,
-							&obj->gsm_sms) !=
-				TRUE) {
+		if (sms_decode_unpacked_stk_pdu(data.gsm_tpdu.tpdu,
+							data.gsm_tpdu.len,
+							&obj->gsm_sms) != TRUE) {
 			status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 			goto out;
 		}
@@ -2701,8 +2674,8 @@ static enum stk_command_parse_result parse_send_sms(
 		goto set_addr;
 	}
 
-	if (sms_decode(gsm_tpdu.tpdu, gsm_tpdu.len, TRUE,
-				gsm_tpdu.len, &obj->gsm_sms) == FALSE) {
+	if (sms_decode(data.gsm_tpdu.tpdu, data.gsm_tpdu.len, TRUE,
+				data.gsm_tpdu.len, &obj->gsm_sms) == FALSE) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
@@ -2714,20 +2687,20 @@ static enum stk_command_parse_result parse_send_sms(
 	}
 
 set_addr:
-	if (sc_address.number == NULL)
+	if (data.sc_address.number == NULL)
 		goto out;
 
-	if (strlen(sc_address.number) > 20) {
+	if (strlen(data.sc_address.number) > 20) {
 		status = STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 		goto out;
 	}
 
-	strcpy(obj->gsm_sms.sc_addr.address, sc_address.number);
-	obj->gsm_sms.sc_addr.numbering_plan = sc_address.ton_npi & 15;
-	obj->gsm_sms.sc_addr.number_type = (sc_address.ton_npi >> 4) & 7;
+	strcpy(obj->gsm_sms.sc_addr.address, data.sc_address.number);
+	obj->gsm_sms.sc_addr.numbering_plan = data.sc_address.ton_npi & 15;
+	obj->gsm_sms.sc_addr.number_type = (data.sc_address.ton_npi >> 4) & 7;
 
 out:
-	g_free(sc_address.number);
+	g_free(data.sc_address.number);
 
 	return status;
 }
@@ -2738,6 +2711,21 @@ static void destroy_send_ss(struct stk_command *command)
 	g_free(command->send_ss.ss.ss);
 }
 
+static const struct dataobj_desc send_ss_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_send_ss, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_SS_STRING,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_send_ss, ss) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_send_ss, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_send_ss, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_send_ss, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
@@ -2751,18 +2739,7 @@ static enum stk_command_parse_result parse_send_ss(struct stk_command *command,
 
 	command->destructor = destroy_send_ss;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_SS_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ss,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, send_ss_dataobjs, obj);
 }
 
 static void destroy_send_ussd(struct stk_command *command)
@@ -2770,6 +2747,21 @@ static void destroy_send_ussd(struct stk_command *command)
 	g_free(command->send_ussd.alpha_id);
 }
 
+static const struct dataobj_desc send_ussd_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_send_ussd, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_USSD_STRING,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_send_ussd, ussd_string) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_send_ussd, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_send_ussd, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_send_ussd, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_send_ussd(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2784,18 +2776,7 @@ static enum stk_command_parse_result parse_send_ussd(
 
 	command->destructor = destroy_send_ussd;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_USSD_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->ussd_string,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, send_ussd_dataobjs, obj);
 }
 
 static void destroy_setup_call(struct stk_command *command)
@@ -2805,6 +2786,33 @@ static void destroy_setup_call(struct stk_command *command)
 	g_free(command->setup_call.alpha_id_call_setup);
 }
 
+static const struct dataobj_desc setup_call_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_setup_call, alpha_id_usr_cfm) },
+	{ STK_DATA_OBJECT_TYPE_ADDRESS,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_setup_call, addr) },
+	{ STK_DATA_OBJECT_TYPE_CCP, 0,
+		offsetof(struct stk_command_setup_call, ccp) },
+	{ STK_DATA_OBJECT_TYPE_SUBADDRESS, 0,
+		offsetof(struct stk_command_setup_call, subaddr) },
+	{ STK_DATA_OBJECT_TYPE_DURATION, 0,
+		offsetof(struct stk_command_setup_call, duration) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_setup_call, icon_id_usr_cfm) },
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_setup_call, alpha_id_call_setup) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_setup_call, icon_id_call_setup) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_setup_call, text_attr_usr_cfm) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_setup_call, text_attr_call_setup) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_setup_call, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_setup_call(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2819,30 +2827,7 @@ static enum stk_command_parse_result parse_setup_call(
 
 	command->destructor = destroy_setup_call;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ADDRESS,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->addr,
-				STK_DATA_OBJECT_TYPE_CCP, 0,
-				&obj->ccp,
-				STK_DATA_OBJECT_TYPE_SUBADDRESS, 0,
-				&obj->subaddr,
-				STK_DATA_OBJECT_TYPE_DURATION, 0,
-				&obj->duration,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_usr_cfm,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id_call_setup,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id_call_setup,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_usr_cfm,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr_call_setup,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, setup_call_dataobjs, obj);
 }
 
 static void destroy_refresh(struct stk_command *command)
@@ -2852,6 +2837,22 @@ static void destroy_refresh(struct stk_command *command)
 	g_free(command->refresh.alpha_id);
 }
 
+static const struct dataobj_desc refresh_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST, 0,
+		offsetof(struct stk_command_refresh, file_list) },
+	{ STK_DATA_OBJECT_TYPE_AID, 0,
+		offsetof(struct stk_command_refresh, aid) },
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_refresh, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_refresh, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_refresh, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_refresh, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_refresh(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2866,19 +2867,7 @@ static enum stk_command_parse_result parse_refresh(
 
 	command->destructor = destroy_refresh;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST, 0,
-				&obj->file_list,
-				STK_DATA_OBJECT_TYPE_AID, 0,
-				&obj->aid,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, refresh_dataobjs, obj);
 }
 
 static enum stk_command_parse_result parse_polling_off(
@@ -2907,6 +2896,13 @@ static enum stk_command_parse_result parse_provide_local_info(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_desc setup_event_list_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_EVENT_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_setup_event_list, event_list) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_setup_event_list(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2919,12 +2915,16 @@ static enum stk_command_parse_result parse_setup_event_list(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_EVENT_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->event_list,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, setup_event_list_dataobjs, obj);
 }
 
+static const struct dataobj_desc perform_card_apdu_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_C_APDU,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_perform_card_apdu, c_apdu) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_perform_card_apdu(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -2938,10 +2938,7 @@ static enum stk_command_parse_result parse_perform_card_apdu(
 			(command->dst > STK_DEVICE_IDENTITY_TYPE_CARD_READER_7))
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_C_APDU,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->c_apdu,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, perform_card_apdu_dataobjs, obj);
 }
 
 static enum stk_command_parse_result parse_power_off_card(
@@ -2997,12 +2994,30 @@ static enum stk_command_parse_result parse_get_reader_status(
 	return STK_PARSE_RESULT_OK;
 }
 
+static const struct dataobj_desc timer_mgmt_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_TIMER_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_timer_mgmt, timer_id) },
+	{ STK_DATA_OBJECT_TYPE_TIMER_VALUE, 0,
+		offsetof(struct stk_command_timer_mgmt, timer_value) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
+/* Starting a timer needs the value, the other operations don't */
+static const struct dataobj_desc timer_start_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_TIMER_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_timer_mgmt, timer_id) },
+	{ STK_DATA_OBJECT_TYPE_TIMER_VALUE, DATAOBJ_FLAG_MANDATORY,
+		offsetof(struct stk_command_timer_mgmt, timer_value) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_timer_mgmt(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
 {
 	struct stk_command_timer_mgmt *obj = &command->timer_mgmt;
-	enum stk_data_object_flag value_flags = 0;
 
 	if (command->src != STK_DEVICE_IDENTITY_TYPE_UICC)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
@@ -3011,14 +3026,9 @@ static enum stk_command_parse_result parse_timer_mgmt(
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
 	if ((command->qualifier & 3) == 0) /* Start a timer */
-		value_flags = DATAOBJ_FLAG_MANDATORY;
+		return parse_dataobj(iter, timer_start_dataobjs, obj);
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TIMER_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->timer_id,
-				STK_DATA_OBJECT_TYPE_TIMER_VALUE, value_flags,
-				&obj->timer_value,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, timer_mgmt_dataobjs, obj);
 }
 
 static void destroy_setup_idle_mode_text(struct stk_command *command)
@@ -3026,6 +3036,19 @@ static void destroy_setup_idle_mode_text(struct stk_command *command)
 	g_free(command->setup_idle_mode_text.text);
 }
 
+static const struct dataobj_desc setup_idle_mode_text_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_setup_idle_mode_text, text) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_setup_idle_mode_text, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_setup_idle_mode_text, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_setup_idle_mode_text, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_setup_idle_mode_text(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3041,16 +3064,7 @@ static enum stk_command_parse_result parse_setup_idle_mode_text(
 
 	command->destructor = destroy_setup_idle_mode_text;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_TEXT,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->text,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, setup_idle_mode_text_dataobjs, obj);
 }
 
 static void destroy_run_at_command(struct stk_command *command)
@@ -3059,6 +3073,21 @@ static void destroy_run_at_command(struct stk_command *command)
 	g_free(command->run_at_command.at_command);
 }
 
+static const struct dataobj_desc run_at_command_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_run_at_command, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_AT_COMMAND,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_run_at_command, at_command) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_run_at_command, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_run_at_command, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_run_at_command, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_run_at_command(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3073,18 +3102,7 @@ static enum stk_command_parse_result parse_run_at_command(
 
 	command->destructor = destroy_run_at_command;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_AT_COMMAND,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->at_command,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, run_at_command_dataobjs, obj);
 }
 
 static void destroy_send_dtmf(struct stk_command *command)
@@ -3093,6 +3111,21 @@ static void destroy_send_dtmf(struct stk_command *command)
 	g_free(command->send_dtmf.dtmf);
 }
 
+static const struct dataobj_desc send_dtmf_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_send_dtmf, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_DTMF_STRING,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_send_dtmf, dtmf) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_send_dtmf, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_send_dtmf, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_send_dtmf, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_send_dtmf(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3107,20 +3140,15 @@ static enum stk_command_parse_result parse_send_dtmf(
 
 	command->destructor = destroy_send_dtmf;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_DTMF_STRING,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->dtmf,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, send_dtmf_dataobjs, obj);
 }
 
+static const struct dataobj_desc language_notification_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
+		offsetof(struct stk_command_language_notification, language) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_language_notification(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3134,9 +3162,7 @@ static enum stk_command_parse_result parse_language_notification(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_LANGUAGE, 0,
-				&obj->language,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, language_notification_dataobjs, obj);
 }
 
 static void destroy_launch_browser(struct stk_command *command)
@@ -3153,6 +3179,37 @@ static void destroy_launch_browser(struct stk_command *command)
 	g_free(command->launch_browser.text_passwd);
 }
 
+static const struct dataobj_desc launch_browser_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_BROWSER_ID, 0,
+		offsetof(struct stk_command_launch_browser, browser_id) },
+	{ STK_DATA_OBJECT_TYPE_URL,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_launch_browser, url) },
+	{ STK_DATA_OBJECT_TYPE_BEARER, 0,
+		offsetof(struct stk_command_launch_browser, bearer) },
+	{ STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF, DATAOBJ_FLAG_LIST,
+		offsetof(struct stk_command_launch_browser, prov_file_refs) },
+	{ STK_DATA_OBJECT_TYPE_TEXT,
+		0,
+		offsetof(struct stk_command_launch_browser,
+				text_gateway_proxy_id) },
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_launch_browser, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_launch_browser, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_launch_browser, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_launch_browser, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
+		offsetof(struct stk_command_launch_browser, network_name) },
+	{ STK_DATA_OBJECT_TYPE_TEXT, 0,
+		offsetof(struct stk_command_launch_browser, text_usr) },
+	{ STK_DATA_OBJECT_TYPE_TEXT, 0,
+		offsetof(struct stk_command_launch_browser, text_passwd) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_launch_browser(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3167,34 +3224,7 @@ static enum stk_command_parse_result parse_launch_browser(
 
 	command->destructor = destroy_launch_browser;
 
-	return parse_dataobj(iter,
-				STK_DATA_OBJECT_TYPE_BROWSER_ID, 0,
-				&obj->browser_id,
-				STK_DATA_OBJECT_TYPE_URL,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->url,
-				STK_DATA_OBJECT_TYPE_BEARER, 0,
-				&obj->bearer,
-				STK_DATA_OBJECT_TYPE_PROVISIONING_FILE_REF,
-				DATAOBJ_FLAG_LIST,
-				&obj->prov_file_refs,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_gateway_proxy_id,
-				STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_NETWORK_ACCESS_NAME, 0,
-				&obj->network_name,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_usr,
-				STK_DATA_OBJECT_TYPE_TEXT, 0,
-				&obj->text_passwd,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, launch_browser_dataobjs, obj);
 }
 
 /* TODO: parse_open_channel */
@@ -3204,6 +3234,18 @@ static void destroy_close_channel(struct stk_command *command)
 	g_free(command->close_channel.alpha_id);
 }
 
+static const struct dataobj_desc close_channel_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_close_channel, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_close_channel, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_close_channel, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_close_channel, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_close_channel(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3218,15 +3260,7 @@ static enum stk_command_parse_result parse_close_channel(
 
 	command->destructor = destroy_close_channel;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, close_channel_dataobjs, obj);
 }
 
 static void destroy_receive_data(struct stk_command *command)
@@ -3234,6 +3268,21 @@ static void destroy_receive_data(struct stk_command *command)
 	g_free(command->receive_data.alpha_id);
 }
 
+static const struct dataobj_desc receive_data_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_receive_data, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_receive_data, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_receive_data, data_len) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_receive_data, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_receive_data, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_receive_data(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3249,18 +3298,7 @@ static enum stk_command_parse_result parse_receive_data(
 
 	command->destructor = destroy_receive_data;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA_LENGTH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data_len,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, receive_data_dataobjs, obj);
 }
 
 static void destroy_send_data(struct stk_command *command)
@@ -3269,6 +3307,21 @@ static void destroy_send_data(struct stk_command *command)
 	g_free(command->send_data.data.array);
 }
 
+static const struct dataobj_desc send_data_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_send_data, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_send_data, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_send_data, data) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_send_data, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_send_data, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_send_data(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3284,18 +3337,7 @@ static enum stk_command_parse_result parse_send_data(
 
 	command->destructor = destroy_send_data;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_CHANNEL_DATA,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->data,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, send_data_dataobjs, obj);
 }
 
 static enum stk_command_parse_result parse_get_channel_status(
@@ -3318,6 +3360,23 @@ static void destroy_service_search(struct stk_command *command)
 	g_free(command->service_search.dev_filter.dev_filter);
 }
 
+static const struct dataobj_desc service_search_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_service_search, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_service_search, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_service_search, serv_search) },
+	{ STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
+		offsetof(struct stk_command_service_search, dev_filter) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_service_search, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_service_search, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_service_search(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3332,20 +3391,7 @@ static enum stk_command_parse_result parse_service_search(
 
 	command->destructor = destroy_service_search;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_SERVICE_SEARCH,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_search,
-				STK_DATA_OBJECT_TYPE_DEVICE_FILTER, 0,
-				&obj->dev_filter,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, service_search_dataobjs, obj);
 }
 
 static void destroy_get_service_info(struct stk_command *command)
@@ -3354,6 +3400,21 @@ static void destroy_get_service_info(struct stk_command *command)
 	g_free(command->get_service_info.attr_info.attr_info);
 }
 
+static const struct dataobj_desc get_service_info_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_get_service_info, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_get_service_info, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_get_service_info, attr_info) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_get_service_info, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_get_service_info, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_get_service_info(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3368,18 +3429,7 @@ static enum stk_command_parse_result parse_get_service_info(
 
 	command->destructor = destroy_get_service_info;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_ATTRIBUTE_INFO,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->attr_info,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, get_service_info_dataobjs, obj);
 }
 
 static void destroy_declare_service(struct stk_command *command)
@@ -3387,6 +3437,15 @@ static void destroy_declare_service(struct stk_command *command)
 	g_free(command->declare_service.serv_rec.serv_rec);
 }
 
+static const struct dataobj_desc declare_service_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_declare_service, serv_rec) },
+	{ STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
+		offsetof(struct stk_command_declare_service, intf) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_declare_service(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3401,14 +3460,20 @@ static enum stk_command_parse_result parse_declare_service(
 
 	command->destructor = destroy_declare_service;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_SERVICE_RECORD,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->serv_rec,
-				STK_DATA_OBJECT_TYPE_UICC_TE_INTERFACE, 0,
-				&obj->intf,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, declare_service_dataobjs, obj);
 }
 
+static const struct dataobj_desc set_frames_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_set_frames, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0,
+		offsetof(struct stk_command_set_frames, frame_layout) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_set_frames, frame_id_default) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_set_frames(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3421,14 +3486,7 @@ static enum stk_command_parse_result parse_set_frames(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FRAME_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_FRAME_LAYOUT, 0,
-				&obj->frame_layout,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id_default,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, set_frames_dataobjs, obj);
 }
 
 static enum stk_command_parse_result parse_get_frames_status(
@@ -3452,6 +3510,29 @@ static void destroy_retrieve_mms(struct stk_command *command)
 	g_slist_free(command->retrieve_mms.mms_rec_files);
 }
 
+static const struct dataobj_desc retrieve_mms_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_retrieve_mms, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_retrieve_mms, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_retrieve_mms, mms_ref) },
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_retrieve_mms, mms_rec_files) },
+	{ STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_retrieve_mms, mms_content_id) },
+	{ STK_DATA_OBJECT_TYPE_MMS_ID, 0,
+		offsetof(struct stk_command_retrieve_mms, mms_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_retrieve_mms, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_retrieve_mms, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_retrieve_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3466,26 +3547,7 @@ static enum stk_command_parse_result parse_retrieve_mms(
 
 	command->destructor = destroy_retrieve_mms;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_MMS_REFERENCE,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_ref,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_rec_files,
-				STK_DATA_OBJECT_TYPE_MMS_CONTENT_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_content_id,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, retrieve_mms_dataobjs, obj);
 }
 
 static void destroy_submit_mms(struct stk_command *command)
@@ -3496,6 +3558,23 @@ static void destroy_submit_mms(struct stk_command *command)
 	g_slist_free(command->submit_mms.mms_subm_files);
 }
 
+static const struct dataobj_desc submit_mms_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
+		offsetof(struct stk_command_submit_mms, alpha_id) },
+	{ STK_DATA_OBJECT_TYPE_ICON_ID, 0,
+		offsetof(struct stk_command_submit_mms, icon_id) },
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_submit_mms, mms_subm_files) },
+	{ STK_DATA_OBJECT_TYPE_MMS_ID, 0,
+		offsetof(struct stk_command_submit_mms, mms_id) },
+	{ STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
+		offsetof(struct stk_command_submit_mms, text_attr) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_submit_mms, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_submit_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3510,20 +3589,7 @@ static enum stk_command_parse_result parse_submit_mms(
 
 	command->destructor = destroy_submit_mms;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ALPHA_ID, 0,
-				&obj->alpha_id,
-				STK_DATA_OBJECT_TYPE_ICON_ID, 0,
-				&obj->icon_id,
-				STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID, 0,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_TEXT_ATTRIBUTE, 0,
-				&obj->text_attr,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, submit_mms_dataobjs, obj);
 }
 
 static void destroy_display_mms(struct stk_command *command)
@@ -3533,6 +3599,20 @@ static void destroy_display_mms(struct stk_command *command)
 	g_slist_free(command->display_mms.mms_subm_files);
 }
 
+static const struct dataobj_desc display_mms_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_FILE_LIST,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_display_mms, mms_subm_files) },
+	{ STK_DATA_OBJECT_TYPE_MMS_ID,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_display_mms, mms_id) },
+	{ STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
+		offsetof(struct stk_command_display_mms, imd_resp) },
+	{ STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
+		offsetof(struct stk_command_display_mms, frame_id) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_display_mms(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3547,19 +3627,16 @@ static enum stk_command_parse_result parse_display_mms(
 
 	command->destructor = destroy_display_mms;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_FILE_LIST,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_subm_files,
-				STK_DATA_OBJECT_TYPE_MMS_ID,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->mms_id,
-				STK_DATA_OBJECT_TYPE_IMMEDIATE_RESPONSE, 0,
-				&obj->imd_resp,
-				STK_DATA_OBJECT_TYPE_FRAME_ID, 0,
-				&obj->frame_id,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, display_mms_dataobjs, obj);
 }
 
+static const struct dataobj_desc activate_dataobjs[] = {
+	{ STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
+		DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
+		offsetof(struct stk_command_activate, actv_desc) },
+	{ STK_DATA_OBJECT_TYPE_INVALID, 0, 0 }
+};
+
 static enum stk_command_parse_result parse_activate(
 					struct stk_command *command,
 					struct comprehension_tlv_iter *iter)
@@ -3572,10 +3649,7 @@ static enum stk_command_parse_result parse_activate(
 	if (command->dst != STK_DEVICE_IDENTITY_TYPE_TERMINAL)
 		return STK_PARSE_RESULT_DATA_NOT_UNDERSTOOD;
 
-	return parse_dataobj(iter, STK_DATA_OBJECT_TYPE_ACTIVATE_DESCRIPTOR,
-				DATAOBJ_FLAG_MANDATORY | DATAOBJ_FLAG_MINIMUM,
-				&obj->actv_desc,
-				STK_DATA_OBJECT_TYPE_INVALID);
+	return parse_dataobj(iter, activate_dataobjs, obj);
 }
 
 static enum stk_command_parse_result parse_command_body(
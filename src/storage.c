@@ -134,61 +134,499 @@ ssize_t write_file(const unsigned char *buffer, size_t len, mode_t mode,
 	return r;
 }
 
-GKeyFile *storage_open(const char *imsi, const char *store)
+#define JOURNAL_MAGIC "OFJ1"
+#define JOURNAL_MAGIC_LEN 4
+#define JOURNAL_HEADER_LEN 7	/* CRC-32, type, 16-bit length */
+#define JOURNAL_MODE (S_IRUSR | S_IWUSR)
+
+static guint32 crc32_table[256];
+
+/* CRC-32 as used by zlib and Ethernet */
+guint32 storage_crc32(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	guint32 crc = 0xffffffff;
+	size_t i;
+
+	if (crc32_table[1] == 0) {
+		guint32 c;
+		int n, k;
+
+		for (n = 0; n < 256; n++) {
+			c = n;
+
+			for (k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+
+			crc32_table[n] = c;
+		}
+	}
+
+	for (i = 0; i < len; i++)
+		crc = crc32_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+static char *storage_root;
+
+/* Lets the unit tests keep their files out of the real STORAGEDIR */
+void storage_set_root(const char *root)
+{
+	g_free(storage_root);
+	storage_root = g_strdup(root);
+}
+
+const char *storage_get_root(void)
+{
+	if (storage_root)
+		return storage_root;
+
+	return STORAGEDIR;
+}
+
+static char *journal_path(const char *imsi, const char *store,
+				const char *suffix)
+{
+	if (imsi)
+		return g_strdup_printf("%s/%s/%s%s", storage_get_root(),
+					imsi, store, suffix);
+
+	return g_strdup_printf("%s/%s%s", storage_get_root(), store, suffix);
+}
+
+static int journal_open_path(const char *path, int flags)
 {
+	struct stat st;
+	int fd;
+
+	if (create_dirs(path, JOURNAL_MODE | S_IXUSR) != 0)
+		return -1;
+
+	fd = TFR(open(path, O_WRONLY | O_APPEND | O_CREAT | flags,
+				JOURNAL_MODE));
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		return fd;
+
+	if (TFR(write(fd, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN)) !=
+			JOURNAL_MAGIC_LEN) {
+		TFR(close(fd));
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Opens the journal for appending, creating it if need be */
+int storage_journal_open(const char *imsi, const char *store)
+{
+	char *path = journal_path(imsi, store, "");
+	int fd;
+
+	fd = journal_open_path(path, 0);
+	g_free(path);
+
+	return fd;
+}
+
+/* Starts an empty replacement for the journal */
+int storage_journal_create(const char *imsi, const char *store)
+{
+	char *path = journal_path(imsi, store, ".new");
+	int fd;
+
+	fd = journal_open_path(path, O_TRUNC);
+	g_free(path);
+
+	return fd;
+}
+
+/*
+ * Puts a replacement from storage_journal_create() in place of the
+ * journal.  On success fd carries on appending to the new journal,
+ * otherwise it is closed and the old journal is left untouched.
+ */
+int storage_journal_commit(const char *imsi, const char *store, int fd)
+{
+	char *newpath = journal_path(imsi, store, ".new");
+	char *path = journal_path(imsi, store, "");
+	int err = 0;
+
+	if (fdatasync(fd) == -1 || rename(newpath, path) == -1) {
+		TFR(close(fd));
+		unlink(newpath);
+		err = -1;
+	}
+
+	g_free(newpath);
+	g_free(path);
+
+	return err;
+}
+
+/*
+ * Appends a record to the journal behind *fd, returning 0 or -1 if the
+ * record did not make it.  A record written only in part is cut off
+ * again, so that the records after it are not lost to replay.  If even
+ * that fails the journal is closed and *fd set to -1, and it is up to
+ * the caller to rewrite it from what it has in memory.
+ */
+int storage_journal_append(int *fd, unsigned char type,
+				const void *data, size_t len)
+{
+	unsigned char *record;
+	guint32 crc;
+	off_t offset;
+	ssize_t r;
+
+	if (len > 0xffff)
+		return -1;
+
+	record = g_try_malloc(JOURNAL_HEADER_LEN + len);
+	if (record == NULL)
+		return -1;
+
+	record[4] = type;
+	record[5] = len & 0xff;
+	record[6] = len >> 8;
+	memcpy(record + JOURNAL_HEADER_LEN, data, len);
+
+	crc = storage_crc32(record + 4, JOURNAL_HEADER_LEN - 4 + len);
+	record[0] = crc & 0xff;
+	record[1] = (crc >> 8) & 0xff;
+	record[2] = (crc >> 16) & 0xff;
+	record[3] = crc >> 24;
+
+	offset = lseek(*fd, 0, SEEK_END);
+
+	/* A single write, so that a record is either whole or torn at EOF */
+	r = TFR(write(*fd, record, JOURNAL_HEADER_LEN + len));
+
+	g_free(record);
+
+	if (r == (ssize_t) (JOURNAL_HEADER_LEN + len))
+		return 0;
+
+	if (offset == -1 || TFR(ftruncate(*fd, offset)) == -1) {
+		TFR(close(*fd));
+		*fd = -1;
+	}
+
+	return -1;
+}
+
+/*
+ * Reads the whole journal in one go and hands every record to cb, in
+ * the order they were appended.  A torn or corrupt record ends the
+ * journal, and is cut off so that appends carry on from the last good
+ * record.  Returns the number of records, or -1 if there is no journal.
+ */
+int storage_journal_replay(const char *imsi, const char *store,
+				storage_journal_cb_t cb, void *user_data)
+{
+	char *path = journal_path(imsi, store, "");
+	gchar *contents;
+	gsize length;
+	gsize offset;
+	size_t len;
+	guint32 crc;
+	int records = 0;
+	const unsigned char *p;
+
+	if (g_file_get_contents(path, &contents, &length, NULL) == FALSE) {
+		g_free(path);
+		return -1;
+	}
+
+	if (length < JOURNAL_MAGIC_LEN ||
+			memcmp(contents, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN)) {
+		unlink(path);
+		goto out;
+	}
+
+	offset = JOURNAL_MAGIC_LEN;
+
+	while (length - offset >= JOURNAL_HEADER_LEN) {
+		p = (const unsigned char *) contents + offset;
+		len = p[5] | (p[6] << 8);
+
+		if (length - offset - JOURNAL_HEADER_LEN < len)
+			break;
+
+		crc = p[0] | (p[1] << 8) | (p[2] << 16) |
+						((guint32) p[3] << 24);
+
+		if (storage_crc32(p + 4, JOURNAL_HEADER_LEN - 4 + len) != crc)
+			break;
+
+		cb(p[4], p + JOURNAL_HEADER_LEN, len, user_data);
+
+		offset += JOURNAL_HEADER_LEN + len;
+		records += 1;
+	}
+
+	if (offset != length && truncate(path, offset) == -1)
+		unlink(path);
+
+out:
+	g_free(contents);
+	g_free(path);
+
+	return records;
+}
+
+void storage_journal_remove(const char *imsi, const char *store)
+{
+	char *path = journal_path(imsi, store, "");
+
+	unlink(path);
+	g_free(path);
+}
+
+/*
+ * Settings changes are written back once they have stopped coming in for
+ * STORAGE_FLUSH_DELAY, but never more than STORAGE_FLUSH_LATENCY after
+ * the first unsaved change.  Both are in milliseconds.
+ */
+#define STORAGE_FLUSH_DELAY 500
+#define STORAGE_FLUSH_LATENCY 2000
+
+struct storage_file {
+	char *path;
 	GKeyFile *keyfile;
+	int refcount;
+	gboolean dirty;
+	guint flush_source;
+	gdouble first_change;		/* Seconds on storage_timer */
+	gdouble last_change;
+};
+
+static GHashTable *storage_files;	/* Open key files by path */
+static GTimer *storage_timer;
+static struct storage_stats storage_stats;
+static guint flush_delay = STORAGE_FLUSH_DELAY;
+static guint flush_latency = STORAGE_FLUSH_LATENCY;
+
+static char *storage_path(const char *imsi, const char *store)
+{
+	if (imsi)
+		return g_strdup_printf("%s/%s/%s", storage_get_root(),
+					imsi, store);
+
+	return g_strdup_printf("%s/%s", storage_get_root(), store);
+}
+
+static void storage_write(const char *path, GKeyFile *keyfile)
+{
+	char *data;
+	gsize length = 0;
+
+	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0)
+		return;
+
+	data = g_key_file_to_data(keyfile, &length, NULL);
+
+	g_file_set_contents(path, data, length, NULL);
+	storage_stats.writes += 1;
+
+	g_free(data);
+}
+
+static void storage_flush(struct storage_file *file)
+{
+	if (file->flush_source) {
+		g_source_remove(file->flush_source);
+		file->flush_source = 0;
+	}
+
+	if (file->dirty == FALSE)
+		return;
+
+	file->dirty = FALSE;
+	storage_write(file->path, file->keyfile);
+}
+
+static gboolean storage_flush_cb(gpointer user_data)
+{
+	struct storage_file *file = user_data;
+	gdouble now = g_timer_elapsed(storage_timer, NULL);
+	gdouble wait;
+
+	/* Still changing, hold off until it settles or has waited enough */
+	wait = MIN(file->last_change + flush_delay / 1000.0,
+			file->first_change + flush_latency / 1000.0);
+	wait -= now;
+
+	if (wait > 0) {
+		file->flush_source = g_timeout_add(wait * 1000 + 1,
+							storage_flush_cb, file);
+		return FALSE;
+	}
+
+	file->flush_source = 0;
+	storage_flush(file);
+
+	return FALSE;
+}
+
+static struct storage_file *storage_lookup(const char *path,
+						GKeyFile *keyfile)
+{
+	struct storage_file *file;
+
+	if (storage_files == NULL)
+		return NULL;
+
+	file = g_hash_table_lookup(storage_files, path);
+	if (file == NULL || file->keyfile != keyfile)
+		return NULL;
+
+	return file;
+}
+
+/*
+ * Everyone opening the same store shares the key file, until the last
+ * of them closes it.
+ */
+GKeyFile *storage_open(const char *imsi, const char *store)
+{
+	struct storage_file *file;
 	char *path;
 
 	if (store == NULL)
 		return NULL;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
+	path = storage_path(imsi, store);
 
-	keyfile = g_key_file_new();
+	if (storage_files == NULL) {
+		storage_files = g_hash_table_new(g_str_hash, g_str_equal);
+		storage_timer = g_timer_new();
+	}
 
-	if (path) {
-		g_key_file_load_from_file(keyfile, path, 0, NULL);
+	file = g_hash_table_lookup(storage_files, path);
+	if (file) {
 		g_free(path);
+		file->refcount += 1;
+		return file->keyfile;
 	}
 
-	return keyfile;
+	file = g_new0(struct storage_file, 1);
+	file->path = path;
+	file->keyfile = g_key_file_new();
+	file->refcount = 1;
+
+	g_key_file_load_from_file(file->keyfile, path, 0, NULL);
+	g_hash_table_insert(storage_files, file->path, file);
+
+	return file->keyfile;
 }
 
+/* Marks the key file as changed, it gets written out shortly */
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
 {
+	struct storage_file *file;
 	char *path;
-	char *data;
-	gsize length = 0;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
+	path = storage_path(imsi, store);
+	file = storage_lookup(path, keyfile);
 
-	if (path == NULL)
-		return;
+	storage_stats.syncs += 1;
 
-	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
+	if (file == NULL) {
+		storage_write(path, keyfile);
 		g_free(path);
 		return;
 	}
 
-	data = g_key_file_to_data(keyfile, &length, NULL);
+	g_free(path);
 
-	g_file_set_contents(path, data, length, NULL);
+	file->last_change = g_timer_elapsed(storage_timer, NULL);
 
-	g_free(data);
-	g_free(path);
+	if (file->dirty == TRUE) {
+		storage_stats.coalesced += 1;
+		return;
+	}
+
+	file->dirty = TRUE;
+	file->first_change = file->last_change;
+
+	if (file->flush_source == 0)
+		file->flush_source = g_timeout_add(flush_delay,
+							storage_flush_cb, file);
 }
 
+/*
+ * Writes out what is pending straight away, and everything when save is
+ * TRUE.  The key file must not be used once closed.
+ */
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save)
 {
+	struct storage_file *file;
+	char *path;
+
+	path = storage_path(imsi, store);
+	file = storage_lookup(path, keyfile);
+
+	if (file == NULL) {
+		if (save == TRUE)
+			storage_write(path, keyfile);
+
+		g_free(path);
+		g_key_file_free(keyfile);
+		return;
+	}
+
+	g_free(path);
+
 	if (save == TRUE)
-		storage_sync(imsi, store, keyfile);
+		file->dirty = TRUE;
+
+	storage_flush(file);
+
+	file->refcount -= 1;
+	if (file->refcount > 0)
+		return;
+
+	g_hash_table_remove(storage_files, file->path);
+	g_key_file_free(file->keyfile);
+	g_free(file->path);
+	g_free(file);
+
+	if (g_hash_table_size(storage_files) > 0)
+		return;
+
+	g_hash_table_destroy(storage_files);
+	storage_files = NULL;
+	g_timer_destroy(storage_timer);
+	storage_timer = NULL;
+}
+
+static void flush_file(gpointer key, gpointer value, gpointer user_data)
+{
+	storage_flush(value);
+}
+
+/* Writes out every pending change, for when we are about to exit */
+void storage_flush_all(void)
+{
+	if (storage_files == NULL)
+		return;
 
-	g_key_file_free(keyfile);
+	g_hash_table_foreach(storage_files, flush_file, NULL);
+}
+
+void storage_get_stats(struct storage_stats *stats)
+{
+	*stats = storage_stats;
+}
+
+/* Both in milliseconds, applies to changes made from now on */
+void storage_set_flush_delays(guint delay, guint latency)
+{
+	flush_delay = delay;
+	flush_latency = latency;
 }
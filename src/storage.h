@@ -27,6 +27,9 @@
 
 #include <fcntl.h>
 
+void storage_set_root(const char *root);
+const char *storage_get_root(void);
+
 int create_dirs(const char *filename, const mode_t mode);
 
 ssize_t read_file(unsigned char *buffer, size_t len,
@@ -37,7 +40,40 @@ ssize_t write_file(const unsigned char *buffer, size_t len, mode_t mode,
 			const char *path_fmt, ...)
 	__attribute__((format(printf, 4, 5)));
 
+guint32 storage_crc32(const void *data, size_t len);
+
+/*
+ * Journals are append-only files of CRC protected records, for state that
+ * changes a record at a time.  They are rewritten from scratch through
+ * storage_journal_create() and storage_journal_commit() to compact them.
+ */
+typedef void (*storage_journal_cb_t)(unsigned char type,
+					const unsigned char *data, size_t len,
+					void *user_data);
+
+int storage_journal_open(const char *imsi, const char *store);
+int storage_journal_create(const char *imsi, const char *store);
+int storage_journal_commit(const char *imsi, const char *store, int fd);
+int storage_journal_append(int *fd, unsigned char type,
+				const void *data, size_t len);
+int storage_journal_replay(const char *imsi, const char *store,
+				storage_journal_cb_t cb, void *user_data);
+void storage_journal_remove(const char *imsi, const char *store);
+
+/*
+ * Settings are key files, written back a short while after the last
+ * storage_sync() so that a burst of changes costs a single write.
+ */
+struct storage_stats {
+	unsigned int syncs;		/* Calls to storage_sync() */
+	unsigned int coalesced;		/* Syncs saved by batching */
+	unsigned int writes;		/* Key files written out */
+};
+
 GKeyFile *storage_open(const char *imsi, const char *store);
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile);
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 			gboolean save);
+void storage_flush_all(void);
+void storage_get_stats(struct storage_stats *stats);
+void storage_set_flush_delays(guint delay, guint latency);
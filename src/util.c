@@ -25,12 +25,12 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <ctype.h>
 #include <stdlib.h>
 
 #include <glib.h>
 
 #include "util.h"
+#include "hexcodec.h"
 
 /*
 	Name:			GSM 03.38 to Unicode
@@ -460,24 +460,105 @@ static const struct alphabet_conversion_table alphabet_lookup[] = {
 		por_unicode, por_ext_unicode, TABLE_SIZE(por_ext_unicode) },
 };
 
-static int compare_codepoints(const void *a, const void *b)
+/* GSM to Unicode single shift tables, indexed by the escaped GSM code */
+static unsigned short gsm_single_shift[GSM_DIALECT_INVALID][128];
+static gboolean gsm_single_shift_ready;
+
+/*
+ * Unicode to GSM tables of a locking and single shift pair, the high byte
+ * of the code point picks a page and the low byte the entry.  Pages with
+ * no characters of either table all point at unmapped_page.  They are
+ * built on first use, in static storage so that nothing is left to free.
+ */
+#define UNICODE_MAP_PAGES 5	/* The most any pair of tables needs */
+
+struct unicode_map {
+	const unsigned short *pages[256];
+	unsigned short data[UNICODE_MAP_PAGES][256];
+	gboolean ready;
+};
+
+static unsigned short unmapped_page[256];
+static struct unicode_map unicode_maps[GSM_DIALECT_INVALID]
+					[GSM_DIALECT_INVALID];
+
+static void gsm_single_shift_init(void)
 {
-	const struct codepoint *ca = (const struct codepoint *)a;
-	const struct codepoint *cb = (const struct codepoint *)b;
+	const struct alphabet_conversion_table *table;
+	unsigned int lang;
+	unsigned int i;
+
+	/* GUND is all ones */
+	memset(gsm_single_shift, 0xff, sizeof(gsm_single_shift));
+
+	for (lang = 0; lang < GSM_DIALECT_INVALID; lang++) {
+		table = &alphabet_lookup[lang];
+
+		for (i = 0; i < table->togsm_single_shift_len; i++) {
+			const struct codepoint *cp =
+					&table->togsm_single_shift[i];
 
-	return (ca->from > cb->from) - (ca->from < cb->from);
+			gsm_single_shift[lang][cp->from] = cp->to;
+		}
+	}
+
+	gsm_single_shift_ready = TRUE;
 }
 
-static unsigned short codepoint_lookup(struct codepoint *key,
-					const struct codepoint *table,
-					unsigned int len)
+static const struct unicode_map *unicode_map_get(enum gsm_dialect locking,
+						enum gsm_dialect single)
 {
-	struct codepoint *result = NULL;
+	struct unicode_map *map = &unicode_maps[locking][single];
+	const struct codepoint *lt;
+	const struct codepoint *st;
+	unsigned int st_len;
+	unsigned short *pages[256];
+	unsigned int npages = 0;
+	unsigned int i;
+
+	if (map->ready)
+		return map;
+
+	lt = alphabet_lookup[locking].tounicode_locking_shift;
+	st = alphabet_lookup[single].tounicode_single_shift;
+	st_len = alphabet_lookup[single].tounicode_single_shift_len;
 
-	result = bsearch(key, table, len, sizeof(struct codepoint),
-				compare_codepoints);
+	memset(pages, 0, sizeof(pages));
+
+	/* Mark the pages in use first, then hand them out in order */
+	for (i = 0; i < 128; i++)
+		pages[lt[i].from >> 8] = unmapped_page;
+
+	for (i = 0; i < st_len; i++)
+		pages[st[i].from >> 8] = unmapped_page;
+
+	for (i = 0; i < 256; i++)
+		if (pages[i])
+			npages += 1;
+
+	if (npages > UNICODE_MAP_PAGES)
+		return NULL;
 
-	return result ? result->to : GUND;
+	memset(unmapped_page, 0xff, sizeof(unmapped_page));
+	memset(map->data, 0xff, sizeof(map->data));
+
+	for (i = 0, npages = 0; i < 256; i++) {
+		if (pages[i])
+			pages[i] = map->data[npages++];
+
+		map->pages[i] = pages[i] ? pages[i] : unmapped_page;
+	}
+
+	/* The locking shift table wins where both have a character */
+	for (i = 0; i < st_len; i++)
+		pages[st[i].from >> 8][st[i].from & 0xff] = st[i].to;
+
+	for (i = 0; i < 128; i++)
+		pages[lt[i].from >> 8][lt[i].from & 0xff] = lt[i].to;
+
+	map->ready = TRUE;
+
+	return map;
 }
 
 static unsigned short gsm_locking_shift_lookup(unsigned char k,
@@ -489,39 +570,13 @@ static unsigned short gsm_locking_shift_lookup(unsigned char k,
 static unsigned short gsm_single_shift_lookup(unsigned char k,
 						unsigned char lang)
 {
-	struct codepoint key = { k, 0 };
-	const struct codepoint *table;
-	unsigned int len;
+	if (k > 0x7f)
+		return GUND;
 
-	table = alphabet_lookup[lang].togsm_single_shift;
-	len = alphabet_lookup[lang].togsm_single_shift_len;
+	if (!gsm_single_shift_ready)
+		gsm_single_shift_init();
 
-	return codepoint_lookup(&key, table, len);
-}
-
-static unsigned short unicode_locking_shift_lookup(unsigned short k,
-							unsigned char lang)
-{
-	struct codepoint key = { k, 0 };
-	const struct codepoint *table;
-	unsigned int len = 128;
-
-	table = alphabet_lookup[lang].tounicode_locking_shift;
-
-	return codepoint_lookup(&key, table, len);
-}
-
-static unsigned short unicode_single_shift_lookup(unsigned short k,
-							unsigned char lang)
-{
-	struct codepoint key = { k, 0 };
-	const struct codepoint *table;
-	unsigned int len;
-
-	table = alphabet_lookup[lang].tounicode_single_shift;
-	len = alphabet_lookup[lang].tounicode_single_shift_len;
-
-	return codepoint_lookup(&key, table, len);
+	return gsm_single_shift[lang][k];
 }
 
 /*!
@@ -546,7 +601,6 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 	char *res = NULL;
 	char *out;
 	long i = 0;
-	long res_length;
 
 	if (locking_lang >= GSM_DIALECT_INVALID)
 		return NULL;
@@ -566,7 +620,14 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 		len = i;
 	}
 
-	for (i = 0, res_length = 0; i < len; i++) {
+	/* No GSM character takes more than three bytes in UTF-8 */
+	res = g_try_malloc(len * 3 + 1);
+	if (!res)
+		goto error;
+
+	out = res;
+
+	for (i = 0; i < len; i++) {
 		unsigned short c;
 
 		if (text[i] > 0x7f)
@@ -585,28 +646,10 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 			c = gsm_locking_shift_lookup(text[i], locking_lang);
 		}
 
-		res_length += UTF8_LENGTH(c);
-	}
-
-	res = g_try_malloc(res_length + 1);
-
-	if (!res)
-		goto error;
-
-	out = res;
-
-	i = 0;
-	while (out < res + res_length) {
-		unsigned short c;
-
-		if (text[i] == 0x1b)
-			c = gsm_single_shift_lookup(text[++i], single_lang);
+		if (c < 0x80)
+			*out++ = c;
 		else
-			c = gsm_locking_shift_lookup(text[i], locking_lang);
-
-		out += g_unichar_to_utf8(c, out);
-
-		++i;
+			out += g_unichar_to_utf8(c, out);
 	}
 
 	*out = '\0';
@@ -614,11 +657,18 @@ char *convert_gsm_to_utf8_with_lang(const unsigned char *text, long len,
 	if (items_written)
 		*items_written = out - res;
 
-error:
 	if (items_read)
 		*items_read = i;
 
 	return res;
+
+error:
+	g_free(res);
+
+	if (items_read)
+		*items_read = i;
+
+	return NULL;
 }
 
 char *convert_gsm_to_utf8(const unsigned char *text, long len,
@@ -648,12 +698,14 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 					enum gsm_dialect locking_lang,
 					enum gsm_dialect single_lang)
 {
-	long nchars = 0;
-	const char *in;
+	const struct unicode_map *map;
+	const unsigned short *ascii;
+	const char *in = text;
+	const char *end;
 	unsigned char *out;
 	unsigned char *res = NULL;
-	long res_len;
-	long i;
+	unsigned short converted;
+	gunichar c;
 
 	if (locking_lang >= GSM_DIALECT_INVALID)
 		return NULL;
@@ -661,62 +713,63 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 	if (single_lang >= GSM_DIALECT_INVALID)
 		return NULL;
 
-	in = text;
-	res_len = 0;
-
-	while ((len < 0 || text + len - in > 0) && *in) {
-		long max = len < 0 ? 6 : text + len - in;
-		gunichar c = g_utf8_get_char_validated(in, max);
-		unsigned short converted = GUND;
+	map = unicode_map_get(locking_lang, single_lang);
+	if (!map)
+		goto err_out;
 
-		if (c & 0x80000000)
-			goto err_out;
+	if (len < 0)
+		end = text + strlen(text);
+	else {
+		end = memchr(text, '\0', len);
+		if (!end)
+			end = text + len;
+	}
 
-		if (c > 0xffff)
-			goto err_out;
+	/* Nothing to convert and no terminator, callers expect NULL */
+	if (end == text && !terminator)
+		goto err_out;
 
-		converted = unicode_locking_shift_lookup(c, locking_lang);
+	/* A character takes at least one byte in and at most two out */
+	res = g_try_malloc((end - text) * 2 + 1);
+	if (!res)
+		goto err_out;
 
-		if (converted == GUND)
-			converted = unicode_single_shift_lookup(c, single_lang);
+	ascii = map->pages[0];
+	out = res;
 
-		if (converted == GUND)
-			goto err_out;
+	while (in < end) {
+		/* Runs of ASCII need no UTF-8 decoding */
+		if ((unsigned char) *in < 0x80) {
+			converted = ascii[(unsigned char) *in];
 
-		if (converted & 0x1b00)
-			res_len += 2;
-		else
-			res_len += 1;
+			if (converted == GUND)
+				goto error;
 
-		in = g_utf8_next_char(in);
-		nchars += 1;
-	}
+			if (converted & 0x1b00)
+				*out++ = 0x1b;
 
-	res = g_try_malloc(res_len + (terminator ? 1 : 0));
+			*out++ = converted;
+			in += 1;
+			continue;
+		}
 
-	if (!res)
-		goto err_out;
+		c = g_utf8_get_char_validated(in, end - in);
 
-	in = text;
-	out = res;
-	for (i = 0; i < nchars; i++) {
-		unsigned short converted;
+		if (c & 0x80000000)
+			goto error;
 
-		gunichar c = g_utf8_get_char(in);
+		if (c > 0xffff)
+			goto error;
 
-		converted = unicode_locking_shift_lookup(c, locking_lang);
+		converted = map->pages[c >> 8][c & 0xff];
 
 		if (converted == GUND)
-			converted = unicode_single_shift_lookup(c, single_lang);
-
-		if (converted & 0x1b00) {
-			*out = 0x1b;
-			++out;
-		}
+			goto error;
 
-		*out = converted;
-		++out;
+		if (converted & 0x1b00)
+			*out++ = 0x1b;
 
+		*out++ = converted;
 		in = g_utf8_next_char(in);
 	}
 
@@ -726,6 +779,15 @@ unsigned char *convert_utf8_to_gsm_with_lang(const char *text, long len,
 	if (items_written)
 		*items_written = out - res;
 
+	if (items_read)
+		*items_read = in - text;
+
+	return res;
+
+error:
+	g_free(res);
+	res = NULL;
+
 err_out:
 	if (items_read)
 		*items_read = in - text;
@@ -758,38 +820,15 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 					unsigned char terminator,
 					unsigned char *buf)
 {
-	long i, j;
-	char c;
-	unsigned char b;
+	long j;
 
 	if (len < 0)
 		len = strlen(in);
 
-	len &= ~0x1;
-
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = toupper(in[i]);
-
-		if (c >= '0' && c <= '9')
-			b = c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = 10 + c - 'A';
-		else
-			return NULL;
-
-		i += 1;
+	j = len / 2;
 
-		c = toupper(in[i]);
-
-		if (c >= '0' && c <= '9')
-			b = b*16 + c - '0';
-		else if (c >= 'A' && c <= 'F')
-			b = b*16 + 10 + c - 'A';
-		else
-			return NULL;
-
-		buf[j] = b;
-	}
+	if (hex_decode(in, len, buf) == FALSE)
+		return NULL;
 
 	if (terminator)
 		buf[j] = terminator;
@@ -803,27 +842,20 @@ unsigned char *decode_hex_own_buf(const char *in, long len, long *items_written,
 unsigned char *decode_hex(const char *in, long len, long *items_written,
 				unsigned char terminator)
 {
-	long i;
-	char c;
 	unsigned char *buf;
 
 	if (len < 0)
 		len = strlen(in);
 
-	len &= ~0x1;
-
-	for (i = 0; i < len; i++) {
-		c = toupper(in[i]);
-
-		if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F'))
-			continue;
+	buf = g_new(unsigned char, (len >> 1) + (terminator ? 1 : 0));
 
+	if (decode_hex_own_buf(in, len, items_written,
+					terminator, buf) == NULL) {
+		g_free(buf);
 		return NULL;
 	}
 
-	buf = g_new(unsigned char, (len >> 1) + (terminator ? 1 : 0));
-
-	return decode_hex_own_buf(in, len, items_written, terminator, buf);
+	return buf;
 }
 
 /*!
@@ -835,8 +867,7 @@ unsigned char *decode_hex(const char *in, long len, long *items_written,
 char *encode_hex_own_buf(const unsigned char *in, long len,
 				unsigned char terminator, char *buf)
 {
-	long i, j;
-	char c;
+	long i;
 
 	if (len < 0) {
 		i = 0;
@@ -847,25 +878,8 @@ char *encode_hex_own_buf(const unsigned char *in, long len,
 		len = i;
 	}
 
-	for (i = 0, j = 0; i < len; i++, j++) {
-		c = (in[i] >> 4) & 0xf;
-
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
-
-		j += 1;
-
-		c = (in[i]) & 0xf;
-
-		if (c <= 9)
-			buf[j] = '0' + c;
-		else
-			buf[j] = 'A' + c - 10;
-	}
-
-	buf[j] = '\0';
+	hex_encode(in, len, buf);
+	buf[len * 2] = '\0';
 
 	return buf;
 }
@@ -889,6 +903,61 @@ char *encode_hex(const unsigned char *in, long len, unsigned char terminator)
 	return encode_hex_own_buf(in, len, terminator, buf);
 }
 
+/*
+ * Eight septets fill seven octets, first septet in the low bits.  Groups
+ * aligned on an octet boundary are packed and unpacked as one 64 bit word.
+ */
+static inline guint64 septet_group_get(const unsigned char *in)
+{
+	return (guint64) in[0] | (guint64) in[1] << 8 |
+		(guint64) in[2] << 16 | (guint64) in[3] << 24 |
+		(guint64) in[4] << 32 | (guint64) in[5] << 40 |
+		(guint64) in[6] << 48;
+}
+
+static inline void septet_group_put(unsigned char *out, guint64 word)
+{
+	out[0] = word;
+	out[1] = word >> 8;
+	out[2] = word >> 16;
+	out[3] = word >> 24;
+	out[4] = word >> 32;
+	out[5] = word >> 40;
+	out[6] = word >> 48;
+}
+
+static inline void unpack_septet_group(const unsigned char *in,
+					unsigned char *out)
+{
+	guint64 word = septet_group_get(in);
+
+	out[0] = word & 0x7f;
+	out[1] = (word >> 7) & 0x7f;
+	out[2] = (word >> 14) & 0x7f;
+	out[3] = (word >> 21) & 0x7f;
+	out[4] = (word >> 28) & 0x7f;
+	out[5] = (word >> 35) & 0x7f;
+	out[6] = (word >> 42) & 0x7f;
+	out[7] = (word >> 49) & 0x7f;
+}
+
+/*
+ * Like the septet at a time loop below, the 8th bit of all but the last
+ * character is not masked off but ORed into the following character.
+ */
+static inline void pack_septet_group(const unsigned char *in,
+					unsigned char *out)
+{
+	guint64 word;
+
+	word = (guint64) in[0] | (guint64) in[1] << 7 |
+		(guint64) in[2] << 14 | (guint64) in[3] << 21 |
+		(guint64) in[4] << 28 | (guint64) in[5] << 35 |
+		(guint64) in[6] << 42 | (guint64) (in[7] & 0x7f) << 49;
+
+	septet_group_put(out, word);
+}
+
 unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 					int byte_offset, gboolean ussd,
 					long max_to_unpack, long *items_written,
@@ -908,6 +977,15 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 		max_to_unpack = len * 8 / 7;
 
 	for (i = 0; (i < len) && ((out-buf) < max_to_unpack); i++) {
+		/* On a group boundary, take whole groups while they fit */
+		if (bits == 7 && len - i >= 7 &&
+				max_to_unpack - (out - buf) >= 8) {
+			unpack_septet_group(in + i, out);
+			out += 8;
+			i += 6;
+			continue;
+		}
+
 		/* Grab what we have in the current octet */
 		*out = (in[i] & ((1 << bits) - 1)) << (7 - bits);
 
@@ -950,8 +1028,9 @@ unsigned char *unpack_7bit_own_buf(const unsigned char *in, long len,
 	 * the message ends on an octet boundary with <CR> as the last
 	 * character.
 	 */
-	if (ussd && (((out - buf) % 8) == 0) && (*(out-1) == '\r'))
-			out = out - 1;
+	if (ussd && out > buf && (((out - buf) % 8) == 0) &&
+			(*(out-1) == '\r'))
+		out = out - 1;
 
 	if (terminator)
 		*out = terminator;
@@ -1005,6 +1084,14 @@ unsigned char *pack_7bit_own_buf(const unsigned char *in, long len,
 	}
 
 	for (i = 0; i < len; i++) {
+		/* On a group boundary the next octet is not started yet */
+		if (bits == 7 && len - i >= 8) {
+			pack_septet_group(in + i, out);
+			out += 7;
+			i += 7;
+			continue;
+		}
+
 		if (bits != 7) {
 			*out |= (in[i] & ((1 << (7 - bits)) - 1)) <<
 					(bits + 1);
@@ -0,0 +1,539 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+
+struct urc_count {
+	const char *prefix;
+	gboolean pdu;
+	int count;
+	int expected;
+};
+
+/* URCs registered by the atmodem drivers on a single channel */
+static struct urc_count urc_table[] = {
+	{ "+CREG:", FALSE },
+	{ "+CGREG:", FALSE },
+	{ "+CSQ:", FALSE },
+	{ "+CIEV:", FALSE },
+	{ "+CMT:", TRUE },
+	{ "+CDS:", TRUE },
+	{ "+CMTI:", FALSE },
+	{ "+CDSI:", FALSE },
+	{ "+CBM:", TRUE },
+	{ "+CUSD:", FALSE },
+	{ "+CSSI:", FALSE },
+	{ "+CSSU:", FALSE },
+	{ "+CLIP:", FALSE },
+	{ "+CCWA:", FALSE },
+	{ "+COLP:", FALSE },
+	{ "+CRING:", FALSE },
+	{ "RING", FALSE },
+	{ "NO CARRIER", FALSE },
+	{ "+CGEV:", FALSE },
+	{ "+STKPCI:", FALSE },
+	{ "+CTZV:", FALSE },
+	{ "+CCCM:", FALSE },
+	{ "+CPIN:", FALSE },
+	{ "*EMRDY:", FALSE },
+	{ "_OSIGQ:", FALSE },
+	{ "+CR", FALSE },
+};
+
+/* Captured from a modem registering and receiving SMS and CBS pages */
+static const char *urc_storm[] = {
+	"\r\n+CREG: 1,\"00A5\",\"0000B9C3\",2\r\n",
+	"\r\n+CSQ: 17,99\r\n",
+	"\r\n+CIEV: 2,3\r\n",
+	"\r\n+CGREG: 1,\"00A5\",\"0000B9C3\",2\r\n",
+	"\r\n+CMT: ,33\r\n07911326040011F5240B911326880736F40000111011315214000"
+		"AE8329BFD4697D9EC37\r\n",
+	"\r\n+CBM: 88\r\n011000320111C2327BFC6E9741F4F29C0E9297DD74D0BC1CA783"
+		"A072BA3C0F9B41C6B0DD0D\r\n",
+	"\r\n+CMTI: \"SM\",3\r\n",
+	"\r\n+CUSD: 0,\"Balance: 10.00\",15\r\n",
+	"\r\nRING\r\n",
+	"\r\n+CLIP: \"+15555555555\",145\r\n",
+	"\r\n+CGEV: NW DETACH\r\n",
+	"\r\n_OSIGQ: 3,0\r\n",
+	"\r\n+CTZV: 10/03/16,18:42:00+08,1\r\n",
+	"\r\n+CME ERROR: 10\r\n",
+};
+
+static GAtChat *chat;
+static int peer;
+static int total_lines;
+
+static void urc_notify(GAtResult *result, gpointer user_data)
+{
+	struct urc_count *urc = user_data;
+	const char *line = result->lines->data;
+
+	g_assert(g_str_has_prefix(line, urc->prefix));
+
+	if (urc->pdu)
+		g_assert(g_at_result_pdu(result) != NULL);
+
+	urc->count += 1;
+}
+
+static void chat_flush(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void chat_feed(const char *data, gsize len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(peer, data, MIN(len, 1024));
+		g_assert(written > 0);
+
+		data += written;
+		len -= written;
+
+		chat_flush();
+	}
+}
+
+static void chat_setup(void)
+{
+	GAtSyntax *syntax;
+	GIOChannel *io;
+	int sv[2];
+	unsigned int i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+
+	syntax = g_at_syntax_new_gsmv1();
+	chat = g_at_chat_new(io, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(io);
+
+	g_assert(chat != NULL);
+
+	peer = sv[1];
+
+	for (i = 0; i < G_N_ELEMENTS(urc_table); i++) {
+		urc_table[i].count = 0;
+		urc_table[i].expected = 0;
+
+		g_assert(g_at_chat_register(chat, urc_table[i].prefix,
+						urc_notify, urc_table[i].pdu,
+						&urc_table[i], NULL) > 0);
+	}
+}
+
+static void chat_teardown(void)
+{
+	g_at_chat_unref(chat);
+	chat = NULL;
+
+	close(peer);
+}
+
+static void count_expected(const char *data)
+{
+	unsigned int i;
+	char **lines = g_strsplit(data, "\r\n", 0);
+	char **line;
+
+	for (line = lines; *line; line++) {
+		if (**line == '\0')
+			continue;
+
+		total_lines += 1;
+
+		for (i = 0; i < G_N_ELEMENTS(urc_table); i++)
+			if (g_str_has_prefix(*line, urc_table[i].prefix))
+				urc_table[i].expected += 1;
+	}
+
+	g_strfreev(lines);
+}
+
+static void check_counts(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(urc_table); i++)
+		g_assert(urc_table[i].count == urc_table[i].expected);
+}
+
+static void test_match_notify(void)
+{
+	unsigned int i;
+
+	chat_setup();
+
+	for (i = 0; i < G_N_ELEMENTS(urc_storm); i++) {
+		count_expected(urc_storm[i]);
+		chat_feed(urc_storm[i], strlen(urc_storm[i]));
+	}
+
+	/* Both +CR and +CREG: match the registration update, while the
+	 * +CME ERROR received outside of a command matches nothing
+	 */
+	g_assert(urc_table[0].count == 1);
+	g_assert(urc_table[G_N_ELEMENTS(urc_table) - 1].count == 1);
+
+	check_counts();
+
+	chat_teardown();
+}
+
+static void test_unregister(void)
+{
+	const char *creg = "\r\n+CREG: 1\r\n";
+	guint id;
+
+	chat_setup();
+
+	id = g_at_chat_register(chat, "+CREG:", urc_notify, FALSE,
+				&urc_table[0], NULL);
+	g_assert(id > 0);
+
+	chat_feed(creg, strlen(creg));
+	g_assert(urc_table[0].count == 2);
+
+	g_at_chat_unregister(chat, id);
+	chat_feed(creg, strlen(creg));
+	g_assert(urc_table[0].count == 3);
+
+	g_at_chat_unregister_all(chat);
+	chat_feed(creg, strlen(creg));
+	g_assert(urc_table[0].count == 3);
+
+	/* Prefixes can be registered again once removed */
+	g_assert(g_at_chat_register(chat, "+CREG:", urc_notify, FALSE,
+					&urc_table[0], NULL) > 0);
+	chat_feed(creg, strlen(creg));
+	g_assert(urc_table[0].count == 4);
+
+	chat_teardown();
+}
+
+static void test_urc_storm(void)
+{
+	int iterations = g_test_perf() ? 20000 : 200;
+	GString *storm = g_string_sized_new(4096);
+	double elapsed;
+	unsigned int i;
+	int n;
+
+	chat_setup();
+
+	for (i = 0; i < G_N_ELEMENTS(urc_storm); i++)
+		g_string_append(storm, urc_storm[i]);
+
+	total_lines = 0;
+	count_expected(storm->str);
+
+	g_test_timer_start();
+
+	for (n = 0; n < iterations; n++)
+		chat_feed(storm->str, storm->len);
+
+	elapsed = g_test_timer_elapsed();
+
+	for (i = 0; i < G_N_ELEMENTS(urc_table); i++)
+		urc_table[i].expected *= iterations;
+
+	check_counts();
+
+	if (g_test_verbose())
+		g_print("%d lines, %d notify prefixes in %.3f s\n",
+				total_lines * iterations,
+				(int) G_N_ELEMENTS(urc_table), elapsed);
+
+	g_test_maximized_result(total_lines * iterations / elapsed,
+				"URC storm: %.0f lines/s",
+				total_lines * iterations / elapsed);
+
+	g_string_free(storm, TRUE);
+
+	chat_teardown();
+}
+
+static GString *responses;
+
+static void pipeline_callback(gboolean ok, GAtResult *result,
+				gpointer user_data)
+{
+	GAtResultIter iter;
+	const char *line;
+
+	g_at_result_iter_init(&iter, result);
+
+	g_string_append_printf(responses, "%s:%d", (char *) user_data, ok);
+
+	while (g_at_result_iter_next(&iter, NULL)) {
+		line = g_at_result_iter_raw_line(&iter);
+		g_string_append_printf(responses, ":%s", line);
+	}
+
+	g_string_append_c(responses, ' ');
+}
+
+static void peer_expect(const char *expected)
+{
+	char buf[256];
+	ssize_t len;
+
+	chat_flush();
+
+	len = recv(peer, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+	if (len < 0)
+		len = 0;
+
+	buf[len] = '\0';
+
+	g_assert_cmpstr(buf, ==, expected);
+}
+
+static gboolean stalled;
+
+static void stall_debug(const char *str, gpointer user_data)
+{
+	if (g_str_has_prefix(str, "Pipelined command got no response"))
+		stalled = TRUE;
+}
+
+static void chat_wait_stall(void)
+{
+	stalled = FALSE;
+
+	while (stalled == FALSE)
+		g_main_context_iteration(NULL, TRUE);
+}
+
+static gboolean peer_readable(GIOChannel *io, GIOCondition cond,
+				gpointer user_data)
+{
+	gboolean *readable = user_data;
+
+	*readable = TRUE;
+
+	return FALSE;
+}
+
+/* Runs the main loop until the chat writes something to the peer */
+static void peer_wait(void)
+{
+	gboolean readable = FALSE;
+	GIOChannel *io;
+
+	io = g_io_channel_unix_new(peer);
+	g_io_add_watch(io, G_IO_IN, peer_readable, &readable);
+	g_io_channel_unref(io);
+
+	while (readable == FALSE)
+		g_main_context_iteration(NULL, TRUE);
+}
+
+static void chat_respond(const char *data)
+{
+	chat_feed(data, strlen(data));
+}
+
+static void test_pipeline(void)
+{
+	const char *cpin_prefix[] = { "+CPIN:", NULL };
+
+	chat_setup();
+	responses = g_string_new(NULL);
+
+	g_assert(g_at_chat_set_pipeline(chat, 4, 1000));
+
+	g_at_chat_send_pipelined(chat, "AT+CGMI", NULL, pipeline_callback,
+					"CGMI", NULL);
+	g_at_chat_send_pipelined(chat, "AT+CGMM", NULL, pipeline_callback,
+					"CGMM", NULL);
+	g_at_chat_send_pipelined(chat, "AT+CGMR", NULL, pipeline_callback,
+					"CGMR", NULL);
+	g_at_chat_send_pipelined(chat, "AT+CGSN", NULL, pipeline_callback,
+					"CGSN", NULL);
+	g_at_chat_send_pipelined(chat, "AT+CPIN?", cpin_prefix,
+					pipeline_callback, "CPIN", NULL);
+	g_at_chat_send(chat, "AT+CFUN=1", NULL, pipeline_callback,
+					"CFUN", NULL);
+
+	/* Only as many as the pipeline depth allows are written */
+	peer_expect("AT+CGMI\rAT+CGMM\rAT+CGMR\rAT+CGSN\r");
+
+	chat_respond("\r\nVendor\r\n\r\nOK\r\n");
+	peer_expect("AT+CPIN?\r");
+
+	chat_respond("\r\nModel\r\n\r\nOK\r\n\r\nRevision\r\n"
+			"\r\nOK\r\n\r\nERROR\r\n");
+	peer_expect("");
+
+	/* A command with side effects waits until the pipeline is empty */
+	chat_respond("\r\n+CSQ: 17,99\r\n\r\n+CPIN: READY\r\n\r\nOK\r\n");
+	peer_expect("AT+CFUN=1\r");
+
+	chat_respond("\r\nOK\r\n");
+
+	g_assert_cmpstr(responses->str, ==, "CGMI:1:Vendor CGMM:1:Model "
+				"CGMR:1:Revision CGSN:0 CPIN:1:+CPIN: READY "
+				"CFUN:1 ");
+	g_assert(urc_table[2].count == 1);
+
+	/* Turning pipelining off needs no timeout */
+	g_assert(g_at_chat_set_pipeline(chat, 2, 0) == FALSE);
+	g_assert(g_at_chat_set_pipeline(chat, 1, 0));
+
+	g_string_free(responses, TRUE);
+	chat_teardown();
+}
+
+static void test_pipeline_fallback(void)
+{
+	chat_setup();
+	responses = g_string_new(NULL);
+
+	/* Generous, nothing waits for it to run out without cause */
+	g_assert(g_at_chat_set_pipeline(chat, 3, 500));
+	g_at_chat_set_debug(chat, stall_debug, NULL);
+
+	g_at_chat_send_pipelined(chat, "AT+CGMI", NULL, pipeline_callback,
+					"CGMI", NULL);
+	g_at_chat_send_pipelined(chat, "AT+CGMM", NULL, pipeline_callback,
+					"CGMM", NULL);
+	g_at_chat_send_pipelined(chat, "AT+CGMR", NULL, pipeline_callback,
+					"CGMR", NULL);
+
+	peer_expect("AT+CGMI\rAT+CGMM\rAT+CGMR\r");
+
+	/* The modem ignores everything received while it was busy */
+	chat_respond("\r\nVendor\r\n\r\nOK\r\n");
+	chat_wait_stall();
+
+	/* Nothing is sent again while a late answer might still come */
+	peer_expect("");
+
+	/* It did get AT+CGMM after all, the answer must not be taken for
+	 * the resubmission or anything after it */
+	chat_respond("\r\nLate\r\n\r\nOK\r\n");
+	peer_expect("");
+
+	peer_wait();
+
+	peer_expect("AT+CGMM\r");
+	chat_respond("\r\nModel\r\n\r\nOK\r\n");
+
+	peer_expect("AT+CGMR\r");
+	chat_respond("\r\nRevision\r\n\r\nOK\r\n");
+
+	/* Pipelining stays off from now on */
+	g_at_chat_send_pipelined(chat, "AT+CGSN", NULL, pipeline_callback,
+					"CGSN", NULL);
+	g_at_chat_send_pipelined(chat, "AT+CPIN?", NULL, pipeline_callback,
+					"CPIN", NULL);
+
+	peer_expect("AT+CGSN\r");
+	chat_respond("\r\n123456\r\n\r\nOK\r\n");
+
+	peer_expect("AT+CPIN?\r");
+	chat_respond("\r\n+CPIN: READY\r\n\r\nOK\r\n");
+
+	g_assert_cmpstr(responses->str, ==, "CGMI:1:Vendor CGMM:1:Model "
+				"CGMR:1:Revision CGSN:1:123456 "
+				"CPIN:1:+CPIN: READY ");
+
+	g_string_free(responses, TRUE);
+	chat_teardown();
+}
+
+static void test_hexstring(void)
+{
+	char line[] = "+CRSM: 144,0,\"62A1b2\",,012G3";
+	char pdu[] = "0891683108200505f0";
+	GSList lines = { line, NULL };
+	GAtResult result = { &lines, pdu };
+	GAtResultIter iter;
+	const guint8 *str;
+	guint8 buf[9];
+	gint length;
+	gint num;
+
+	g_at_result_iter_init(&iter, &result);
+	g_assert(g_at_result_iter_next(&iter, "+CRSM:"));
+	g_assert(g_at_result_iter_next_number(&iter, &num));
+	g_assert(g_at_result_iter_next_number(&iter, &num));
+
+	g_assert(g_at_result_iter_next_hexstring(&iter, &str, &length));
+	g_assert(length == 3);
+	g_assert(memcmp(str, "\x62\xa1\xb2", 3) == 0);
+
+	/* Omitted */
+	g_assert(g_at_result_iter_next_hexstring(&iter, &str, &length));
+	g_assert(length == 0);
+
+	/* The digits stop at G, leaving an odd count */
+	g_assert(!g_at_result_iter_next_hexstring(&iter, &str, &length));
+
+	g_assert(g_at_result_pdu_decode(&result, buf, sizeof(buf), &length));
+	g_assert(length == 9);
+	g_assert(memcmp(buf, "\x08\x91\x68\x31\x08\x20\x05\x05\xf0",
+				9) == 0);
+
+	/* Too long for the buffer, odd, and not hex at all */
+	g_assert(!g_at_result_pdu_decode(&result, buf, 8, &length));
+
+	pdu[17] = '\0';
+	g_assert(!g_at_result_pdu_decode(&result, buf, sizeof(buf), &length));
+
+	pdu[0] = 'O';
+	pdu[1] = 'K';
+	pdu[2] = '\0';
+	g_assert(!g_at_result_pdu_decode(&result, buf, sizeof(buf), &length));
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgatchat/match_notify", test_match_notify);
+	g_test_add_func("/testgatchat/unregister", test_unregister);
+	g_test_add_func("/testgatchat/urc_storm", test_urc_storm);
+	g_test_add_func("/testgatchat/pipeline", test_pipeline);
+	g_test_add_func("/testgatchat/pipeline_fallback",
+					test_pipeline_fallback);
+	g_test_add_func("/testgatchat/hexstring", test_hexstring);
+
+	return g_test_run();
+}
@@ -0,0 +1,385 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "crc-ccitt.h"
+#include "gathdlc.h"
+
+#define HDLC_FLAG	0x7e
+#define HDLC_ESCAPE	0x7d
+#define HDLC_TRANS	0x20
+
+#define FRAME_SIZE	1500
+
+static GAtHDLC *hdlc;
+static int peer;
+static GByteArray *received;
+static int received_frames;
+
+static void hdlc_flush(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void hdlc_receive(const unsigned char *data, gsize size,
+				gpointer user_data)
+{
+	g_byte_array_append(received, data, size);
+	received_frames += 1;
+}
+
+static void hdlc_setup(void)
+{
+	GIOChannel *io;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+
+	hdlc = g_at_hdlc_new(io);
+	g_io_channel_unref(io);
+
+	g_assert(hdlc != NULL);
+
+	g_at_hdlc_set_receive(hdlc, hdlc_receive, NULL);
+
+	peer = sv[1];
+	received = g_byte_array_new();
+	received_frames = 0;
+}
+
+static void hdlc_teardown(void)
+{
+	g_at_hdlc_unref(hdlc);
+	hdlc = NULL;
+
+	close(peer);
+
+	g_byte_array_free(received, TRUE);
+	received = NULL;
+}
+
+/* Byte at a time encoder, the way GAtHDLC used to frame everything */
+static void ref_encode_bytes(GByteArray *out, guint32 accm,
+				const guint8 *data, gsize size)
+{
+	guint8 esc[2] = { HDLC_ESCAPE };
+	gsize i;
+
+	for (i = 0; i < size; i++) {
+		if ((data[i] < 0x20 && (accm & (1 << data[i]))) ||
+				data[i] == HDLC_FLAG || data[i] == HDLC_ESCAPE) {
+			esc[1] = data[i] ^ HDLC_TRANS;
+			g_byte_array_append(out, esc, 2);
+		} else
+			g_byte_array_append(out, data + i, 1);
+	}
+}
+
+static void ref_encode(GByteArray *out, guint32 accm,
+				const guint8 *data, gsize size)
+{
+	guint16 fcs = 0xffff;
+	guint8 tail[3];
+	gsize i;
+
+	for (i = 0; i < size; i++)
+		fcs = crc_ccitt_byte(fcs, data[i]);
+
+	fcs ^= 0xffff;
+	tail[0] = fcs & 0xff;
+	tail[1] = fcs >> 8;
+	tail[2] = HDLC_FLAG;
+
+	ref_encode_bytes(out, accm, data, size);
+	ref_encode_bytes(out, accm, tail, 2);
+	g_byte_array_append(out, tail + 2, 1);
+}
+
+/* Mostly printable payload with the odd byte that needs escaping */
+static void fill_frame(guint8 *buf, gsize size, int escapes)
+{
+	gsize i;
+
+	for (i = 0; i < size; i++)
+		buf[i] = g_test_rand_int_range(0x20, 0x7d);
+
+	while (escapes-- > 0) {
+		static const guint8 special[] = {
+			HDLC_FLAG, HDLC_ESCAPE, 0x00, 0x11, 0x13, 0x1f, 0xff,
+		};
+
+		i = g_test_rand_int_range(0, size);
+		buf[i] = special[g_test_rand_int_range(0,
+						G_N_ELEMENTS(special))];
+	}
+}
+
+static void peer_write(const guint8 *data, gsize len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(peer, data, MIN(len, 4096));
+		g_assert(written > 0);
+
+		data += written;
+		len -= written;
+
+		hdlc_flush();
+	}
+}
+
+static void peer_read(GByteArray *out)
+{
+	guint8 buf[4096];
+	ssize_t len;
+
+	while ((len = recv(peer, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+		g_byte_array_append(out, buf, len);
+
+	g_assert(len < 0 && errno == EAGAIN);
+}
+
+static void test_crc(void)
+{
+	static const guint8 check[] = "123456789";
+	guint8 buf[256];
+	guint16 ref;
+	unsigned int i;
+	unsigned int off;
+	unsigned int len;
+
+	/* CRC-16/X-25 check value */
+	ref = crc_ccitt(0xffff, check, 9) ^ 0xffff;
+	g_assert(ref == 0x906e);
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = g_test_rand_int_range(0, 256);
+
+	for (off = 0; off < 8; off++) {
+		for (len = 0; len < sizeof(buf) - off; len++) {
+			ref = 0xffff;
+
+			for (i = 0; i < len; i++)
+				ref = crc_ccitt_byte(ref, buf[off + i]);
+
+			g_assert(crc_ccitt(0xffff, buf + off, len) == ref);
+		}
+	}
+}
+
+static void test_send(void)
+{
+	static const guint32 accms[] = { ~0U, 0x000a0000, 0 };
+	GByteArray *expected = g_byte_array_new();
+	GByteArray *sent = g_byte_array_new();
+	guint8 buf[FRAME_SIZE];
+	unsigned int i;
+	int n;
+
+	hdlc_setup();
+
+	/* Initial wakeup flag */
+	g_byte_array_append(expected, (guint8 *) "\x7e", 1);
+
+	for (i = 0; i < G_N_ELEMENTS(accms); i++) {
+		g_at_hdlc_set_xmit_accm(hdlc, accms[i]);
+
+		for (n = 0; n < 50; n++) {
+			gsize size = g_test_rand_int_range(1, FRAME_SIZE);
+
+			fill_frame(buf, size, n);
+			ref_encode(expected, accms[i], buf, size);
+
+			g_assert(g_at_hdlc_send(hdlc, buf, size) == TRUE);
+
+			hdlc_flush();
+			peer_read(sent);
+		}
+	}
+
+	g_assert(sent->len == expected->len);
+	g_assert(memcmp(sent->data, expected->data, sent->len) == 0);
+
+	g_byte_array_free(expected, TRUE);
+	g_byte_array_free(sent, TRUE);
+
+	hdlc_teardown();
+}
+
+static void test_receive(void)
+{
+	GByteArray *stream = g_byte_array_new();
+	GByteArray *payload = g_byte_array_new();
+	guint8 buf[FRAME_SIZE];
+	guint8 noise[] = { 0x11, HDLC_FLAG, 0x13 };
+	int n;
+
+	hdlc_setup();
+
+	for (n = 0; n < 100; n++) {
+		gsize size = g_test_rand_int_range(1, FRAME_SIZE);
+
+		fill_frame(buf, size, n);
+		ref_encode(stream, ~0U, buf, size);
+		g_byte_array_append(payload, buf, size);
+
+		/* XON/XOFF injected by the line, dropped by the recv ACCM */
+		g_byte_array_append(stream, noise, sizeof(noise));
+	}
+
+	/* A frame with a bad FCS must not be delivered */
+	g_byte_array_append(stream, (guint8 *) "\x7e" "abcd" "\x7e", 6);
+
+	peer_write(stream->data, stream->len);
+
+	g_assert(received_frames == 100);
+	g_assert(received->len == payload->len);
+	g_assert(memcmp(received->data, payload->data, payload->len) == 0);
+
+	g_byte_array_free(stream, TRUE);
+	g_byte_array_free(payload, TRUE);
+
+	hdlc_teardown();
+}
+
+static void test_oversized(void)
+{
+	GByteArray *stream = g_byte_array_new();
+	guint8 buf[FRAME_SIZE * 4];
+
+	hdlc_setup();
+
+	fill_frame(buf, sizeof(buf), 0);
+	ref_encode(stream, ~0U, buf, sizeof(buf));
+	ref_encode(stream, ~0U, buf, 64);
+
+	peer_write(stream->data, stream->len);
+
+	/* Frames beyond the decode buffer are dropped, not overrun */
+	g_assert(received_frames == 1);
+	g_assert(received->len == 64);
+
+	g_byte_array_free(stream, TRUE);
+
+	hdlc_teardown();
+}
+
+static void test_throughput(void)
+{
+	int frames = g_test_perf() ? 50000 : 500;
+	GByteArray *stream = g_byte_array_new();
+	GByteArray *sent = g_byte_array_new();
+	guint8 buf[FRAME_SIZE];
+	double bytes = (double) frames * FRAME_SIZE;
+	double elapsed;
+	guint16 fcs = 0xffff;
+	int n;
+	int i;
+
+	hdlc_setup();
+
+	fill_frame(buf, sizeof(buf), 4);
+
+	g_test_timer_start();
+
+	for (n = 0; n < frames; n++)
+		for (i = 0; i < FRAME_SIZE; i++)
+			fcs = crc_ccitt_byte(fcs, buf[i]);
+
+	elapsed = g_test_timer_elapsed();
+
+	if (g_test_verbose())
+		g_print("FCS byte at a time: %.1f MB/s (%04x)\n",
+				bytes / elapsed / 1e6, fcs);
+
+	g_test_timer_start();
+
+	for (n = 0; n < frames; n++)
+		fcs = crc_ccitt(fcs, buf, FRAME_SIZE);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed, "FCS slicing-by-8: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	for (n = 0; n < 64; n++)
+		ref_encode(stream, ~0U, buf, FRAME_SIZE);
+
+	g_test_timer_start();
+
+	for (n = 0; n < frames; n += 64)
+		peer_write(stream->data, stream->len);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(received_frames == (frames + 63) / 64 * 64);
+
+	g_test_minimized_result(elapsed, "HDLC decode: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	g_test_timer_start();
+
+	for (n = 0; n < frames; n++) {
+		g_assert(g_at_hdlc_send(hdlc, buf, FRAME_SIZE) == TRUE);
+
+		hdlc_flush();
+		peer_read(sent);
+		g_byte_array_set_size(sent, 0);
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed, "HDLC encode: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	g_byte_array_free(stream, TRUE);
+	g_byte_array_free(sent, TRUE);
+
+	hdlc_teardown();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testhdlc/crc", test_crc);
+	g_test_add_func("/testhdlc/send", test_send);
+	g_test_add_func("/testhdlc/receive", test_receive);
+	g_test_add_func("/testhdlc/oversized", test_oversized);
+	g_test_add_func("/testhdlc/throughput", test_throughput);
+
+	return g_test_run();
+}
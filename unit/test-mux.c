@@ -33,6 +33,8 @@
 #include <glib.h>
 #include <glib/gprintf.h>
 
+#include "ringbuffer.h"
+#include "gatio.h"
 #include "gatmux.h"
 #include "gsm0710.h"
 
@@ -554,6 +556,525 @@ static void test_extract_advanced()
 	g_assert(total == sizeof(advanced_input2) - 1);
 }
 
+#define DEMUX_CHANNELS 4
+#define MUX_TEST_BUFFER 4096
+
+struct demux_dlc {
+	GAtIO *io;
+	guint8 pattern[MUX_TEST_BUFFER];
+	int bytes;
+	int expected;
+	int mismatches;
+};
+
+static struct demux_dlc demux_dlcs[DEMUX_CHANNELS];
+
+static void demux_flush(void)
+{
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void demux_read(struct ring_buffer *rbuf, gpointer user_data)
+{
+	struct demux_dlc *dd = user_data;
+	unsigned int len;
+
+	while ((len = ring_buffer_len_no_wrap(rbuf)) > 0) {
+		len = MIN(len, sizeof(dd->pattern));
+
+		if (memcmp(ring_buffer_read_ptr(rbuf, 0), dd->pattern, len))
+			dd->mismatches += 1;
+
+		dd->bytes += len;
+		ring_buffer_drain(rbuf, len);
+	}
+}
+
+static void test_demux(gboolean advanced, int frame_size)
+{
+	int rounds = g_test_perf() ? 20000 : 200;
+	GIOChannel *io;
+	GAtMux *demux;
+	GString *stream = g_string_new(NULL);
+	guint8 *payload = g_malloc(frame_size);
+	guint8 *frame = g_malloc(frame_size * 2 + 7);
+	double elapsed;
+	double frames;
+	int sv[2];
+	int peer;
+	int len;
+	int n;
+	int i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+	g_io_channel_set_flags(io, G_IO_FLAG_NONBLOCK, NULL);
+
+	if (advanced)
+		demux = g_at_mux_new_gsm0710_advanced(io, frame_size);
+	else
+		demux = g_at_mux_new_gsm0710_basic(io, frame_size);
+
+	g_io_channel_unref(io);
+	peer = sv[1];
+
+	g_assert(g_at_mux_start(demux) == TRUE);
+
+	for (i = 0; i < DEMUX_CHANNELS; i++) {
+		GIOChannel *channel = g_at_mux_create_channel(demux);
+
+		memset(&demux_dlcs[i], 0, sizeof(demux_dlcs[i]));
+		memset(demux_dlcs[i].pattern, i + 1, MUX_TEST_BUFFER);
+		demux_dlcs[i].io = g_at_io_new(channel);
+		g_io_channel_unref(channel);
+
+		g_at_io_set_read_handler(demux_dlcs[i].io, demux_read,
+						&demux_dlcs[i]);
+	}
+
+	/* One frame per DLC per round, interleaved like a busy modem */
+	for (i = 0; i < DEMUX_CHANNELS; i++) {
+		memset(payload, i + 1, frame_size);
+
+		if (advanced)
+			len = gsm0710_advanced_fill_frame(frame, i + 1,
+						GSM0710_DATA, payload,
+						frame_size);
+		else
+			len = gsm0710_basic_fill_frame(frame, i + 1,
+						GSM0710_DATA, payload,
+						frame_size);
+
+		g_string_append_len(stream, (char *) frame, len);
+	}
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++) {
+		const char *p = stream->str;
+		gsize left = stream->len;
+
+		while (left > 0) {
+			ssize_t written = write(peer, p, left);
+
+			g_assert(written > 0);
+			p += written;
+			left -= written;
+		}
+
+		if (n % 64 == 63)
+			demux_flush();
+	}
+
+	demux_flush();
+
+	elapsed = g_test_timer_elapsed();
+	frames = (double) rounds * DEMUX_CHANNELS;
+
+	for (i = 0; i < DEMUX_CHANNELS; i++) {
+		g_assert(demux_dlcs[i].bytes == rounds * frame_size);
+		g_assert(demux_dlcs[i].mismatches == 0);
+
+		if (g_test_verbose())
+			g_print("DLC %d: %.0f frames/s, %.2f MB/s\n", i + 1,
+					rounds / elapsed,
+					rounds * frame_size / elapsed / 1e6);
+
+		g_at_io_unref(demux_dlcs[i].io);
+	}
+
+	g_test_maximized_result(frames / elapsed, "%s N1=%d: %.0f frames/s, "
+				"%.2f MB/s", advanced ? "advanced" : "basic",
+				frame_size, frames / elapsed,
+				frames * frame_size / elapsed / 1e6);
+
+	g_at_mux_unref(demux);
+	close(peer);
+
+	g_string_free(stream, TRUE);
+	g_free(payload);
+	g_free(frame);
+}
+
+static void test_demux_basic(void)
+{
+	test_demux(FALSE, 31);
+	test_demux(FALSE, 127);
+}
+
+static void test_demux_advanced(void)
+{
+	test_demux(TRUE, 64);
+}
+
+static GAtMux *sched_mux;
+static int sched_peer;
+
+/* DLCs of the data frames seen by the peer, in order */
+static GByteArray *sched_frames;
+static GByteArray *sched_control;
+
+static gboolean sched_receive(void)
+{
+	static guint8 buf[65536];
+	static int used;
+	guint8 dlc;
+	guint8 ctrl;
+	guint8 *frame;
+	int frame_len;
+	ssize_t len;
+	int nread;
+
+	len = recv(sched_peer, buf + used, sizeof(buf) - used, MSG_DONTWAIT);
+	if (len <= 0)
+		return FALSE;
+
+	used += len;
+
+	do {
+		frame = NULL;
+		nread = gsm0710_basic_extract_frame(buf, used, &dlc, &ctrl,
+							&frame, &frame_len);
+
+		memmove(buf, buf + nread, used - nread);
+		used -= nread;
+
+		if (frame == NULL || ctrl != GSM0710_DATA)
+			continue;
+
+		if (dlc == 0)
+			g_byte_array_append(sched_control, frame, frame_len);
+		else
+			g_byte_array_append(sched_frames, &dlc, 1);
+	} while (nread > 0);
+
+	return TRUE;
+}
+
+static void sched_collect(void)
+{
+	demux_flush();
+
+	while (sched_receive())
+		demux_flush();
+}
+
+static void sched_command(const guint8 *data, int len)
+{
+	guint8 frame[4096];
+	int frame_len;
+
+	frame_len = gsm0710_basic_fill_frame(frame, 0, GSM0710_DATA,
+						data, len);
+	g_assert(write(sched_peer, frame, frame_len) == frame_len);
+
+	sched_collect();
+}
+
+static gsize sched_write(GIOChannel *channel, gsize len)
+{
+	static gchar buf[MUX_TEST_BUFFER];
+	gsize written;
+
+	g_assert(len <= sizeof(buf));
+	memset(buf, 'x', len);
+
+	g_io_channel_write(channel, buf, len, &written);
+
+	return written;
+}
+
+static int sched_count(int first, int count, guint8 dlc)
+{
+	int found = 0;
+	int i;
+
+	for (i = first; i < first + count && i < (int) sched_frames->len; i++)
+		if (sched_frames->data[i] == dlc)
+			found += 1;
+
+	return found;
+}
+
+static void sched_setup(int frame_size)
+{
+	GIOChannel *io;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+	g_io_channel_set_flags(io, G_IO_FLAG_NONBLOCK, NULL);
+
+	sched_mux = g_at_mux_new_gsm0710_basic(io, frame_size);
+	g_io_channel_unref(io);
+	sched_peer = sv[1];
+
+	g_assert(g_at_mux_start(sched_mux) == TRUE);
+
+	sched_frames = g_byte_array_new();
+	sched_control = g_byte_array_new();
+}
+
+static void sched_teardown(void)
+{
+	g_at_mux_unref(sched_mux);
+	close(sched_peer);
+
+	g_byte_array_free(sched_frames, TRUE);
+	g_byte_array_free(sched_control, TRUE);
+}
+
+static void test_priority(void)
+{
+	GIOChannel *bulk;
+	GIOChannel *control;
+	int first;
+
+	sched_setup(31);
+
+	bulk = g_at_mux_create_channel(sched_mux);
+	control = g_at_mux_create_channel(sched_mux);
+
+	g_assert(g_at_mux_set_channel_priority(sched_mux, control, 0, 1));
+	g_assert(g_at_mux_set_channel_priority(sched_mux, bulk, 1, 1));
+
+	/* Queued behind a bulk transfer, a command still goes out first */
+	g_assert(sched_write(bulk, 2000) == 2000);
+	g_assert(sched_write(control, 20) == 20);
+
+	sched_collect();
+
+	g_assert(sched_frames->len == 65 + 1);
+	g_assert(sched_frames->data[0] == 2);
+	g_assert(sched_count(1, 65, 1) == 65);
+
+	/* Queue limits push back on the writer instead of growing */
+	first = sched_frames->len;
+	g_assert(sched_write(bulk, MUX_TEST_BUFFER) == MUX_TEST_BUFFER);
+	g_assert(sched_write(bulk, MUX_TEST_BUFFER) < MUX_TEST_BUFFER);
+	sched_collect();
+	g_assert(sched_count(first, sched_frames->len - first, 1) > 0);
+
+	g_io_channel_unref(bulk);
+	g_io_channel_unref(control);
+
+	sched_teardown();
+}
+
+static void test_fairness(void)
+{
+	GIOChannel *light;
+	GIOChannel *heavy;
+	int ratio;
+
+	sched_setup(31);
+
+	light = g_at_mux_create_channel(sched_mux);
+	heavy = g_at_mux_create_channel(sched_mux);
+
+	g_assert(g_at_mux_set_channel_priority(sched_mux, light, 0, 1));
+	g_assert(g_at_mux_set_channel_priority(sched_mux, heavy, 0, 3));
+
+	sched_write(light, 3100);
+	sched_write(heavy, 3100);
+
+	sched_collect();
+
+	g_assert(sched_frames->len == 200);
+
+	/* While both have backlog the link is shared 1:3 */
+	ratio = sched_count(0, 120, 2) * 10 / sched_count(0, 120, 1);
+	g_assert(ratio >= 25 && ratio <= 35);
+
+	g_io_channel_unref(light);
+	g_io_channel_unref(heavy);
+
+	sched_teardown();
+}
+
+static void test_flow_control(void)
+{
+	static const guint8 fcoff[] = { GSM0710_FCOFF, 0x01 };
+	static const guint8 fcon[] = { GSM0710_FCON, 0x01 };
+	static const guint8 msc_off[] = { GSM0710_STATUS_SET, 0x05,
+						(1 << 2) | 0x03, 0x0F };
+	static const guint8 msc_on[] = { GSM0710_STATUS_SET, 0x05,
+						(1 << 2) | 0x03, 0x0D };
+	GAtMuxChannelStats stats;
+	GIOChannel *channel;
+
+	sched_setup(31);
+
+	channel = g_at_mux_create_channel(sched_mux);
+
+	/* FCoff holds back all data, and is acknowledged */
+	sched_command(fcoff, sizeof(fcoff));
+	g_assert(sched_control->len == 2);
+	g_assert(sched_control->data[0] == (GSM0710_FCOFF & ~0x02));
+
+	g_assert(sched_write(channel, 310) == 310);
+	sched_collect();
+	g_assert(sched_frames->len == 0);
+
+	g_assert(g_at_mux_get_channel_stats(sched_mux, channel, &stats));
+	g_assert(stats.queue_depth == 10);
+	g_assert(stats.queue_bytes == 10 * 37);
+	g_assert(stats.frames_sent == 0);
+
+	usleep(1000);
+
+	sched_command(fcon, sizeof(fcon));
+	g_assert(sched_frames->len == 10);
+
+	g_assert(g_at_mux_get_channel_stats(sched_mux, channel, &stats));
+	g_assert(stats.queue_depth == 0);
+	g_assert(stats.frames_sent == 10);
+	g_assert(stats.bytes_sent == 10 * 37);
+	g_assert(stats.max_queue_bytes == 10 * 37);
+	g_assert(stats.max_latency >= 1000);
+
+	/* So does the FC bit of a modem status command, for its DLC only */
+	g_byte_array_set_size(sched_frames, 0);
+	sched_command(msc_off, sizeof(msc_off));
+
+	g_assert(sched_write(channel, 31) == 31);
+	sched_collect();
+	g_assert(sched_frames->len == 0);
+
+	sched_command(msc_on, sizeof(msc_on));
+	g_assert(sched_frames->len == 1);
+
+	g_io_channel_unref(channel);
+
+	sched_teardown();
+}
+
+static void test_large_frame_size(void)
+{
+	GAtMuxChannelStats stats;
+	GIOChannel *channel;
+
+	/* N1 beyond what the queues hold is used in smaller frames */
+	sched_setup(32768);
+
+	channel = g_at_mux_create_channel(sched_mux);
+
+	g_assert(sched_write(channel, 4000) == 4000);
+	sched_collect();
+
+	g_assert(sched_frames->len >= 2);
+	g_assert(g_at_mux_get_channel_stats(sched_mux, channel, &stats));
+	g_assert(stats.queue_depth == 0);
+	g_assert(stats.frames_sent == sched_frames->len);
+
+	g_io_channel_unref(channel);
+
+	sched_teardown();
+}
+
+static void test_large_test_command(void)
+{
+	guint8 command[3000];
+	int i;
+
+	/* Control frames are not held to the smaller data frames */
+	sched_setup(8192);
+
+	command[0] = 0x43;
+	command[1] = 0x01;
+
+	for (i = 2; i < (int) sizeof(command); i++)
+		command[i] = i & 0xff;
+
+	sched_command(command, sizeof(command));
+
+	/* The peer gets every byte of it echoed back */
+	g_assert(sched_control->len == sizeof(command));
+	g_assert(sched_control->data[0] == 0x41);
+	g_assert(memcmp(sched_control->data + 1, command + 1,
+				sizeof(command) - 1) == 0);
+
+	sched_teardown();
+}
+
+#define BACKPRESSURE_BYTES 20000
+#define BACKPRESSURE_FRAMES ((BACKPRESSURE_BYTES + 30) / 31)
+
+static gchar backpressure_buf[BACKPRESSURE_BYTES];
+static gsize backpressure_written;
+
+static gboolean backpressure_write(gpointer user_data)
+{
+	GAtIO *io = user_data;
+	gsize written;
+
+	written = g_at_io_write(io, backpressure_buf + backpressure_written,
+				BACKPRESSURE_BYTES - backpressure_written);
+	if (written == 0)
+		return FALSE;
+
+	backpressure_written += written;
+
+	return backpressure_written < BACKPRESSURE_BYTES;
+}
+
+static void test_backpressure(void)
+{
+	GAtMuxChannelStats stats;
+	GIOChannel *channel;
+	GAtIO *io;
+	gsize written;
+	int i;
+
+	sched_setup(31);
+
+	channel = g_at_mux_create_channel(sched_mux);
+	io = g_at_io_new(channel);
+	g_io_channel_unref(channel);
+
+	/* A full DLC queue tells the writer to wait for G_IO_OUT */
+	backpressure_written = g_at_io_write(io, backpressure_buf,
+						BACKPRESSURE_BYTES);
+	g_assert(backpressure_written > 0);
+	g_assert(backpressure_written < BACKPRESSURE_BYTES);
+
+	g_assert(g_io_channel_write(channel, backpressure_buf, 31,
+					&written) == G_IO_ERROR_AGAIN);
+	g_assert(written == 0);
+	g_assert(g_at_io_write(io, backpressure_buf, 31) == 0);
+
+	g_at_io_set_write_handler(io, backpressure_write, io);
+
+	/* Frames only count as sent once the device took all of them */
+	demux_flush();
+
+	while (sched_receive())
+		;
+
+	g_assert(g_at_mux_get_channel_stats(sched_mux, channel, &stats));
+	g_assert(stats.frames_sent == sched_frames->len);
+
+	for (i = 0; i < 1000 && sched_frames->len < BACKPRESSURE_FRAMES; i++)
+		sched_collect();
+
+	g_assert(backpressure_written == BACKPRESSURE_BYTES);
+	g_assert(sched_frames->len == BACKPRESSURE_FRAMES);
+
+	g_assert(g_at_mux_get_channel_stats(sched_mux, channel, &stats));
+	g_assert(stats.frames_sent == BACKPRESSURE_FRAMES);
+
+	g_at_io_unref(io);
+
+	sched_teardown();
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -563,6 +1084,15 @@ int main(int argc, char **argv)
 	g_test_add_func("/testmux/extract_basic", test_extract_basic);
 	g_test_add_func("/testmux/extract_advanced", test_extract_advanced);
 	g_test_add_func("/testmux/basic", test_basic);
+	g_test_add_func("/testmux/demux_basic", test_demux_basic);
+	g_test_add_func("/testmux/demux_advanced", test_demux_advanced);
+	g_test_add_func("/testmux/priority", test_priority);
+	g_test_add_func("/testmux/fairness", test_fairness);
+	g_test_add_func("/testmux/flow_control", test_flow_control);
+	g_test_add_func("/testmux/large_frame_size", test_large_frame_size);
+	g_test_add_func("/testmux/large_test_command",
+						test_large_test_command);
+	g_test_add_func("/testmux/backpressure", test_backpressure);
 
 	return g_test_run();
 }
@@ -0,0 +1,677 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+
+#include "gathdlc.h"
+#include "gatppp.h"
+#include "ppp.h"
+
+#define PACKET_SIZE	1000
+#define HEADROOM	4
+
+static GAtPPP *ppp;
+static GAtHDLC *peer;
+static GArray *received;
+
+static void peer_receive(const unsigned char *data, gsize size,
+				gpointer user_data)
+{
+	guint16 seq = 0xffff;
+
+	if (ppp_proto(data) == PPP_IP_PROTO) {
+		g_assert(size == PACKET_SIZE + sizeof(struct ppp_header));
+		seq = ppp_info(data)[0] << 8 | ppp_info(data)[1];
+	}
+
+	g_array_append_val(received, seq);
+}
+
+static void ppp_setup(void)
+{
+	GIOChannel *io;
+	int sv[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	io = g_io_channel_unix_new(sv[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	ppp = g_at_ppp_new(io);
+	g_io_channel_unref(io);
+
+	io = g_io_channel_unix_new(sv[1]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+	peer = g_at_hdlc_new(io);
+	g_io_channel_unref(io);
+
+	g_assert(ppp != NULL);
+	g_assert(peer != NULL);
+
+	g_at_hdlc_set_receive(peer, peer_receive, NULL);
+
+	received = g_array_new(FALSE, FALSE, sizeof(guint16));
+}
+
+static void ppp_teardown(void)
+{
+	g_at_ppp_unref(ppp);
+	ppp = NULL;
+
+	g_at_hdlc_unref(peer);
+	peer = NULL;
+
+	g_array_free(received, TRUE);
+	received = NULL;
+}
+
+static gboolean send_ip(struct ppp_header *packet, guint16 seq)
+{
+	packet->info[0] = seq >> 8;
+	packet->info[1] = seq & 0xff;
+
+	return ppp_transmit(ppp, (guint8 *) packet, PACKET_SIZE);
+}
+
+static void test_xmit_queue(void)
+{
+	struct ppp_header *packet;
+	struct ppp_header *echo;
+	GAtPPPXmitStats stats;
+	guint seq;
+	guint sent = 0;
+	guint i;
+
+	ppp_setup();
+
+	g_at_ppp_set_xmit_budget(ppp, 8 * 1024);
+	packet = ppp_packet_new(PACKET_SIZE, PPP_IP_PROTO);
+
+	/* Without the main loop running nothing reaches the modem */
+	for (seq = 0; seq < 40; seq++) {
+		if (send_ip(packet, seq) == FALSE)
+			continue;
+
+		g_assert(seq == sent);
+		sent += 1;
+	}
+
+	g_assert(g_at_ppp_get_xmit_stats(ppp, &stats));
+	g_assert(stats.queued > 0);
+	g_assert(stats.queue_bytes > 0);
+	g_assert(stats.queue_bytes <= 8 * 1024);
+	g_assert(stats.max_queue_bytes == stats.queue_bytes);
+	g_assert(stats.dropped == 40 - sent);
+
+	g_assert(ppp_can_transmit(ppp, PACKET_SIZE) == FALSE);
+
+	/* Control packets are queued over the budget */
+	echo = ppp_packet_new(4, LCP_PROTOCOL);
+	echo->info[0] = 9;
+	g_assert(ppp_transmit(ppp, (guint8 *) echo, 4) == TRUE);
+	g_free(echo);
+
+	while (received->len < sent + 1)
+		g_main_context_iteration(NULL, TRUE);
+
+	/* Queued frames go out in order, behind those sent directly */
+	for (i = 0; i < sent; i++)
+		g_assert(g_array_index(received, guint16, i) == i);
+
+	g_assert(g_array_index(received, guint16, sent) == 0xffff);
+
+	g_assert(g_at_ppp_get_xmit_stats(ppp, &stats));
+	g_assert(stats.queue_bytes == 0);
+	g_assert(ppp_can_transmit(ppp, PACKET_SIZE) == TRUE);
+
+	g_free(packet);
+
+	ppp_teardown();
+}
+
+static void test_xmit_budget(void)
+{
+	struct ppp_header *packet;
+	GAtPPPXmitStats stats;
+	guint seq;
+
+	ppp_setup();
+
+	/* A queue that is empty always takes a packet, however large */
+	g_at_ppp_set_xmit_budget(ppp, 0);
+	packet = ppp_packet_new(PACKET_SIZE, PPP_IP_PROTO);
+
+	for (seq = 0; ppp_can_transmit(ppp, PACKET_SIZE); seq++)
+		g_assert(send_ip(packet, seq) == TRUE);
+
+	g_assert(send_ip(packet, seq) == FALSE);
+
+	g_assert(g_at_ppp_get_xmit_stats(ppp, &stats));
+	g_assert(stats.queued == 1);
+	g_assert(stats.dropped == 1);
+
+	while (received->len < seq)
+		g_main_context_iteration(NULL, TRUE);
+
+	g_assert(received->len == seq);
+	g_assert(ppp_can_transmit(ppp, PACKET_SIZE) == TRUE);
+
+	g_free(packet);
+
+	ppp_teardown();
+}
+
+struct tcp_flow {
+	guint32 saddr;
+	guint32 daddr;
+	guint16 sport;
+	guint16 dport;
+	guint32 seq;
+	guint32 ack;
+	guint16 win;
+	guint16 id;
+	guint8 options;		/* Bytes of TCP options */
+};
+
+static guint16 ip_sum(const guint8 *ip, guint len)
+{
+	guint32 sum = 0;
+	guint i;
+
+	for (i = 0; i < len; i += 2)
+		sum += ip[i] << 8 | ip[i + 1];
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+/* Builds a TCP/IP packet of the flow at buf, returns its length */
+static guint build_tcp(guint8 *buf, const struct tcp_flow *flow,
+				guint8 flags, guint16 urp, guint datalen)
+{
+	guint thlen = 20 + flow->options;
+	guint len = 20 + thlen + datalen;
+	guint8 *th = buf + 20;
+	guint16 sum;
+	guint i;
+
+	memset(buf, 0, 20 + thlen);
+
+	buf[0] = 0x45;
+	buf[2] = len >> 8;
+	buf[3] = len & 0xff;
+	buf[4] = flow->id >> 8;
+	buf[5] = flow->id & 0xff;
+	buf[6] = 0x40;		/* Don't fragment */
+	buf[8] = 64;
+	buf[9] = IPPROTO_TCP;
+	memcpy(buf + 12, &flow->saddr, 4);
+	memcpy(buf + 16, &flow->daddr, 4);
+
+	sum = ip_sum(buf, 20);
+	buf[10] = sum >> 8;
+	buf[11] = sum & 0xff;
+
+	th[0] = flow->sport >> 8;
+	th[1] = flow->sport & 0xff;
+	th[2] = flow->dport >> 8;
+	th[3] = flow->dport & 0xff;
+	put_network_short(th + 4, flow->seq >> 16);
+	put_network_short(th + 6, flow->seq & 0xffff);
+	put_network_short(th + 8, flow->ack >> 16);
+	put_network_short(th + 10, flow->ack & 0xffff);
+	th[12] = (thlen / 4) << 4;
+	th[13] = flags;
+	put_network_short(th + 14, flow->win);
+	put_network_short(th + 16, g_test_rand_int_range(0, 0x10000));
+	put_network_short(th + 18, urp);
+
+	/* Timestamps, different in every packet */
+	for (i = 20; i < thlen; i++)
+		th[i] = g_test_rand_int_range(0, 256);
+
+	for (i = 20 + thlen; i < len; i++)
+		buf[i] = g_test_rand_int_range(0, 256);
+
+	return len;
+}
+
+#define TH_FIN		0x01
+#define TH_SYN		0x02
+#define TH_PUSH		0x08
+#define TH_ACK		0x10
+#define TH_URG		0x20
+
+struct vj_stats {
+	guint packets;
+	guint compressed;
+	guint64 bytes;		/* Full headers, as without compression */
+	guint64 wire;		/* With VJ, ACFC and PFC */
+};
+
+static void vj_roundtrip(struct ppp_vj *xmit, struct ppp_vj *recv,
+				const struct tcp_flow *flow, guint8 flags,
+				guint16 urp, guint datalen,
+				struct vj_stats *stats)
+{
+	guint8 orig[1500];
+	guint8 buf[HEADROOM + 1500];
+	guint8 *packet = buf + HEADROOM;
+	const guint8 *out;
+	gsize len;
+	guint16 proto;
+
+	len = build_tcp(orig, flow, flags, urp, datalen);
+	memcpy(packet, orig, len);
+
+	stats->packets += 1;
+	stats->bytes += len + sizeof(struct ppp_header);
+
+	proto = ppp_vj_compress(xmit, &packet, &len);
+
+	g_assert(packet >= buf + HEADROOM);
+	stats->wire += len + 1;
+
+	if (proto == PPP_VJ_COMP_PROTO)
+		stats->compressed += 1;
+
+	if (proto == PPP_IP_PROTO)
+		out = packet;
+	else
+		out = ppp_vj_uncompress(recv, proto, packet, &len);
+
+	g_assert(out != NULL);
+	g_assert(len == 40 + flow->options + datalen);
+	g_assert(memcmp(out, orig, len) == 0);
+}
+
+/* Bulk data one way, acks and the odd keystroke the other way */
+static void vj_session(struct ppp_vj *xmit, struct ppp_vj *recv,
+				struct tcp_flow *data, struct tcp_flow *ack,
+				int segments, struct vj_stats *stats)
+{
+	guint mss = 1460 - data->options;
+	guint datalen;
+	int n;
+
+	for (n = 0; n < segments; n++) {
+		datalen = n % 8 == 7 ? (guint) g_test_rand_int_range(1, mss) : mss;
+
+		vj_roundtrip(xmit, recv, data, TH_ACK | (n % 4 ? 0 : TH_PUSH),
+				0, datalen, stats);
+		data->seq += datalen;
+		data->id += 1;
+
+		if (n % 2)
+			continue;
+
+		ack->ack = data->seq;
+		ack->id += g_test_rand_int_range(1, 3);
+
+		if (n % 16 == 0)
+			ack->win += g_test_rand_int_range(-2000, 2000);
+
+		vj_roundtrip(xmit, recv, ack, TH_ACK, 0, 0, stats);
+	}
+}
+
+static void flow_init(struct tcp_flow *flow, struct tcp_flow *reverse,
+			int n)
+{
+	memset(flow, 0, sizeof(*flow));
+
+	flow->saddr = htonl(0x0a000001);
+	flow->daddr = htonl(0xc0a80000 + n);
+	flow->sport = 40000 + n;
+	flow->dport = 80;
+	flow->seq = g_test_rand_int();
+	flow->ack = g_test_rand_int();
+	flow->win = 5840;
+	flow->id = g_test_rand_int_range(0, 0x10000);
+
+	if (reverse == NULL)
+		return;
+
+	reverse->saddr = flow->daddr;
+	reverse->daddr = flow->saddr;
+	reverse->sport = flow->dport;
+	reverse->dport = flow->sport;
+	reverse->seq = flow->ack;
+	reverse->ack = flow->seq;
+	reverse->win = 65535;
+	reverse->id = g_test_rand_int_range(0, 0x10000);
+	reverse->options = 0;
+}
+
+static void test_vj_roundtrip(void)
+{
+	struct ppp_vj *xmit = ppp_vj_new();
+	struct ppp_vj *recv = ppp_vj_new();
+	struct vj_stats stats;
+	struct tcp_flow flows[24];
+	struct tcp_flow reverse[24];
+	struct tcp_flow *f = &flows[0];
+	struct tcp_flow *r = &reverse[0];
+	int n;
+
+	memset(&stats, 0, sizeof(stats));
+
+	g_assert(ppp_vj_set_xmit(xmit, 15, TRUE));
+	g_assert(ppp_vj_set_recv(recv, 15));
+
+	flow_init(f, r, 0);
+
+	/* Connection setup goes out as plain IP */
+	vj_roundtrip(xmit, recv, f, TH_SYN, 0, 0, &stats);
+	vj_roundtrip(xmit, recv, r, TH_SYN | TH_ACK, 0, 0, &stats);
+	g_assert(stats.compressed == 0);
+
+	vj_session(xmit, recv, r, f, 200, &stats);
+	g_assert(stats.compressed > stats.packets / 2);
+
+	/* Interactive echo, data and ack move in step */
+	for (n = 0; n < 50; n++) {
+		vj_roundtrip(xmit, recv, f, TH_ACK | TH_PUSH, 0, 1, &stats);
+		f->seq += 1;
+		f->id += 1;
+
+		r->ack = f->seq;
+		vj_roundtrip(xmit, recv, r, TH_ACK | TH_PUSH, 0, 1, &stats);
+		r->seq += 1;
+		r->id += 1;
+		f->ack = r->seq;
+	}
+
+	/* Urgent data, a retransmission and a jump in sequence space */
+	vj_roundtrip(xmit, recv, f, TH_ACK | TH_URG, 1, 1, &stats);
+	vj_roundtrip(xmit, recv, f, TH_ACK | TH_URG, 1, 1, &stats);
+	vj_roundtrip(xmit, recv, f, TH_ACK, 0, 10, &stats);
+	f->seq += 0x20000;
+	f->ack -= 1000;
+	f->id += 700;
+	vj_roundtrip(xmit, recv, f, TH_ACK, 0, 10, &stats);
+	vj_roundtrip(xmit, recv, f, TH_ACK, 0, 10, &stats);
+
+	/* More connections than slots, in turns */
+	for (n = 1; n < 24; n++)
+		flow_init(&flows[n], &reverse[n], n);
+
+	for (n = 0; n < 24 * 20; n++) {
+		f = &flows[n % 24];
+		r = &reverse[n % 24];
+
+		vj_session(xmit, recv, f, r, g_test_rand_int_range(1, 4),
+				&stats);
+	}
+
+	/* Timestamps defeat the compression, but must survive */
+	flow_init(f, r, 100);
+	f->options = 12;
+	r->options = 12;
+	vj_session(xmit, recv, f, r, 20, &stats);
+
+	vj_roundtrip(xmit, recv, f, TH_FIN | TH_ACK, 0, 0, &stats);
+
+	ppp_vj_free(xmit);
+	ppp_vj_free(recv);
+}
+
+static void test_vj_toss(void)
+{
+	struct ppp_vj *xmit = ppp_vj_new();
+	struct ppp_vj *recv = ppp_vj_new();
+	struct tcp_flow flow;
+	guint8 buf[HEADROOM + 1500];
+	guint8 *packet;
+	gsize len;
+	guint16 proto;
+	int n;
+
+	g_assert(ppp_vj_set_xmit(xmit, 3, TRUE));
+	g_assert(ppp_vj_set_recv(recv, 3));
+
+	flow_init(&flow, NULL, 0);
+
+	/* Compressed packets before any state are dropped */
+	for (n = 0; n < 3; n++) {
+		packet = buf + HEADROOM;
+		len = build_tcp(packet, &flow, TH_ACK, 0, 100);
+		flow.seq += 100;
+		flow.id += 1;
+
+		proto = ppp_vj_compress(xmit, &packet, &len);
+
+		if (n == 0) {
+			g_assert(proto == PPP_VJ_UNCOMP_PROTO);
+			continue;
+		}
+
+		g_assert(proto == PPP_VJ_COMP_PROTO);
+		g_assert(ppp_vj_uncompress(recv, proto, packet, &len) == NULL);
+	}
+
+	/* A slot beyond what was negotiated, and a truncated header */
+	packet = buf + HEADROOM;
+	len = build_tcp(packet, &flow, TH_ACK, 0, 100);
+	packet[9] = 4;
+	g_assert(ppp_vj_uncompress(recv, PPP_VJ_UNCOMP_PROTO,
+					packet, &len) == NULL);
+
+	len = 30;
+	g_assert(ppp_vj_uncompress(recv, PPP_VJ_UNCOMP_PROTO,
+					packet, &len) == NULL);
+
+	packet[0] = 0x40 | 0x08;
+	packet[1] = 0;
+	len = 3;
+	g_assert(ppp_vj_uncompress(recv, PPP_VJ_COMP_PROTO,
+					packet, &len) == NULL);
+
+	/* Not negotiated at all */
+	g_assert(ppp_vj_set_recv(recv, -1));
+	len = build_tcp(packet, &flow, TH_ACK, 0, 100);
+	packet[9] = 0;
+	g_assert(ppp_vj_uncompress(recv, PPP_VJ_UNCOMP_PROTO,
+					packet, &len) == NULL);
+
+	ppp_vj_free(xmit);
+	ppp_vj_free(recv);
+}
+
+/* The uplink of a download: requests now and then, acks in between */
+static void test_vj_benchmark(void)
+{
+	int sessions = g_test_perf() ? 5000 : 50;
+	struct ppp_vj *xmit = ppp_vj_new();
+	struct ppp_vj *recv = ppp_vj_new();
+	struct tcp_flow flow;
+	struct vj_stats stats;
+	double elapsed;
+	double saved;
+	int n;
+	int k;
+
+	memset(&stats, 0, sizeof(stats));
+
+	g_assert(ppp_vj_set_xmit(xmit, 15, TRUE));
+	g_assert(ppp_vj_set_recv(recv, 15));
+
+	g_test_timer_start();
+
+	for (n = 0; n < sessions; n++) {
+		flow_init(&flow, NULL, n % 8);
+
+		for (k = 0; k < 64; k++) {
+			if (k % 16 == 0) {
+				vj_roundtrip(xmit, recv, &flow, TH_ACK | TH_PUSH,
+						0, 300, &stats);
+				flow.seq += 300;
+				flow.id += 1;
+			}
+
+			flow.ack += 2 * 1460;
+			flow.id += 1;
+			vj_roundtrip(xmit, recv, &flow, TH_ACK, 0, 0, &stats);
+		}
+	}
+
+	elapsed = g_test_timer_elapsed();
+	saved = 100.0 * (stats.bytes - stats.wire) / stats.bytes;
+
+	g_assert(stats.wire < stats.bytes);
+
+	g_test_minimized_result(elapsed, "VJ round trip: %.0f packets/s",
+					stats.packets / elapsed);
+
+	if (g_test_verbose())
+		g_print("%u packets, %u compressed, %" G_GUINT64_FORMAT
+				" bytes, %" G_GUINT64_FORMAT " on the wire\n",
+				stats.packets, stats.compressed,
+				stats.bytes, stats.wire);
+
+	g_test_maximized_result(saved, "Bytes on the wire saved: %.1f%%",
+					saved);
+
+	ppp_vj_free(xmit);
+	ppp_vj_free(recv);
+}
+
+static GByteArray *frame;
+
+static void frame_receive(const unsigned char *data, gsize size,
+				gpointer user_data)
+{
+	g_byte_array_set_size(frame, 0);
+	g_byte_array_append(frame, data, size);
+}
+
+static void frame_wait(void)
+{
+	g_byte_array_set_size(frame, 0);
+
+	while (frame->len == 0)
+		g_main_context_iteration(NULL, TRUE);
+}
+
+static void test_header_compression(void)
+{
+	struct ppp_vj *recv = ppp_vj_new();
+	struct ppp_header *packet;
+	struct ppp_header *echo;
+	struct tcp_flow flow;
+	const guint8 *ip;
+	gsize len;
+	guint size;
+
+	ppp_setup();
+
+	frame = g_byte_array_new();
+	g_at_hdlc_set_receive(peer, frame_receive, NULL);
+
+	packet = ppp_packet_new(1500, PPP_IP_PROTO);
+	flow_init(&flow, NULL, 0);
+
+	ppp_set_xmit_pfc(ppp, TRUE);
+	ppp_set_xmit_acfc(ppp, TRUE);
+
+	size = build_tcp(packet->info, &flow, TH_ACK, 0, 100);
+	g_assert(ppp_transmit(ppp, (guint8 *) packet, size));
+	frame_wait();
+
+	g_assert(frame->len == size + 1);
+	g_assert(frame->data[0] == PPP_IP_PROTO);
+
+	/* LCP keeps its full header */
+	echo = ppp_packet_new(4, LCP_PROTOCOL);
+	echo->info[0] = 9;
+	g_assert(ppp_transmit(ppp, (guint8 *) echo, 4));
+	frame_wait();
+
+	g_assert(frame->len == 8);
+	g_assert(memcmp(frame->data, "\xff\x03\xc0\x21", 4) == 0);
+	g_free(echo);
+
+	/* VJ on top, the peer rebuilds the very same packet */
+	ppp_set_xmit_acfc(ppp, FALSE);
+	ppp_set_xmit_vj(ppp, 15, TRUE);
+	g_assert(ppp_vj_set_recv(recv, 15));
+
+	size = build_tcp(packet->info, &flow, TH_ACK, 0, 100);
+	g_assert(ppp_transmit(ppp, (guint8 *) packet, size));
+	frame_wait();
+
+	g_assert(frame->len == size + 3);
+	g_assert(memcmp(frame->data, "\xff\x03\x2f", 3) == 0);
+
+	len = frame->len - 3;
+	g_assert(ppp_vj_uncompress(recv, PPP_VJ_UNCOMP_PROTO,
+					frame->data + 3, &len) != NULL);
+
+	flow.seq += 100;
+	flow.id += 1;
+
+	size = build_tcp(packet->info, &flow, TH_ACK, 0, 100);
+	ip = g_memdup(packet->info, size);
+
+	g_assert(ppp_transmit(ppp, (guint8 *) packet, size));
+	frame_wait();
+
+	g_assert(frame->len < size - 30);
+	g_assert(memcmp(frame->data, "\xff\x03\x2d", 3) == 0);
+
+	len = frame->len - 3;
+	g_assert(memcmp(ppp_vj_uncompress(recv, PPP_VJ_COMP_PROTO,
+					frame->data + 3, &len),
+				ip, size) == 0);
+	g_assert(len == size);
+
+	g_free((gpointer) ip);
+	g_free(packet);
+	ppp_vj_free(recv);
+	g_byte_array_free(frame, TRUE);
+
+	ppp_teardown();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testppp/xmit_queue", test_xmit_queue);
+	g_test_add_func("/testppp/xmit_budget", test_xmit_budget);
+	g_test_add_func("/testppp/vj_roundtrip", test_vj_roundtrip);
+	g_test_add_func("/testppp/vj_toss", test_vj_toss);
+	g_test_add_func("/testppp/vj_benchmark", test_vj_benchmark);
+	g_test_add_func("/testppp/header_compression",
+					test_header_compression);
+
+	return g_test_run();
+}
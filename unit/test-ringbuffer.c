@@ -0,0 +1,372 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "ringbuffer.h"
+
+#define HDLC_FLAG	0x7e
+#define HDLC_ESCAPE	0x7d
+#define HDLC_TRANS	0x20
+
+static void test_mirrored(void)
+{
+	unsigned int page_size = sysconf(_SC_PAGESIZE);
+	struct ring_buffer *rbuf = ring_buffer_new_mirrored(100);
+	unsigned char data[256];
+	unsigned char *ptr;
+	unsigned int i;
+
+	g_assert(rbuf != NULL);
+
+	if (!ring_buffer_is_mirrored(rbuf)) {
+		g_test_message("Mirroring not supported, skipped");
+		ring_buffer_free(rbuf);
+		return;
+	}
+
+	g_assert(ring_buffer_capacity(rbuf) == (int) page_size);
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i;
+
+	/* Leave the read and write counters just before the end */
+	ring_buffer_write_advance(rbuf, page_size - 100);
+	ring_buffer_drain(rbuf, page_size - 100);
+
+	/* Everything free is writable in one go */
+	g_assert(ring_buffer_avail_no_wrap(rbuf) == (int) page_size);
+
+	ptr = ring_buffer_write_ptr(rbuf, 0);
+	memcpy(ptr, data, sizeof(data));
+	ring_buffer_write_advance(rbuf, sizeof(data));
+
+	/* And readable in one go, straddling the end of the buffer */
+	g_assert(ring_buffer_len_no_wrap(rbuf) == sizeof(data));
+
+	ptr = ring_buffer_read_ptr(rbuf, 0);
+	g_assert(memcmp(ptr, data, sizeof(data)) == 0);
+
+	/* The wrapped bytes really are at the start */
+	ptr = ring_buffer_read_ptr(rbuf, 100);
+	g_assert(memcmp(ptr, data + 100, sizeof(data) - 100) == 0);
+
+	ring_buffer_drain(rbuf, 50);
+	ring_buffer_write(rbuf, data, sizeof(data));
+	g_assert(ring_buffer_len_no_wrap(rbuf) == ring_buffer_len(rbuf));
+
+	ptr = ring_buffer_read_ptr(rbuf, sizeof(data) - 50);
+	g_assert(memcmp(ptr, data, sizeof(data)) == 0);
+
+	ring_buffer_free(rbuf);
+}
+
+static void test_compare(void)
+{
+	struct ring_buffer *plain = ring_buffer_new(4096);
+	struct ring_buffer *mirrored = ring_buffer_new_mirrored(4096);
+	unsigned char in[1024];
+	unsigned char out1[1024];
+	unsigned char out2[1024];
+	unsigned int len;
+	int n1;
+	int n2;
+	int i;
+
+	g_assert(plain != NULL);
+	g_assert(mirrored != NULL);
+
+	/* Same capacity, so both wrap and fill up at the same points */
+	g_assert(ring_buffer_capacity(plain) ==
+			ring_buffer_capacity(mirrored));
+
+	for (i = 0; i < 10000; i++) {
+		len = g_test_rand_int_range(0, sizeof(in));
+
+		if (g_test_rand_int_range(0, 2)) {
+			memset(in, i, len);
+
+			n1 = ring_buffer_write(plain, in, len);
+			n2 = ring_buffer_write(mirrored, in, len);
+		} else {
+			n1 = ring_buffer_read(plain, out1, len);
+			n2 = ring_buffer_read(mirrored, out2, len);
+
+			g_assert(memcmp(out1, out2, n1) == 0);
+		}
+
+		g_assert(n1 == n2);
+		g_assert(ring_buffer_len(plain) == ring_buffer_len(mirrored));
+		g_assert(ring_buffer_avail(plain) ==
+				ring_buffer_avail(mirrored));
+		g_assert(ring_buffer_len_no_wrap(plain) <=
+				ring_buffer_len_no_wrap(mirrored));
+	}
+
+	ring_buffer_free(plain);
+	ring_buffer_free(mirrored);
+}
+
+/* Fills the buffer the way GAtIO reads into it */
+static unsigned int feed(struct ring_buffer *rbuf, const unsigned char *data,
+				unsigned int len)
+{
+	unsigned int total = 0;
+	unsigned int toread;
+
+	while (total < len) {
+		toread = MIN((unsigned int) ring_buffer_avail_no_wrap(rbuf),
+				len - total);
+		if (toread == 0)
+			break;
+
+		memcpy(ring_buffer_write_ptr(rbuf, 0), data + total, toread);
+		ring_buffer_write_advance(rbuf, toread);
+		total += toread;
+	}
+
+	return total;
+}
+
+/* Line splitting along the lines of GAtChat's extract_line */
+static unsigned int extract_lines(struct ring_buffer *rbuf)
+{
+	char line[256];
+	unsigned int len = ring_buffer_len(rbuf);
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	unsigned int lines = 0;
+	unsigned int start = 0;
+	unsigned int pos = 0;
+
+	while (pos < len) {
+		if (*buf == '\n') {
+			ring_buffer_read(rbuf, line,
+					MIN(pos + 1 - start, sizeof(line)));
+			start = pos + 1;
+			lines += 1;
+		}
+
+		buf += 1;
+		pos += 1;
+
+		if (pos == wrap)
+			buf = ring_buffer_read_ptr(rbuf, pos - start);
+	}
+
+	return lines;
+}
+
+struct decoder {
+	unsigned char frame[4096];
+	unsigned int offset;
+	gboolean escape;
+};
+
+/* Frame splitting along the lines of GAtHDLC's new_bytes */
+static unsigned int decode_frames(struct ring_buffer *rbuf,
+					struct decoder *d)
+{
+	unsigned int len = ring_buffer_len(rbuf);
+	unsigned int wrap = ring_buffer_len_no_wrap(rbuf);
+	unsigned char *buf = ring_buffer_read_ptr(rbuf, 0);
+	unsigned int frames = 0;
+	unsigned int pos = 0;
+	unsigned int end;
+	unsigned int run;
+
+	while (pos < len) {
+		if (d->escape == FALSE) {
+			end = pos < wrap ? wrap : len;
+
+			for (run = 0; run < end - pos; run++)
+				if (buf[run] == HDLC_FLAG ||
+						buf[run] == HDLC_ESCAPE)
+					break;
+
+			if (run > 0) {
+				memcpy(d->frame + d->offset, buf, run);
+				d->offset += run;
+				buf += run;
+				pos += run;
+				goto next;
+			}
+		}
+
+		if (d->escape == TRUE) {
+			d->frame[d->offset++] = *buf ^ HDLC_TRANS;
+			d->escape = FALSE;
+		} else if (*buf == HDLC_ESCAPE) {
+			d->escape = TRUE;
+		} else {
+			frames += d->offset > 0;
+			d->offset = 0;
+		}
+
+		buf++;
+		pos++;
+
+next:
+		if (pos == wrap)
+			buf = ring_buffer_read_ptr(rbuf, pos);
+	}
+
+	ring_buffer_drain(rbuf, pos);
+
+	return frames;
+}
+
+static double run_lines(struct ring_buffer *rbuf, const unsigned char *data,
+				unsigned int size, int rounds,
+				unsigned int *lines)
+{
+	unsigned int pos;
+	unsigned int chunk;
+	int n;
+
+	*lines = 0;
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++) {
+		for (pos = 0; pos < size; pos += chunk) {
+			chunk = feed(rbuf, data + pos, MIN(size - pos, 1000));
+			*lines += extract_lines(rbuf);
+		}
+	}
+
+	return g_test_timer_elapsed();
+}
+
+static double run_frames(struct ring_buffer *rbuf, const unsigned char *data,
+				unsigned int size, int rounds,
+				unsigned int *frames)
+{
+	struct decoder d;
+	unsigned int pos;
+	unsigned int chunk;
+	int n;
+
+	*frames = 0;
+	memset(&d, 0, sizeof(d));
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++) {
+		for (pos = 0; pos < size; pos += chunk) {
+			chunk = feed(rbuf, data + pos, MIN(size - pos, 1000));
+			*frames += decode_frames(rbuf, &d);
+		}
+	}
+
+	return g_test_timer_elapsed();
+}
+
+static void test_benchmark(void)
+{
+	static const char *responses[] = {
+		"\r\n+CREG: 1,\"00C3\",\"0000E4A1\",2\r\n",
+		"\r\n+CSQ: 21,99\r\n",
+		"\r\nOK\r\n",
+		"\r\n+CMT: ,23\r\n0891683108200505F0040D91683106"
+							"02030405F00000\r\n",
+	};
+	int rounds = g_test_perf() ? 2000 : 20;
+	struct ring_buffer *plain = ring_buffer_new(4096);
+	struct ring_buffer *mirrored = ring_buffer_new_mirrored(4096);
+	GByteArray *data = g_byte_array_new();
+	unsigned int count1;
+	unsigned int count2;
+	double elapsed;
+	double bytes;
+	int i;
+
+	g_assert(plain != NULL);
+	g_assert(mirrored != NULL);
+
+	while (data->len < 64 * 1024) {
+		const char *r = responses[g_test_rand_int_range(0,
+						G_N_ELEMENTS(responses))];
+
+		g_byte_array_append(data, (const guint8 *) r, strlen(r));
+	}
+
+	bytes = (double) data->len * rounds;
+
+	elapsed = run_lines(plain, data->data, data->len, rounds, &count1);
+	g_test_minimized_result(elapsed, "Line extraction, plain: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	elapsed = run_lines(mirrored, data->data, data->len, rounds, &count2);
+	g_test_minimized_result(elapsed, "Line extraction, mirrored: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	g_assert(count1 == count2);
+
+	/* Frames with the odd escaped byte */
+	g_byte_array_set_size(data, 0);
+
+	while (data->len < 64 * 1024) {
+		guint8 frame[1502];
+
+		for (i = 0; i < (int) sizeof(frame) - 1; i++)
+			frame[i] = g_test_rand_int_range(0x20, HDLC_ESCAPE);
+
+		frame[g_test_rand_int_range(0, 100)] = HDLC_ESCAPE;
+		frame[sizeof(frame) - 1] = HDLC_FLAG;
+
+		g_byte_array_append(data, frame, sizeof(frame));
+	}
+
+	bytes = (double) data->len * rounds;
+
+	elapsed = run_frames(plain, data->data, data->len, rounds, &count1);
+	g_test_minimized_result(elapsed, "HDLC decoding, plain: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	elapsed = run_frames(mirrored, data->data, data->len, rounds, &count2);
+	g_test_minimized_result(elapsed, "HDLC decoding, mirrored: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	g_assert(count1 == count2);
+
+	g_byte_array_free(data, TRUE);
+	ring_buffer_free(plain);
+	ring_buffer_free(mirrored);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testringbuffer/mirrored", test_mirrored);
+	g_test_add_func("/testringbuffer/compare", test_compare);
+	g_test_add_func("/testringbuffer/benchmark", test_benchmark);
+
+	return g_test_run();
+}
@@ -23,15 +23,19 @@
 #include <config.h>
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <glib.h>
 
 #include <ofono/types.h>
 
 #include "simutil.h"
 #include "util.h"
+#include "storage.h"
 
 /* Taken from 51.011 Appendix K.2 */
 const unsigned char valid_mms_params[] = {
@@ -444,10 +448,113 @@ static void test_3g_status_data()
 	g_free(response);
 }
 
+#define CACHE_IMSI "cache"
+
+static void test_sim_cache()
+{
+	struct sim_cache *cache;
+	const struct sim_cache_file *file;
+	unsigned char data[64];
+	struct stat st;
+	off_t size;
+	FILE *f;
+	int i;
+	char *dir = g_strdup_printf("%s/" CACHE_IMSI "-1",
+					storage_get_root());
+	char *path = g_strdup_printf("%s/cache", dir);
+
+	for (i = 0; i < 64; i++)
+		data[i] = i;
+
+	unlink(path);
+
+	cache = sim_cache_new(CACHE_IMSI, 1);
+	g_assert(cache != NULL);
+	g_assert(sim_cache_lookup(cache, 0x6f40) == NULL);
+
+	g_assert(sim_cache_store(cache, 0x6f40, 1, 64, 16, data));
+	g_assert(sim_cache_store(cache, 0x2fe2, 0, 10, 10, data + 1));
+
+	file = sim_cache_lookup(cache, 0x6f40);
+	g_assert(file != NULL);
+	g_assert(file->structure == 1);
+	g_assert(file->length == 64);
+	g_assert(file->record_length == 16);
+	g_assert(memcmp(file->data, data, 64) == 0);
+
+	sim_cache_free(cache);
+
+	/* Reopened, EFs come straight from the mapping */
+	cache = sim_cache_new(CACHE_IMSI, 1);
+	file = sim_cache_lookup(cache, 0x2fe2);
+	g_assert(file != NULL);
+	g_assert(file->structure == 0);
+	g_assert(file->length == 10);
+	g_assert(memcmp(file->data, data + 1, 10) == 0);
+
+	/* A later copy replaces an earlier one, removal sticks */
+	g_assert(sim_cache_store(cache, 0x2fe2, 0, 8, 8, data + 8));
+	sim_cache_remove(cache, 0x6f40);
+	g_assert(sim_cache_lookup(cache, 0x6f40) == NULL);
+
+	sim_cache_free(cache);
+
+	/* More dead than live data, so the file was compacted */
+	g_assert(stat(path, &st) == 0);
+	g_assert(st.st_size == 4 + 12 + 8);
+
+	cache = sim_cache_new(CACHE_IMSI, 1);
+	g_assert(sim_cache_lookup(cache, 0x6f40) == NULL);
+
+	file = sim_cache_lookup(cache, 0x2fe2);
+	g_assert(file != NULL);
+	g_assert(file->length == 8);
+	g_assert(memcmp(file->data, data + 8, 8) == 0);
+
+	sim_cache_free(cache);
+
+	/* A torn or corrupt EF at the end is dropped on load */
+	size = st.st_size;
+
+	f = fopen(path, "a");
+	g_assert(f != NULL);
+	fwrite("\x6f\x40\x01\x00\x00\x10\x00\x10\x12\x34\x56\x78" "abcd",
+		1, 16, f);
+	fclose(f);
+
+	cache = sim_cache_new(CACHE_IMSI, 1);
+	g_assert(sim_cache_lookup(cache, 0x6f40) == NULL);
+	g_assert(sim_cache_lookup(cache, 0x2fe2) != NULL);
+
+	g_assert(stat(path, &st) == 0);
+	g_assert(st.st_size == size);
+
+	g_assert(sim_cache_store(cache, 0x6f40, 1, 64, 16, data));
+	sim_cache_free(cache);
+
+	cache = sim_cache_new(CACHE_IMSI, 1);
+	file = sim_cache_lookup(cache, 0x6f40);
+	g_assert(file != NULL);
+	g_assert(memcmp(file->data, data, 64) == 0);
+	sim_cache_free(cache);
+
+	unlink(path);
+	rmdir(dir);
+
+	g_free(path);
+	g_free(dir);
+}
+
 int main(int argc, char **argv)
 {
+	char root[] = "/tmp/ofono-simutil-XXXXXX";
+	int ret;
+
 	g_test_init(&argc, &argv, NULL);
 
+	g_assert(mkdtemp(root) != NULL);
+	storage_set_root(root);
+
 	g_test_add_func("/testsimutil/ber tlv iter", test_ber_tlv_iter);
 	g_test_add_func("/testsimutil/ber tlv encode MMS",
 			test_ber_tlv_builder_mms);
@@ -458,6 +565,11 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsimutil/EONS Handling", test_eons);
 	g_test_add_func("/testsimutil/Elementary File DB", test_ef_db);
 	g_test_add_func("/testsimutil/3G Status response", test_3g_status_data);
+	g_test_add_func("/testsimutil/SIM cache", test_sim_cache);
+
+	ret = g_test_run();
+
+	rmdir(root);
 
-	return g_test_run();
+	return ret;
 }
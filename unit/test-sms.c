@@ -32,6 +32,7 @@
 #include <glib/gprintf.h>
 
 #include "util.h"
+#include "storage.h"
 #include "smsutil.h"
 
 static const char *simple_deliver = "07911326040000F0"
@@ -768,17 +769,17 @@ static void test_assembly()
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	sms_assembly_expire(assembly, time(NULL) + 40);
 
-	g_assert(g_slist_length(assembly->assembly_list) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
 
 	sms_extract_concatenation(&sms, &ref, &max, &seq);
 	l = sms_assembly_add_fragment(assembly, &sms, time(NULL),
 					&sms.deliver.oaddr, ref, max, seq);
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1138,7 +1139,7 @@ static void test_cbs_assembly()
 	/* Add an initial page to the assembly */
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell.serials) == 1);
 	g_slist_foreach(l, (GFunc)g_free, NULL);
 	g_slist_free(l);
 
@@ -1146,7 +1147,7 @@ static void test_cbs_assembly()
 	dec1.update_number = 8;
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell.serials) == 1);
 	g_slist_foreach(l, (GFunc)g_free, NULL);
 	g_slist_free(l);
 
@@ -1160,7 +1161,7 @@ static void test_cbs_assembly()
 	g_assert(l == NULL);
 
 	cbs_assembly_location_changed(assembly, TRUE, TRUE, TRUE);
-	g_assert(assembly->recv_cell == NULL);
+	g_assert(g_hash_table_size(assembly->recv_cell.serials) == 0);
 
 	dec1.update_number = 9;
 	dec1.page = 3;
@@ -1200,6 +1201,250 @@ static void test_cbs_assembly()
 	cbs_assembly_free(assembly);
 }
 
+static GSList *cbs_storm_add(struct cbs_assembly *assembly, int message,
+				guint8 update, guint8 page, guint8 max_pages)
+{
+	struct cbs cbs;
+
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.gs = CBS_GEO_SCOPE_PLMN;
+	cbs.message_identifier = 4352 + message / 1024;
+	cbs.message_code = message % 1024;
+	cbs.update_number = update;
+	cbs.dcs = 0x0f;
+	cbs.max_pages = max_pages;
+	cbs.page = page;
+	memset(cbs.ud, page, sizeof(cbs.ud));
+
+	return cbs_assembly_add_page(assembly, &cbs);
+}
+
+static void cbs_storm_check(GSList *l, int *completed)
+{
+	GSList *i;
+	guint8 page = 1;
+
+	if (l == NULL)
+		return;
+
+	for (i = l; i; i = i->next, page++)
+		g_assert(((struct cbs *) i->data)->ud[0] == page);
+
+	g_slist_foreach(l, (GFunc)g_free, NULL);
+	g_slist_free(l);
+
+	*completed += 1;
+}
+
+static void test_cbs_storm()
+{
+	int updates = g_test_perf() ? 64 : 4;
+	struct cbs_assembly *assembly = cbs_assembly_new();
+	int completed = 0;
+	double elapsed;
+	int update;
+	int repeat;
+	int group;
+	int page;
+	int n;
+
+	g_test_timer_start();
+
+	/*
+	 * 400 three page messages are broadcast in groups of 32, with the
+	 * pages of a group interleaved.  Every broadcast is repeated five
+	 * times before the update number moves on.
+	 */
+	for (update = 0; update < updates; update++)
+		for (repeat = 0; repeat < 5; repeat++)
+			for (group = 0; group < 400; group += 32)
+				for (page = 3; page > 0; page--)
+					for (n = group; n < group + 32 &&
+							n < 400; n++)
+						cbs_storm_check(
+							cbs_storm_add(assembly,
+								n * 37,
+								update % 16,
+								page, 3),
+							&completed);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed, "%d pages assembled in %.3f s",
+					updates * 5 * 400 * 3, elapsed);
+
+	g_assert(completed == updates * 400);
+	g_assert(g_queue_get_length(assembly->assembly_lru) == 0);
+	g_assert(g_hash_table_size(assembly->recv_plmn.serials) == 400);
+
+	cbs_assembly_free(assembly);
+}
+
+static void test_cbs_assembly_bounds()
+{
+	struct cbs_assembly *assembly = cbs_assembly_new();
+	int completed = 0;
+	guint size;
+	int n;
+
+	/* Single page messages, the oldest get forgotten */
+	for (n = 0; n < 1000; n++)
+		cbs_storm_check(cbs_storm_add(assembly, n, 0, 1, 1),
+					&completed);
+
+	g_assert(completed == 1000);
+
+	size = g_hash_table_size(assembly->recv_plmn.serials);
+	g_assert(size < 1000);
+	g_assert(size == g_queue_get_length(assembly->recv_plmn.lru));
+
+	cbs_storm_check(cbs_storm_add(assembly, 999, 0, 1, 1), &completed);
+	g_assert(completed == 1000);
+
+	/* Repeats keep a message from being forgotten */
+	for (n = 1000; n < 2000; n++) {
+		cbs_storm_check(cbs_storm_add(assembly, n, 0, 1, 1),
+					&completed);
+		cbs_storm_check(cbs_storm_add(assembly, 999, 0, 1, 1),
+					&completed);
+	}
+
+	g_assert(completed == 2000);
+
+	cbs_storm_check(cbs_storm_add(assembly, 0, 0, 1, 1), &completed);
+	g_assert(completed == 2001);
+
+	cbs_assembly_location_changed(assembly, TRUE, TRUE, TRUE);
+	g_assert(g_hash_table_size(assembly->recv_plmn.serials) == 0);
+
+	/* Partially assembled messages, the least recently used go */
+	for (n = 0; n < 1000; n++)
+		cbs_storm_check(cbs_storm_add(assembly, n, 0, 2, 2),
+					&completed);
+
+	g_assert(completed == 2001);
+	g_assert(g_queue_get_length(assembly->assembly_lru) < 1000);
+	g_assert(g_queue_get_length(assembly->assembly_lru) ==
+			g_hash_table_size(assembly->assembly_table));
+
+	cbs_storm_check(cbs_storm_add(assembly, 0, 0, 1, 2), &completed);
+	g_assert(completed == 2001);
+
+	cbs_storm_check(cbs_storm_add(assembly, 999, 0, 1, 2), &completed);
+	g_assert(completed == 2002);
+
+	cbs_assembly_location_changed(assembly, TRUE, FALSE, FALSE);
+	g_assert(g_queue_get_length(assembly->assembly_lru) == 0);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+
+	cbs_assembly_free(assembly);
+}
+
+static void test_cbs_assembly_free_partial()
+{
+	struct cbs_assembly *assembly = cbs_assembly_new();
+	int completed = 0;
+	int n;
+
+	/* Pages of several updates of the same message share a node list */
+	cbs_storm_check(cbs_storm_add(assembly, 1, 0, 1, 3), &completed);
+	cbs_storm_check(cbs_storm_add(assembly, 1, 1, 2, 3), &completed);
+
+	for (n = 2; n < 10; n++)
+		cbs_storm_check(cbs_storm_add(assembly, n, 0, 2, 3),
+					&completed);
+
+	g_assert(completed == 0);
+	g_assert(g_queue_get_length(assembly->assembly_lru) == 10);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 9);
+
+	/* As on modem removal, with all of these still being assembled */
+	cbs_assembly_free(assembly);
+}
+
+static GSList *assembly_index_add(struct sms_assembly *assembly, int sender,
+					guint16 ref, time_t ts, guint8 seq)
+{
+	struct sms_address addr;
+	struct sms sms;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.number_type = SMS_NUMBER_TYPE_INTERNATIONAL;
+	addr.numbering_plan = SMS_NUMBERING_PLAN_ISDN;
+	sprintf(addr.address, "%d", 1000000 + sender);
+
+	memset(&sms, 0, sizeof(sms));
+	sms.type = SMS_TYPE_DELIVER;
+	sms.deliver.udl = 1;
+	sms.deliver.ud[0] = seq;
+
+	return sms_assembly_add_fragment(assembly, &sms, ts, &addr,
+						ref, 4, seq);
+}
+
+static void test_assembly_index()
+{
+	int senders = g_test_perf() ? 20000 : 200;
+	struct sms_assembly *assembly = sms_assembly_new(NULL);
+	double elapsed;
+	GSList *l;
+	GSList *i;
+	int n;
+	guint8 seq;
+
+	g_test_timer_start();
+
+	/*
+	 * Every sender has two concatenated messages pending, with the
+	 * fragments arriving out of order and interleaved with everyone
+	 * else's.  The older message never completes.
+	 */
+	for (seq = 4; seq > 2; seq--)
+		for (n = 0; n < senders; n++)
+			g_assert(!assembly_index_add(assembly, n, 1, 1000, seq));
+
+	for (seq = 4; seq > 1; seq--)
+		for (n = 0; n < senders; n++)
+			g_assert(!assembly_index_add(assembly, n, 2, 1001, seq));
+
+	g_assert(g_hash_table_size(assembly->assembly_table) ==
+			(guint) senders * 2);
+
+	/* Duplicate fragments are ignored */
+	g_assert(!assembly_index_add(assembly, 0, 2, 1001, 2));
+	g_assert(g_hash_table_size(assembly->assembly_table) ==
+			(guint) senders * 2);
+
+	sms_assembly_expire(assembly, 999);
+	g_assert(g_hash_table_size(assembly->assembly_table) ==
+			(guint) senders * 2);
+
+	sms_assembly_expire(assembly, 1000);
+	g_assert(g_hash_table_size(assembly->assembly_table) ==
+			(guint) senders);
+
+	for (n = 0; n < senders; n++) {
+		l = assembly_index_add(assembly, n, 2, 1001, 1);
+		g_assert(g_slist_length(l) == 4);
+
+		for (i = l, seq = 1; i; i = i->next, seq++)
+			g_assert(((struct sms *) i->data)->deliver.ud[0] == seq);
+
+		g_slist_foreach(l, (GFunc)g_free, NULL);
+		g_slist_free(l);
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+	g_assert(assembly->expiry_heap->len == 0);
+
+	g_test_minimized_result(elapsed, "%d fragments: %.0f fragments/s",
+				senders * 6, senders * 6 / elapsed);
+
+	sms_assembly_free(assembly);
+}
+
 static void test_serialize_assembly()
 {
 	unsigned char pdu[176];
@@ -1225,7 +1470,7 @@ static void test_serialize_assembly()
 				sms_address_to_string(&sms.deliver.oaddr));
 	}
 
-	g_assert(g_slist_length(assembly->assembly_list) == 1);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
 	g_assert(l == NULL);
 
 	decode_hex_own_buf(assembly_pdu2, -1, &pdu_len, 0, pdu);
@@ -1291,6 +1536,92 @@ static void test_range_minimizer()
 	}
 }
 
+static void check_topic_filter(GSList *r)
+{
+	struct cbs_topic_filter *filter = cbs_topic_filter_new(r);
+	unsigned int topic;
+
+	for (topic = 0; topic < 65536; topic++)
+		g_assert(cbs_topic_filter_match(filter, topic) ==
+				cbs_topic_in_range(topic, r));
+
+	cbs_topic_filter_free(filter);
+}
+
+static void test_topic_filter()
+{
+	static struct cbs_topic_range edges[] = {
+		{ 0, 0 }, { 31, 32 }, { 64, 95 }, { 97, 97 }, { 200, 100 },
+		{ 1000, 4000 }, { 65503, 65535 },
+	};
+	int rounds = g_test_perf() ? 2000 : 20;
+	struct cbs_topic_filter *filter;
+	struct cbs_topic_range *range;
+	GSList *r = NULL;
+	double elapsed;
+	unsigned int topic;
+	unsigned int hits;
+	unsigned int i;
+	int n;
+
+	g_assert(cbs_topic_filter_new(NULL) == NULL);
+	g_assert(cbs_topic_filter_match(NULL, 0) == FALSE);
+
+	for (i = 0; ranges[i]; i++) {
+		r = cbs_extract_topic_ranges(ranges[i]);
+		check_topic_filter(r);
+		g_slist_foreach(r, (GFunc)g_free, NULL);
+		g_slist_free(r);
+	}
+
+	r = NULL;
+
+	for (i = 0; i < G_N_ELEMENTS(edges); i++)
+		r = g_slist_prepend(r, &edges[i]);
+
+	check_topic_filter(r);
+	g_slist_free(r);
+
+	/* A long list of single topics, the way EFcbmid hands them over */
+	r = NULL;
+
+	for (i = 0; i < 256; i++) {
+		range = g_new0(struct cbs_topic_range, 1);
+		range->min = range->max = 4352 + i * 7;
+		r = g_slist_prepend(r, range);
+	}
+
+	check_topic_filter(r);
+
+	filter = cbs_topic_filter_new(r);
+
+	g_test_timer_start();
+
+	for (n = 0, hits = 0; n < rounds; n++)
+		for (topic = 4096; topic < 8192; topic++)
+			hits += cbs_topic_in_range(topic, r);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "Range list: %.0f topics/s",
+					rounds * 4096 / elapsed);
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++)
+		for (topic = 4096; topic < 8192; topic++)
+			hits -= cbs_topic_filter_match(filter, topic);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_minimized_result(elapsed, "Compiled filter: %.0f topics/s",
+					rounds * 4096 / elapsed);
+
+	g_assert(hits == 0);
+
+	cbs_topic_filter_free(filter);
+	g_slist_foreach(r, (GFunc)g_free, NULL);
+	g_slist_free(r);
+}
+
 static void test_sr_assembly()
 {
 	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
@@ -1336,13 +1667,347 @@ static void test_sr_assembly()
 	status_report_assembly_free(sra);
 }
 
+#define JOURNAL_IMSI "journal"
+
+static char *journal_path(const char *name)
+{
+	return g_strdup_printf("%s/" JOURNAL_IMSI "/%s", storage_get_root(),
+				name);
+}
+
+static void test_journal_assembly()
+{
+	struct sms_assembly *assembly;
+	unsigned char pdu[176];
+	unsigned char buf[177];
+	long pdu_len;
+	struct sms sms;
+	char straddr[25];
+	FILE *f;
+	GSList *l;
+	GSList *i;
+	int n;
+	guint8 seq;
+	char *path = journal_path("sms_assembly.journal");
+	char *legacy = journal_path("sms_assembly");
+
+	unlink(path);
+
+	assembly = sms_assembly_new(JOURNAL_IMSI);
+
+	/* Most messages complete, so the journal gets compacted as we go */
+	for (n = 0; n < 100; n++)
+		for (seq = 1; seq < 3; seq++)
+			g_assert(!assembly_index_add(assembly, n, n, 1000 + n,
+							seq));
+
+	for (n = 0; n < 90; n++) {
+		l = assembly_index_add(assembly, n, n, 1000 + n, 4);
+		l = assembly_index_add(assembly, n, n, 1000 + n, 3);
+		g_assert(g_slist_length(l) == 4);
+
+		g_slist_foreach(l, (GFunc)g_free, NULL);
+		g_slist_free(l);
+	}
+
+	g_assert(assembly->journal_records < 100);
+	sms_assembly_free(assembly);
+
+	/* A torn record at the end is dropped on load */
+	f = fopen(path, "a");
+	g_assert(f != NULL);
+	fwrite("\x12\x34\x56\x78\x01\xff", 1, 6, f);
+	fclose(f);
+
+	assembly = sms_assembly_new(JOURNAL_IMSI);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 10);
+	g_assert(assembly->fragments == 20);
+	g_assert(assembly->journal_records == 20);
+
+	sms_assembly_expire(assembly, 1094);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 5);
+
+	for (n = 95; n < 100; n++) {
+		g_assert(!assembly_index_add(assembly, n, n, 1000 + n, 4));
+		l = assembly_index_add(assembly, n, n, 1000 + n, 3);
+
+		for (i = l, seq = 1; i; i = i->next, seq++)
+			g_assert(((struct sms *) i->data)->
+						deliver.ud[0] == seq);
+
+		g_assert(seq == 5);
+
+		g_slist_foreach(l, (GFunc)g_free, NULL);
+		g_slist_free(l);
+	}
+
+	sms_assembly_free(assembly);
+
+	/* Nothing pending, so the journal goes away */
+	assembly = sms_assembly_new(JOURNAL_IMSI);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 0);
+	g_assert(g_file_test(path, G_FILE_TEST_EXISTS) == FALSE);
+	sms_assembly_free(assembly);
+
+	/* Fragments backed up one file each are moved into the journal */
+	decode_hex_own_buf(assembly_pdu1, -1, &pdu_len, 0, pdu);
+	sms_decode(pdu, pdu_len, FALSE, assembly_pdu_len1, &sms);
+	sms_address_to_hex_string(&sms.deliver.oaddr, straddr);
+
+	buf[0] = assembly_pdu_len1;
+	memcpy(buf + 1, pdu, pdu_len);
+
+	g_assert(write_file(buf, pdu_len + 1, 0600, "%s/%s-%i-%i/%03i",
+				legacy, straddr, 0xf0, 3, 1) == pdu_len + 1);
+
+	assembly = sms_assembly_new(JOURNAL_IMSI);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+	g_assert(g_file_test(path, G_FILE_TEST_EXISTS) == TRUE);
+	g_assert(g_file_test(legacy, G_FILE_TEST_EXISTS) == FALSE);
+	sms_assembly_free(assembly);
+
+	assembly = sms_assembly_new(JOURNAL_IMSI);
+	g_assert(g_hash_table_size(assembly->assembly_table) == 1);
+
+	sms_assembly_expire(assembly, time(NULL));
+	sms_assembly_free(assembly);
+
+	unlink(path);
+	g_free(legacy);
+	g_free(path);
+}
+
+static void sr_address(struct sms_address *addr, int receiver)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->number_type = SMS_NUMBER_TYPE_INTERNATIONAL;
+	addr->numbering_plan = SMS_NUMBERING_PLAN_ISDN;
+	sprintf(addr->address, "%d", 1000000 + receiver);
+}
+
+static gboolean sr_report(struct status_report_assembly *sra, int receiver,
+				unsigned char mr, enum sms_st st,
+				unsigned int *id, gboolean *delivered)
+{
+	struct sms sr;
+
+	memset(&sr, 0, sizeof(sr));
+	sr.type = SMS_TYPE_STATUS_REPORT;
+	sr.status_report.mr = mr;
+	sr.status_report.st = st;
+	sr_address(&sr.status_report.raddr, receiver);
+
+	return status_report_assembly_report(sra, &sr, id, delivered);
+}
+
+static void count_expired(gpointer data, gpointer user_data)
+{
+	int *count = user_data;
+
+	*count += 1;
+}
+
+static void test_sr_assembly_index()
+{
+	int receivers = g_test_perf() ? 1000 : 20;
+	struct status_report_assembly *sra = status_report_assembly_new(NULL);
+	struct sms_address addr;
+	gboolean delivered;
+	double elapsed;
+	unsigned int id;
+	int expired = 0;
+	int n;
+	int m;
+	int mr;
+
+	g_test_timer_start();
+
+	/*
+	 * Every receiver gets 64 four part messages, using up all of the
+	 * TP-MRs, with reports requested.
+	 */
+	for (m = 0; m < 64; m++)
+		for (n = 0; n < receivers; n++)
+			for (mr = m * 4; mr < m * 4 + 4; mr++) {
+				sr_address(&addr, n);
+				status_report_assembly_add_fragment(sra,
+							n * 64 + m, &addr,
+							mr, 1000 + m, 4);
+			}
+
+	g_assert(g_hash_table_size(sra->assembly_table) ==
+			(guint) receivers * 64);
+	g_assert(g_hash_table_size(sra->mr_table) ==
+			(guint) receivers * 256);
+
+	/* Reports come back in reverse, each message completes once */
+	for (mr = 255; mr >= 0; mr--) {
+		for (n = 0; n < receivers; n++) {
+			if (!sr_report(sra, n, mr, SMS_ST_COMPLETED_RECEIVED,
+						&id, &delivered)) {
+				g_assert(mr % 4 != 0);
+				continue;
+			}
+
+			g_assert(mr % 4 == 0);
+			g_assert(id == (unsigned int) (n * 64 + mr / 4));
+			g_assert(delivered == TRUE);
+		}
+
+		/* Except for the oldest, which are left to expire */
+		if (mr == 4)
+			break;
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed, "%d reports correlated in %.3f s",
+					receivers * 252, elapsed);
+
+	g_assert(g_hash_table_size(sra->assembly_table) ==
+			(guint) receivers);
+
+	/* A report for an unknown TP-MR or receiver is not ours */
+	g_assert(!sr_report(sra, 0, 4, SMS_ST_COMPLETED_RECEIVED,
+				&id, &delivered));
+	g_assert(!sr_report(sra, receivers, 0, SMS_ST_COMPLETED_RECEIVED,
+				&id, &delivered));
+
+	status_report_assembly_expire(sra, 999, count_expired, &expired);
+	g_assert(expired == 0);
+
+	status_report_assembly_expire(sra, 1000, count_expired, &expired);
+	g_assert(expired == receivers);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+	g_assert(g_hash_table_size(sra->mr_table) == 0);
+
+	/* A reused TP-MR belongs to the newest message */
+	sr_address(&addr, 0);
+	status_report_assembly_add_fragment(sra, 1, &addr, 7, 2000, 1);
+	status_report_assembly_add_fragment(sra, 2, &addr, 7, 2001, 1);
+
+	g_assert(sr_report(sra, 0, 7, SMS_ST_PERMANENT_RP_ERROR,
+				&id, &delivered));
+	g_assert(id == 2);
+	g_assert(delivered == FALSE);
+
+	g_assert(!sr_report(sra, 0, 7, SMS_ST_COMPLETED_RECEIVED,
+				&id, &delivered));
+
+	status_report_assembly_expire(sra, 2000, NULL, NULL);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+
+	status_report_assembly_free(sra);
+}
+
+static void test_sr_journal()
+{
+	struct status_report_assembly *sra;
+	struct sms_address addr;
+	gboolean delivered;
+	unsigned int id;
+	int n;
+	int mr;
+	char *path = journal_path("sms_sr_assembly.journal");
+
+	unlink(path);
+
+	sra = status_report_assembly_new(JOURNAL_IMSI);
+
+	/* 100 three part messages, the first 90 get all their reports */
+	for (n = 0; n < 100; n++) {
+		sr_address(&addr, n);
+
+		for (mr = 0; mr < 3; mr++)
+			status_report_assembly_add_fragment(sra, n, &addr,
+							mr, 1000 + n, 3);
+	}
+
+	for (n = 0; n < 90; n++) {
+		g_assert(!sr_report(sra, n, 0, SMS_ST_COMPLETED_RECEIVED,
+					&id, &delivered));
+		g_assert(!sr_report(sra, n, 1, SMS_ST_COMPLETED_RECEIVED,
+					&id, &delivered));
+		g_assert(sr_report(sra, n, 2, SMS_ST_COMPLETED_RECEIVED,
+					&id, &delivered));
+		g_assert(id == (unsigned int) n);
+	}
+
+	/* One report is in for the rest */
+	for (n = 90; n < 100; n++)
+		g_assert(!sr_report(sra, n, 1, SMS_ST_COMPLETED_RECEIVED,
+					&id, &delivered));
+
+	g_assert(sra->journal_records < 200);
+	status_report_assembly_free(sra);
+
+	/* Pending reports survive a restart */
+	sra = status_report_assembly_new(JOURNAL_IMSI);
+	g_assert(g_hash_table_size(sra->assembly_table) == 10);
+	g_assert(g_hash_table_size(sra->mr_table) == 20);
+	g_assert(sra->journal_records == 10);
+
+	status_report_assembly_expire(sra, 1094, NULL, NULL);
+	g_assert(g_hash_table_size(sra->assembly_table) == 5);
+
+	for (n = 95; n < 100; n++) {
+		g_assert(!sr_report(sra, n, 1, SMS_ST_COMPLETED_RECEIVED,
+					&id, &delivered));
+		g_assert(!sr_report(sra, n, 0, SMS_ST_COMPLETED_RECEIVED,
+					&id, &delivered));
+		g_assert(sr_report(sra, n, 2, SMS_ST_COMPLETED_RECEIVED,
+					&id, &delivered));
+		g_assert(id == (unsigned int) n);
+		g_assert(delivered == TRUE);
+	}
+
+	status_report_assembly_free(sra);
+
+	/* Nothing pending, so the journal goes away */
+	sra = status_report_assembly_new(JOURNAL_IMSI);
+	g_assert(g_hash_table_size(sra->assembly_table) == 0);
+	g_assert(g_file_test(path, G_FILE_TEST_EXISTS) == FALSE);
+	status_report_assembly_free(sra);
+
+	g_free(path);
+}
+
+static void remove_dir(const char *path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *name;
+
+	if (dir == NULL)
+		return;
+
+	while ((name = g_dir_read_name(dir))) {
+		char *child = g_build_filename(path, name, NULL);
+
+		if (g_file_test(child, G_FILE_TEST_IS_DIR))
+			remove_dir(child);
+		else
+			unlink(child);
+
+		g_free(child);
+	}
+
+	g_dir_close(dir);
+	rmdir(path);
+}
+
 int main(int argc, char **argv)
 {
 	char long_string[152*33 + 1];
 	struct sms_concat_data long_string_test;
+	char root[] = "/tmp/ofono-sms-XXXXXX";
+	int ret;
 
 	g_test_init(&argc, &argv, NULL);
 
+	/* Assemblies with an IMSI keep their backups under the root */
+	g_assert(mkdtemp(root) != NULL);
+	storage_set_root(root);
+
 	g_test_add_func("/testsms/Test Simple Deliver", test_simple_deliver);
 	g_test_add_func("/testsms/Test Alnum Deliver", test_alnum_sender);
 	g_test_add_func("/testsms/Test Deliver Encode", test_deliver_encode);
@@ -1355,6 +2020,7 @@ int main(int argc, char **argv)
 			&ems_udh_test_2, test_ems_udh);
 
 	g_test_add_func("/testsms/Test Assembly", test_assembly);
+	g_test_add_func("/testsms/Test Assembly Index", test_assembly_index);
 	g_test_add_func("/testsms/Test Prepare 7Bit", test_prepare_7bit);
 
 	g_test_add_data_func("/testsms/Test Prepare Concat",
@@ -1377,13 +2043,29 @@ int main(int argc, char **argv)
 	g_test_add_func("/testsms/Test CBS Encode / Decode",
 			test_cbs_encode_decode);
 	g_test_add_func("/testsms/Test CBS Assembly", test_cbs_assembly);
+	g_test_add_func("/testsms/Test CBS Assembly Bounds",
+			test_cbs_assembly_bounds);
+	g_test_add_func("/testsms/Test CBS Assembly Free Partial",
+			test_cbs_assembly_free_partial);
+	g_test_add_func("/testsms/Test CBS Storm", test_cbs_storm);
 
 	g_test_add_func("/testsms/Test SMS Assembly Serialize",
 			test_serialize_assembly);
+	g_test_add_func("/testsms/Test SMS Assembly Journal",
+			test_journal_assembly);
 
 	g_test_add_func("/testsms/Range minimizer", test_range_minimizer);
+	g_test_add_func("/testsms/Topic filter", test_topic_filter);
 
 	g_test_add_func("/testsms/Status Report Assembly", test_sr_assembly);
+	g_test_add_func("/testsms/Status Report Assembly Index",
+			test_sr_assembly_index);
+	g_test_add_func("/testsms/Status Report Assembly Journal",
+			test_sr_journal);
+
+	ret = g_test_run();
+
+	remove_dir(root);
 
-	return g_test_run();
+	return ret;
 }
@@ -22927,6 +22927,79 @@ static void test_img_to_xpm(gconstpointer data)
 	g_free(xpm);
 }
 
+struct command_pdu {
+	const unsigned char *pdu;
+	unsigned int len;
+};
+
+/* A mix of the commands above, weighted towards the frequent ones */
+static const struct command_pdu parse_speed_pdus[] = {
+	{ display_text_111, sizeof(display_text_111) },
+	{ display_text_171, sizeof(display_text_171) },
+	{ get_inkey_111, sizeof(get_inkey_111) },
+	{ get_inkey_161, sizeof(get_inkey_161) },
+	{ get_input_111, sizeof(get_input_111) },
+	{ get_input_191, sizeof(get_input_191) },
+	{ more_time_111, sizeof(more_time_111) },
+	{ play_tone_111, sizeof(play_tone_111) },
+	{ poll_interval_111, sizeof(poll_interval_111) },
+	{ setup_menu_111, sizeof(setup_menu_111) },
+	{ select_item_111, sizeof(select_item_111) },
+	{ select_item_161, sizeof(select_item_161) },
+	{ send_sms_111, sizeof(send_sms_111) },
+	{ send_sms_181, sizeof(send_sms_181) },
+	{ send_ss_111, sizeof(send_ss_111) },
+	{ send_ussd_111, sizeof(send_ussd_111) },
+	{ setup_call_111, sizeof(setup_call_111) },
+	{ setup_call_191, sizeof(setup_call_191) },
+	{ refresh_121, sizeof(refresh_121) },
+	{ provide_local_info_121, sizeof(provide_local_info_121) },
+	{ setup_event_list_111, sizeof(setup_event_list_111) },
+	{ setup_event_list_141, sizeof(setup_event_list_141) },
+	{ perform_card_apdu_111, sizeof(perform_card_apdu_111) },
+	{ get_reader_status_111, sizeof(get_reader_status_111) },
+	{ timer_mgmt_111, sizeof(timer_mgmt_111) },
+	{ timer_mgmt_121, sizeof(timer_mgmt_121) },
+	{ timer_mgmt_141, sizeof(timer_mgmt_141) },
+	{ timer_mgmt_161, sizeof(timer_mgmt_161) },
+	{ setup_idle_mode_text_111, sizeof(setup_idle_mode_text_111) },
+	{ run_at_command_111, sizeof(run_at_command_111) },
+	{ send_dtmf_111, sizeof(send_dtmf_111) },
+	{ language_notification_111, sizeof(language_notification_111) },
+	{ launch_browser_111, sizeof(launch_browser_111) },
+	{ poll_interval_111, sizeof(poll_interval_111) },
+	{ timer_mgmt_111, sizeof(timer_mgmt_111) },
+	{ timer_mgmt_121, sizeof(timer_mgmt_121) },
+	{ setup_event_list_111, sizeof(setup_event_list_111) },
+};
+
+static void test_parse_speed(void)
+{
+	int rounds = g_test_perf() ? 100000 : 1000;
+	struct stk_command *command;
+	double elapsed;
+	unsigned int i;
+	int n;
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++) {
+		for (i = 0; i < G_N_ELEMENTS(parse_speed_pdus); i++) {
+			command = stk_command_new_from_pdu(
+						parse_speed_pdus[i].pdu,
+						parse_speed_pdus[i].len);
+			g_assert(command->status == STK_PARSE_RESULT_OK);
+			stk_command_free(command);
+		}
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed, "Parsed %.0f commands/s",
+			(double) rounds * G_N_ELEMENTS(parse_speed_pdus) /
+			elapsed);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -24974,5 +25047,7 @@ int main(int argc, char **argv)
 	g_test_add_data_func("/teststk/IMG to XPM Test 6",
 				&xpm_test_6, test_img_to_xpm);
 
+	g_test_add_func("/teststk/Parse Speed", test_parse_speed);
+
 	return g_test_run();
 }
@@ -0,0 +1,339 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+
+#include "storage.h"
+
+#define TEST_IMSI "storagetest"
+#define TEST_STORE "settings"
+#define TEST_JOURNAL "journal"
+
+/* Short enough for the tests to run through them on the main loop */
+#define TEST_FLUSH_DELAY 20
+#define TEST_FLUSH_LATENCY 100
+
+static char *test_path;
+
+/* Runs the main loop until the settings were written out count times */
+static void wait_for_writes(const struct storage_stats *before,
+				unsigned int count)
+{
+	struct storage_stats stats;
+
+	storage_get_stats(&stats);
+
+	while (stats.writes - before->writes < count) {
+		g_main_context_iteration(NULL, TRUE);
+		storage_get_stats(&stats);
+	}
+}
+
+/* What made it to disk, -1 if nothing did */
+static int stored_count(void)
+{
+	GKeyFile *keyfile = g_key_file_new();
+	GError *error = NULL;
+	int count = -1;
+
+	if (g_key_file_load_from_file(keyfile, test_path, 0, NULL))
+		count = g_key_file_get_integer(keyfile, "Settings", "Count",
+						&error);
+
+	if (error) {
+		g_error_free(error);
+		count = -1;
+	}
+
+	g_key_file_free(keyfile);
+
+	return count;
+}
+
+static void test_coalesce(void)
+{
+	struct storage_stats before;
+	struct storage_stats after;
+	GKeyFile *keyfile;
+	int i;
+
+	unlink(test_path);
+	storage_get_stats(&before);
+
+	keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	g_assert(keyfile != NULL);
+
+	for (i = 0; i < 100; i++) {
+		g_key_file_set_integer(keyfile, "Settings", "Count", i);
+		storage_sync(TEST_IMSI, TEST_STORE, keyfile);
+	}
+
+	/* Nothing is written while the changes keep coming */
+	storage_get_stats(&after);
+	g_assert(after.syncs - before.syncs == 100);
+	g_assert(after.coalesced - before.coalesced == 99);
+	g_assert(after.writes == before.writes);
+	g_assert(stored_count() == -1);
+
+	wait_for_writes(&before, 1);
+
+	storage_get_stats(&after);
+	g_assert(after.writes - before.writes == 1);
+	g_assert(stored_count() == 99);
+
+	/* Closing without anything pending does not write */
+	storage_close(TEST_IMSI, TEST_STORE, keyfile, FALSE);
+
+	storage_get_stats(&after);
+	g_assert(after.writes - before.writes == 1);
+
+	unlink(test_path);
+}
+
+struct trickle {
+	GKeyFile *keyfile;
+	int count;
+	int first;		/* Count when first seen on disk */
+};
+
+static gboolean trickle_cb(gpointer user_data)
+{
+	struct trickle *trickle = user_data;
+
+	if (trickle->first == -1)
+		trickle->first = stored_count();
+
+	if (trickle->count == 30)
+		return FALSE;
+
+	g_key_file_set_integer(trickle->keyfile, "Settings", "Count",
+				trickle->count);
+	storage_sync(TEST_IMSI, TEST_STORE, trickle->keyfile);
+	trickle->count += 1;
+
+	return TRUE;
+}
+
+static void test_latency(void)
+{
+	struct storage_stats before;
+	struct storage_stats after;
+	struct trickle trickle;
+
+	unlink(test_path);
+	storage_get_stats(&before);
+
+	trickle.keyfile = storage_open(TEST_IMSI, TEST_STORE);
+	trickle.count = 0;
+	trickle.first = -1;
+
+	/* A steady trickle of changes, never far enough apart to settle,
+	 * still gets written out
+	 */
+	g_timeout_add(TEST_FLUSH_DELAY / 4, trickle_cb, &trickle);
+
+	while (trickle.count < 30)
+		g_main_context_iteration(NULL, TRUE);
+
+	g_assert(trickle.first != -1);
+
+	storage_get_stats(&after);
+	g_assert(after.writes - before.writes >= 1);
+	g_assert(after.writes - before.writes < 30);
+
+	/* Closing writes out what is still pending */
+	g_key_file_set_integer(trickle.keyfile, "Settings", "Count", 30);
+	storage_sync(TEST_IMSI, TEST_STORE, trickle.keyfile);
+	storage_close(TEST_IMSI, TEST_STORE, trickle.keyfile, FALSE);
+
+	g_assert(stored_count() == 30);
+
+	unlink(test_path);
+}
+
+static void test_shared(void)
+{
+	GKeyFile *keyfile1;
+	GKeyFile *keyfile2;
+
+	unlink(test_path);
+
+	keyfile1 = storage_open(TEST_IMSI, TEST_STORE);
+	keyfile2 = storage_open(TEST_IMSI, TEST_STORE);
+	g_assert(keyfile1 == keyfile2);
+
+	g_key_file_set_integer(keyfile1, "Settings", "Count", 1);
+	storage_sync(TEST_IMSI, TEST_STORE, keyfile1);
+
+	storage_close(TEST_IMSI, TEST_STORE, keyfile1, FALSE);
+	g_assert(stored_count() == 1);
+
+	/* Still open through the other user */
+	g_key_file_set_integer(keyfile2, "Settings", "Count", 2);
+	storage_sync(TEST_IMSI, TEST_STORE, keyfile2);
+	g_assert(stored_count() == 1);
+
+	storage_flush_all();
+	g_assert(stored_count() == 2);
+
+	storage_close(TEST_IMSI, TEST_STORE, keyfile2, TRUE);
+
+	/* The next open reads back what was written */
+	keyfile1 = storage_open(TEST_IMSI, TEST_STORE);
+	g_assert(g_key_file_get_integer(keyfile1, "Settings", "Count",
+						NULL) == 2);
+	storage_close(TEST_IMSI, TEST_STORE, keyfile1, FALSE);
+
+	unlink(test_path);
+}
+
+struct replayed {
+	unsigned char types[4];
+	int count;
+};
+
+static void replay_cb(unsigned char type, const unsigned char *data,
+			size_t len, void *user_data)
+{
+	struct replayed *replayed = user_data;
+
+	g_assert(len == 32);
+	g_assert(data[0] == type && data[31] == type);
+
+	if (replayed->count < 4)
+		replayed->types[replayed->count] = type;
+
+	replayed->count += 1;
+}
+
+static void test_torn_append(void)
+{
+	struct replayed replayed;
+	unsigned char data[32];
+	struct rlimit saved;
+	struct rlimit limit;
+	struct stat st;
+	off_t size;
+	int fd;
+
+	storage_journal_remove(TEST_IMSI, TEST_JOURNAL);
+
+	fd = storage_journal_open(TEST_IMSI, TEST_JOURNAL);
+	g_assert(fd != -1);
+
+	memset(data, 1, sizeof(data));
+	g_assert(storage_journal_append(&fd, 1, data, sizeof(data)) == 0);
+
+	size = lseek(fd, 0, SEEK_END);
+	g_assert(size > 0);
+
+	/* Let the disk fill up half way through the next record */
+	g_assert(getrlimit(RLIMIT_FSIZE, &saved) == 0);
+	limit = saved;
+	limit.rlim_cur = size + 16;
+	signal(SIGXFSZ, SIG_IGN);
+	g_assert(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+	memset(data, 2, sizeof(data));
+	g_assert(storage_journal_append(&fd, 2, data, sizeof(data)) == -1);
+
+	g_assert(setrlimit(RLIMIT_FSIZE, &saved) == 0);
+	signal(SIGXFSZ, SIG_DFL);
+
+	/* What got written of it is cut off again */
+	g_assert(fd != -1);
+	g_assert(fstat(fd, &st) == 0);
+	g_assert(st.st_size == size);
+
+	memset(data, 3, sizeof(data));
+	g_assert(storage_journal_append(&fd, 3, data, sizeof(data)) == 0);
+	close(fd);
+
+	/* So the record after the torn one still replays */
+	memset(&replayed, 0, sizeof(replayed));
+	g_assert(storage_journal_replay(TEST_IMSI, TEST_JOURNAL,
+					replay_cb, &replayed) == 2);
+	g_assert(replayed.count == 2);
+	g_assert(replayed.types[0] == 1);
+	g_assert(replayed.types[1] == 3);
+
+	storage_journal_remove(TEST_IMSI, TEST_JOURNAL);
+}
+
+static void remove_dir(const char *path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *name;
+
+	if (dir == NULL)
+		return;
+
+	while ((name = g_dir_read_name(dir))) {
+		char *child = g_build_filename(path, name, NULL);
+
+		if (g_file_test(child, G_FILE_TEST_IS_DIR))
+			remove_dir(child);
+		else
+			unlink(child);
+
+		g_free(child);
+	}
+
+	g_dir_close(dir);
+	rmdir(path);
+}
+
+int main(int argc, char **argv)
+{
+	char root[] = "/tmp/ofono-storage-XXXXXX";
+	int ret;
+
+	g_test_init(&argc, &argv, NULL);
+
+	g_assert(mkdtemp(root) != NULL);
+	storage_set_root(root);
+	storage_set_flush_delays(TEST_FLUSH_DELAY, TEST_FLUSH_LATENCY);
+
+	test_path = g_strdup_printf("%s/%s/%s", root, TEST_IMSI, TEST_STORE);
+
+	g_test_add_func("/teststorage/Coalesce", test_coalesce);
+	g_test_add_func("/teststorage/Latency", test_latency);
+	g_test_add_func("/teststorage/Shared", test_shared);
+	g_test_add_func("/teststorage/TornAppend", test_torn_append);
+
+	ret = g_test_run();
+
+	remove_dir(root);
+	g_free(test_path);
+
+	return ret;
+}
@@ -0,0 +1,202 @@
+/*
+ *
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2008-2010  Intel Corporation. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "tracebuffer.h"
+
+static void collect(const char *str, void *user_data)
+{
+	GPtrArray *lines = user_data;
+
+	/* Skip the time of day, "HH:MM:SS.uuuuuu " */
+	g_assert(strlen(str) > 16);
+	g_assert(str[2] == ':' && str[8] == '.' && str[15] == ' ');
+
+	g_ptr_array_add(lines, g_strdup(str + 16));
+}
+
+static GPtrArray *dump_lines(struct trace_buffer *tb)
+{
+	GPtrArray *lines = g_ptr_array_new();
+
+	trace_buffer_dump(tb, collect, lines);
+
+	return lines;
+}
+
+static void free_lines(GPtrArray *lines)
+{
+	unsigned int i;
+
+	for (i = 0; i < lines->len; i++)
+		g_free(lines->pdata[i]);
+
+	g_ptr_array_free(lines, TRUE);
+}
+
+static void test_format(void)
+{
+	struct trace_buffer *tb = trace_buffer_new(4096);
+	struct trace_channel *at = trace_channel_new("io", TRACE_FORMAT_TEXT);
+	struct trace_channel *isi = trace_channel_new("isi", TRACE_FORMAT_HEX);
+	static const unsigned char frame[] = { 0x01, 0x7e, 0xff };
+	unsigned char id = 0x42;
+	struct iovec iov[2] = {
+		{ &id, 1 },
+		{ (void *) frame, sizeof(frame) },
+	};
+	GPtrArray *lines;
+
+	g_assert(tb != NULL);
+
+	/* Nothing is recorded until there is somewhere to record to */
+	trace_record(at, FALSE, "AT\r", 3);
+
+	trace_set_buffer(tb);
+
+	trace_record(at, FALSE, "AT+CSQ\r", 7);
+	trace_record(at, TRUE, "\r\n+CSQ: 21,99\r\n\x1a\x80", 17);
+	trace_recordv(isi, TRUE, iov, 2);
+	trace_record(isi, FALSE, frame, 0);
+
+	g_assert(trace_buffer_len(tb) == 3);
+	g_assert(trace_buffer_dropped(tb) == 0);
+
+	lines = dump_lines(tb);
+	g_assert(lines->len == 3);
+
+	g_assert(g_str_has_prefix(lines->pdata[0], "io/"));
+	g_assert(g_str_has_suffix(lines->pdata[0], " > AT+CSQ\\r"));
+
+	g_assert(g_str_has_suffix(lines->pdata[1],
+				" < \\r\\n+CSQ: 21,99\\r\\n<CtrlZ>\\200"));
+	g_assert(g_str_has_prefix(lines->pdata[2], "isi/"));
+	g_assert(g_str_has_suffix(lines->pdata[2], " < 42 01 7e ff"));
+
+	free_lines(lines);
+
+	/* Records outlive their channel */
+	trace_channel_free(isi);
+
+	lines = dump_lines(tb);
+	g_assert(g_str_has_prefix(lines->pdata[2], "?/"));
+	free_lines(lines);
+
+	trace_channel_free(at);
+	trace_set_buffer(NULL);
+	trace_buffer_free(tb);
+}
+
+static void test_bounded(void)
+{
+	struct trace_buffer *tb = trace_buffer_new(4096);
+	struct trace_channel *at = trace_channel_new("io", TRACE_FORMAT_TEXT);
+	unsigned char big[8192];
+	GPtrArray *lines;
+	char buf[32];
+	int i;
+
+	trace_set_buffer(tb);
+
+	for (i = 0; i < 10000; i++) {
+		sprintf(buf, "\r\n+CREG: %d\r\n", i);
+		trace_record(at, TRUE, buf, strlen(buf));
+	}
+
+	/* Only the most recent records are kept */
+	g_assert(trace_buffer_len(tb) > 0);
+	g_assert(trace_buffer_len(tb) < 4096 / 16);
+	g_assert(trace_buffer_len(tb) + trace_buffer_dropped(tb) == 10000);
+
+	lines = dump_lines(tb);
+	g_assert(lines->len == trace_buffer_len(tb));
+
+	sprintf(buf, "+CREG: %u\\r\\n", 10000 - lines->len);
+	g_assert(g_str_has_suffix(lines->pdata[0], buf));
+	g_assert(g_str_has_suffix(lines->pdata[lines->len - 1],
+					" < \\r\\n+CREG: 9999\\r\\n"));
+	free_lines(lines);
+
+	/* Too big to fit, only the start of it is kept */
+	memset(big, 'A', sizeof(big));
+	trace_record(at, FALSE, big, sizeof(big));
+
+	g_assert(trace_buffer_len(tb) == 1);
+
+	lines = dump_lines(tb);
+	g_assert(lines->len == 1);
+	g_assert(g_str_has_suffix(lines->pdata[0], "AAAA ..."));
+	g_assert(strlen(lines->pdata[0]) < 4096 + 32);
+	free_lines(lines);
+
+	trace_channel_free(at);
+	trace_set_buffer(NULL);
+	trace_buffer_free(tb);
+}
+
+static void test_benchmark(void)
+{
+	struct trace_buffer *tb = trace_buffer_new(256 * 1024);
+	struct trace_channel *at = trace_channel_new("io", TRACE_FORMAT_TEXT);
+	static const char response[] = "\r\n+CREG: 1,\"00C3\",\"0000E4A1\",2\r\n";
+	int rounds = g_test_perf() ? 10000000 : 100000;
+	double elapsed;
+	int i;
+
+	trace_set_buffer(tb);
+
+	g_test_timer_start();
+
+	for (i = 0; i < rounds; i++)
+		trace_record(at, TRUE, response, sizeof(response) - 1);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed, "Recording: %.1f ns per record",
+					elapsed / rounds * 1e9);
+
+	g_assert(trace_buffer_len(tb) + trace_buffer_dropped(tb) ==
+						(unsigned int) rounds);
+
+	trace_channel_free(at);
+	trace_set_buffer(NULL);
+	trace_buffer_free(tb);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testtracebuffer/format", test_format);
+	g_test_add_func("/testtracebuffer/bounded", test_bounded);
+	g_test_add_func("/testtracebuffer/benchmark", test_benchmark);
+
+	return g_test_run();
+}
@@ -905,6 +905,330 @@ static void test_sim()
 	g_assert(utf8 == NULL);
 }
 
+static void test_dialects()
+{
+	unsigned char gsm[2];
+	unsigned char *back;
+	GString *text = g_string_new(NULL);
+	GString *decoded = g_string_new(NULL);
+	GByteArray *encoded = g_byte_array_new();
+	long nwritten;
+	long nread;
+	char *utf8;
+	char *again;
+	int locking;
+	int single;
+	int c;
+
+	for (locking = 0; locking < GSM_DIALECT_INVALID; locking++)
+	for (single = 0; single < GSM_DIALECT_INVALID; single++) {
+		g_string_truncate(text, 0);
+		g_string_truncate(decoded, 0);
+		g_byte_array_set_size(encoded, 0);
+
+		for (c = 0; c < 0x100; c++) {
+			long size = 1;
+
+			/* 0x1b on its own is invalid, 0x1b 0x1b is a space */
+			gsm[0] = c < 0x80 ? c : 0x1b;
+			gsm[1] = c & 0x7f;
+
+			if (c >= 0x80)
+				size = 2;
+
+			utf8 = convert_gsm_to_utf8_with_lang(gsm, size, &nread,
+							&nwritten, 0,
+							locking, single);
+			if (!utf8) {
+				g_assert(c == 0x1b || c >= 0x80);
+				continue;
+			}
+
+			g_assert(nread == size);
+
+			back = convert_utf8_to_gsm_with_lang(utf8, -1, &nread,
+							&nwritten, 0,
+							locking, single);
+
+			/* The Portuguese table has no way back for 0x40 */
+			if (!back) {
+				g_assert(locking == GSM_DIALECT_PORTUGUESE &&
+						c == 0x40);
+				g_free(utf8);
+				continue;
+			}
+
+			g_assert(nread == (long) strlen(utf8));
+
+			again = convert_gsm_to_utf8_with_lang(back, nwritten,
+							NULL, NULL, 0,
+							locking, single);
+			g_assert(again);
+
+			g_string_append(text, utf8);
+			g_string_append(decoded, again);
+			g_byte_array_append(encoded, back, nwritten);
+
+			g_free(again);
+			g_free(back);
+			g_free(utf8);
+		}
+
+		/* All of it in one go gives the same as char by char */
+		back = convert_utf8_to_gsm_with_lang(text->str, text->len,
+							&nread, &nwritten, 0xff,
+							locking, single);
+		g_assert(back);
+		g_assert(nread == (long) text->len);
+		g_assert(nwritten == (long) encoded->len);
+		g_assert(memcmp(back, encoded->data, nwritten) == 0);
+		g_assert(back[nwritten] == 0xff);
+		g_free(back);
+
+		utf8 = convert_gsm_to_utf8_with_lang(encoded->data,
+							encoded->len, NULL,
+							&nwritten, 0,
+							locking, single);
+		g_assert(utf8);
+		g_assert(nwritten == (long) decoded->len);
+		g_assert(strcmp(utf8, decoded->str) == 0);
+		g_free(utf8);
+
+		/* Reading stops at the first character that has no mapping */
+		g_string_append_unichar(text, 0x4E2D);
+		g_string_append(text, "abc");
+
+		back = convert_utf8_to_gsm_with_lang(text->str, -1, &nread,
+							NULL, 0,
+							locking, single);
+		g_assert(back == NULL);
+		g_assert(nread == (long) text->len - 6);
+	}
+
+	/* Empty input only gives a result if there is a terminator */
+	back = convert_utf8_to_gsm("", -1, &nread, &nwritten, 0);
+	g_assert(back == NULL);
+
+	back = convert_utf8_to_gsm("", -1, &nread, &nwritten, 0xff);
+	g_assert(back);
+	g_assert(nwritten == 0);
+	g_assert(back[0] == 0xff);
+	g_free(back);
+
+	g_string_free(text, TRUE);
+	g_string_free(decoded, TRUE);
+	g_byte_array_free(encoded, TRUE);
+}
+
+static void test_conversion_speed()
+{
+	static const char *texts[] = {
+		"Meeting moved to 10:30 tomorrow, see you there!",
+		"Yar\xc4\xb1n saat \xc3\xbc\xc3\xa7te "
+			"g\xc3\xb6r\xc3\xbc\xc5\x9f\xc3\xbcr\xc3\xbcz, "
+			"\xc5\x9fimdilik ho\xc5\x9f\xc3\xa7"
+			"a kal\xc4\xb1n.",
+		"\xc2\xbf""D\xc3\xb3nde est\xc3\xa1s? Te espero en la "
+			"estaci\xc3\xb3n a las 8, \xc2\xa1no tardes!",
+		"Pre\xc3\xa7o: 25\xe2\x82\xac {promo\xc3\xa7\xc3\xa3o} "
+			"v\xc3\xa1lida at\xc3\xa9 sexta.",
+	};
+	static const enum gsm_dialect dialects[] = {
+		GSM_DIALECT_DEFAULT, GSM_DIALECT_TURKISH,
+		GSM_DIALECT_SPANISH, GSM_DIALECT_PORTUGUESE,
+	};
+	int rounds = g_test_perf() ? 200000 : 2000;
+	double bytes = 0;
+	double elapsed;
+	long nwritten;
+	unsigned char *gsm;
+	char *utf8;
+	int i;
+	int n;
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++) {
+		i = n % G_N_ELEMENTS(texts);
+
+		gsm = convert_utf8_to_gsm_with_lang(texts[i], -1, NULL,
+							&nwritten, 0,
+							dialects[i],
+							dialects[i]);
+		g_assert(gsm);
+
+		bytes += nwritten;
+		g_free(gsm);
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	g_test_minimized_result(elapsed, "UTF-8 to GSM: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	gsm = convert_utf8_to_gsm_with_lang(texts[1], -1, NULL, &nwritten, 0,
+						GSM_DIALECT_TURKISH,
+						GSM_DIALECT_TURKISH);
+	g_assert(gsm);
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++) {
+		utf8 = convert_gsm_to_utf8_with_lang(gsm, nwritten, NULL,
+							NULL, 0,
+							GSM_DIALECT_TURKISH,
+							GSM_DIALECT_TURKISH);
+		g_assert(utf8);
+		g_free(utf8);
+	}
+
+	elapsed = g_test_timer_elapsed();
+
+	bytes = (double) nwritten * rounds;
+
+	g_test_minimized_result(elapsed, "GSM to UTF-8: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	g_free(gsm);
+}
+
+static void test_pack_speed()
+{
+	unsigned char text[160];
+	unsigned char packed[140];
+	unsigned char unpacked[160];
+	int rounds = g_test_perf() ? 1000000 : 10000;
+	double bytes = (double) sizeof(text) * rounds;
+	double elapsed;
+	long written;
+	unsigned int i;
+	int n;
+
+	for (i = 0; i < sizeof(text); i++)
+		text[i] = g_test_rand_int_range(0, 128);
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++)
+		pack_7bit_own_buf(text, sizeof(text), 0, FALSE, &written, 0,
+					packed);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(written == 140);
+
+	g_test_minimized_result(elapsed, "Pack: %.1f M septets/s",
+					bytes / elapsed / 1e6);
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++)
+		unpack_7bit_own_buf(packed, sizeof(packed), 0, FALSE,
+					sizeof(unpacked), &written, 0,
+					unpacked);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(written == 160);
+	g_assert(memcmp(text, unpacked, sizeof(text)) == 0);
+
+	g_test_minimized_result(elapsed, "Unpack: %.1f M septets/s",
+					bytes / elapsed / 1e6);
+
+	/* A UDH of 6 octets puts the text at a septet offset */
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++)
+		pack_7bit_own_buf(text, 153, 6, FALSE, &written, 0, packed);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(written == 134);
+
+	unpack_7bit_own_buf(packed, written, 6, FALSE, 153, &written, 0,
+				unpacked);
+	g_assert(written == 153);
+	g_assert(memcmp(text, unpacked, 153) == 0);
+
+	g_test_minimized_result(elapsed, "Pack at offset: %.1f M septets/s",
+					153.0 * rounds / elapsed / 1e6);
+}
+
+static void test_hex()
+{
+	unsigned char buf[16];
+	unsigned char *decoded;
+	char encoded[33];
+	long len;
+
+	decoded = decode_hex_own_buf("00a1B2c3D4e5F6ff", -1, &len, 0, buf);
+	g_assert(decoded == buf);
+	g_assert(len == 8);
+	g_assert(memcmp(buf, "\x00\xa1\xb2\xc3\xd4\xe5\xf6\xff", 8) == 0);
+
+	encode_hex_own_buf(buf, len, 0, encoded);
+	g_assert(strcmp(encoded, "00A1B2C3D4E5F6FF") == 0);
+
+	/* A trailing odd digit is ignored, the terminator is appended */
+	decoded = decode_hex_own_buf("0102030", -1, &len, 0xff, buf);
+	g_assert(decoded == buf);
+	g_assert(len == 3);
+	g_assert(buf[3] == 0xff);
+
+	/* Anything but a hex digit fails, wherever it is */
+	g_assert(decode_hex_own_buf("0102030405060708091G", -1, &len,
+						0, buf) == NULL);
+	g_assert(decode_hex_own_buf("0x", -1, &len, 0, buf) == NULL);
+	g_assert(decode_hex_own_buf(" 1", -1, &len, 0, buf) == NULL);
+	g_assert(decode_hex("0102:3", -1, &len, 0) == NULL);
+
+	/* Only the first len characters are looked at */
+	decoded = decode_hex_own_buf("0102zz", 4, &len, 0, buf);
+	g_assert(decoded == buf);
+	g_assert(len == 2);
+}
+
+static void test_hex_speed()
+{
+	unsigned char pdu[176];
+	unsigned char decoded[176];
+	char hex[sizeof(pdu) * 2 + 1];
+	int rounds = g_test_perf() ? 1000000 : 10000;
+	double bytes = (double) sizeof(pdu) * rounds;
+	double elapsed;
+	long len;
+	unsigned int i;
+	int n;
+
+	for (i = 0; i < sizeof(pdu); i++)
+		pdu[i] = g_test_rand_int_range(0, 256);
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++)
+		encode_hex_own_buf(pdu, sizeof(pdu), 0, hex);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(strlen(hex) == sizeof(pdu) * 2);
+
+	g_test_minimized_result(elapsed, "Hex encode: %.1f MB/s",
+					bytes / elapsed / 1e6);
+
+	g_test_timer_start();
+
+	for (n = 0; n < rounds; n++)
+		decode_hex_own_buf(hex, sizeof(hex) - 1, &len, 0, decoded);
+
+	elapsed = g_test_timer_elapsed();
+
+	g_assert(len == sizeof(pdu));
+	g_assert(memcmp(pdu, decoded, sizeof(pdu)) == 0);
+
+	g_test_minimized_result(elapsed, "Hex decode: %.1f MB/s",
+					bytes / elapsed / 1e6);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -918,6 +1242,11 @@ int main(int argc, char **argv)
 	g_test_add_func("/testutil/SMS Handling", test_sms_handling);
 	g_test_add_func("/testutil/Offset Handling", test_offset_handling);
 	g_test_add_func("/testutil/SIM conversions", test_sim);
+	g_test_add_func("/testutil/Dialect Conversions", test_dialects);
+	g_test_add_func("/testutil/Conversion Speed", test_conversion_speed);
+	g_test_add_func("/testutil/Pack Speed", test_pack_speed);
+	g_test_add_func("/testutil/Hex", test_hex);
+	g_test_add_func("/testutil/Hex Speed", test_hex_speed);
 
 	return g_test_run();
 }